@@ -39,6 +39,8 @@
 #define GOOGLE_BREAKPAD_PROCESSOR_MEMORY_REGION_H__
 
 
+#include <stddef.h>
+
 #include "google_breakpad/common/breakpad_types.h"
 
 
@@ -68,6 +70,13 @@ class MemoryRegion {
   virtual bool GetMemoryAtAddress(uint64_t address, uint32_t* value) const = 0;
   virtual bool GetMemoryAtAddress(uint64_t address, uint64_t* value) const = 0;
 
+  // Direct access to the whole region: GetSize() bytes starting at
+  // GetBase(), already in the running program's byte order.  Returns NULL
+  // if the region can't hand out its memory that way (for example, when it
+  // would need byte-swapping), in which case callers must fall back to
+  // GetMemoryAtAddress.  The default implementation always returns NULL.
+  virtual const uint8_t* GetContiguousMemory() const { return NULL; }
+
   // Print a human-readable representation of the object to stdout.
   virtual void Print() const = 0;
 };
@@ -234,6 +234,10 @@ class MinidumpMemoryRegion : public MinidumpObject,
   bool GetMemoryAtAddress(uint64_t address, uint32_t* value) const;
   bool GetMemoryAtAddress(uint64_t address, uint64_t* value) const;
 
+  // The region's memory as returned by GetMemory, or NULL if the minidump
+  // needs byte-swapping and so its contents can't be read in place.
+  const uint8_t* GetContiguousMemory() const;
+
   // Print a human-readable representation of the object to stdout.
   void Print() const;
   void SetPrintMode(bool hexdump, unsigned int width);
@@ -266,6 +270,10 @@ class MinidumpMemoryRegion : public MinidumpObject,
 
   // Cached memory.
   mutable vector<uint8_t>* memory_;
+
+  // The region's memory, as a view into the memory-mapped minidump file.
+  // Used instead of memory_ when the minidump is mapped.
+  mutable const uint8_t* view_;
 };
 
 
@@ -1229,6 +1237,21 @@ class Minidump {
   // Returns the current position of the minidump file.
   off_t Tell();
 
+  // Returns a pointer to count bytes at offset in the minidump file, without
+  // copying them, or NULL if the minidump isn't memory-mapped or the range is
+  // out of bounds.  The bytes stay valid for as long as the Minidump does.
+  const uint8_t* MapBytes(off_t offset, size_t count) const;
+
+  // Asks Open() to memory-map the minidump file instead of reading it
+  // through a stream, so that memory regions can be served straight out of
+  // the mapping (only the pages that are actually touched are ever read).
+  // Falls back to a stream if the file can't be mapped.  Must be called
+  // before Read().
+  void set_mapped(bool mapped) { map_requested_ = mapped; }
+
+  // Whether the minidump file is memory-mapped.
+  bool mapped() const { return map_base_ != NULL; }
+
   // Medium-level I/O routines.
 
   // ReadString returns a string which is owned by the caller!  offset
@@ -1292,6 +1315,10 @@ class Minidump {
   // Opens the minidump file, or if already open, seeks to the beginning.
   bool Open();
 
+  // Memory-maps the minidump file for Open(), and undoes it.
+  bool MapFile();
+  void UnmapFile();
+
   // The largest number of top-level streams that will be read from a minidump.
   // Note that streams are only read (and only consume memory) as needed,
   // when directed by the caller.  The default is 128.
@@ -1334,6 +1361,15 @@ class Minidump {
   bool                      hexdump_;
   unsigned int              hexdump_width_;
 
+  // The memory-mapped minidump file, when set_mapped was requested and the
+  // file could be mapped.  When map_base_ is set, ReadBytes and SeekSet work
+  // on the mapping (at map_offset_) instead of stream_.
+  bool                      map_requested_;
+  const uint8_t*            map_base_;
+  uint64_t                  map_size_;
+  uint64_t                  map_offset_;
+  void*                     map_handle_;
+
   DISALLOW_COPY_AND_ASSIGN(Minidump);
 };
 
@@ -32,6 +32,8 @@
 
 #include <assert.h>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "common/using_std_string.h"
 #include "google_breakpad/common/breakpad_types.h"
@@ -77,6 +79,15 @@ class MinidumpProcessor {
   // result.
   ProcessResult Process(Minidump* minidump,
                         ProcessState* process_state);
+
+  // Walks the stacks of the threads that the last Process call left
+  // unwalked because set_requesting_thread_only was on.  Their CallStacks
+  // are already in process_state (empty, but with their thread IDs set), so
+  // this only fills in their frames.  minidump and process_state must be the
+  // ones passed to Process.  Does nothing if no threads were left unwalked,
+  // so it's safe to call more than once.
+  ProcessResult WalkDeferredThreads(Minidump* minidump,
+                                    ProcessState* process_state);
   // Populates the cpu_* fields of the |info| parameter with textual
   // representations of the CPU type that the minidump in |dump| was
   // produced on.  Returns false if this information is not available in
@@ -127,6 +138,31 @@ class MinidumpProcessor {
 
   void set_enable_objdump(bool enabled) { enable_objdump_ = enabled; }
 
+  // When enabled and the minidump names a requesting thread, Process walks
+  // only that thread's stack.  Every other thread gets an empty CallStack
+  // until WalkDeferredThreads is called.  This is what crash bucketing
+  // wants: the requesting thread is the only one that's hashed, and
+  // walking the rest of a many-threaded process is most of the work.
+  void set_requesting_thread_only(bool enabled) {
+    requesting_thread_only_ = enabled;
+  }
+
+  // Limits the requesting thread's stack to max_frames frames, or no limit
+  // if 0 (the default).  Other threads are always walked in full.
+  void set_max_frames(uint32_t max_frames) { max_frames_ = max_frames; }
+
+  // Limits each stack scan, on every thread, to max_scan_words words, or
+  // leaves the stackwalkers' own search depths alone if 0 (the default).
+  // Scanning is what walks corrupt stacks, so a small limit trades frames
+  // recovered from a smashed stack for speed.
+  void set_max_scan_words(uint32_t max_scan_words) {
+    max_scan_words_ = max_scan_words;
+  }
+
+  // The wall-clock time spent walking stacks in the last Process call and
+  // any WalkDeferredThreads calls since, in microseconds.
+  uint64_t stackwalk_microseconds() const { return stackwalk_microseconds_; }
+
  private:
   StackFrameSymbolizer* frame_symbolizer_;
   // Indicate whether resolver_helper_ is owned by this instance.
@@ -140,6 +176,23 @@ class MinidumpProcessor {
   // This flag permits the exploitability scanner to shell out to objdump
   // for purposes of disassembly.
   bool enable_objdump_;
+
+  // See set_requesting_thread_only.
+  bool requesting_thread_only_;
+
+  // See set_max_frames.
+  uint32_t max_frames_;
+
+  // See set_max_scan_words.
+  uint32_t max_scan_words_;
+
+  // See stackwalk_microseconds.
+  uint64_t stackwalk_microseconds_;
+
+  // The threads that the last Process call didn't walk, as pairs of their
+  // index in ProcessState::threads_ and their index in the minidump's
+  // thread list.
+  std::vector<std::pair<size_t, unsigned int> > deferred_threads_;
 };
 
 }  // namespace google_breakpad
@@ -41,8 +41,11 @@
 #ifndef GOOGLE_BREAKPAD_PROCESSOR_STACKWALKER_H__
 #define GOOGLE_BREAKPAD_PROCESSOR_STACKWALKER_H__
 
+#include <string.h>
+
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "common/using_std_string.h"
@@ -103,6 +106,16 @@ class Stackwalker {
     max_frames_scanned_ = max_frames_scanned;
   }
 
+  // Limits this stackwalker alone to |frame_limit| frames, on top of the
+  // global max_frames_.  Zero (the default) means no per-walk limit.  Unlike
+  // set_max_frames, hitting this limit is expected and isn't logged.
+  void set_frame_limit(uint32_t frame_limit) { frame_limit_ = frame_limit; }
+
+  // Limits every stack scan this stackwalker does to |scan_limit| words,
+  // overriding the usual kRASearchWords-based depth when that's larger.
+  // Zero (the default) means no limit.
+  void set_scan_limit(uint32_t scan_limit) { scan_limit_ = scan_limit; }
+
  protected:
   // system_info identifies the operating system, NULL or empty if unknown.
   // memory identifies a MemoryRegion that provides the stack memory
@@ -169,6 +182,67 @@ class Stackwalker {
                             InstructionType* location_found,
                             InstructionType* ip_found,
                             int searchwords) {
+    if (scan_limit_ && searchwords > static_cast<int>(scan_limit_))
+      searchwords = scan_limit_;
+
+    // Nothing can look like a return address without modules to find it in.
+    if (!modules_)
+      return false;
+
+    BuildModuleRanges();
+    if (module_ranges_.empty())
+      return false;
+
+    // When the stack is one flat buffer, scan it directly rather than making
+    // a bounds-checked, virtual GetMemoryAtAddress call per word.
+    const uint8_t* stack = memory_->GetContiguousMemory();
+    if (stack) {
+      const uint64_t base = memory_->GetBase();
+      const uint64_t size = memory_->GetSize();
+      if (location_start < base || location_start - base > size)
+        return false;
+
+      // The words from location_start up to and including searchwords words
+      // past it, as far as the region goes.
+      uint64_t count = (base + size - location_start) / sizeof(InstructionType);
+      if (count > static_cast<uint64_t>(searchwords) + 1)
+        count = static_cast<uint64_t>(searchwords) + 1;
+
+      const uint8_t* words = stack + (location_start - base);
+      const uint64_t low = module_ranges_.front().first;
+      const uint64_t span = module_ranges_.back().second - low;
+
+      for (uint64_t block = 0; block < count; block += kScanBlockWords) {
+        const uint64_t block_words = count - block < kScanBlockWords ?
+                                     count - block : kScanBlockWords;
+
+        // Most stack words are nowhere near any module.  Test the whole
+        // block against the span covering all of them first; this loop has
+        // no early exit, so it vectorizes.
+        bool candidate = false;
+        for (uint64_t i = 0; i < block_words; ++i) {
+          InstructionType ip;
+          memcpy(&ip, words + (block + i) * sizeof(ip), sizeof(ip));
+          candidate |= static_cast<uint64_t>(ip) - low < span;
+        }
+        if (!candidate)
+          continue;
+
+        for (uint64_t i = 0; i < block_words; ++i) {
+          InstructionType ip;
+          memcpy(&ip, words + (block + i) * sizeof(ip), sizeof(ip));
+          if (InModuleRanges(ip) && modules_->GetModuleForAddress(ip) &&
+              InstructionAddressSeemsValid(ip)) {
+            *ip_found = ip;
+            *location_found = location_start +
+                              (block + i) * sizeof(InstructionType);
+            return true;
+          }
+        }
+      }
+      return false;
+    }
+
     for (InstructionType location = location_start;
          location <= location_start + searchwords * sizeof(InstructionType);
          location += sizeof(InstructionType)) {
@@ -176,7 +250,7 @@ class Stackwalker {
       if (!memory_->GetMemoryAtAddress(location, &ip))
         break;
 
-      if (modules_ && modules_->GetModuleForAddress(ip) &&
+      if (InModuleRanges(ip) && modules_->GetModuleForAddress(ip) &&
           InstructionAddressSeemsValid(ip)) {
         *ip_found = ip;
         *location_found = location;
@@ -187,6 +261,14 @@ class Stackwalker {
     return false;
   }
 
+  // Builds module_ranges_ from modules_, the first time it's needed.
+  void BuildModuleRanges();
+
+  // Returns true if address falls inside one of module_ranges_.  This is a
+  // cheap filter only: it can't tell a module from a gap between two
+  // adjacent ones, so GetModuleForAddress still has the final say.
+  bool InModuleRanges(uint64_t address) const;
+
   // Information about the system that produced the minidump.  Subclasses
   // and the SymbolSupplier may find this information useful.
   const SystemInfo* system_info_;
@@ -249,6 +331,20 @@ class Stackwalker {
   // disable or limit it is helpful in cases where unwind performance is
   // important.  This defaults to 1024, the same as max_frames_.
   static uint32_t max_frames_scanned_;
+
+  // The per-walk frame limit, or 0 for none.  See set_frame_limit.
+  uint32_t frame_limit_;
+
+  // The per-scan word limit, or 0 for none.  See set_scan_limit.
+  uint32_t scan_limit_;
+
+  // The number of stack words ScanForReturnAddress prefilters at once.
+  static const uint64_t kScanBlockWords = 8;
+
+  // The address ranges of modules_, sorted, with overlapping and adjacent
+  // ranges merged, as [start, end) pairs.  Built lazily by BuildModuleRanges.
+  std::vector<std::pair<uint64_t, uint64_t> > module_ranges_;
+  bool module_ranges_built_;
 };
 
 }  // namespace google_breakpad
@@ -69,6 +69,11 @@ class CFIFrameInfo {
   template<typename ValueType> class RegisterValueMap: 
     public map<string, ValueType> { };
 
+  // A map from register names onto evaluation rules.
+  typedef map<string, string> RuleMap;
+
+  CFIFrameInfo() : range_start_(0), range_end_(0) { }
+
   // Set the expression for computing a call frame address, return
   // address, or register's value. At least the CFA rule and the RA
   // rule must be set before calling FindCallerRegs.
@@ -104,10 +109,28 @@ class CFIFrameInfo {
   // of STACK CFI records.
   string Serialize() const;
 
- private:
+  // The raw rules, for callers that want to compile them rather than
+  // evaluate them with FindCallerRegs.
+  const string &cfa_rule() const { return cfa_rule_; }
+  const string &ra_rule() const { return ra_rule_; }
+  const RuleMap &register_rules() const { return register_rules_; }
+
+  // The module-relative address range [start, end) over which exactly
+  // these rules are in effect, if the resolver that produced them recorded
+  // it. GetRange returns false if it didn't.
+  void SetRange(uint64_t start, uint64_t end) {
+    range_start_ = start;
+    range_end_ = end;
+  }
+  bool GetRange(uint64_t *start, uint64_t *end) const {
+    if (range_start_ >= range_end_)
+      return false;
+    *start = range_start_;
+    *end = range_end_;
+    return true;
+  }
 
-  // A map from register names onto evaluation rules. 
-  typedef map<string, string> RuleMap;
+ private:
 
   // In this type, a "postfix expression" is an expression of the sort
   // interpreted by google_breakpad::PostfixEvaluator.
@@ -132,6 +155,10 @@ class CFIFrameInfo {
   // which leaves the value of REG in the calling frame on the top of
   // the stack. You should evaluate this expression
   RuleMap register_rules_;
+
+  // See SetRange.
+  uint64_t range_start_;
+  uint64_t range_end_;
 };
 
 // A parser for STACK CFI-style rule sets.
@@ -0,0 +1,428 @@
+// XXX_INCLUDE_TOB_COPYRIGHT_HERE
+
+// compiled_cfi_walker.h: A drop-in replacement for SimpleCFIWalker that
+// evaluates STACK CFI rules from precompiled bytecode.
+//
+// SimpleCFIWalker hands CFIFrameInfo a map of register names, and
+// CFIFrameInfo re-tokenizes each rule's postfix expression with
+// PostfixEvaluator every time a frame is unwound.  CompiledCFIWalker
+// compiles a CFIFrameInfo once into a Program: a few bytes of stack-machine
+// code per rule, with register names already resolved to indices into the
+// walker's register map.  Running a Program reads registers from a fixed
+// array and keeps its operand stack on the C++ stack, so unwinding a frame
+// allocates nothing.
+//
+// Programs don't depend on the frame they were compiled for, so callers can
+// cache them by module and by the address range the rules cover (see
+// CFIFrameInfo::GetRange) and reuse them across frames, threads and dumps.
+
+#ifndef PROCESSOR_COMPILED_CFI_WALKER_H_
+#define PROCESSOR_COMPILED_CFI_WALKER_H_
+
+#include <assert.h>
+#include <string.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/scoped_ptr.h"
+#include "common/using_std_string.h"
+#include "google_breakpad/common/breakpad_types.h"
+#include "google_breakpad/processor/memory_region.h"
+#include "processor/cfi_frame_info.h"
+
+namespace google_breakpad {
+
+template <typename RegisterType, class RawContextType>
+class CompiledCFIWalker {
+ public:
+  typedef typename SimpleCFIWalker<RegisterType, RawContextType>::RegisterSet
+      RegisterSet;
+
+  // The most registers a register map may describe.  Register values and
+  // their validity are kept in fixed arrays of this size.
+  static const size_t kMaxRegisters = 32;
+
+  // A compiled rule set.  Opaque to everything but the walker.
+  class Program {
+   private:
+    friend class CompiledCFIWalker;
+
+    // Stack machine opcodes.  kLiteral is followed by a RegisterType
+    // literal, kRegister by a one-byte register index; everything else
+    // operates on the operand stack.  Every expression ends with kEnd.
+    enum Opcode {
+      kEnd,
+      kLiteral,
+      kRegister,
+      kAdd,
+      kSubtract,
+      kMultiply,
+      kDivide,
+      kModulus,
+      kAlign,
+      kDereference
+    };
+
+    // Where the caller's value for a register comes from: a register rule
+    // (by index into rules_), or one of these.
+    enum Source {
+      kFromCFA = -1,
+      kFromRA = -2,
+      kCalleeSaves = -3,
+      kUnknown = -4
+    };
+
+    std::vector<uint8_t> code_;
+
+    // Offsets into code_ of the CFA rule, the RA rule and every register
+    // rule, including rules for registers that aren't in the register map:
+    // those still have to evaluate successfully, as with FindCallerRegs.
+    size_t cfa_rule_;
+    size_t ra_rule_;
+    std::vector<size_t> rules_;
+
+    // For each register in the map, a Source or an index into rules_.
+    std::vector<int> sources_;
+  };
+
+  // See SimpleCFIWalker::SimpleCFIWalker.  map_size must be less than
+  // kMaxRegisters, since one slot is reserved for the CFA.
+  CompiledCFIWalker(const RegisterSet *register_map, size_t map_size)
+      : register_map_(register_map), map_size_(map_size) {
+    assert(map_size_ < kMaxRegisters);
+  }
+
+  // Compiles the rules in cfi_frame_info.  Returns NULL if the rules use
+  // something the bytecode can't express (assignments, names that aren't
+  // registers, very deep expressions, too many rules), in which case the
+  // caller should fall back to SimpleCFIWalker.  The caller takes ownership.
+  Program *Compile(const CFIFrameInfo &cfi_frame_info) const;
+
+  // Exactly SimpleCFIWalker::FindCallerRegisters, given a compiled program
+  // in place of the CFIFrameInfo it was compiled from.
+  bool FindCallerRegisters(const MemoryRegion &memory,
+                           const Program &program,
+                           const RawContextType &callee_context,
+                           int callee_validity,
+                           RawContextType *caller_context,
+                           int *caller_validity) const;
+
+ private:
+  // The deepest operand stack an expression may need.
+  static const int kMaxStackDepth = 16;
+
+  // Appends the code for a postfix expression to program->code_.  ".cfa" is
+  // only a valid name if allow_cfa is true.  Returns false if the
+  // expression can't be compiled.
+  bool CompileExpression(const string &expression, bool allow_cfa,
+                         Program *program) const;
+
+  // Runs the expression at program.code_[offset].  registers and valid
+  // describe the callee's registers, plus the CFA in slot map_size_ once
+  // it's known.
+  bool Run(const MemoryRegion &memory, const Program &program, size_t offset,
+           const RegisterType *registers, uint64_t valid,
+           RegisterType *result) const;
+
+  // Returns the index of the register called name in the register map, or
+  // -1 if there's none.
+  int RegisterIndex(const string &name) const {
+    for (size_t i = 0; i < map_size_; i++) {
+      if (name == register_map_[i].name)
+        return static_cast<int>(i);
+    }
+    return -1;
+  }
+
+  const RegisterSet *register_map_;
+  size_t map_size_;
+};
+
+template <typename RegisterType, class RawContextType>
+bool CompiledCFIWalker<RegisterType, RawContextType>::CompileExpression(
+    const string &expression, bool allow_cfa, Program *program) const {
+  std::istringstream stream(expression);
+  string token;
+  int depth = 0;
+
+  while (stream >> token) {
+    uint8_t opcode = Program::kEnd;
+    if (token == "+")
+      opcode = Program::kAdd;
+    else if (token == "-")
+      opcode = Program::kSubtract;
+    else if (token == "*")
+      opcode = Program::kMultiply;
+    else if (token == "/")
+      opcode = Program::kDivide;
+    else if (token == "%")
+      opcode = Program::kModulus;
+    else if (token == "@")
+      opcode = Program::kAlign;
+
+    if (opcode != Program::kEnd) {
+      if (depth < 2)
+        return false;
+      depth--;
+      program->code_.push_back(opcode);
+      continue;
+    }
+
+    if (token == "^") {
+      if (depth < 1)
+        return false;
+      program->code_.push_back(Program::kDereference);
+      continue;
+    }
+
+    // Assignments only make sense for STACK WIN programs.
+    if (token[0] == '=')
+      return false;
+
+    if (++depth > kMaxStackDepth)
+      return false;
+
+    // Parse literals exactly as PostfixEvaluator::PopValueOrIdentifier does.
+    std::istringstream token_stream(token);
+    RegisterType literal = RegisterType();
+    bool negative = token_stream.peek() == '-';
+    if (negative)
+      token_stream.get();
+    if (token_stream >> literal && token_stream.peek() == EOF) {
+      if (negative)
+        literal = -literal;
+      uint8_t bytes[sizeof(literal)];
+      memcpy(bytes, &literal, sizeof(literal));
+      program->code_.push_back(Program::kLiteral);
+      program->code_.insert(program->code_.end(), bytes,
+                            bytes + sizeof(bytes));
+      continue;
+    }
+
+    int index = RegisterIndex(token);
+    if (index < 0 && allow_cfa && token == ".cfa")
+      index = static_cast<int>(map_size_);
+    if (index < 0)
+      return false;
+
+    program->code_.push_back(Program::kRegister);
+    program->code_.push_back(static_cast<uint8_t>(index));
+  }
+
+  if (depth != 1)
+    return false;
+
+  program->code_.push_back(Program::kEnd);
+  return true;
+}
+
+template <typename RegisterType, class RawContextType>
+typename CompiledCFIWalker<RegisterType, RawContextType>::Program *
+CompiledCFIWalker<RegisterType, RawContextType>::Compile(
+    const CFIFrameInfo &cfi_frame_info) const {
+  // FindCallerRegs refuses to use rules that lack either of these.
+  if (cfi_frame_info.cfa_rule().empty() || cfi_frame_info.ra_rule().empty())
+    return NULL;
+
+  scoped_ptr<Program> program(new Program());
+
+  program->cfa_rule_ = program->code_.size();
+  if (!CompileExpression(cfi_frame_info.cfa_rule(), false, program.get()))
+    return NULL;
+
+  program->ra_rule_ = program->code_.size();
+  if (!CompileExpression(cfi_frame_info.ra_rule(), true, program.get()))
+    return NULL;
+
+  const CFIFrameInfo::RuleMap &rules = cfi_frame_info.register_rules();
+  // Rule sets with more register rules than this are vanishingly rare;
+  // leave them to SimpleCFIWalker.
+  if (rules.size() > kMaxRegisters)
+    return NULL;
+
+  std::vector<string> rule_names;
+  for (CFIFrameInfo::RuleMap::const_iterator it = rules.begin();
+       it != rules.end(); ++it) {
+    program->rules_.push_back(program->code_.size());
+    rule_names.push_back(it->first);
+    if (!CompileExpression(it->second, true, program.get()))
+      return NULL;
+  }
+
+  // Work out where each of the caller's registers comes from, in the same
+  // order of preference as SimpleCFIWalker.
+  for (size_t i = 0; i < map_size_; i++) {
+    const RegisterSet &r = register_map_[i];
+    int source = Program::kUnknown;
+
+    for (size_t j = 0; j < rule_names.size(); j++) {
+      if (rule_names[j] == r.name) {
+        source = static_cast<int>(j);
+        break;
+      }
+    }
+
+    if (source == Program::kUnknown && r.alternate_name) {
+      string alternate(r.alternate_name);
+      if (alternate == ".cfa") {
+        source = Program::kFromCFA;
+      } else if (alternate == ".ra") {
+        source = Program::kFromRA;
+      } else {
+        for (size_t j = 0; j < rule_names.size(); j++) {
+          if (rule_names[j] == alternate) {
+            source = static_cast<int>(j);
+            break;
+          }
+        }
+      }
+    }
+
+    if (source == Program::kUnknown && r.callee_saves)
+      source = Program::kCalleeSaves;
+
+    program->sources_.push_back(source);
+  }
+
+  return program.release();
+}
+
+template <typename RegisterType, class RawContextType>
+bool CompiledCFIWalker<RegisterType, RawContextType>::Run(
+    const MemoryRegion &memory, const Program &program, size_t offset,
+    const RegisterType *registers, uint64_t valid,
+    RegisterType *result) const {
+  RegisterType stack[kMaxStackDepth];
+  int depth = 0;
+  const uint8_t *pc = &program.code_[offset];
+
+  // Compile has already checked the stack depth at every step.
+  while (true) {
+    switch (*pc++) {
+      case Program::kEnd:
+        *result = stack[0];
+        return true;
+
+      case Program::kLiteral:
+        memcpy(&stack[depth++], pc, sizeof(RegisterType));
+        pc += sizeof(RegisterType);
+        break;
+
+      case Program::kRegister:
+        if (!(valid & (1ULL << *pc)))
+          return false;
+        stack[depth++] = registers[*pc++];
+        break;
+
+      case Program::kAdd:
+        depth--;
+        stack[depth - 1] += stack[depth];
+        break;
+
+      case Program::kSubtract:
+        depth--;
+        stack[depth - 1] -= stack[depth];
+        break;
+
+      case Program::kMultiply:
+        depth--;
+        stack[depth - 1] *= stack[depth];
+        break;
+
+      case Program::kDivide:
+        depth--;
+        if (!stack[depth])
+          return false;
+        stack[depth - 1] /= stack[depth];
+        break;
+
+      case Program::kModulus:
+        depth--;
+        if (!stack[depth])
+          return false;
+        stack[depth - 1] %= stack[depth];
+        break;
+
+      case Program::kAlign:
+        depth--;
+        stack[depth - 1] &= static_cast<RegisterType>(-1) ^ (stack[depth] - 1);
+        break;
+
+      case Program::kDereference:
+        if (!memory.GetMemoryAtAddress(stack[depth - 1], &stack[depth - 1]))
+          return false;
+        break;
+
+      default:
+        assert(false);
+        return false;
+    }
+  }
+}
+
+template <typename RegisterType, class RawContextType>
+bool CompiledCFIWalker<RegisterType, RawContextType>::FindCallerRegisters(
+    const MemoryRegion &memory,
+    const Program &program,
+    const RawContextType &callee_context,
+    int callee_validity,
+    RawContextType *caller_context,
+    int *caller_validity) const {
+  RegisterType registers[kMaxRegisters];
+  RegisterType rule_values[kMaxRegisters];
+  uint64_t valid = 0;
+
+  for (size_t i = 0; i < map_size_; i++) {
+    const RegisterSet &r = register_map_[i];
+    if (callee_validity & r.validity_flag) {
+      registers[i] = callee_context.*r.context_member;
+      valid |= 1ULL << i;
+    }
+  }
+
+  RegisterType cfa, ra;
+  if (!Run(memory, program, program.cfa_rule_, registers, valid, &cfa))
+    return false;
+
+  registers[map_size_] = cfa;
+  valid |= 1ULL << map_size_;
+
+  if (!Run(memory, program, program.ra_rule_, registers, valid, &ra))
+    return false;
+
+  for (size_t i = 0; i < program.rules_.size(); i++) {
+    if (!Run(memory, program, program.rules_[i], registers, valid,
+             &rule_values[i]))
+      return false;
+  }
+
+  memset(caller_context, 0xda, sizeof(*caller_context));
+  *caller_validity = 0;
+  for (size_t i = 0; i < map_size_; i++) {
+    const RegisterSet &r = register_map_[i];
+    int source = program.sources_[i];
+
+    if (source >= 0) {
+      caller_context->*r.context_member = rule_values[source];
+    } else if (source == Program::kFromCFA) {
+      caller_context->*r.context_member = cfa;
+    } else if (source == Program::kFromRA) {
+      caller_context->*r.context_member = ra;
+    } else if (source == Program::kCalleeSaves &&
+               (callee_validity & r.validity_flag) != 0) {
+      caller_context->*r.context_member = callee_context.*r.context_member;
+    } else {
+      continue;
+    }
+
+    *caller_validity |= r.validity_flag;
+  }
+
+  return true;
+}
+
+}  // namespace google_breakpad
+
+#endif  // PROCESSOR_COMPILED_CFI_WALKER_H_
@@ -38,6 +38,7 @@
 #ifndef PROCESSOR_STACKWALKER_AMD64_H__
 #define PROCESSOR_STACKWALKER_AMD64_H__
 
+#include <memory>
 #include <vector>
 
 #include "google_breakpad/common/breakpad_types.h"
@@ -45,6 +46,7 @@
 #include "google_breakpad/processor/stackwalker.h"
 #include "google_breakpad/processor/stack_frame_cpu.h"
 #include "processor/cfi_frame_info.h"
+#include "processor/compiled_cfi_walker.h"
 
 namespace google_breakpad {
 
@@ -66,6 +68,10 @@ class StackwalkerAMD64 : public Stackwalker {
   // A STACK CFI-driven frame walker for the AMD64
   typedef SimpleCFIWalker<uint64_t, MDRawContextAMD64> CFIWalker;
 
+  // The same walker, running precompiled rules.
+  typedef CompiledCFIWalker<uint64_t, MDRawContextAMD64> CompiledWalker;
+  typedef CompiledWalker::Program CFIProgram;
+
   // Implementation of Stackwalker, using amd64 context (stack pointer in %rsp,
   // stack base in %rbp) and stack conventions (saved stack pointer at 0(%rbp))
   virtual StackFrame* GetContextFrame();
@@ -78,6 +84,21 @@ class StackwalkerAMD64 : public Stackwalker {
   StackFrameAMD64* GetCallerByCFIFrameInfo(const vector<StackFrame*> &frames,
                                            CFIFrameInfo* cfi_frame_info);
 
+  // Like GetCallerByCFIFrameInfo, but runs rules compiled by
+  // compiled_cfi_walker_.
+  StackFrameAMD64* GetCallerByCFIProgram(const vector<StackFrame*> &frames,
+                                         const CFIProgram &cfi_program);
+
+  // Returns the compiled CFI rules in effect at frame's instruction, if
+  // they've already been compiled for this module, or NULL.
+  std::shared_ptr<const CFIProgram> FindCFIProgram(const StackFrame* frame);
+
+  // Compiles cfi_frame_info, the rules in effect at frame's instruction, and
+  // caches the result if the resolver said which addresses the rules cover.
+  // Returns NULL if the rules couldn't be compiled.
+  std::shared_ptr<const CFIProgram> CompileCFIProgram(
+      const StackFrame* frame, const CFIFrameInfo& cfi_frame_info);
+
   // Assumes a traditional frame layout where the frame pointer has not been
   // omitted. The expectation is that caller's %rbp is pushed to the stack
   // after the return address of the callee, and that the callee's %rsp can
@@ -99,6 +120,9 @@ class StackwalkerAMD64 : public Stackwalker {
 
   // Our CFI frame walker.
   const CFIWalker cfi_walker_;
+
+  // Our CFI frame walker, for compiled rules.
+  const CompiledWalker compiled_cfi_walker_;
 };
 
 
@@ -66,8 +66,10 @@ SystemInfo::SystemInfo(const Dump &dump,
   D16(system_info.suite_mask);
   D16(system_info.reserved2);           // Well, why not?
 
-  // MDCPUInformation cpu;
-  if (system_info.processor_architecture == MD_CPU_ARCHITECTURE_X86) {
+  // MDCPUInformation cpu;  x86-64 processors describe themselves with CPUID,
+  // just like x86 ones.
+  if (system_info.processor_architecture == MD_CPU_ARCHITECTURE_X86 ||
+      system_info.processor_architecture == MD_CPU_ARCHITECTURE_AMD64) {
     D32(system_info.cpu.x86_cpu_info.vendor_id[0]);
     D32(system_info.cpu.x86_cpu_info.vendor_id[1]);
     D32(system_info.cpu.x86_cpu_info.vendor_id[2]);
@@ -173,6 +175,66 @@ Context::Context(const Dump &dump, const MDRawContextX86 &context)
   assert(Size() == sizeof(MDRawContextX86));
 }
 
+Context::Context(const Dump &dump, const MDRawContextAMD64 &context)
+  : Section(dump) {
+  // The caller should have properly set the CPU type flag.
+  assert(((context.context_flags & MD_CONTEXT_CPU_MASK) == 0) ||
+         (context.context_flags & MD_CONTEXT_AMD64));
+  // It doesn't make sense to store x86-64 registers in big-endian form.
+  assert(dump.endianness() == kLittleEndian);
+  D64(context.p1_home);
+  D64(context.p2_home);
+  D64(context.p3_home);
+  D64(context.p4_home);
+  D64(context.p5_home);
+  D64(context.p6_home);
+  D32(context.context_flags);
+  D32(context.mx_csr);
+  D16(context.cs);
+  D16(context.ds);
+  D16(context.es);
+  D16(context.fs);
+  D16(context.gs);
+  D16(context.ss);
+  D32(context.eflags);
+  D64(context.dr0);
+  D64(context.dr1);
+  D64(context.dr2);
+  D64(context.dr3);
+  D64(context.dr6);
+  D64(context.dr7);
+  D64(context.rax);
+  D64(context.rcx);
+  D64(context.rdx);
+  D64(context.rbx);
+  D64(context.rsp);
+  D64(context.rbp);
+  D64(context.rsi);
+  D64(context.rdi);
+  D64(context.r8);
+  D64(context.r9);
+  D64(context.r10);
+  D64(context.r11);
+  D64(context.r12);
+  D64(context.r13);
+  D64(context.r14);
+  D64(context.r15);
+  D64(context.rip);
+  // The floating-point and vector state is only ever stored little-endian,
+  // as asserted above, so it can be appended exactly as it's laid out.
+  Append(reinterpret_cast<const uint8_t *>(&context.flt_save),
+         sizeof(context.flt_save));
+  Append(reinterpret_cast<const uint8_t *>(context.vector_register),
+         sizeof(context.vector_register));
+  D64(context.vector_control);
+  D64(context.debug_control);
+  D64(context.last_branch_to_rip);
+  D64(context.last_branch_from_rip);
+  D64(context.last_exception_to_rip);
+  D64(context.last_exception_from_rip);
+  assert(Size() == sizeof(MDRawContextAMD64));
+}
+
 Context::Context(const Dump &dump, const MDRawContextARM &context)
   : Section(dump) {
   // The caller should have properly set the CPU type flag.
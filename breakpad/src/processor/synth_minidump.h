@@ -229,6 +229,7 @@ class Context: public Section {
   Context(const Dump &dump, const MDRawContextX86 &context);
   Context(const Dump &dump, const MDRawContextARM &context);
   Context(const Dump &dump, const MDRawContextMIPS &context);
+  Context(const Dump &dump, const MDRawContextAMD64 &context);
   // Add an empty context to the dump.
   Context(const Dump &dump) : Section(dump) {}
   // Add constructors for other architectures here. Remember to byteswap.
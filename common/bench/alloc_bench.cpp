@@ -0,0 +1,115 @@
+#include <set>
+#include <vector>
+
+#include "common/sl2_dr_client.hpp"
+
+// Compares the allocators available to our DR clients on the kind of workload the tracer puts on
+// its taint sets: lots of small node insertions and removals. Each benchmark runs on the
+// application's first thread, so that the slab allocator's thread cache is in play.
+
+/*! Number of insert/erase operations per benchmark */
+#define SL2_BENCH_OPS 1000000
+/*! Number of distinct keys, i.e. the steady-state size of each set */
+#define SL2_BENCH_KEYS 4096
+
+static bool benchmarked = false;
+
+/**
+ * Churns a set by inserting and erasing pseudorandom keys.
+ * @tparam Set - the set type (and therefore allocator) to benchmark
+ * @param set the set to churn
+ * @return the elapsed time, in microseconds
+ */
+template <typename Set> static uint64_t churn(Set &set) {
+  uint64_t state = 0x2545F4914F6CDD1DULL;
+  uint64_t start = dr_get_microseconds();
+
+  for (int i = 0; i < SL2_BENCH_OPS; i++) {
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    app_pc key = (app_pc)(state % SL2_BENCH_KEYS);
+
+    if (!set.erase(key)) {
+      set.insert(key);
+    }
+  }
+
+  return dr_get_microseconds() - start;
+}
+
+/**
+ * Reports a single benchmark result in the same JSONL format as the rest of our clients.
+ * @param name the allocator's name
+ * @param usecs the elapsed time, in microseconds
+ */
+static void report(const char *name, uint64_t usecs) {
+  json j;
+  j["type"] = "alloc_bench";
+  j["allocator"] = name;
+  j["ops"] = SL2_BENCH_OPS;
+  j["usecs"] = usecs;
+  j["ns_per_op"] = (usecs * 1000) / SL2_BENCH_OPS;
+  SL2_LOG_JSONL(j);
+}
+
+/** Runs every benchmark on the first application thread, then exits. */
+static void on_thread_init(void *drcontext) {
+  if (benchmarked) {
+    return;
+  }
+
+  benchmarked = true;
+
+  {
+    std::set<app_pc, std::less<app_pc>, sl2_dr_allocator<app_pc>> set;
+    report("sl2_dr_allocator", churn(set));
+  }
+
+  {
+    std::set<app_pc, std::less<app_pc>, sl2_slab_allocator<app_pc>> set;
+    report("sl2_slab_allocator", churn(set));
+  }
+
+  {
+    sl2_bump_arena arena;
+    sl2_bump_allocator<app_pc> alloc(&arena);
+    std::set<app_pc, std::less<app_pc>, sl2_bump_allocator<app_pc>> set(std::less<app_pc>(),
+                                                                         alloc);
+    report("sl2_bump_allocator", churn(set));
+
+    json j;
+    j["type"] = "alloc_bench";
+    j["allocator"] = "sl2_bump_allocator";
+    j["arena_bytes"] = arena.used();
+    SL2_LOG_JSONL(j);
+  }
+
+  dr_exit_process(0);
+}
+
+/** Clean up after the benchmark */
+static void on_dr_exit(void) {
+  drmgr_unregister_thread_init_event(on_thread_init);
+  sl2_slab_exit();
+  drmgr_exit();
+}
+
+/** Sets up the benchmark; the actual work happens in on_thread_init. */
+DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
+  dr_set_client_name("Sienna-Locomotive Allocation Benchmark",
+                     "https://github.com/trailofbits/sienna-locomotive/issues");
+  dr_enable_console_printing();
+
+  if (!drmgr_init() || !sl2_slab_init()) {
+    DR_ASSERT(false);
+  }
+
+  dr_register_exit_event(on_dr_exit);
+
+  if (!drmgr_register_thread_init_event(on_thread_init)) {
+    DR_ASSERT(false);
+  }
+}
@@ -40,74 +40,256 @@ sl2_funcmod SL2_FUNCMOD_TABLE[] = {
  * Common functionality for DynamoRIO clients
  */
 SL2Client::SL2Client() {
+  call_counts.fill(0);
+  needsLegacyArgHash.fill(false);
+}
+
+/*! TLS slot holding each thread's freelist of sl2_call_records */
+static int call_record_tls_idx = -1;
+
+/** Frees every call record on an exiting thread's freelist. */
+static void on_call_record_thread_exit(void *drcontext) {
+  sl2_call_record *record = (sl2_call_record *)drmgr_get_tls_field(drcontext, call_record_tls_idx);
+
+  while (record) {
+    sl2_call_record *next = record->next;
+    dr_thread_free(drcontext, record, sizeof(sl2_call_record));
+    record = next;
+  }
+
+  drmgr_set_tls_field(drcontext, call_record_tls_idx, NULL);
+}
+
+/**
+ * Returns the slot for a return address: either the slot already holding it, or the empty slot
+ * it should be inserted into.
+ * @param retAddr the return address to look up
+ * @return the slot
+ */
+sl2_retaddr_table::slot *sl2_retaddr_table::find_slot(uint64_t retAddr) {
+  // Fibonacci hashing; return addresses tend to share their low bits.
+  size_t i = (size_t)((retAddr * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+
+  while (slots[i].count && slots[i].retAddr != retAddr) {
+    i = (i + 1) & (capacity - 1);
+  }
+
+  return &slots[i];
 }
 
 /**
- * Creates a SHA256 hash of the arguments to a function
+ * Doubles the table's capacity (or creates it) and rehashes every occupied slot.
+ */
+void sl2_retaddr_table::grow() {
+  slot *old_slots = slots;
+  size_t old_capacity = capacity;
+
+  capacity = old_capacity ? old_capacity * 2 : 1024;
+  slots = (slot *)dr_global_alloc(capacity * sizeof(slot));
+  memset(slots, 0, capacity * sizeof(slot));
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_slots[i].count) {
+      *find_slot(old_slots[i].retAddr) = old_slots[i];
+    }
+  }
+
+  if (old_slots) {
+    dr_global_free(old_slots, old_capacity * sizeof(slot));
+  }
+}
+
+/**
+ * Gets the number of times a return address has been seen
+ * @param retAddr the return address
+ * @return the count, or 0 if it hasn't been seen
+ */
+uint64_t sl2_retaddr_table::get(uint64_t retAddr) {
+  if (!capacity) {
+    return 0;
+  }
+
+  return find_slot(retAddr)->count;
+}
+
+/**
+ * Increments the number of times a return address has been seen
+ * @param retAddr the return address
+ * @return the count before incrementing
+ */
+uint64_t sl2_retaddr_table::increment(uint64_t retAddr) {
+  // Keep the load factor under 3/4, so that probes stay short.
+  if ((size + 1) * 4 > capacity * 3) {
+    grow();
+  }
+
+  slot *s = find_slot(retAddr);
+
+  if (!s->count) {
+    s->retAddr = retAddr;
+    size++;
+  }
+
+  return s->count++;
+}
+
+/** Mixes all the bits of a 64-bit word together (the MurmurHash3 finalizer). */
+static inline uint64_t fingerprint_mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/** Folds a 64-bit word into a running fingerprint. */
+static inline uint64_t fingerprint_round(uint64_t h, uint64_t word) {
+  h ^= fingerprint_mix(word);
+  h = (h << 27) | (h >> 37);
+  return h * 0x9E3779B185EBCA87ULL + 0x85EBCA77C2B2AE63ULL;
+}
+
+/**
+ * Creates a 64-bit (non-cryptographic) fingerprint of the arguments to a function. Only the used
+ * part of the filename is covered, and nothing is allocated.
+ * @param hash_ctx pointer to the context containing the information to hash
+ * @return the fingerprint
+ */
+uint64_t SL2Client::fingerprint_args(hash_context *hash_ctx) {
+  size_t name_bytes = wcsnlen_s(hash_ctx->fileName, MAX_PATH + 1) * sizeof(wchar_t);
+  const uint8_t *name = (const uint8_t *)hash_ctx->fileName;
+  uint64_t h = 0x27D4EB2F165667C5ULL ^ name_bytes;
+  size_t i;
+
+  for (i = 0; i + sizeof(uint64_t) <= name_bytes; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, name + i, sizeof(word));
+    h = fingerprint_round(h, word);
+  }
+
+  if (i < name_bytes) {
+    uint64_t word = 0;
+    memcpy(&word, name + i, name_bytes - i);
+    h = fingerprint_round(h, word);
+  }
+
+  h = fingerprint_round(h, hash_ctx->count);
+  h = fingerprint_round(h, hash_ctx->position);
+  h = fingerprint_round(h, hash_ctx->readSize);
+
+  return fingerprint_mix(h);
+}
+
+/**
+ * Creates the SHA256 hash of the arguments to a function that older targets files were recorded
+ * with. Only used when a loaded target needs it, since it's much slower than `fingerprint_args`.
  * @param argHash pointer to the char buffer to write the hex-encoded hash into
  * @param hash_ctx pointer to the context containing the information to hash
  */
-void SL2Client::hash_args(char *argHash, hash_context *hash_ctx) {
-  std::vector<unsigned char> blob_vec((unsigned char *)hash_ctx,
-                                      ((unsigned char *)hash_ctx) + sizeof(hash_context));
+void SL2Client::legacy_hash_args(char *argHash, hash_context *hash_ctx) {
   std::string hash_str;
-  picosha2::hash256_hex_string(blob_vec, hash_str);
+  picosha2::hash256_hex_string((unsigned char *)hash_ctx,
+                               ((unsigned char *)hash_ctx) + sizeof(hash_context), hash_str);
   argHash[SL2_HASH_LEN] = 0;
   memcpy((void *)argHash, hash_str.c_str(), SL2_HASH_LEN);
 }
 
+/**
+ * Fills in the argument fingerprint of a hooked call (and its legacy SHA256, if any target for
+ * its function still needs one).
+ * @param info the hooked call
+ * @param hash_ctx pointer to the context containing the information to hash
+ */
+void SL2Client::hash_args(client_read_info *info, hash_context *hash_ctx) {
+  info->argHash = fingerprint_args(hash_ctx);
+
+  if (needsLegacyArgHash[(size_t)info->function] && info->legacyArgHash) {
+    legacy_hash_args(info->legacyArgHash, hash_ctx);
+  }
+}
+
+/**
+ * Hex-encodes an argument fingerprint, for the wizard's output and the targets file.
+ * @param argHash the fingerprint
+ * @param str buffer of at least SL2_ARG_HASH_LEN + 1 chars to write into
+ */
+void SL2Client::arg_hash_to_string(uint64_t argHash, char *str) {
+  dr_snprintf(str, SL2_ARG_HASH_LEN + 1, "%016llx", argHash);
+  str[SL2_ARG_HASH_LEN] = 0;
+}
+
 /**
  * Implements targeting strategies to determine whether we should fuzz a given function call.
+ * Only consults the index built by `compileTargets`, so it never allocates.
  * @param info - struct containing information about the last function call hooked via pre callback
  * @return true if the current function should be targeted.
  */
 bool SL2Client::is_function_targeted(client_read_info *info) {
-  Function function = info->function;
-  const char *func_name = function_to_string(function);
+  const sl2_target_index &index = targetIndex[(size_t)info->function];
 
-  for (targetFunction t : parsedJson) {
-    if (t.selected && STREQ(t.functionName.c_str(), func_name)) {
-      if (t.mode & MATCH_INDEX && compare_indices(t, function)) {
-        return true;
-      }
-      if (t.mode & MATCH_RETN_ADDRESS && compare_return_addresses(t, info)) {
-        return true;
-      }
-      if (t.mode & MATCH_ARG_HASH && compare_arg_hashes(t, info)) {
-        return true;
-      }
-      if (t.mode & MATCH_ARG_COMPARE && compare_arg_buffers(t, info)) {
-        return true;
-      }
-      if (t.mode & MATCH_FILENAMES && compare_filenames(t, info)) {
-        return true;
-      }
-      if (t.mode & MATCH_RETN_COUNT && compare_index_at_retaddr(t, info)) {
-        return true;
-      }
-      if (t.mode & LOW_PRECISION) {
-        // if filename is available
-        if (info->source && compare_filenames(t, info)) {
-          if (compare_filenames(t, info)) {
-            return true;
-          }
-        }
-        if (compare_return_addresses(t, info) && compare_arg_buffers(t, info)) {
-          return true;
-        }
-      }
-      if (t.mode & MEDIUM_PRECISION) {
-        if (compare_arg_hashes(t, info) && compare_return_addresses(t, info)) {
-          return true;
-        }
-      }
-      if (t.mode & HIGH_PRECISION) {
-        if (compare_arg_hashes(t, info) && compare_index_at_retaddr(t, info)) {
-          return true;
-        }
-      }
+  if (!index.byIndex.empty() && index.byIndex.count(call_counts[(size_t)info->function])) {
+    return true;
+  }
+
+  if (!index.byRetAddr.empty() && index.byRetAddr.count(info->retAddrOffset & SUB_ASLR_BITS)) {
+    return true;
+  }
+
+  for (const sl2_compiled_target &t : index.general) {
+    if (is_compiled_target_matched(t, info)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Evaluates each of a target's strategies against a hooked call.
+ * @param t - the compiled target to check
+ * @param info - information about the last hooked function call
+ * @return true if any of the target's strategies match
+ */
+bool SL2Client::is_compiled_target_matched(const sl2_compiled_target &t, client_read_info *info) {
+  if (t.mode & MATCH_INDEX && compare_indices(t, info->function)) {
+    return true;
+  }
+  if (t.mode & MATCH_RETN_ADDRESS && compare_return_addresses(t, info)) {
+    return true;
+  }
+  if (t.mode & MATCH_ARG_HASH && compare_arg_hashes(t, info)) {
+    return true;
+  }
+  if (t.mode & MATCH_ARG_COMPARE && compare_arg_buffers(t, info)) {
+    return true;
+  }
+  if (t.mode & MATCH_FILENAMES && compare_filenames(t, info)) {
+    return true;
+  }
+  if (t.mode & MATCH_RETN_COUNT && compare_index_at_retaddr(t, info)) {
+    return true;
+  }
+  if (t.mode & LOW_PRECISION) {
+    // if filename is available
+    if (info->source && compare_filenames(t, info)) {
+      return true;
+    }
+    if (compare_return_addresses(t, info) && compare_arg_buffers(t, info)) {
+      return true;
     }
   }
+  if (t.mode & MEDIUM_PRECISION) {
+    if (compare_arg_hashes(t, info) && compare_return_addresses(t, info)) {
+      return true;
+    }
+  }
+  if (t.mode & HIGH_PRECISION) {
+    if (compare_arg_hashes(t, info) && compare_index_at_retaddr(t, info)) {
+      return true;
+    }
+  }
+
   return false;
 }
 
@@ -118,8 +300,8 @@ bool SL2Client::is_function_targeted(client_read_info *info) {
  * @param info - information about the last hooked function call
  * @return true if they match, false if they don't
  */
-bool SL2Client::compare_filenames(targetFunction &t, client_read_info *info) {
-  return !wcscmp(t.source.c_str(), info->source);
+bool SL2Client::compare_filenames(const sl2_compiled_target &t, client_read_info *info) {
+  return info->source && !wcscmp(t.source, info->source);
 }
 
 /**
@@ -128,8 +310,8 @@ bool SL2Client::compare_filenames(targetFunction &t, client_read_info *info) {
  * @param function - the function currently hooked
  * @return true if they match, false if they don't
  */
-bool SL2Client::compare_indices(targetFunction &t, Function &function) {
-  return call_counts[function] == t.index;
+bool SL2Client::compare_indices(const sl2_compiled_target &t, Function &function) {
+  return call_counts[(size_t)function] == t.index;
 }
 
 /**
@@ -139,8 +321,8 @@ bool SL2Client::compare_indices(targetFunction &t, Function &function) {
  * @param info - information about the last hooked function call
  * @return true if they match, false if they don't
  */
-bool SL2Client::compare_index_at_retaddr(targetFunction &t, client_read_info *info) {
-  return ret_addr_counts[info->retAddrOffset] == t.retAddrCount;
+bool SL2Client::compare_index_at_retaddr(const sl2_compiled_target &t, client_read_info *info) {
+  return ret_addr_counts.get(info->retAddrOffset) == t.retAddrCount;
 }
 
 /**
@@ -149,14 +331,12 @@ bool SL2Client::compare_index_at_retaddr(targetFunction &t, client_read_info *in
  * @param info - information about the last hooked function call
  * @return true if they match, false if they don't
  */
-bool SL2Client::compare_return_addresses(targetFunction &t, client_read_info *info) {
+bool SL2Client::compare_return_addresses(const sl2_compiled_target &t, client_read_info *info) {
   // Get around ASLR by only examining the bottom bits. This is something of a cheap hack and we
   // should ideally store a copy of the memory map in every run
-  uint64_t left = t.retAddrOffset & SUB_ASLR_BITS;
+  // NOTE(ww): t.retAddrOffset is masked once, in compileTargets.
   uint64_t right = info->retAddrOffset & SUB_ASLR_BITS;
-  // SL2_DR_DEBUG("Comparing 0x%llx to 0x%llx (%s)\n", left, right, left == right ? "True" :
-  // "False");
-  return left == right;
+  return t.retAddrOffset == right;
 }
 
 /**
@@ -165,8 +345,12 @@ bool SL2Client::compare_return_addresses(targetFunction &t, client_read_info *in
  * @param info - information about the last hooked function call
  * @return true if they match, false if they don't
  */
-bool SL2Client::compare_arg_hashes(targetFunction &t, client_read_info *info) {
-  return STREQ(t.argHash.c_str(), info->argHash);
+bool SL2Client::compare_arg_hashes(const sl2_compiled_target &t, client_read_info *info) {
+  if (t.legacyArgHash[0]) {
+    return info->legacyArgHash && STREQ(t.legacyArgHash, info->legacyArgHash);
+  }
+
+  return t.argHash == info->argHash;
 }
 
 /**
@@ -176,8 +360,9 @@ bool SL2Client::compare_arg_hashes(targetFunction &t, client_read_info *info) {
  * @param info - information about the last hooked function call
  * @return true if they match, false if they don't
  */
-bool SL2Client::compare_arg_buffers(targetFunction &t, client_read_info *info) { // Not working
-  size_t minimum = min(16, t.buffer.size());
+bool SL2Client::compare_arg_buffers(const sl2_compiled_target &t,
+                                    client_read_info *info) { // Not working
+  size_t minimum = t.bufferSize;
   if (info->lpNumberOfBytesRead) {
     minimum = min(minimum, *info->lpNumberOfBytesRead);
   } else {
@@ -185,7 +370,7 @@ bool SL2Client::compare_arg_buffers(targetFunction &t, client_read_info *info) {
                  "a segfault\n");
   }
 
-  return !memcmp(t.buffer.data(), info->lpBuffer, minimum);
+  return !memcmp(t.buffer, info->lpBuffer, minimum);
 }
 
 /**
@@ -194,7 +379,7 @@ bool SL2Client::compare_arg_buffers(targetFunction &t, client_read_info *info) {
  * @return the incremented value
  */
 uint64_t SL2Client::increment_call_count(Function function) {
-  return call_counts[function]++;
+  return call_counts[(size_t)function]++;
 }
 
 /**
@@ -203,7 +388,7 @@ uint64_t SL2Client::increment_call_count(Function function) {
  * @return the incremented value
  */
 uint64_t SL2Client::increment_retaddr_count(uint64_t retAddr) {
-  return ret_addr_counts[retAddr]++;
+  return ret_addr_counts.increment(retAddr);
 }
 
 /**
@@ -233,7 +418,75 @@ bool SL2Client::loadTargets(string path) {
 
   dr_global_free(buffer, targets_size);
 
-  return parsedJson.is_array();
+  if (!parsedJson.is_array()) {
+    return false;
+  }
+
+  compileTargets();
+
+  return true;
+}
+
+/**
+ * Flattens the selected targets in parsedJson into targetIndex, so that `is_function_targeted`
+ * doesn't have to deserialize each target on every hooked call.
+ */
+void SL2Client::compileTargets() {
+  for (sl2_target_index &index : targetIndex) {
+    index.byIndex.clear();
+    index.byRetAddr.clear();
+    index.general.clear();
+  }
+
+  needsLegacyArgHash.fill(false);
+
+  for (targetFunction t : parsedJson) {
+    Function function;
+
+    if (!t.selected) {
+      continue;
+    }
+
+    if (!string_to_function(t.functionName.c_str(), &function)) {
+      SL2_DR_DEBUG("compileTargets: ignoring target with unknown function: %s\n",
+                   t.functionName.c_str());
+      continue;
+    }
+
+    sl2_target_index &index = targetIndex[(size_t)function];
+
+    // The two most common strategies only need a single key, so we index them directly.
+    if (t.mode == MATCH_INDEX) {
+      index.byIndex.insert(t.index);
+      continue;
+    }
+
+    if (t.mode == MATCH_RETN_ADDRESS) {
+      index.byRetAddr.insert(t.retAddrOffset & SUB_ASLR_BITS);
+      continue;
+    }
+
+    sl2_compiled_target compiled = {0};
+    compiled.mode = t.mode;
+    compiled.index = t.index;
+    compiled.retAddrOffset = t.retAddrOffset & SUB_ASLR_BITS;
+    compiled.retAddrCount = t.retAddrCount;
+
+    // NOTE(ww): Targets files recorded before we switched to fingerprints have hex-encoded
+    // SHA256 argHashes. We can't convert those, so we keep computing SHA256 for their functions.
+    if (t.argHash.length() == SL2_HASH_LEN) {
+      strncpy_s(compiled.legacyArgHash, t.argHash.c_str(), _TRUNCATE);
+      needsLegacyArgHash[(size_t)function] = true;
+    } else {
+      compiled.argHash = strtoull(t.argHash.c_str(), NULL, 16);
+    }
+
+    wcsncpy_s(compiled.source, t.source.c_str(), _TRUNCATE);
+    compiled.bufferSize = min(SL2_ARG_BUFFER_COMPARE_LEN, t.buffer.size());
+    memcpy(compiled.buffer, t.buffer.data(), compiled.bufferSize);
+
+    index.general.push_back(compiled);
+  }
 }
 
 /*
@@ -292,6 +545,105 @@ void SL2Client::wrap_pre_UnhandledExceptionFilter(void *wrapcxt, OUT void **user
   on_exception(drwrap_get_drcontext(wrapcxt), &excpt);
 }
 
+/**
+ * Folds a code location into a running fingerprint as its module's name and the offset into it,
+ * so that fingerprints survive ASLR.
+ * @return whether the location is inside a module
+ */
+static bool fingerprint_location(uint64_t *h, app_pc pc) {
+  module_data_t *mod = dr_lookup_module(pc);
+
+  if (!mod) {
+    *h = fingerprint_round(*h, 0);
+    return false;
+  }
+
+  const char *name = dr_module_preferred_name(mod);
+
+  for (size_t i = 0; name && name[i]; i += sizeof(uint64_t)) {
+    uint64_t word = 0;
+    strncpy((char *)&word, name + i, sizeof(word));
+    *h = fingerprint_round(*h, word);
+  }
+
+  *h = fingerprint_round(*h, (uint64_t)(pc - mod->start));
+  dr_free_module_data(mod);
+
+  return true;
+}
+
+/**
+ * Checks whether the instruction just before an address is a call, i.e. whether the address
+ * looks like a return address.
+ */
+static bool follows_call(app_pc pc) {
+  uint8_t b[7];
+
+  if (!dr_safe_read(pc - sizeof(b), sizeof(b), b, NULL)) {
+    return false;
+  }
+
+  // call rel32, then call r/m64 (FF /2) with 0, 1, 4 and 5 bytes of ModRM/SIB/displacement.
+  return b[2] == 0xE8 || (b[5] == 0xFF && (b[6] & 0x38) == 0x10) ||
+         (b[4] == 0xFF && (b[5] & 0x38) == 0x10) || (b[1] == 0xFF && (b[2] & 0x38) == 0x10) ||
+         (b[0] == 0xFF && (b[1] & 0x38) == 0x10);
+}
+
+/**
+ * Creates a cheap 64-bit fingerprint of a crash, for deduplication: the exception code, the
+ * faulting module and offset, and the module-relative offsets of the first few return addresses
+ * found by scanning up the stack. The application's name is mixed in too, so that the same
+ * crash in a shared DLL buckets separately per target.
+ * @param drcontext the crashing thread's DynamoRIO context
+ * @param excpt the exception (mcontext may be NULL, for exceptions we've stolen via a hook)
+ * @return the fingerprint
+ */
+uint64_t SL2Client::fingerprint_crash(void *drcontext, dr_exception_t *excpt) {
+  uint64_t h = 0x27D4EB2F165667C5ULL;
+  const char *app_name = dr_get_application_name();
+
+  for (size_t i = 0; app_name && app_name[i]; i += sizeof(uint64_t)) {
+    uint64_t word = 0;
+    strncpy((char *)&word, app_name + i, sizeof(word));
+    h = fingerprint_round(h, word);
+  }
+
+  h = fingerprint_round(h, excpt->record->ExceptionCode);
+  fingerprint_location(&h, (app_pc)excpt->record->ExceptionAddress);
+
+  dr_mcontext_t mc = {sizeof(mc), DR_MC_CONTROL};
+
+  if (excpt->mcontext) {
+    mc.xsp = excpt->mcontext->xsp;
+  } else {
+    dr_get_mcontext(drcontext, &mc);
+  }
+
+  app_pc *sp = (app_pc *)mc.xsp;
+  size_t frames = 0;
+
+  for (size_t i = 0; i < SL2_CRASH_SCAN_WORDS && frames < SL2_CRASH_FRAMES; i++) {
+    app_pc candidate;
+
+    if (!dr_safe_read(sp + i, sizeof(candidate), &candidate, NULL)) {
+      break;
+    }
+
+    if (!follows_call(candidate)) {
+      continue;
+    }
+
+    uint64_t frame_h = h;
+
+    if (fingerprint_location(&frame_h, candidate)) {
+      h = frame_h;
+      frames++;
+    }
+  }
+
+  return fingerprint_mix(h);
+}
+
 /**
     We also intercept VerifierStopMessage and VerifierStopMessageEx,
     which are supplied by Application Verifier for the purpose of catching
@@ -346,8 +698,8 @@ void SL2Client::wrap_pre_ReadEventLog(void *wrapcxt, OUT void **user_data) {
   DWORD *pnBytesRead = (DWORD *)drwrap_get_arg(wrapcxt, 5);
   DWORD *pnMinNumberOfBytesNeeded = (DWORD *)drwrap_get_arg(wrapcxt, 6);
 
-  *user_data = dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(client_read_info));
-  client_read_info *info = (client_read_info *)*user_data;
+  client_read_info *info = alloc_call_record(drwrap_get_drcontext(wrapcxt));
+  *user_data = info;
 
   info->function = Function::ReadEventLog;
   info->hFile = hEventLog;
@@ -364,8 +716,7 @@ void SL2Client::wrap_pre_ReadEventLog(void *wrapcxt, OUT void **user_data) {
   hash_ctx.position = dwRecordOffset;
   hash_ctx.readSize = nNumberOfBytesToRead;
 
-  info->argHash = (char *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), SL2_HASH_LEN + 1);
-  hash_args(info->argHash, &hash_ctx);
+  hash_args(info, &hash_ctx);
 }
 
 /** Pre-function wrapper for RegQueryValu
@@ -394,8 +745,8 @@ void SL2Client::wrap_pre_RegQueryValueEx(void *wrapcxt, OUT void **user_data) {
   LPDWORD lpcbData = (LPDWORD)drwrap_get_arg(wrapcxt, 5);
 
   if (lpData != NULL && lpcbData != NULL) {
-    *user_data = dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(client_read_info));
-    client_read_info *info = (client_read_info *)*user_data;
+    client_read_info *info = alloc_call_record(drwrap_get_drcontext(wrapcxt));
+    *user_data = info;
 
     info->function = Function::RegQueryValueEx;
     info->hFile = hKey;
@@ -411,8 +762,7 @@ void SL2Client::wrap_pre_RegQueryValueEx(void *wrapcxt, OUT void **user_data) {
     //        mbstowcs_s(hash_ctx.fileName, , lpValueName, MAX_PATH);
     hash_ctx.readSize = *lpcbData;
 
-    info->argHash = (char *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), SL2_HASH_LEN + 1);
-    hash_args(info->argHash, &hash_ctx);
+    hash_args(info, &hash_ctx);
   } else {
     *user_data = NULL;
   }
@@ -449,8 +799,8 @@ void SL2Client::wrap_pre_WinHttpWebSocketReceive(void *wrapcxt, OUT void **user_
   // DWORD positionLow = InternetSetFilePointer(hRequest, 0, &positionHigh, FILE_CURRENT);
   // uint64_t position = positionHigh;
 
-  *user_data = dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(client_read_info));
-  client_read_info *info = (client_read_info *)*user_data;
+  client_read_info *info = alloc_call_record(drwrap_get_drcontext(wrapcxt));
+  *user_data = info;
 
   info->function = Function::WinHttpWebSocketReceive;
   info->hFile = hRequest;
@@ -466,8 +816,7 @@ void SL2Client::wrap_pre_WinHttpWebSocketReceive(void *wrapcxt, OUT void **user_
   //    hash_ctx.fileName[0] = (wchar_t) s;
   hash_ctx.readSize = dwBufferLength;
 
-  info->argHash = (char *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), SL2_HASH_LEN + 1);
-  hash_args(info->argHash, &hash_ctx);
+  hash_args(info, &hash_ctx);
 }
 
 /** Pre-function wrapper for InternetReadFile
@@ -496,8 +845,8 @@ void SL2Client::wrap_pre_InternetReadFile(void *wrapcxt, OUT void **user_data) {
   // DWORD positionLow = InternetSetFilePointer(hFile, 0, &positionHigh, FILE_CURRENT);
   // uint64_t position = positionHigh;
 
-  *user_data = dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(client_read_info));
-  client_read_info *info = (client_read_info *)*user_data;
+  client_read_info *info = alloc_call_record(drwrap_get_drcontext(wrapcxt));
+  *user_data = info;
 
   info->function = Function::InternetReadFile;
   info->hFile = hFile;
@@ -513,8 +862,7 @@ void SL2Client::wrap_pre_InternetReadFile(void *wrapcxt, OUT void **user_data) {
   //    hash_ctx.fileName[0] = (wchar_t) s;
   hash_ctx.readSize = nNumberOfBytesToRead;
 
-  info->argHash = (char *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), SL2_HASH_LEN + 1);
-  hash_args(info->argHash, &hash_ctx);
+  hash_args(info, &hash_ctx);
 }
 
 /** Pre-function wrapper for WinHttpReadD
@@ -543,8 +891,8 @@ void SL2Client::wrap_pre_WinHttpReadData(void *wrapcxt, OUT void **user_data) {
   // DWORD positionLow = InternetSetFilePointer(hRequest, 0, &positionHigh, FILE_CURRENT);
   // uint64_t position = positionHigh;
 
-  *user_data = dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(client_read_info));
-  client_read_info *info = (client_read_info *)*user_data;
+  client_read_info *info = alloc_call_record(drwrap_get_drcontext(wrapcxt));
+  *user_data = info;
 
   info->function = Function::WinHttpReadData;
   info->hFile = hRequest;
@@ -560,8 +908,7 @@ void SL2Client::wrap_pre_WinHttpReadData(void *wrapcxt, OUT void **user_data) {
   //    hash_ctx.fileName[0] = (wchar_t) s;
   hash_ctx.readSize = nNumberOfBytesToRead;
 
-  info->argHash = (char *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), SL2_HASH_LEN + 1);
-  hash_args(info->argHash, &hash_ctx);
+  hash_args(info, &hash_ctx);
 }
 
 /** Pre-function wrapper for recv
@@ -587,8 +934,8 @@ void SL2Client::wrap_pre_recv(void *wrapcxt, OUT void **user_data) {
 #pragma warning(suppress : 4311 4302)
   int flags = (int)drwrap_get_arg(wrapcxt, 3);
 
-  *user_data = dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(client_read_info));
-  client_read_info *info = (client_read_info *)*user_data;
+  client_read_info *info = alloc_call_record(drwrap_get_drcontext(wrapcxt));
+  *user_data = info;
 
   info->function = Function::recv;
   info->hFile = NULL;
@@ -604,8 +951,7 @@ void SL2Client::wrap_pre_recv(void *wrapcxt, OUT void **user_data) {
   hash_ctx.fileName[0] = (wchar_t)s;
   hash_ctx.readSize = len;
 
-  info->argHash = (char *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), SL2_HASH_LEN + 1);
-  hash_args(info->argHash, &hash_ctx);
+  hash_args(info, &hash_ctx);
 }
 
 /** Pre-function wrapper for ReadFile
@@ -642,8 +988,8 @@ void SL2Client::wrap_pre_ReadFile(void *wrapcxt, OUT void **user_data) {
   hash_ctx.position = position.QuadPart;
   hash_ctx.readSize = nNumberOfBytesToRead;
 
-  *user_data = dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(client_read_info));
-  client_read_info *info = (client_read_info *)*user_data;
+  client_read_info *info = alloc_call_record(drwrap_get_drcontext(wrapcxt));
+  *user_data = info;
 
   info->function = Function::ReadFile;
   info->hFile = hFile;
@@ -653,12 +999,10 @@ void SL2Client::wrap_pre_ReadFile(void *wrapcxt, OUT void **user_data) {
   info->position = hash_ctx.position;
   info->retAddrOffset = (uint64_t)drwrap_get_retaddr(wrapcxt) - baseAddr;
 
-  info->source =
-      (wchar_t *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(hash_ctx.fileName));
+  info->source = ((sl2_call_record *)info)->source;
   memcpy(info->source, hash_ctx.fileName, sizeof(hash_ctx.fileName));
 
-  info->argHash = (char *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), SL2_HASH_LEN + 1);
-  hash_args(info->argHash, &hash_ctx);
+  hash_args(info, &hash_ctx);
 }
 
 /**
@@ -677,8 +1021,8 @@ void SL2Client::wrap_pre_fread_s(void *wrapcxt, OUT void **user_data) {
   size_t count = (size_t)drwrap_get_arg(wrapcxt, 3);
   FILE *file = (FILE *)drwrap_get_arg(wrapcxt, 4);
 
-  *user_data = dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(client_read_info));
-  client_read_info *info = (client_read_info *)*user_data;
+  client_read_info *info = alloc_call_record(drwrap_get_drcontext(wrapcxt));
+  *user_data = info;
 
   info->function = Function::fread_s;
   // TODO(ww): Figure out why _get_osfhandle breaks DR.
@@ -699,8 +1043,7 @@ void SL2Client::wrap_pre_fread_s(void *wrapcxt, OUT void **user_data) {
   hash_ctx.readSize = size;
   hash_ctx.count = count;
 
-  info->argHash = (char *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), SL2_HASH_LEN + 1);
-  hash_args(info->argHash, &hash_ctx);
+  hash_args(info, &hash_ctx);
 }
 
 /**
@@ -719,8 +1062,8 @@ void SL2Client::wrap_pre_fread(void *wrapcxt, OUT void **user_data) {
   size_t count = (size_t)drwrap_get_arg(wrapcxt, 2);
   FILE *file = (FILE *)drwrap_get_arg(wrapcxt, 3);
 
-  *user_data = dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(client_read_info));
-  client_read_info *info = (client_read_info *)*user_data;
+  client_read_info *info = alloc_call_record(drwrap_get_drcontext(wrapcxt));
+  *user_data = info;
 
   info->function = Function::fread;
   // TODO(ww): Figure out why _get_osfhandle breaks DR.
@@ -741,8 +1084,7 @@ void SL2Client::wrap_pre_fread(void *wrapcxt, OUT void **user_data) {
   hash_ctx.readSize = size;
   hash_ctx.count = count;
 
-  info->argHash = (char *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), SL2_HASH_LEN + 1);
-  hash_args(info->argHash, &hash_ctx);
+  hash_args(info, &hash_ctx);
 }
 
 /**
@@ -760,8 +1102,8 @@ void SL2Client::wrap_pre__read(void *wrapcxt, OUT void **user_data) {
 #pragma warning(suppress : 4311 4302)
   unsigned int count = (unsigned int)drwrap_get_arg(wrapcxt, 2);
 
-  *user_data = dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(client_read_info));
-  client_read_info *info = (client_read_info *)*user_data;
+  client_read_info *info = alloc_call_record(drwrap_get_drcontext(wrapcxt));
+  *user_data = info;
 
   info->function = Function::_read;
   // TODO(ww): Figure out why _get_osfhandle breaks DR.
@@ -779,8 +1121,7 @@ void SL2Client::wrap_pre__read(void *wrapcxt, OUT void **user_data) {
   hash_ctx.fileName[0] = (wchar_t)fd;
   hash_ctx.count = count;
 
-  info->argHash = (char *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), SL2_HASH_LEN + 1);
-  hash_args(info->argHash, &hash_ctx);
+  hash_args(info, &hash_ctx);
 }
 
 /**
@@ -801,8 +1142,8 @@ void SL2Client::wrap_pre_MapViewOfFile(void *wrapcxt, OUT void **user_data) {
   DWORD dwFileOffsetLow = (DWORD)drwrap_get_arg(wrapcxt, 3);
   size_t dwNumberOfBytesToMap = (size_t)drwrap_get_arg(wrapcxt, 4);
 
-  *user_data = dr_thread_alloc(drwrap_get_drcontext(wrapcxt), sizeof(client_read_info));
-  client_read_info *info = (client_read_info *)*user_data;
+  client_read_info *info = alloc_call_record(drwrap_get_drcontext(wrapcxt));
+  *user_data = info;
 
   info->function = Function::MapViewOfFile;
   info->hFile = hFileMappingObject;
@@ -816,7 +1157,6 @@ void SL2Client::wrap_pre_MapViewOfFile(void *wrapcxt, OUT void **user_data) {
 
   // NOTE(ww): We populate these in the post-hook, when necessary.
   info->lpBuffer = NULL;
-  info->argHash = (char *)dr_thread_alloc(drwrap_get_drcontext(wrapcxt), SL2_HASH_LEN + 1);
 
   // Change write-access requests to copy-on-write requests, since we don't want to clobber
   // our original input file with mutated data.
@@ -856,6 +1196,68 @@ bool SL2Client::is_sane_post_hook(void *wrapcxt, void *user_data, void **drconte
   return true;
 }
 
+/**
+ * Sets up the per-thread call record freelists. Must be called after drmgr_init.
+ * @return success
+ */
+bool SL2Client::init_call_records() {
+  call_record_tls_idx = drmgr_register_tls_field();
+
+  if (call_record_tls_idx == -1) {
+    return false;
+  }
+
+  return drmgr_register_thread_exit_event(on_call_record_thread_exit);
+}
+
+/**
+ * Tears down the per-thread call record freelists. Must be called before drmgr_exit.
+ */
+void SL2Client::exit_call_records() {
+  drmgr_unregister_thread_exit_event(on_call_record_thread_exit);
+  drmgr_unregister_tls_field(call_record_tls_idx);
+}
+
+/**
+ * Gets a call record for a pre-hook from the current thread's freelist, only allocating when the
+ * freelist is empty.
+ * @param drcontext the DynamoRIO context for the current thread
+ * @return the record's client_read_info, with legacyArgHash pointing into the record and source
+ * NULL
+ */
+client_read_info *SL2Client::alloc_call_record(void *drcontext) {
+  sl2_call_record *record = (sl2_call_record *)drmgr_get_tls_field(drcontext, call_record_tls_idx);
+
+  if (record) {
+    drmgr_set_tls_field(drcontext, call_record_tls_idx, record->next);
+  } else {
+    record = (sl2_call_record *)dr_thread_alloc(drcontext, sizeof(sl2_call_record));
+  }
+
+  record->next = NULL;
+  record->info.argHash = 0;
+  record->info.legacyArgHash = record->legacyArgHash;
+  record->info.legacyArgHash[0] = 0;
+  record->info.source = NULL;
+
+  return &record->info;
+}
+
+/**
+ * Returns a call record to the current thread's freelist.
+ * @param drcontext the DynamoRIO context for the current thread
+ * @param info the record's client_read_info, as returned by `alloc_call_record`
+ */
+void SL2Client::free_call_record(void *drcontext, client_read_info *info) {
+  if (!info || !drcontext) {
+    return;
+  }
+
+  sl2_call_record *record = (sl2_call_record *)info;
+  record->next = (sl2_call_record *)drmgr_get_tls_field(drcontext, call_record_tls_idx);
+  drmgr_set_tls_field(drcontext, call_record_tls_idx, record);
+}
+
 /**
  * Simple mapping from functions to their stringified names
  * @param function member of the Function enum
@@ -890,6 +1292,23 @@ const char *SL2Client::function_to_string(Function function) {
   return "unknown";
 }
 
+/**
+ * Inverse of `function_to_string`
+ * @param func_name the stringified name of the function
+ * @param function the Function to fill in, if found
+ * @return whether func_name corresponds to a member of the Function enum
+ */
+bool SL2Client::string_to_function(const char *func_name, Function *function) {
+  for (size_t i = 0; i < SL2_FUNCTION_COUNT; i++) {
+    if (STREQ(func_name, function_to_string((Function)i))) {
+      *function = (Function)i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
 /**
  * maps exception codes to strings
  * @param exception_code
@@ -1004,7 +1423,7 @@ bool SL2Client::function_is_in_expected_module(const char *func, const char *mod
 
     func_name --  ""
 
-    argHash --  ""
+    argHash --  "" (either a hex-encoded fingerprint, or a legacy hex-encoded SHA256)
  * @param j - values loaded from target file on disk
  * @param t - struct to fill out
  */
@@ -0,0 +1,370 @@
+#include <cstdint>
+#include <cstring>
+
+#include "drmgr.h"
+
+#include "common/sl2_dr_slab.hpp"
+
+/** There's no sensible way to recover from DR refusing to give us memory. */
+#define SL2_SLAB_OOM()                                                                             \
+  do {                                                                                             \
+    dr_fprintf(STDERR, "sl2_slab: out of memory!\n");                                              \
+    dr_abort();                                                                                    \
+  } while (0)
+
+/** A free block within a slab. Free blocks are threaded through their own first word. */
+struct sl2_slab_block {
+  sl2_slab_block *next;
+};
+
+/** A thread's cached free blocks, one list per size class. */
+struct sl2_slab_cache {
+  sl2_slab_block *free[SL2_SLAB_NUM_CLASSES];
+  size_t nfree[SL2_SLAB_NUM_CLASSES];
+};
+
+/** Header at the start of every chunk we get from dr_raw_mem_alloc. */
+struct sl2_slab_chunk {
+  sl2_slab_chunk *next;
+  size_t size;
+};
+
+/*! Guards everything below. Only taken on cache misses and on the uninitialized path. */
+static void *slab_lock = NULL;
+/*! Shared free blocks, one list per size class */
+static sl2_slab_block *shared_free[SL2_SLAB_NUM_CLASSES];
+/*! Every chunk we've allocated */
+static sl2_slab_chunk *chunks = NULL;
+/*! The unused tail of the most recent chunk */
+static char *chunk_cursor = NULL;
+static char *chunk_limit = NULL;
+
+/*! TLS slot holding each thread's sl2_slab_cache, or -1 outside of sl2_slab_init/sl2_slab_exit */
+static int slab_tls_idx = -1;
+
+/**
+ * Maps an allocation size onto its size class.
+ * @param size the size of the allocation, no larger than SL2_SLAB_MAX_SIZE
+ * @return the index of the smallest size class that fits size
+ */
+static size_t size_class(size_t size) {
+  size_t cls = 0;
+  size_t class_size = SL2_SLAB_MIN_SIZE;
+
+  while (class_size < size) {
+    class_size <<= 1;
+    cls++;
+  }
+
+  return cls;
+}
+
+/**
+ * Takes the slab lock, creating it if necessary.
+ * NOTE(ww): The lazy creation here is only safe because the first allocation happens either
+ * during static initialization or in dr_client_main, both of which are single-threaded.
+ */
+static void slab_lock_acquire() {
+  if (!slab_lock) {
+    slab_lock = dr_mutex_create();
+  }
+
+  dr_mutex_lock(slab_lock);
+}
+
+static void slab_lock_release() {
+  dr_mutex_unlock(slab_lock);
+}
+
+/**
+ * Carves a new block out of the current chunk, allocating a fresh chunk if it's exhausted.
+ * Must be called with the slab lock held.
+ * @param cls the size class to carve a block for
+ * @return the new block, or NULL if DR couldn't give us any memory
+ */
+static sl2_slab_block *carve_block(size_t cls) {
+  size_t block_size = (size_t)SL2_SLAB_MIN_SIZE << cls;
+
+  if (!chunk_cursor || chunk_cursor + block_size > chunk_limit) {
+    sl2_slab_chunk *chunk = (sl2_slab_chunk *)dr_raw_mem_alloc(
+        SL2_SLAB_CHUNK_SIZE, DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+
+    if (!chunk) {
+      return NULL;
+    }
+
+    chunk->next = chunks;
+    chunk->size = SL2_SLAB_CHUNK_SIZE;
+    chunks = chunk;
+
+    // NOTE(ww): Any leftover space at the end of the old chunk is simply abandoned.
+    // Keep the first block SL2_SLAB_MIN_SIZE-aligned, like every block after it.
+    chunk_cursor = (char *)chunk + SL2_SLAB_MIN_SIZE;
+    chunk_limit = (char *)chunk + SL2_SLAB_CHUNK_SIZE;
+  }
+
+  sl2_slab_block *block = (sl2_slab_block *)chunk_cursor;
+  chunk_cursor += block_size;
+
+  return block;
+}
+
+/**
+ * Moves up to SL2_SLAB_BATCH blocks of a size class from the shared pool into a thread's cache,
+ * carving new ones as needed.
+ * @param cache the thread's cache
+ * @param cls the size class to refill
+ */
+static void refill_cache(sl2_slab_cache *cache, size_t cls) {
+  slab_lock_acquire();
+
+  for (size_t i = 0; i < SL2_SLAB_BATCH; i++) {
+    sl2_slab_block *block = shared_free[cls];
+
+    if (block) {
+      shared_free[cls] = block->next;
+    } else if (!(block = carve_block(cls))) {
+      break;
+    }
+
+    block->next = cache->free[cls];
+    cache->free[cls] = block;
+    cache->nfree[cls]++;
+  }
+
+  slab_lock_release();
+}
+
+/**
+ * Returns a thread's surplus cached blocks of a size class to the shared pool, so that a thread
+ * that frees much more than it allocates doesn't hoard memory.
+ * @param cache the thread's cache
+ * @param cls the size class to drain
+ */
+static void drain_cache(sl2_slab_cache *cache, size_t cls) {
+  slab_lock_acquire();
+
+  while (cache->nfree[cls] > SL2_SLAB_BATCH) {
+    sl2_slab_block *block = cache->free[cls];
+    cache->free[cls] = block->next;
+    cache->nfree[cls]--;
+
+    block->next = shared_free[cls];
+    shared_free[cls] = block;
+  }
+
+  slab_lock_release();
+}
+
+/**
+ * Gets the calling thread's cache, creating it on first use.
+ * @return the cache, or NULL if we're not initialized or not on a DR-managed thread
+ */
+static sl2_slab_cache *get_cache() {
+  if (slab_tls_idx == -1) {
+    return NULL;
+  }
+
+  void *drcontext = dr_get_current_drcontext();
+
+  if (!drcontext) {
+    return NULL;
+  }
+
+  sl2_slab_cache *cache = (sl2_slab_cache *)drmgr_get_tls_field(drcontext, slab_tls_idx);
+
+  if (!cache) {
+    cache = (sl2_slab_cache *)dr_thread_alloc(drcontext, sizeof(sl2_slab_cache));
+    memset(cache, 0, sizeof(sl2_slab_cache));
+    drmgr_set_tls_field(drcontext, slab_tls_idx, cache);
+  }
+
+  return cache;
+}
+
+/** Hands an exiting thread's cached blocks back to the shared pool. */
+static void on_slab_thread_exit(void *drcontext) {
+  sl2_slab_cache *cache = (sl2_slab_cache *)drmgr_get_tls_field(drcontext, slab_tls_idx);
+
+  if (!cache) {
+    return;
+  }
+
+  slab_lock_acquire();
+
+  for (size_t cls = 0; cls < SL2_SLAB_NUM_CLASSES; cls++) {
+    while (cache->free[cls]) {
+      sl2_slab_block *block = cache->free[cls];
+      cache->free[cls] = block->next;
+
+      block->next = shared_free[cls];
+      shared_free[cls] = block;
+    }
+  }
+
+  slab_lock_release();
+
+  drmgr_set_tls_field(drcontext, slab_tls_idx, NULL);
+  dr_thread_free(drcontext, cache, sizeof(sl2_slab_cache));
+}
+
+/**
+ * Enables the per-thread caches. Must be called after drmgr_init.
+ * @return success
+ */
+bool sl2_slab_init() {
+  slab_tls_idx = drmgr_register_tls_field();
+
+  if (slab_tls_idx == -1) {
+    return false;
+  }
+
+  return drmgr_register_thread_exit_event(on_slab_thread_exit);
+}
+
+/**
+ * Disables the per-thread caches. Must be called before drmgr_exit.
+ * NOTE(ww): We deliberately don't unmap our chunks here: static containers (parsedJson, the
+ * tracer's taint sets, etc.) still walk their nodes in their destructors, which run after
+ * DR's exit event. The chunks go away with the process.
+ */
+void sl2_slab_exit() {
+  if (slab_tls_idx != -1) {
+    drmgr_unregister_thread_exit_event(on_slab_thread_exit);
+    drmgr_unregister_tls_field(slab_tls_idx);
+    slab_tls_idx = -1;
+  }
+}
+
+/**
+ * Allocates memory from the calling thread's slab cache.
+ * @param size the number of bytes to allocate
+ * @return the allocation
+ */
+void *sl2_slab_alloc(size_t size) {
+  if (size > SL2_SLAB_MAX_SIZE) {
+    return dr_global_alloc(size);
+  }
+
+  size_t cls = size_class(size);
+  sl2_slab_cache *cache = get_cache();
+  sl2_slab_block *block;
+
+  if (cache) {
+    if (!cache->free[cls]) {
+      refill_cache(cache, cls);
+    }
+
+    block = cache->free[cls];
+
+    if (block) {
+      cache->free[cls] = block->next;
+      cache->nfree[cls]--;
+    }
+  } else {
+    slab_lock_acquire();
+
+    block = shared_free[cls];
+
+    if (block) {
+      shared_free[cls] = block->next;
+    } else {
+      block = carve_block(cls);
+    }
+
+    slab_lock_release();
+  }
+
+  if (!block) {
+    SL2_SLAB_OOM();
+  }
+
+  return block;
+}
+
+/**
+ * Returns memory from `sl2_slab_alloc` to the calling thread's slab cache.
+ * @param ptr the allocation
+ * @param size the size originally passed to `sl2_slab_alloc`
+ */
+void sl2_slab_free(void *ptr, size_t size) {
+  if (!ptr) {
+    return;
+  }
+
+  if (size > SL2_SLAB_MAX_SIZE) {
+    dr_global_free(ptr, size);
+    return;
+  }
+
+  size_t cls = size_class(size);
+  sl2_slab_cache *cache = get_cache();
+  sl2_slab_block *block = (sl2_slab_block *)ptr;
+
+  if (cache) {
+    block->next = cache->free[cls];
+    cache->free[cls] = block;
+    cache->nfree[cls]++;
+
+    if (cache->nfree[cls] > 2 * SL2_SLAB_BATCH) {
+      drain_cache(cache, cls);
+    }
+  } else {
+    slab_lock_acquire();
+    block->next = shared_free[cls];
+    shared_free[cls] = block;
+    slab_lock_release();
+  }
+}
+
+/**
+ * Bumps a new allocation off the arena's current chunk, allocating a new chunk when necessary.
+ * @param size the number of bytes to allocate
+ * @param align the required alignment, which must be a power of two
+ * @return the allocation
+ */
+void *sl2_bump_arena::alloc(size_t size, size_t align) {
+  char *ptr = (char *)(((uintptr_t)cursor_ + (align - 1)) & ~(uintptr_t)(align - 1));
+
+  if (!cursor_ || ptr + size > limit_) {
+    size_t header = (sizeof(chunk) + (align - 1)) & ~(align - 1);
+    size_t chunk_size = SL2_SLAB_CHUNK_SIZE;
+
+    while (chunk_size < header + size) {
+      chunk_size <<= 1;
+    }
+
+    chunk *c = (chunk *)dr_raw_mem_alloc(chunk_size, DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+
+    if (!c) {
+      SL2_SLAB_OOM();
+    }
+
+    c->next = chunks_;
+    c->size = chunk_size;
+    chunks_ = c;
+
+    ptr = (char *)c + header;
+    limit_ = (char *)c + chunk_size;
+  }
+
+  cursor_ = ptr + size;
+  used_ += size;
+
+  return ptr;
+}
+
+/**
+ * Frees every allocation made from the arena at once.
+ */
+void sl2_bump_arena::reset() {
+  while (chunks_) {
+    chunk *next = chunks_->next;
+    dr_raw_mem_free(chunks_, chunks_->size);
+    chunks_ = next;
+  }
+
+  cursor_ = NULL;
+  limit_ = NULL;
+  used_ = 0;
+}
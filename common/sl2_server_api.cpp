@@ -200,6 +200,7 @@ SL2Response sl2_conn_request_crash_paths(sl2_conn *conn, uint64_t pid, sl2_crash
   sl2_conn_read_prefixed_string(conn, paths->crash_path, MAX_PATH);
   sl2_conn_read_prefixed_string(conn, paths->mem_dump_path, MAX_PATH);
   sl2_conn_read_prefixed_string(conn, paths->initial_dump_path, MAX_PATH);
+  sl2_conn_read_prefixed_string(conn, paths->trace_path, MAX_PATH);
 
   return SL2Response::OK;
 }
@@ -325,3 +326,20 @@ SL2Response sl2_conn_get_coverage(sl2_conn *conn, sl2_arena *arena, sl2_coverage
 
   return SL2Response::OK;
 }
+
+SL2_EXPORT
+SL2Response sl2_conn_register_crash(sl2_conn *conn, uint64_t fingerprint,
+                                     sl2_crash_bucket *bucket) {
+  DWORD txsize;
+
+  // First, tell the server that we're registering a crash.
+  SL2_CONN_EVT(EVT_CRASH_FINGERPRINT);
+
+  // Then, tell the server the crash's fingerprint.
+  SL2_CONN_WRITE(&fingerprint, sizeof(fingerprint));
+
+  // Finally, read back the fingerprint's bucket.
+  SL2_CONN_READ(bucket, sizeof(sl2_crash_bucket));
+
+  return SL2Response::OK;
+}
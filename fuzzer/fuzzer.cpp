@@ -12,6 +12,9 @@
 // we want to do coverage for anyways.
 #define SL2_MAX_MODULES 1024
 
+// NOTE(ww): Likewise, nobody should need more than a handful of coverage ranges.
+#define SL2_MAX_COV_RANGES 64
+
 static droption_t<bool> op_no_coverage(DROPTION_SCOPE_CLIENT, "n", false, "nocoverage",
                                        "disable coverage, even when possible");
 
@@ -21,6 +24,12 @@ static droption_t<std::string> op_run_id(DROPTION_SCOPE_CLIENT, "r", "", "run_id
 static droption_t<std::string> op_arena_id(DROPTION_SCOPE_CLIENT, "a", "", "arena_id",
                                            "specify the arena ID for coverage guidance");
 
+static droption_t<unsigned int> op_crash_sample(
+    DROPTION_SCOPE_CLIENT, "crash_sample", 0, "fully triage every Nth repeat of a known crash",
+    "Crashes whose fingerprint the server has already seen are normally only counted: no initial "
+    "dump is written, and the harness doesn't replay them. With this set, every Nth repeat of a "
+    "known crash is dumped and triaged anyway. 0 never re-triages a known crash.");
+
 // TODO(ww): Add options here for edge/bb coverage,
 // if we decided to support edge as well.
 
@@ -30,28 +39,179 @@ static SL2Client client;
 static sl2_conn sl2_conn;
 static sl2_exception_ctx fuzz_exception_ctx;
 static bool crashed = false;
+/*! Whether the crash is a repeat of one the server already knows about, and isn't being sampled */
+static bool known_crash = false;
 static bool exiting = false;
 static uint32_t mut_count = 0;
 /*! Blank arena that tracks our path for this single run. Gets sent to the server and merged with
  * old arenas*/
 static sl2_arena arena = {0};
 static bool coverage_guided = false;
+
+/*! A module we're collecting coverage for, along with what it's costing us to instrument. */
+struct sl2_cov_module {
+  module_data_t *data;
+  /*! Number of basic blocks we've inserted coverage instrumentation into */
+  volatile LONG blocks;
+  /*! Number of basic blocks we've seen in this module, but skipped due to cov_ranges */
+  volatile LONG skipped;
+};
+
+/*! An address range parsed from the cov_ranges option. */
+struct sl2_cov_range {
+  /*! Module glob for a module-relative range, or an empty string for an absolute range */
+  char module[MAX_PATH];
+  uint64_t start;
+  uint64_t end;
+};
+
 /*! Map of the modules we've ssen so far (so we can find the base addresses) */
-static std::array<module_data_t *, SL2_MAX_MODULES> seen_modules;
+static std::array<sl2_cov_module, SL2_MAX_MODULES> seen_modules;
 static uint32_t nmodules = 0;
 
+/*! Address ranges that coverage is restricted to. Module-relative ranges get rebased on load. */
+static std::array<sl2_cov_range, SL2_MAX_COV_RANGES> cov_ranges;
+static uint32_t ncov_ranges = 0;
+/*! The absolute versions of cov_ranges, filled in as their modules are loaded */
+static std::array<std::pair<app_pc, app_pc>, SL2_MAX_COV_RANGES> resolved_cov_ranges;
+static uint32_t nresolved_cov_ranges = 0;
+
 /**
- * Finds the base address of the module containing a given memory address
- * @param addr memory address of a basic block
- * @return base address of the module containing addr
+ * Case-insensitively matches a string against a glob containing `*` and `?` wildcards.
+ * @param pattern the glob to match against
+ * @param str the string to match
+ * @return whether str matches pattern
+ */
+static bool glob_match(const char *pattern, const char *str) {
+  const char *star = NULL;
+  const char *backtrack = NULL;
+
+  while (*str) {
+    if (*pattern == '*') {
+      star = pattern++;
+      backtrack = str;
+    } else if (*pattern == '?' || tolower(*pattern) == tolower(*str)) {
+      pattern++;
+      str++;
+    } else if (star) {
+      pattern = star + 1;
+      str = ++backtrack;
+    } else {
+      return false;
+    }
+  }
+
+  while (*pattern == '*') {
+    pattern++;
+  }
+
+  return !*pattern;
+}
+
+/**
+ * Checks a module against a semicolon-separated list of globs, using both its full path and its
+ * preferred name.
+ * @param globs semicolon-separated list of globs
+ * @param mod the module to check
+ * @return whether any of the globs match the module
+ */
+static bool module_matches_globs(const std::string &globs, const module_data_t *mod) {
+  const char *mod_name = dr_module_preferred_name(mod);
+  size_t pos = 0;
+
+  while (pos < globs.length()) {
+    size_t end = globs.find(';', pos);
+    if (end == std::string::npos) {
+      end = globs.length();
+    }
+
+    std::string glob = globs.substr(pos, end - pos);
+    pos = end + 1;
+
+    if (glob.empty()) {
+      continue;
+    }
+
+    if (glob_match(glob.c_str(), mod->full_path) ||
+        (mod_name && glob_match(glob.c_str(), mod_name))) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Parses the cov_ranges option into cov_ranges. Absolute ranges are resolved immediately.
+ * @param ranges semicolon-separated list of `[module+]0xSTART-0xEND` ranges
+ * @return whether every range was parsed successfully
  */
-static app_pc get_base_pc(app_pc addr) {
-  module_data_t *containing_module = NULL;
+static bool parse_cov_ranges(const std::string &ranges) {
+  size_t pos = 0;
+
+  while (pos < ranges.length()) {
+    size_t end = ranges.find(';', pos);
+    if (end == std::string::npos) {
+      end = ranges.length();
+    }
+
+    std::string spec = ranges.substr(pos, end - pos);
+    pos = end + 1;
+
+    if (spec.empty()) {
+      continue;
+    }
+
+    if (ncov_ranges >= SL2_MAX_COV_RANGES) {
+      SL2_DR_DEBUG("parse_cov_ranges: too many ranges (max %d)\n", SL2_MAX_COV_RANGES);
+      return false;
+    }
+
+    sl2_cov_range &range = cov_ranges[ncov_ranges];
+    size_t plus = spec.rfind('+');
+    size_t dash = spec.rfind('-');
+
+    if (dash == std::string::npos || (plus != std::string::npos && plus > dash) ||
+        (plus != std::string::npos && plus >= MAX_PATH)) {
+      SL2_DR_DEBUG("parse_cov_ranges: malformed range: %s\n", spec.c_str());
+      return false;
+    }
+
+    if (plus != std::string::npos) {
+      strncpy_s(range.module, spec.c_str(), plus);
+    } else {
+      range.module[0] = '\0';
+    }
+
+    std::string start_s = spec.substr(plus == std::string::npos ? 0 : plus + 1);
+    range.start = strtoull(start_s.c_str(), NULL, 0);
+    range.end = strtoull(spec.c_str() + dash + 1, NULL, 0);
 
+    if (range.start >= range.end) {
+      SL2_DR_DEBUG("parse_cov_ranges: empty range: %s\n", spec.c_str());
+      return false;
+    }
+
+    if (!range.module[0]) {
+      resolved_cov_ranges[nresolved_cov_ranges++] =
+          std::make_pair((app_pc)range.start, (app_pc)range.end);
+    }
+
+    ncov_ranges++;
+  }
+
+  return true;
+}
+
+/**
+ * Finds the coverage module containing a given memory address
+ * @param addr memory address of a basic block
+ * @return the module containing addr, or NULL if we aren't tracking it
+ */
+static sl2_cov_module *get_cov_module(app_pc addr) {
   for (uint32_t i = 0; i < nmodules; ++i) {
-    if (dr_module_contains_addr(seen_modules[i], addr)) {
-      containing_module = seen_modules[i];
-      break;
+    if (dr_module_contains_addr(seen_modules[i].data, addr)) {
+      return &seen_modules[i];
     }
   }
 
@@ -59,11 +219,26 @@ static app_pc get_base_pc(app_pc addr) {
   // 1. When the address given is in a module we don't care about (e.g., system DLLs)
   // 2. When the address given is in a module we aren't tracking
   //  (i.e., when nmodules == SL2_MAX_MODULES)
-  if (!containing_module) {
-    return NULL;
+  return NULL;
+}
+
+/**
+ * Checks whether an address falls inside one of the (resolved) coverage ranges.
+ * @param addr memory address of a basic block
+ * @return whether addr is in range, or true if no ranges were requested
+ */
+static bool is_in_cov_ranges(app_pc addr) {
+  if (!ncov_ranges) {
+    return true;
   }
 
-  return containing_module->start;
+  for (uint32_t i = 0; i < nresolved_cov_ranges; ++i) {
+    if (addr >= resolved_cov_ranges[i].first && addr < resolved_cov_ranges[i].second) {
+      return true;
+    }
+  }
+
+  return false;
 }
 
 /**
@@ -81,13 +256,19 @@ static dr_emit_flags_t on_bb_instrument(void *drcontext, void *tag, instrlist_t
   }
 
   start_pc = dr_fragment_app_pc(tag);
-  app_pc base_pc = get_base_pc(start_pc);
+  sl2_cov_module *cov_module = get_cov_module(start_pc);
 
-  if (!base_pc) {
+  if (!cov_module) {
     return DR_EMIT_DEFAULT;
   }
 
-  offset = (start_pc - base_pc) & (FUZZ_ARENA_SIZE - 1);
+  if (!is_in_cov_ranges(start_pc)) {
+    InterlockedIncrement(&cov_module->skipped);
+    return DR_EMIT_DEFAULT;
+  }
+
+  InterlockedIncrement(&cov_module->blocks);
+  offset = (start_pc - cov_module->data->start) & (FUZZ_ARENA_SIZE - 1);
 
   drreg_reserve_aflags(drcontext, bb, inst);
   // TODO(ww): Is it really necessary to inject an instruction here?
@@ -119,8 +300,23 @@ static bool on_exception(void *drcontext, dr_exception_t *excpt) {
   // Make our own copy of the exception record.
   memcpy(&(fuzz_exception_ctx.record), excpt->record, sizeof(EXCEPTION_RECORD));
 
+  // NOTE(ww): The fingerprint is deliberately cheap (see SL2Client::fingerprint_crash) -- it only
+  // needs to be good enough to tell us whether this crash is worth a dump and a tracer replay.
+  uint64_t fingerprint = client.fingerprint_crash(drcontext, excpt);
+  sl2_crash_bucket bucket = {0};
+  char fingerprint_s[17] = {0};
+
+  sl2_conn_register_crash(&sl2_conn, fingerprint, &bucket);
+  dr_snprintf(fingerprint_s, sizeof(fingerprint_s) - 1, "%016llx", fingerprint);
+
+  uint32_t sample = op_crash_sample.get_value();
+  known_crash = bucket.hits > 1 && !(sample && (bucket.hits - 1) % sample == 0);
+
   json j;
   j["exception"] = client.exception_to_string(exception_code);
+  j["fingerprint"] = fingerprint_s;
+  j["hits"] = bucket.hits;
+  j["skip_triage"] = known_crash;
   SL2_LOG_JSONL(j);
 
   dr_exit_process(1);
@@ -133,7 +329,9 @@ static void on_dr_exit(void) {
   exiting = true;
   SL2_DR_DEBUG("Dynamorio exiting (fuzzer)\n");
 
-  if (crashed) {
+  if (crashed && known_crash) {
+    SL2_DR_DEBUG("fuzzer#on_dr_exit: known crash, not writing an initial dump\n");
+  } else if (crashed) {
     char run_id_s[SL2_UUID_SIZE];
     sl2_uuid_to_string(sl2_conn.run_id, run_id_s);
     SL2_DR_DEBUG("<crash found for run id %s>\n", run_id_s);
@@ -187,11 +385,22 @@ static void on_dr_exit(void) {
   sl2_conn_close(&sl2_conn);
 
   for (uint32_t i = 0; i < nmodules; ++i) {
-    dr_free_module_data(seen_modules[i]);
+    if (coverage_guided) {
+      json j;
+      j["type"] = "module_coverage";
+      j["module"] = seen_modules[i].data->full_path;
+      j["blocks"] = seen_modules[i].blocks;
+      j["skipped"] = seen_modules[i].skipped;
+      SL2_LOG_JSONL(j);
+    }
+
+    dr_free_module_data(seen_modules[i].data);
   }
 
   dr_log(NULL, DR_LOG_ALL, ERROR, "fuzzer#on_dr_exit: Dynamorio Exiting\n");
+  client.exit_call_records();
   drwrap_exit();
+  sl2_slab_exit();
   drmgr_exit();
   drreg_exit();
 }
@@ -433,16 +642,7 @@ static void wrap_post_Generic(void *wrapcxt, void *user_data) {
 
 cleanup:
 
-  if (info->source) {
-    dr_thread_free(drcontext, info->source,
-                   wcsnlen_s(info->source, MAX_PATH + 1) * sizeof(wchar_t));
-  }
-
-  if (info->argHash) {
-    dr_thread_free(drcontext, info->argHash, SL2_HASH_LEN + 1);
-  }
-
-  dr_thread_free(drcontext, info, sizeof(client_read_info));
+  client.free_call_record(drcontext, (client_read_info *)user_data);
 }
 
 /**
@@ -487,7 +687,7 @@ static void wrap_post_MapViewOfFile(void *wrapcxt, void *user_data) {
   info->source = hash_ctx.fileName;
 
   // Create the argHash, now that we have the correct source and nNumberOfBytesToRead.
-  client.hash_args(info->argHash, &hash_ctx);
+  client.hash_args(info, &hash_ctx);
 
   if (interesting_call && client.is_function_targeted(info)) {
     // If the mutation process fails in any way, consider this fuzzing run a loss.
@@ -500,21 +700,46 @@ static void wrap_post_MapViewOfFile(void *wrapcxt, void *user_data) {
 #pragma warning(suppress : 4533)
 cleanup:
 
-  dr_thread_free(drcontext, info->argHash, SL2_HASH_LEN + 1);
-  dr_thread_free(drcontext, info, sizeof(client_read_info));
+  client.free_call_record(drcontext, (client_read_info *)user_data);
 }
 
 /** Runs when a new module (typically an exe or dll) is loaded. Tells DynamoRIO to hook all the
  * interesting functions in that module. */
 static void on_module_load(void *drcontext, const module_data_t *mod, bool loaded) {
-  if (nmodules < SL2_MAX_MODULES - 1 && _strnicmp("C:\\Windows\\", mod->full_path, 11) &&
+  std::string cov_include = op_cov_include.get_value();
+
+  // NOTE(ww): Our own DLLs are never interesting, regardless of what the user asks for.
+  if (nmodules < SL2_MAX_MODULES - 1 &&
+      (cov_include.empty() || module_matches_globs(cov_include, mod)) &&
+      !module_matches_globs(op_cov_exclude.get_value(), mod) &&
       !strstr(mod->full_path, "dynamorio.dll") && !strstr(mod->full_path, "drreg.dll") &&
       !strstr(mod->full_path, "drwrap.dll") && !strstr(mod->full_path, "drmgr.dll") &&
       !strstr(mod->full_path, "fuzzer.dll")) {
     // Add a copy of the module to our seen module map so that we can avoid
     // doing basic block coverage of it later (if necessary).
-    seen_modules[nmodules++] = dr_copy_module_data(mod);
+    seen_modules[nmodules].data = dr_copy_module_data(mod);
+    seen_modules[nmodules].blocks = 0;
+    seen_modules[nmodules].skipped = 0;
+    nmodules++;
     SL2_DR_DEBUG("Adding %s to seen_modules\n", mod->full_path);
+
+    // Rebase any module-relative coverage ranges that apply to this module.
+    for (uint32_t i = 0; i < ncov_ranges; ++i) {
+      if (!cov_ranges[i].module[0] ||
+          !module_matches_globs(std::string(cov_ranges[i].module), mod)) {
+        continue;
+      }
+
+      if (nresolved_cov_ranges >= SL2_MAX_COV_RANGES) {
+        SL2_DR_DEBUG("on_module_load: too many resolved coverage ranges, ignoring the rest\n");
+        break;
+      }
+
+      resolved_cov_ranges[nresolved_cov_ranges++] = std::make_pair(
+          mod->start + cov_ranges[i].start, mod->start + cov_ranges[i].end);
+      SL2_DR_DEBUG("Restricting coverage in %s to 0x%llx-0x%llx\n", mod->full_path,
+                   cov_ranges[i].start, cov_ranges[i].end);
+    }
   }
 
   if (!strcmp(dr_get_application_name(), dr_module_preferred_name(mod))) {
@@ -696,7 +921,8 @@ DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
 
   drreg_options_t opts = {sizeof(opts), 3, false};
 
-  if (!drmgr_init() || drreg_init(&opts) != DRREG_SUCCESS || !drwrap_init()) {
+  if (!drmgr_init() || drreg_init(&opts) != DRREG_SUCCESS || !drwrap_init() ||
+      !client.init_call_records() || !sl2_slab_init()) {
     DR_ASSERT(false);
   }
 
@@ -705,6 +931,12 @@ DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
 
   if (coverage_guided) {
     SL2_DR_DEBUG("dr_client_main: arena given, instrumenting BBs!\n");
+
+    if (!parse_cov_ranges(op_cov_ranges.get_value())) {
+      SL2_DR_DEBUG("ERROR: malformed -cov_ranges\n");
+      dr_abort();
+    }
+
     mbstowcs_s(NULL, arena.id, SL2_HASH_LEN + 1, arena_id_s.c_str(), SL2_HASH_LEN);
     sl2_conn_request_arena(&sl2_conn, &arena);
 
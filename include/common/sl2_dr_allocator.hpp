@@ -21,7 +21,7 @@ template <typename T> struct sl2_dr_allocator {
   }
 
   void deallocate(T *ptr, size_t size) {
-    dr_global_free(ptr, size);
+    dr_global_free(ptr, size * sizeof(T));
   }
 };
 
@@ -17,7 +17,9 @@
 #include "droption.h"
 #include "drreg.h"
 
+#include <array>
 #include <string>
+#include <unordered_set>
 
 using namespace std;
 
@@ -27,10 +29,17 @@ extern "C" {
 }
 
 #include "common/sl2_dr_allocator.hpp"
+#include "common/sl2_dr_slab.hpp"
 
 /** Used for iterating over the function-module pair table. */
 #define SL2_FUNCMOD_TABLE_SIZE (sizeof(SL2_FUNCMOD_TABLE) / sizeof(SL2_FUNCMOD_TABLE[0]))
 
+/** The number of return addresses that go into a crash fingerprint. */
+#define SL2_CRASH_FRAMES 4
+
+/** The number of stack words scanned for return addresses when fingerprinting a crash. */
+#define SL2_CRASH_SCAN_WORDS 512
+
 /** Used for debugging prints. */
 #define SL2_DR_DEBUG(...) (dr_fprintf(STDERR, __VA_ARGS__))
 
@@ -81,6 +90,12 @@ enum class Function {
   MapViewOfFile,
 };
 
+/** The number of members in the Function enum. Keep this in sync with the last member! */
+#define SL2_FUNCTION_COUNT ((size_t)Function::MapViewOfFile + 1)
+
+/** The number of argument buffer bytes compared by `MATCH_ARG_COMPARE`. */
+#define SL2_ARG_BUFFER_COMPARE_LEN 16
+
 /** The set of supported function targeting techniques. */
 enum {
   /*! Target a function by its index, e.g. the 5th `fread` call */
@@ -106,8 +121,8 @@ enum {
 
 /** The struct filled with function information for hashing. See `MATCH_ARG_HASH`.
  * Note that the member names aren't quite right for all the function calls we fill this struct out
- * for. We mix and match as necessary since it's just used as a contiguous region of memory for
- * hashing, not an actual record.
+ * for. We mix and match as necessary since it's just used as a bag of values for hashing, not an
+ * actual record. Only the used part of fileName (up to its NUL) contributes to the fingerprint.
  */
 struct hash_context {
   wchar_t fileName[MAX_PATH + 1]; /*! Name of the file (if applicable) */
@@ -140,6 +155,51 @@ typedef struct targetFunction {
   vector<uint8_t> buffer;
 } TargetFunction;
 
+/**
+ * A selected targetFunction, flattened at load time into a fixed-size record so that matching
+ * it against a hooked call doesn't need to allocate.
+ */
+struct sl2_compiled_target {
+  /*! Which targeting strategy to use for this function */
+  uint64_t mode;
+  /*! The number of times we've encountered this function during execution */
+  uint64_t index;
+  /*! The ASLR-independent return address, already masked with SUB_ASLR_BITS */
+  uint64_t retAddrOffset;
+  /*! The number of times we've encountered this return address during execution*/
+  uint64_t retAddrCount;
+  /*! The fingerprint of the arguments of the function */
+  uint64_t argHash;
+  /*! The hex-encoded SHA256 of the arguments, for targets recorded before fingerprints (or "") */
+  char legacyArgHash[SL2_HASH_LEN + 1];
+  /*! The name of the source file (if available) */
+  wchar_t source[MAX_PATH + 1];
+  /*! The first few bytes of the argument buffer*/
+  uint8_t buffer[SL2_ARG_BUFFER_COMPARE_LEN];
+  /*! The number of valid bytes in buffer */
+  size_t bufferSize;
+};
+
+typedef std::vector<sl2_compiled_target, sl2_slab_allocator<sl2_compiled_target>>
+    sl2_compiled_target_vec;
+
+typedef std::unordered_set<uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                           sl2_slab_allocator<uint64_t>>
+    sl2_target_key_set;
+
+/**
+ * The selected targets for a single Function. Targets that match on nothing but their call index
+ * or their return address are keyed directly; everything else is checked against its predicates.
+ */
+struct sl2_target_index {
+  /*! Call indices of targets with mode == MATCH_INDEX */
+  sl2_target_key_set byIndex;
+  /*! Masked return addresses of targets with mode == MATCH_RETN_ADDRESS */
+  sl2_target_key_set byRetAddr;
+  /*! Targets using any other combination of strategies */
+  sl2_compiled_target_vec general;
+};
+
 /**
  * Information for read in fuzzer and tracer clients
  */
@@ -156,15 +216,59 @@ struct client_read_info {
   DWORD *lpNumberOfBytesRead;
   /*! Pointer to the buffer containing the user bytes (ie - the file being read) */
   void *lpBuffer;
-  /*! Pointer to the hex-encoded hash of the arguments */ // TODO(ww): Make this a wchar_t * for
-                                                          // consistency.
-  char *argHash;
+  /*! The fingerprint of the arguments. See `SL2Client::hash_args` */
+  uint64_t argHash;
+  /*! Pointer to the hex-encoded SHA256 of the arguments. Only filled in when a target from an
+   * older targets file needs it; otherwise an empty string. */
+  char *legacyArgHash;
   /*! Pointer to the string name of the source file (if applicable) */
   wchar_t *source;
   /*! Number of bytes this function wants to read */
   size_t nNumberOfBytesToRead;
 };
 
+/**
+ * Per-call state for a hooked function, including the storage that `info`'s argHash and source
+ * point into. Handed out by `SL2Client::alloc_call_record` from a per-thread freelist, so
+ * that hooking a call doesn't touch the heap once a thread has warmed up.
+ */
+struct sl2_call_record {
+  /*! Must be the first member, since hooks pass around pointers to it */
+  client_read_info info;
+  /*! Storage for info.legacyArgHash */
+  char legacyArgHash[SL2_HASH_LEN + 1];
+  /*! Storage for info.source, when the hook has a source */
+  wchar_t source[MAX_PATH + 1];
+  /*! Next free record on this thread, when on the freelist */
+  sl2_call_record *next;
+};
+
+/**
+ * Open-addressing (linear probing) table mapping return addresses to the number of times we've
+ * seen them. A slot with a count of zero is empty, since addresses only enter the table by being
+ * incremented.
+ */
+class sl2_retaddr_table {
+public:
+  uint64_t get(uint64_t retAddr);
+  uint64_t increment(uint64_t retAddr);
+
+private:
+  struct slot {
+    uint64_t retAddr;
+    uint64_t count;
+  };
+
+  slot *find_slot(uint64_t retAddr);
+  void grow();
+
+  // NOTE(ww): There's deliberately no destructor here: the table lives as long as the client,
+  // and DR's heap is gone by the time static destructors run.
+  slot *slots = NULL;
+  size_t capacity = 0;
+  size_t size = 0;
+};
+
 /**
  * The struct filled with exception information for registering within a minidump.
  */
@@ -187,22 +291,14 @@ typedef void (*sl2_pre_proto)(void *, void **);
 typedef void (*sl2_post_proto)(void *, void *);
 
 typedef std::map<char *, sl2_pre_proto, std::less<char *>,
-                 sl2_dr_allocator<std::pair<const char *, sl2_pre_proto>>>
+                 sl2_slab_allocator<std::pair<const char *, sl2_pre_proto>>>
     sl2_pre_proto_map;
 typedef std::map<char *, sl2_post_proto, std::less<char *>,
-                 sl2_dr_allocator<std::pair<const char *, sl2_post_proto>>>
+                 sl2_slab_allocator<std::pair<const char *, sl2_post_proto>>>
     sl2_post_proto_map;
 
-typedef std::map<Function, uint64_t, std::less<Function>,
-                 sl2_dr_allocator<std::pair<Function, uint64_t>>>
-    sl2_call_counts_map;
-
-typedef std::map<uint64_t, uint64_t, std::less<uint64_t>,
-                 sl2_dr_allocator<std::pair<uint64_t, uint64_t>>>
-    sl2_retaddr_counts_map;
-
 typedef nlohmann::basic_json<std::map, std::vector, std::string, bool, int64_t, uint64_t, double,
-                             sl2_dr_allocator>
+                             sl2_slab_allocator>
     json;
 
 // Declared in sl2_dr_client.cpp; contains pairs of functions and their expected modules.
@@ -219,26 +315,34 @@ public:
   ////////////////////////////////////////////////////////////////////////////////////////////
   // Variables
   // TODO(ww): Subsume sl2_conn under SL2Client.
-  /*! Map holding the number of times we've seen each function */
-  sl2_call_counts_map call_counts;
-  /*! Map holding the number of times we've seen each return address */
-  sl2_retaddr_counts_map ret_addr_counts;
+  /*! Array holding the number of times we've seen each function, indexed by Function */
+  std::array<uint64_t, SL2_FUNCTION_COUNT> call_counts;
+  /*! Table holding the number of times we've seen each return address */
+  sl2_retaddr_table ret_addr_counts;
   /*! JSON object holding targeted functions */
   json parsedJson;
+  /*! parsedJson's selected targets, compiled into a per-Function index by loadTargets */
+  std::array<sl2_target_index, SL2_FUNCTION_COUNT> targetIndex;
+  /*! Whether any of a Function's targets still use a hex SHA256 argHash */
+  std::array<bool, SL2_FUNCTION_COUNT> needsLegacyArgHash;
   /*! Base address for the main module */
   uint64_t baseAddr;
 
   ////////////////////////////////////////////////////////////////////////////////////////////
   // Methods
   // Method targeting methods.
-  void hash_args(char *argHash, hash_context *fStruct);
+  void hash_args(client_read_info *info, hash_context *hash_ctx);
+  uint64_t fingerprint_args(hash_context *hash_ctx);
+  void legacy_hash_args(char *argHash, hash_context *hash_ctx);
+  void arg_hash_to_string(uint64_t argHash, char *str);
   bool is_function_targeted(client_read_info *info);
-  bool compare_filenames(targetFunction &t, client_read_info *info);
-  bool compare_indices(targetFunction &t, Function &function);
-  bool compare_index_at_retaddr(targetFunction &t, client_read_info *info);
-  bool compare_return_addresses(targetFunction &t, client_read_info *info);
-  bool compare_arg_hashes(targetFunction &t, client_read_info *info);
-  bool compare_arg_buffers(targetFunction &t, client_read_info *info);
+  bool is_compiled_target_matched(const sl2_compiled_target &t, client_read_info *info);
+  bool compare_filenames(const sl2_compiled_target &t, client_read_info *info);
+  bool compare_indices(const sl2_compiled_target &t, Function &function);
+  bool compare_index_at_retaddr(const sl2_compiled_target &t, client_read_info *info);
+  bool compare_return_addresses(const sl2_compiled_target &t, client_read_info *info);
+  bool compare_arg_hashes(const sl2_compiled_target &t, client_read_info *info);
+  bool compare_arg_buffers(const sl2_compiled_target &t, client_read_info *info);
   bool function_is_in_expected_module(const char *func, const char *mod);
 
   // Crash-diversion mitigation methods.
@@ -248,6 +352,7 @@ public:
                                          bool (*on_exception)(void *, dr_exception_t *));
   void wrap_pre_VerifierStopMessage(void *wrapcxt, OUT void **user_data,
                                     bool (*on_exception)(void *, dr_exception_t *));
+  uint64_t fingerprint_crash(void *drcontext, dr_exception_t *excpt);
 
   // Pre- and post-hook related methods.
   void wrap_pre_ReadEventLog(void *wrapcxt, OUT void **user_data);
@@ -262,12 +367,18 @@ public:
   void wrap_pre__read(void *wrapcxt, OUT void **user_data);
   void wrap_pre_MapViewOfFile(void *wrapcxt, OUT void **user_data);
   bool is_sane_post_hook(void *wrapcxt, void *user_data, void **drcontext);
+  bool init_call_records();
+  void exit_call_records();
+  client_read_info *alloc_call_record(void *drcontext);
+  void free_call_record(void *drcontext, client_read_info *info);
   bool loadTargets(string json);
+  void compileTargets();
   uint64_t increment_call_count(Function function);
   uint64_t increment_retaddr_count(uint64_t retAddr);
 
   // Utility methods.
   const char *function_to_string(Function function);
+  bool string_to_function(const char *func_name, Function *function);
   const char *exception_to_string(DWORD exception_code);
 };
 
@@ -15,4 +15,40 @@ static droption_t<bool> op_registry(DROPTION_SCOPE_CLIENT, "registry", false,
                                     "Enable Registry Tracking",
                                     "Tracking of RegQuery*() functions");
 
+/*! Semicolon-separated globs of modules to collect coverage for. Empty means every module. */
+static droption_t<std::string> op_cov_include(DROPTION_SCOPE_CLIENT, "cov_include", "",
+                                              "Module globs to instrument for coverage",
+                                              "Semicolon-separated list of globs (matched against "
+                                              "the module's path or name) to instrument.");
+
+/*! Semicolon-separated globs of modules to exclude from coverage. Beats cov_include. */
+static droption_t<std::string> op_cov_exclude(DROPTION_SCOPE_CLIENT, "cov_exclude",
+                                              "C:\\Windows\\*",
+                                              "Module globs to skip for coverage",
+                                              "Semicolon-separated list of globs (matched against "
+                                              "the module's path or name) to never instrument.");
+
+/*! Semicolon-separated address ranges to restrict coverage to. */
+static droption_t<std::string> op_cov_ranges(DROPTION_SCOPE_CLIENT, "cov_ranges", "",
+                                             "Address ranges to instrument for coverage",
+                                             "Semicolon-separated list of ranges, either absolute "
+                                             "(0xSTART-0xEND) or module-relative "
+                                             "(module.dll+0xSTART-0xEND). When given, only basic "
+                                             "blocks inside a range are instrumented.");
+
+/*! Path to write the wizard's binary record stream to. Empty means JSONL on stderr. */
+static droption_t<std::string> op_wizard_stream(DROPTION_SCOPE_CLIENT, "wizard_stream", "",
+                                                "Path to write wizard records to",
+                                                "When given, the wizard writes a compact binary "
+                                                "record stream to this path instead of emitting "
+                                                "one JSON line per hooked call on stderr.");
+
+/*! Maximum number of records the wizard emits per call site. 0 means no limit. */
+static droption_t<unsigned int> op_wizard_samples(DROPTION_SCOPE_CLIENT, "wizard_samples", 0,
+                                                  "Max wizard records per call site",
+                                                  "Maximum number of records to emit for each "
+                                                  "call site (function + return address). Later "
+                                                  "calls are only counted, and the last one is "
+                                                  "emitted at exit. 0 means no limit.");
+
 #endif
\ No newline at end of file
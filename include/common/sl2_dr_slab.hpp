@@ -0,0 +1,138 @@
+#ifndef SL2_DR_SLAB_H
+#define SL2_DR_SLAB_H
+
+#include <cstddef>
+#include <memory>
+
+#include "dr_api.h"
+
+/** The smallest size class handed out by the slab allocator. Must be a power of two. */
+#define SL2_SLAB_MIN_SIZE 16
+
+/** The number of (power-of-two) size classes, from SL2_SLAB_MIN_SIZE up to SL2_SLAB_MAX_SIZE. */
+#define SL2_SLAB_NUM_CLASSES 8
+
+/** The largest allocation served from a slab. Anything bigger goes to dr_global_alloc. */
+#define SL2_SLAB_MAX_SIZE (SL2_SLAB_MIN_SIZE << (SL2_SLAB_NUM_CLASSES - 1))
+
+/** The size of each chunk of memory requested from dr_raw_mem_alloc. */
+#define SL2_SLAB_CHUNK_SIZE (64 * 1024)
+
+/** The number of blocks moved between a thread's cache and the shared pool at once. */
+#define SL2_SLAB_BATCH 32
+
+// Size-class slab allocator backed by dr_raw_mem_alloc chunks.
+//
+// Each thread keeps a freelist per size class in a drmgr TLS field, so that the common
+// case of allocating or freeing a small node takes no locks and never touches DR's global heap.
+// Threads refill their caches from (and return surplus to) a shared pool in batches.
+// Before `sl2_slab_init` is called (e.g., during static initialization or while parsing
+// targets in dr_client_main), allocations are served directly from the shared pool.
+bool sl2_slab_init();
+void sl2_slab_exit();
+void *sl2_slab_alloc(size_t size);
+void sl2_slab_free(void *ptr, size_t size);
+
+/**
+ * Drop-in STL allocator backed by the slab allocator above.
+ * @tparam T - Type to allocate memory for
+ */
+template <typename T> struct sl2_slab_allocator {
+  using value_type = T;
+
+  sl2_slab_allocator() {
+  }
+
+  template <typename U> sl2_slab_allocator(const sl2_slab_allocator<U> &) {
+  }
+
+  T *allocate(size_t size) {
+    return static_cast<T *>(sl2_slab_alloc(size * sizeof(T)));
+  }
+
+  void deallocate(T *ptr, size_t size) {
+    sl2_slab_free(ptr, size * sizeof(T));
+  }
+};
+
+template <class T, class U>
+constexpr bool operator==(const sl2_slab_allocator<T> &, const sl2_slab_allocator<U> &) {
+  return true;
+}
+
+template <class T, class U>
+constexpr bool operator!=(const sl2_slab_allocator<T> &, const sl2_slab_allocator<U> &) {
+  return false;
+}
+
+/**
+ * Bump allocator for data that lives as long as a run does. Individual allocations are never
+ * freed; everything is released at once by `reset` (or when the arena is destroyed).
+ */
+class sl2_bump_arena {
+public:
+  sl2_bump_arena() {
+  }
+
+  ~sl2_bump_arena() {
+    reset();
+  }
+
+  sl2_bump_arena(const sl2_bump_arena &) = delete;
+  sl2_bump_arena &operator=(const sl2_bump_arena &) = delete;
+
+  void *alloc(size_t size, size_t align = alignof(std::max_align_t));
+  void reset();
+
+  /*! The total number of bytes handed out since the last reset */
+  size_t used() const {
+    return used_;
+  }
+
+private:
+  struct chunk {
+    chunk *next;
+    size_t size;
+  };
+
+  chunk *chunks_ = NULL;
+  char *cursor_ = NULL;
+  char *limit_ = NULL;
+  size_t used_ = 0;
+};
+
+/**
+ * STL allocator adaptor for `sl2_bump_arena`. Deallocation is a no-op, so this is only
+ * appropriate for containers that grow for the whole run.
+ * @tparam T - Type to allocate memory for
+ */
+template <typename T> struct sl2_bump_allocator {
+  using value_type = T;
+
+  sl2_bump_arena *arena;
+
+  sl2_bump_allocator(sl2_bump_arena *arena) : arena(arena) {
+  }
+
+  template <typename U> sl2_bump_allocator(const sl2_bump_allocator<U> &other) : arena(other.arena) {
+  }
+
+  T *allocate(size_t size) {
+    return static_cast<T *>(arena->alloc(size * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *ptr, size_t size) {
+  }
+};
+
+template <class T, class U>
+bool operator==(const sl2_bump_allocator<T> &a, const sl2_bump_allocator<U> &b) {
+  return a.arena == b.arena;
+}
+
+template <class T, class U>
+bool operator!=(const sl2_bump_allocator<T> &a, const sl2_bump_allocator<U> &b) {
+  return a.arena != b.arena;
+}
+
+#endif
@@ -187,4 +187,15 @@ SL2Response sl2_conn_advise_mutation(sl2_conn *conn, sl2_arena *arena, sl2_mutat
 SL2_EXPORT
 SL2Response sl2_conn_get_coverage(sl2_conn *conn, sl2_arena *arena, sl2_coverage_info *cov);
 
+/**
+ * Registers a crash fingerprint with the server's dedup registry.
+ * @param conn sl2_conn struct containing a pipe to the server
+ * @param fingerprint the crash fingerprint
+ * @param bucket filled with the fingerprint's bucket, including how often it's been seen
+ * @return SL2Response code
+ */
+SL2_EXPORT
+SL2Response sl2_conn_register_crash(sl2_conn *conn, uint64_t fingerprint,
+                                     sl2_crash_bucket *bucket);
+
 #endif
@@ -18,6 +18,11 @@
  */
 #define SL2_HASH_LEN 64
 
+/**
+ * The size of a hex-encoded argument fingerprint (64 bits).
+ */
+#define SL2_ARG_HASH_LEN 16
+
 /**
  * The maximum length of a target application's arguments (including program name and NULL).
  *  NOTE(ww): This is based on the maximum argument length on the command line,
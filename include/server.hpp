@@ -80,6 +80,8 @@ enum Event {
   EVT_ADVISE_MUTATION, // 14
   /*! Request information about an arena's coverage from the server. */
   EVT_COVERAGE_INFO, // 15
+  /*! Register a crash fingerprint with the server's dedup registry. */
+  EVT_CRASH_FINGERPRINT, // 16
   /*! Use this as a default value when handling multiple events. WARNING: The server will complain
      and may die if you send this. */
   EVT_INVALID = 255,
@@ -113,13 +115,24 @@ struct sl2_mutation {
 
 /**
  * A structure containing valid pathnames for storage
- * of JSON-formatted crash data and a minidump-formatted
- * memory dump, respectively, for a run.
+ * of JSON-formatted crash data, a minidump-formatted
+ * memory dump, and a branch trace, respectively, for a run.
  */
 struct sl2_crash_paths {
   wchar_t crash_path[MAX_PATH + 1];
   wchar_t mem_dump_path[MAX_PATH + 1];
   wchar_t initial_dump_path[MAX_PATH + 1];
+  wchar_t trace_path[MAX_PATH + 1];
+};
+
+/**
+ * A crash bucket in the server's dedup registry, as returned when a fingerprint is registered.
+ */
+struct sl2_crash_bucket {
+  /*! The crash fingerprint. See `SL2Client::fingerprint_crash` */
+  uint64_t fingerprint;
+  /*! The number of times the fingerprint has been registered, including this one */
+  uint64_t hits;
 };
 
 /**
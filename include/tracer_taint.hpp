@@ -0,0 +1,98 @@
+#ifndef SL2_TRACER_TAINT_H
+#define SL2_TRACER_TAINT_H
+
+#include <cstdint>
+#include <vector>
+
+#include "dr_api.h"
+
+#include "common/sl2_dr_slab.hpp"
+
+/** The number of 64-bit words in a thread's register taint bitmask. */
+#define SL2_TAINT_REG_WORDS ((DR_REG_LAST_ENUM + 64) / 64)
+
+/** log2 of the number of application bytes covered by each shadow page. */
+#define SL2_TAINT_PAGE_BITS 12
+#define SL2_TAINT_PAGE_SIZE (1 << SL2_TAINT_PAGE_BITS)
+#define SL2_TAINT_PAGE_WORDS (SL2_TAINT_PAGE_SIZE / 64)
+
+/** The number of slots in the shadow page directory. Must be a power of two. */
+#define SL2_TAINT_DIR_BITS 18
+#define SL2_TAINT_DIR_SIZE (1 << SL2_TAINT_DIR_BITS)
+
+/** Labels with this bit set are unions of two other labels; the rest are input byte labels. */
+#define SL2_TAINT_UNION_BIT 0x80000000
+
+/** The maximum number of union labels. Past this, unions degrade to one of their operands. */
+#define SL2_TAINT_MAX_UNIONS (1 << 24)
+
+/** The maximum number of labels visited when resolving a label back to input offsets. */
+#define SL2_TAINT_MAX_WALK (1 << 20)
+
+/**
+ * A taint label: 0 for "no provenance", an input byte label, or (with SL2_TAINT_UNION_BIT) a
+ * union of two other labels.
+ */
+typedef uint32_t sl2_label;
+
+/** A contiguous run of tainted application memory. */
+struct sl2_taint_range {
+  uint64_t start;
+  uint64_t size;
+};
+
+typedef std::vector<sl2_taint_range, sl2_slab_allocator<sl2_taint_range>> sl2_taint_range_vec;
+
+/** A contiguous run of input bytes, from the `read`th targeted call, that a label derives from. */
+struct sl2_taint_offsets {
+  uint32_t read;
+  uint64_t start;
+  uint64_t size;
+};
+
+typedef std::vector<sl2_taint_offsets, sl2_slab_allocator<sl2_taint_offsets>>
+    sl2_taint_offsets_vec;
+
+// Taint state for the tracer.
+//
+// Register taint is per-thread: each application thread gets a fixed-size bitmask, indexed by
+// full-width register, in a drmgr TLS field. Memory taint is process-wide: a bitmap shadow of
+// application memory, one bit per byte, split into pages that hang off of an open-addressed
+// directory. Directory slots are claimed with a CAS and shadow pages are never freed, so lookups
+// take no locks; individual bits are set and cleared with interlocked operations.
+//
+// In label mode, every tainted byte and register additionally carries a label recording which
+// input bytes it was derived from, in the style of DFSan. Each targeted read gets a contiguous
+// block of byte labels (which cost nothing to create), and labels that meet in an instruction
+// are combined into memoized union labels. Memory labels live in a second, lazily allocated
+// shadow alongside each bitmap page.
+//
+// Propagation can be suspended on a thread while it's inside a function whose effect on taint
+// is applied all at once (see SL2_TAINT_MODEL_TABLE in the tracer).
+bool sl2_taint_init(bool labels);
+void sl2_taint_exit();
+bool sl2_taint_labels_enabled();
+
+bool sl2_taint_reg_is_tainted(void *drcontext, reg_id_t reg);
+void sl2_taint_reg_set(void *drcontext, reg_id_t reg, sl2_label label = 0);
+bool sl2_taint_reg_clear(void *drcontext, reg_id_t reg);
+bool sl2_taint_reg_any(void *drcontext);
+sl2_label sl2_taint_reg_label(void *drcontext, reg_id_t reg);
+
+bool sl2_taint_mem_is_tainted(app_pc addr, size_t size);
+void sl2_taint_mem_set(app_pc addr, size_t size, sl2_label label = 0);
+bool sl2_taint_mem_clear(app_pc addr, size_t size);
+uint64_t sl2_taint_mem_count();
+void sl2_taint_mem_ranges(sl2_taint_range_vec *ranges);
+sl2_label sl2_taint_mem_label(app_pc addr, size_t size);
+void sl2_taint_mem_copy(app_pc dst, app_pc src, size_t size);
+
+void sl2_taint_suspend(void *drcontext);
+void sl2_taint_resume(void *drcontext);
+bool sl2_taint_suspended(void *drcontext);
+
+void sl2_taint_mem_set_input(app_pc addr, size_t size, uint32_t read, uint64_t offset);
+sl2_label sl2_taint_union(sl2_label l1, sl2_label l2);
+bool sl2_taint_label_offsets(sl2_label label, sl2_taint_offsets_vec *offsets);
+
+#endif
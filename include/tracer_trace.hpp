@@ -0,0 +1,68 @@
+#ifndef SL2_TRACER_TRACE_H
+#define SL2_TRACER_TRACE_H
+
+#include <cstdint>
+
+#include "dr_api.h"
+
+/** Identifies a branch trace file. */
+#define SL2_TRACE_MAGIC 0x54324c53
+
+/** Bump this whenever the record format changes. Keep sl2/harness/branch_trace.py up-to-date! */
+#define SL2_TRACE_VERSION 1
+
+/** The size of each thread's chunk buffer. Chunks are the unit of (random) access for readers. */
+#define SL2_TRACE_CHUNK_SIZE (64 * 1024)
+
+/** The size of each of the writer's two output buffers. */
+#define SL2_TRACE_WRITE_SIZE (1024 * 1024)
+
+/** The kinds of records in a branch trace. Every record is prefixed with its u32 size. */
+enum class TraceRecord : uint8_t {
+  Module = 1, // u64 start, u64 end, u16-prefixed name
+  Block = 2,  // varint id, u64 start, u64 taken, u64 fallthrough, u8 kind
+  Chunk = 3,  // u32 thread, u32 blocks, u64 last indirect target, then tokens
+  Crash = 4,  // u32 thread
+};
+
+/** How a block's successor is predicted, from its final instruction. */
+enum class TraceBlockKind : uint8_t {
+  Direct = 0,      // always continues at `taken`
+  Conditional = 1, // continues at `taken` or `fallthrough`, recorded as one bit
+  Indirect = 2,    // continues wherever the last indirect target delta says
+};
+
+/** The tokens within a chunk, besides the taken/not-taken bytes (which are all < 0x80). */
+enum class TraceToken : uint8_t {
+  Indirect = 0x80, // zigzag varint delta from the thread's last indirect target
+  Escape = 0x81,   // varint id of the block we left, varint id of the block we landed in
+};
+
+/**
+ * A basic block, as described to readers of the trace.
+ */
+struct sl2_trace_block {
+  uint32_t id;
+  TraceBlockKind kind;
+  app_pc start;
+  app_pc taken;
+  app_pc fallthrough;
+};
+
+// Compressed branch tracing for the tracer.
+//
+// Each application thread encodes the blocks that it executes into a chunk buffer, in the style
+// of Intel PT: conditional branches become taken/not-taken bits (packed six to a byte), indirect
+// branches become deltas from the previous indirect target, and direct branches cost nothing.
+// Whenever execution doesn't go where the block's final instruction predicts (exceptions,
+// callbacks), an escape token records the actual block IDs. Block IDs are varint-encoded.
+//
+// Full chunks are handed to a double-buffered writer: threads fill one buffer while a client
+// thread writes the other out to the trace file. Every chunk starts with an escape, so readers
+// can decode the last few chunks of a thread without touching the rest of the trace.
+bool sl2_trace_init(const char *path);
+void sl2_trace_exit();
+void sl2_trace_module(const module_data_t *mod);
+void sl2_trace_crash(void *drcontext);
+
+#endif
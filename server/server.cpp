@@ -74,6 +74,9 @@ static std::shared_mutex fkt_mutex;
 static std::shared_mutex arena_mutex;
 static std::shared_mutex strategy_mutex;
 static sl2_strategy_map_t strategy_map;
+static std::mutex crash_bucket_mutex;
+/*! Crash dedup registry: the number of times each crash fingerprint has been seen */
+static std::map<uint64_t, uint64_t> crash_buckets;
 
 /** Gets the processor affinity mask for the given process ID.
  *
@@ -985,6 +988,21 @@ static void handle_crash_paths(HANDLE pipe) {
 
   SL2_SERVER_LOG_INFO("wrote initial.dmp path: %S", target_path);
 
+  memset(target_path, 0, (MAX_PATH + 1) * sizeof(wchar_t));
+  PathCchCombine(target_path, MAX_PATH, run_dir, FUZZ_RUN_EXECUTION_TRC);
+
+  size = wcsnlen_s(target_path, MAX_PATH + 1) * sizeof(wchar_t);
+
+  if (!WriteFile(pipe, &size, sizeof(size), &txsize, NULL)) {
+    SL2_SERVER_LOG_FATAL("failed to write length of execution.trc path to pipe");
+  }
+
+  if (!WriteFile(pipe, &target_path, (DWORD)size, &txsize, NULL)) {
+    SL2_SERVER_LOG_FATAL("failed to write execution.trc path to pipe");
+  }
+
+  SL2_SERVER_LOG_INFO("wrote execution.trc path: %S", target_path);
+
   RpcStringFree((RPC_WSTR *)&run_id_s);
 }
 
@@ -1163,6 +1181,32 @@ static void handle_coverage_info(HANDLE pipe) {
   }
 }
 
+/**
+ * Registers a crash fingerprint in the dedup registry, and tells the client how many times
+ * (including this one) it's been seen.
+ * @param pipe handle to the named pipe that communicates with the client
+ */
+static void handle_crash_fingerprint(HANDLE pipe) {
+  DWORD txsize;
+  sl2_crash_bucket bucket = {0};
+
+  if (!ReadFile(pipe, &bucket.fingerprint, sizeof(bucket.fingerprint), &txsize, NULL)) {
+    SL2_SERVER_LOG_FATAL("failed to read crash fingerprint");
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(crash_bucket_mutex);
+    bucket.hits = ++crash_buckets[bucket.fingerprint];
+  }
+
+  SL2_SERVER_LOG_INFO("crash fingerprint %016llx seen %llu time(s)", bucket.fingerprint,
+                      bucket.hits);
+
+  if (!WriteFile(pipe, &bucket, sizeof(bucket), &txsize, NULL)) {
+    SL2_SERVER_LOG_FATAL("failed to write crash bucket to pipe");
+  }
+}
+
 /**
  * Handles incoming connections from clients
  * @param data HANDLE to the named pipe
@@ -1232,6 +1276,9 @@ static DWORD WINAPI thread_handler(void *data) {
     case EVT_COVERAGE_INFO:
       handle_coverage_info(pipe);
       break;
+    case EVT_CRASH_FINGERPRINT:
+      handle_crash_fingerprint(pipe);
+      break;
     case EVT_SESSION_TEARDOWN:
       SL2_SERVER_LOG_INFO("ending a client's session with the server.");
       break;
@@ -15,6 +15,7 @@ from .conf import Conf
 from .tracer import Tracer  # noqa: F401
 from .checksec import Checksec  # noqa: F401
 from .crash import Crash  # noqa: F401
+from .crash_index import CrashBucket, CrashBand, CrashStack  # noqa: F401
 from .target_config import TargetConfig  # noqa: F401
 from .run_block import RunBlock  # noqa: F401
 from .coverage import PathRecord  # noqa: F401
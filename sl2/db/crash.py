@@ -9,16 +9,15 @@ from sqlalchemy import *
 from sqlalchemy import orm
 from sqlalchemy.orm import relationship
 from sl2.harness import config
+from sl2.harness import triage_daemon
 import json
 import os
-import re
 import subprocess
 from sqlalchemy.sql.expression import func
 
 from .base import Base
 from sl2 import db
 
-
 # Holds information about a specific crash
 # Example json
 # <pre>
@@ -235,6 +234,53 @@ class Crash(Base):
         session = db.getSession()
         return session.query(Crash).filter(Crash.crashash == self.crashash).count()
 
+    ## Number of crashes with exactly the same stack as this one (module frames, not the crashash),
+    # or None if it wasn't indexed
+    @property
+    def duplicates(self):
+        session = db.getSession()
+        bucket = db.CrashBucket.forCrash(session, self)
+        return bucket.count if bucket else None
+
+    ## Finds the stacks most like this crash's, other than its own, from the crash index
+    # @param k maximum number of stacks to return
+    # @return list of (similarity, CrashBucket), most similar first. Each bucket's crash is the first one
+    # seen with that stack.
+    def similar(self, k=10):
+        session = db.getSession()
+        bucket = db.CrashBucket.forCrash(session, self)
+        if not bucket:
+            return []
+        return bucket.similar(session, k)
+
+    ## The module frames of this crash's stack, for the crash index. Crashes triaged before the triager
+    # reported them have their minidumps triaged again, and the frames are saved with their results.
+    # @return list of "module+0xoffset" strings, or None if they can't be found
+    def findModuleFrames(self):
+        if "moduleFrames" in self.obj:
+            return self.obj["moduleFrames"]
+
+        if not self.minidumpPath or not os.path.isfile(self.minidumpPath):
+            return None
+
+        j = Crash.triage(config.config["triager_path"], self.minidumpPath)
+        if not j or "moduleFrames" not in j:
+            return None
+
+        self.obj = dict(self.obj, moduleFrames=j["moduleFrames"])
+        return j["moduleFrames"]
+
+    ## Adds any crashes that aren't in the crash index to it, such as those stored before the index
+    # existed. This can triage every one of their minidumps again, so it's only run by the harness's
+    # INDEX stage, never while looking crashes up.
+    # @return number of crashes added
+    @staticmethod
+    def backfillIndex():
+        session = db.getSession()
+        added = db.CrashBucket.backfill(session, Crash.findModuleFrames)
+        session.commit()
+        return added
+
     ## Converts integer rank to exploitability string
     # @param rank integer rank
     # @return string
@@ -278,10 +324,13 @@ class Crash(Base):
     # it already exists in the db, return the row.
     # @param runid Run id
     # @param dmpPath string path to minidump file
+    # @param timeout seconds to wait for the triager, or None to use the configured triage timeout
     # @return Crash object
     @staticmethod
-    def factory(runid, slug=None, targetPath=None):
+    def factory(runid, slug=None, targetPath=None, timeout=None):
         cfg = config
+        if timeout is None:
+            timeout = cfg.config.get("tracer_timeout")
         session = db.getSession()
         runid = str(runid)
         ret = session.query(Crash).filter(Crash.runid == runid).first()
@@ -297,21 +346,7 @@ class Crash(Base):
         # Runs triager, which will give us exploitability info
         # using 2 engines: Google's breakpad and an reimplementation of Microsofts
         # !exploitable
-        cmd = [cfg.config["triager_path"], dmpPath]
-        out = subprocess.check_output(cmd, shell=False)
-        # TODO: sorry didn't have time to clean this up before leave
-        dirname = os.path.dirname(dmpPath)
-        path = os.path.join(dirname, "triage.txt")
-        with open(path, "wb", newline=None) as f:
-            f.write(out)
-
-        out = out.decode("utf8")
-        j = None
-        for line in out.splitlines():
-            line = line.strip()
-            if re.match(r"{.*}", line):
-                j = json.loads(line)
-                j["output"] = out
+        j = Crash.triage(cfg.config["triager_path"], dmpPath, timeout)
 
         if not j:
             return None
@@ -323,10 +358,83 @@ class Crash(Base):
 
         ret.mergeTracer()
         ret.reconstructor()
+
+        # The crash and its place in the crash index go in together, so the index never misses a crash
         session.add(ret)
+        session.flush()
+        db.CrashBucket.index(session, ret)
         session.commit()
         return ret
 
+    ## Triages a minidump, with the resident triager if it's available and answers in time, and a one-off
+    # triager process if not
+    # @param triager_path path to triager.exe
+    # @param dmpPath path to the minidump
+    # @param timeout seconds to wait for each of the daemon and the process, or None to wait forever
+    # @return the triager's json, with its "output", or None if triage failed
+    @staticmethod
+    def triage(triager_path, dmpPath, timeout=None):
+        try:
+            return Crash.triageWithDaemon(triager_path, dmpPath, timeout)
+        except triage_daemon.TriageDaemonError as e:
+            print("Triager daemon unavailable (%s), running the triager directly" % e)
+            return Crash.triageWithProcess(triager_path, dmpPath, timeout)
+
+    ## Triages a minidump with the resident triager, which only returns structured results.
+    # The pretty-printed results stand in for the triager's text output.
+    # @param triager_path path to triager.exe
+    # @param dmpPath path to the minidump
+    # @param timeout seconds to wait for the daemon's answer, or None to wait forever
+    # @return the triager's json, with its "output", or None if triage failed
+    @staticmethod
+    def triageWithDaemon(triager_path, dmpPath, timeout=None):
+        j = triage_daemon.triage(triager_path, dmpPath, timeout)
+        if "error" in j:
+            print("Unable to triage %s: %s" % (dmpPath, j["error"]))
+            return None
+
+        out = json.dumps(j, indent=4, sort_keys=True)
+        with open(os.path.join(os.path.dirname(dmpPath), "triage.txt"), "w") as f:
+            f.write(out)
+
+        j["output"] = out
+        return j
+
+    ## Triages a minidump with a one-off triager process, which writes its json to triage.json next to the
+    # minidump. Like the daemon, it skips the text report; the pretty-printed results stand in for it.
+    # @param triager_path path to triager.exe
+    # @param dmpPath path to the minidump
+    # @param timeout seconds to let the triager run, or None to wait forever
+    # @return the triager's json, with its "output", or None if triage failed
+    @staticmethod
+    def triageWithProcess(triager_path, dmpPath, timeout=None):
+        dirname = os.path.dirname(dmpPath)
+        path = os.path.join(dirname, "triage.json")
+        cmd = [triager_path, "-m", "json", "-o", path, dmpPath]
+        try:
+            subprocess.check_call(cmd, shell=False, timeout=timeout)
+        except subprocess.TimeoutExpired:
+            print("Triager took more than %d seconds on %s, giving up" % (timeout, dmpPath))
+            return None
+
+        try:
+            with open(path, "r") as f:
+                j = json.load(f)
+        except (OSError, ValueError) as e:
+            print("Unable to read triage results for %s: %s" % (dmpPath, e))
+            return None
+
+        if "error" in j:
+            print("Unable to triage %s: %s" % (dmpPath, j["error"]))
+            return None
+
+        out = json.dumps(j, indent=4, sort_keys=True)
+        with open(os.path.join(dirname, "triage.txt"), "w") as f:
+            f.write(out)
+
+        j["output"] = out
+        return j
+
     ## Converts ranks list to colon seperated string
     def ranksStringGenerate(self):
         tmp = [str(_) for _ in self.ranks]
@@ -0,0 +1,268 @@
+############################################################################
+## @package crash_index
+# crash_index.py
+#
+# Indexes crashes by the shape of their stacks: the crashing thread's frames, as module+offset so that
+# they survive ASLR. Crashes with exactly the same frames share a bucket. Buckets are also indexed with
+# MinHash locality sensitive hashing, so that the buckets most like a given crash can be found without
+# comparing it against every crash in the database.
+#
+# Each stack is reduced to a set of shingles: its frames, its pairs of adjacent frames, and the frame it
+# crashed in. The MinHash signature of that set estimates the Jaccard similarity of two stacks, so a stack
+# with one extra frame still shares most of its signature with the original. Signatures are split into
+# bands, and every band of every bucket is stored under a hash of its values; buckets that agree on a
+# whole band are candidates, and only the candidates' signatures are compared.
+
+from sqlalchemy import *
+from sqlalchemy.orm import relationship
+import hashlib
+import random
+import struct
+
+from .base import Base
+
+## Number of MinHash values in a signature
+NUM_HASHES = 64
+## Number of bands the signature is split into. With 4 values per band, stacks that are 60% similar are
+## found about 90% of the time, and stacks that are 30% similar only about 10% of the time.
+NUM_BANDS = 16
+## Only this many of the innermost frames are used for similarity, so deep recursion doesn't drown out the
+## frames near the crash
+MAX_SIMILARITY_FRAMES = 32
+## What the triager reports for a frame outside of any module
+UNKNOWN_FRAME = "???"
+
+_PRIME = (1 << 61) - 1
+_rng = random.Random(0x534C32)
+## (a, b) for each of the hash functions h(x) = (a*x + b) mod _PRIME
+_PERMUTATIONS = [(_rng.randrange(1, _PRIME), _rng.randrange(0, _PRIME)) for _ in range(NUM_HASHES)]
+
+
+## Hashes a string to 64 bits
+def _hash64(s):
+    return int.from_bytes(hashlib.blake2b(s.encode("utf-8"), digest_size=8).digest(), "little")
+
+
+## The exact bucket for a stack
+# @param frames list of "module+0xoffset" strings, innermost first
+# @return hex digest of the whole stack
+def stackBucket(frames):
+    return hashlib.sha1("\n".join(frames).encode("utf-8")).hexdigest()
+
+
+## Whether a stack says anything about where a crash happened. Stacks with no frames, or with no frames in
+# any module, would all land in the same bucket however different the crashes were.
+# @param frames list of "module+0xoffset" strings, or "???" for frames outside of any module
+# @return bool
+def hasModuleFrames(frames):
+    return bool(frames) and any(frame != UNKNOWN_FRAME for frame in frames)
+
+
+## The set of shingles that similarity is measured over
+# @param frames list of "module+0xoffset" strings, innermost first
+# @return set of strings
+def shingles(frames):
+    frames = frames[:MAX_SIMILARITY_FRAMES]
+    if not frames:
+        return set()
+
+    ret = set(frames)
+    ret.update("%s|%s" % pair for pair in zip(frames, frames[1:]))
+    ret.add("^" + frames[0])
+    return ret
+
+
+## MinHash signature of a stack
+# @param frames list of "module+0xoffset" strings, innermost first
+# @return list of NUM_HASHES ints
+def signature(frames):
+    hashes = [_hash64(s) % _PRIME for s in shingles(frames)]
+    if not hashes:
+        return [_PRIME] * NUM_HASHES
+    return [min((a * x + b) % _PRIME for x in hashes) for a, b in _PERMUTATIONS]
+
+
+## Hashes each band of a signature to a key that fits in a (signed) sqlite integer
+# @param sig signature from signature()
+# @return list of NUM_BANDS ints
+def bandKeys(sig):
+    rows = NUM_HASHES // NUM_BANDS
+    keys = []
+    for band in range(NUM_BANDS):
+        data = struct.pack("<%dQ" % rows, *sig[band * rows : (band + 1) * rows])
+        keys.append(int.from_bytes(hashlib.blake2b(data, digest_size=8).digest(), "little") >> 1)
+    return keys
+
+
+## Packs a signature for storage
+# @param sig signature from signature()
+# @return bytes
+def packSignature(sig):
+    return struct.pack("<%dQ" % NUM_HASHES, *sig)
+
+
+## Estimated Jaccard similarity of the stacks behind two signatures
+def similarity(sig1, sig2):
+    return sum(1 for x, y in zip(sig1, sig2) if x == y) / NUM_HASHES
+
+
+## class CrashBucket
+#  Every distinct stack that's been seen, with its MinHash signature
+class CrashBucket(Base):
+    __tablename__ = "crash_buckets"
+
+    ## Hash of the whole stack, from stackBucket()
+    bucket = Column(String(40), primary_key=True)
+    ## The stack itself, as a list of "module+0xoffset" strings
+    frames = Column(PickleType)
+    ## Packed MinHash signature
+    packedSignature = Column(LargeBinary)
+    ## Number of crashes with this stack
+    count = Column(Integer)
+    ## The first crash seen with this stack
+    crash_id = Column(Integer, ForeignKey("crash.id"))
+    crash = relationship("Crash")
+
+    def __init__(self, bucket, frames, crash_id):
+        self.bucket = bucket
+        self.frames = frames
+        self.packedSignature = packSignature(signature(frames))
+        self.count = 0
+        self.crash_id = crash_id
+
+    ## The unpacked MinHash signature
+    @property
+    def signature(self):
+        return list(struct.unpack("<%dQ" % NUM_HASHES, self.packedSignature))
+
+    ## Adds a crash to the index, under the stack in its triage results. Does nothing for crashes that
+    # were triaged without module frames, whose frames are all outside any module, or that have already
+    # been indexed. The caller commits, and
+    # should do so in the same transaction that added the crash.
+    #
+    # Other triage workers may be indexing the same stack at the same time, so rows that may already exist
+    # are inserted with OR IGNORE, and the bucket's count is incremented by the database rather than read
+    # and written back.
+    # @param session database session
+    # @param crash Crash, which must have an id (i.e., have been flushed)
+    # @param frames the crash's module frames, if they aren't in its triage results
+    # @return the crash's CrashBucket, or None
+    @staticmethod
+    def index(session, crash, frames=None):
+        if frames is None:
+            frames = crash.obj.get("moduleFrames") if crash.obj else None
+        if not hasModuleFrames(frames):
+            return None
+
+        bucket = stackBucket(frames)
+        sig = signature(frames)
+        session.execute(
+            CrashBucket.__table__.insert()
+            .prefix_with("OR IGNORE")
+            .values(bucket=bucket, frames=frames, packedSignature=packSignature(sig), count=0, crash_id=crash.id)
+        )
+        session.execute(
+            CrashBand.__table__.insert().prefix_with("OR IGNORE"),
+            [{"bucket": bucket, "band": band, "key": key} for band, key in enumerate(bandKeys(sig))],
+        )
+
+        added = session.execute(
+            CrashStack.__table__.insert().prefix_with("OR IGNORE").values(crash_id=crash.id, bucket=bucket)
+        )
+        if added.rowcount:
+            session.execute(
+                CrashBucket.__table__.update()
+                .where(CrashBucket.bucket == bucket)
+                .values(count=CrashBucket.__table__.c.count + 1)
+            )
+
+        ret = session.query(CrashBucket).get(bucket)
+        session.refresh(ret)
+        return ret
+
+    ## Adds every crash that isn't in the index yet, such as those stored before the index existed.
+    # The caller commits.
+    # @param session database session
+    # @param findFrames function from a Crash to its module frames, or None if they can't be found
+    # @return number of crashes added
+    @staticmethod
+    def backfill(session, findFrames):
+        from .crash import Crash
+
+        added = 0
+        for crash in session.query(Crash).filter(~Crash.id.in_(session.query(CrashStack.crash_id))).all():
+            frames = findFrames(crash)
+            if hasModuleFrames(frames) and CrashBucket.index(session, crash, frames):
+                added += 1
+        return added
+
+    ## Looks up the bucket a crash was indexed under
+    # @return CrashBucket, or None if the crash isn't indexed
+    @staticmethod
+    def forCrash(session, crash):
+        stack = session.query(CrashStack).get(crash.id)
+        if not stack:
+            return None
+        return session.query(CrashBucket).get(stack.bucket)
+
+    ## Crashes with exactly the same stack as this bucket, including the one it was looked up for
+    # @return query of Crash
+    def crashes(self, session):
+        from .crash import Crash
+
+        return session.query(Crash).join(CrashStack, CrashStack.crash_id == Crash.id).filter(
+            CrashStack.bucket == self.bucket
+        )
+
+    ## Finds the buckets whose stacks are most similar to this one's, other than itself. Only buckets that
+    # share at least one band with it are compared, so this doesn't scan the whole index, but very
+    # dissimilar buckets may be missed.
+    # @param session database session
+    # @param k maximum number of buckets to return
+    # @return list of (similarity, CrashBucket), most similar first
+    def similar(self, session, k=10):
+        sig = self.signature
+        matches = or_(*(and_(CrashBand.band == band, CrashBand.key == key) for band, key in enumerate(bandKeys(sig))))
+        candidates = (
+            session.query(CrashBucket)
+            .filter(
+                CrashBucket.bucket.in_(session.query(CrashBand.bucket).filter(matches)),
+                CrashBucket.bucket != self.bucket,
+            )
+            .all()
+        )
+
+        scored = [(similarity(sig, candidate.signature), candidate) for candidate in candidates]
+        scored.sort(key=lambda pair: pair[0], reverse=True)
+        return scored[:k]
+
+
+## class CrashBand
+#  One band of a bucket's MinHash signature, for finding candidate similar buckets
+class CrashBand(Base):
+    __tablename__ = "crash_bands"
+    __table_args__ = (Index("ix_crash_bands_band_key", "band", "key"),)
+
+    bucket = Column(String(40), ForeignKey("crash_buckets.bucket"), primary_key=True)
+    ## Which band of the signature this is
+    band = Column(Integer, primary_key=True)
+    ## Hash of the band's values
+    key = Column(Integer)
+
+    def __init__(self, bucket, band, key):
+        self.bucket = bucket
+        self.band = band
+        self.key = key
+
+
+## class CrashStack
+#  The bucket each crash's stack falls in
+class CrashStack(Base):
+    __tablename__ = "crash_stacks"
+
+    crash_id = Column(Integer, ForeignKey("crash.id"), primary_key=True)
+    bucket = Column(String(40), ForeignKey("crash_buckets.bucket"), index=True)
+
+    def __init__(self, crash_id, bucket):
+        self.crash_id = crash_id
+        self.bucket = bucket
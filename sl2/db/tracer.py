@@ -41,6 +41,7 @@ regs = [
 # Example json file
 # <pre>
 #     "exception": "EXCEPTION_BREAKPOINT",
+#     "fingerprint": "5f0c2e9a4b7d1e38",
 #     "instruction": "int3",
 #     "last_calls": [
 #         140699242861232,
@@ -75,6 +76,16 @@ regs = [
 #     ]
 # }
 # </pre>
+#
+# With --taint_labels, the json also records which input bytes reached the crash:
+# <pre>
+#     "input_offsets": {
+#         "address": [{"read": 0, "size": 4, "start": 16}],
+#         "complete": true,
+#         "pc": [],
+#         "regs": {"rax": [{"read": 0, "size": 4, "start": 16}]}
+#     }
+# </pre>
 class Tracer(Base):
     __tablename__ = "tracer"
 
@@ -91,6 +102,12 @@ class Tracer(Base):
     ## The exploitability rank based solely on tracer
     rank = Column(Integer)
 
+    ## Identifies the crash by exception code, faulting site and return addresses, for deduplication. The
+    ## fuzzer fingerprints crashes the same way.
+    fingerprint = Column(String(300), index=True)
+    ## Number of later runs that crashed the same way, and so weren't traced or stored
+    duplicates = Column(Integer, default=0)
+
     ## The string-ified exception code
     exception = Column(String)
     ## Disassembly of the instruction that caused the crash
@@ -191,6 +208,8 @@ class Tracer(Base):
         self.addrs = rawJson["tainted_addrs"]  # TODO - record memory map so these are actually useful
         self.rank = rawJson["score"] / 25
 
+        self.fingerprint = rawJson.get("fingerprint")
+        self.duplicates = 0
         self.exception = rawJson["exception"]
         self.instruction = rawJson["instruction"]
         self.reason = rawJson["reason"]
@@ -224,6 +243,38 @@ class Tracer(Base):
         self.tainted_src = rawJson["tainted_src"]
         self.tainted_dst = rawJson["tainted_dst"]
 
+    ## Finds an earlier tracer run against the same target that crashed the same way. Fingerprints are
+    # only comparable within a target, so runs whose crash was never stored don't count.
+    # @param fingerprint Crash fingerprint, as reported by the tracer
+    # @param slug Target slug of the run being deduplicated
+    # @return the earliest matching Tracer, or None
+    @staticmethod
+    def find_by_fingerprint(fingerprint, slug):
+        if not fingerprint:
+            return None
+
+        session = db.getSession()
+        return (
+            session.query(Tracer)
+            .join(db.Crash, Tracer.crashId == db.Crash.id)
+            .filter(Tracer.fingerprint == fingerprint, db.Crash.target_config_slug == slug)
+            .first()
+        )
+
+    ## Counts a later run that crashed the same way as this one. Several triage workers may find
+    # duplicates of the same run at once, so the count is incremented by the database rather than read
+    # and written back.
+    # @return the new count
+    def add_duplicate(self):
+        session = db.getSession()
+        session.execute(
+            Tracer.__table__.update()
+            .where(Tracer.runid == self.runid)
+            .values(duplicates=func.coalesce(Tracer.__table__.c.duplicates, 0) + 1)
+        )
+        session.commit()
+        return session.query(Tracer.duplicates).filter(Tracer.runid == self.runid).scalar()
+
     ## Factory for create or retrieving tracer object from db
     # @param runid Runid of the tracer run
     # @param formatted String summary of tracer run
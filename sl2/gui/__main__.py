@@ -666,12 +666,25 @@ class MainWindow(QtWidgets.QMainWindow):
 
     ## Clicked on Crash
     # When a cell is clicked in the crashes table, find the row
-    # and update the Crash browser to show triage.txt
+    # and update the Crash browser to show triage.txt, followed by the crashes with the most similar stacks
     def crash_clicked(self, a):
         # row, col = a.row(), a.column()
         data = a.data(Qt.UserRole)
         crash = db.Crash.factory(data.runid)
-        self.crash_browser.setText(crash.output)
+        text = crash.output
+
+        similar = crash.similar(5)
+        if similar:
+            text += "\n\nSimilar crashes:\n"
+            for score, bucket in similar:
+                text += "  %3d%%  run %s  %s  (%d with this stack)\n" % (
+                    score * 100,
+                    bucket.crash.runid,
+                    bucket.crash.tag,
+                    bucket.count,
+                )
+
+        self.crash_browser.setText(text)
 
 
 ## Build a GUI window and display it to the user.
@@ -14,8 +14,19 @@ import sys
 
 import msgpack
 
+from sl2 import db
 from .config import config
-from .instrument import print_l, wizard_run, fuzzer_run, tracer_run, start_server, fuzz_and_triage, kill
+from .instrument import (
+    print_l,
+    wizard_run,
+    fuzzer_run,
+    tracer_run,
+    start_server,
+    start_triage,
+    finish_triage,
+    fuzz_and_triage,
+    kill,
+)
 from .state import sanity_checks, get_target_dir, get_all_targets, get_runs, stringify_program_array
 
 
@@ -101,6 +112,11 @@ def hexdump(buffer, lines=4, line_len=16):
 def _main():
     sanity_checks()
 
+    # Indexing triages the stored minidumps again if need be, but never runs the target
+    if config.get("stage") == "INDEX":
+        print_l("Added %d crashes to the crash index" % db.Crash.backfillIndex())
+        return
+
     start_server(no_window=config["no_server_window"])
 
     target_file = os.path.join(get_target_dir(config), "targets.msg")
@@ -165,6 +181,9 @@ def _main():
         config["client_args"].append("-t")
         config["client_args"].append(target_file)
 
+        # Crashes are triaged by their own pool of workers, so that fuzzing continues during triage
+        start_triage(config)
+
         # Spawn a thread that will run DynamoRIO and wait for the output
         with concurrent.futures.ThreadPoolExecutor(max_workers=config["simultaneous"]) as executor:
             # If we're in continuous mode, spawn as many futures as we can run simultaneously.
@@ -177,6 +196,8 @@ def _main():
             # Wait for exit
             concurrent.futures.wait(fuzz_futures)
 
+        finish_triage()
+
 
 ## wrapper around_main that handles keyboard interrupts
 def main():
@@ -0,0 +1,222 @@
+"""
+Reader for the tracer's compressed branch traces (see -branch_trace in tracer/tracer.cpp and
+include/tracer_trace.hpp for the format).
+
+Indexing a trace only reads the module and block records and the chunk headers; chunk bodies are
+decoded on demand, newest first, so reconstructing the last few thousand blocks before a crash
+doesn't depend on how long the target ran.
+"""
+import struct
+
+# NOTE(ww): Keep these up-to-date with include/tracer_trace.hpp!
+TRACE_MAGIC = 0x54324C53
+TRACE_VERSION = 1
+
+RECORD_MODULE = 1
+RECORD_BLOCK = 2
+RECORD_CHUNK = 3
+RECORD_CRASH = 4
+
+KIND_DIRECT = 0
+KIND_CONDITIONAL = 1
+KIND_INDIRECT = 2
+
+TOKEN_INDIRECT = 0x80
+TOKEN_ESCAPE = 0x81
+
+_header = struct.Struct("<II")
+_size = struct.Struct("<I")
+_module = struct.Struct("<QQH")
+_block = struct.Struct("<QQQB")
+_chunk = struct.Struct("<IIQ")
+_crash = struct.Struct("<I")
+
+_MASK64 = (1 << 64) - 1
+
+
+class BranchTraceError(Exception):
+    pass
+
+
+## Reads a varint (LEB128) from a buffer.
+#  @return (value, offset): Tuple(int, int) - the value and the offset just past it
+def _read_varint(buf, offset):
+    value = 0
+    shift = 0
+    while True:
+        byte = buf[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, offset
+
+
+## A basic block, as described by the trace.
+class Block(object):
+    __slots__ = ("id", "start", "taken", "fallthrough", "kind")
+
+    def __init__(self, id, start, taken, fallthrough, kind):
+        self.id = id
+        self.start = start
+        self.taken = taken
+        self.fallthrough = fallthrough
+        self.kind = kind
+
+
+## An indexed branch trace.
+class BranchTrace(object):
+
+    ## Indexes a branch trace.
+    #  A truncated final record (e.g. from a tracer that was killed mid-write) ends the trace.
+    #  @param trace_file: file - a seekable binary file object positioned at the start of the trace
+    def __init__(self, trace_file):
+        self._file = trace_file
+        ## List[Tuple(int, int, str)] - each module's start, end and name
+        self.modules = []
+        ## Dict[int, Block] - every block, by ID
+        self.blocks = {}
+        ## Dict[int, List[Tuple(int, int, int, int)]] - each thread's chunks, as (offset, size, blocks, last target)
+        self.chunks = {}
+        ## int - the thread that crashed, if the tracer saw the crash
+        self.crash_thread = None
+        self._by_start = {}
+        self._last_thread = None
+
+        header = trace_file.read(_header.size)
+        if len(header) < _header.size:
+            return
+
+        magic, version = _header.unpack(header)
+        if magic != TRACE_MAGIC:
+            raise BranchTraceError("bad branch trace magic: {:#x}".format(magic))
+        if version != TRACE_VERSION:
+            raise BranchTraceError("unsupported branch trace version: {}".format(version))
+
+        while True:
+            size = trace_file.read(_size.size)
+            if len(size) < _size.size:
+                break
+
+            (size,) = _size.unpack(size)
+            offset = trace_file.tell()
+            kind = trace_file.read(1)
+            if not kind:
+                break
+
+            kind = kind[0]
+            if kind == RECORD_CHUNK:
+                header = trace_file.read(_chunk.size)
+                if len(header) < _chunk.size:
+                    break
+
+                thread, blocks, last_target = _chunk.unpack(header)
+                body = offset + 1 + _chunk.size
+                self.chunks.setdefault(thread, []).append((body, offset + size - body, blocks, last_target))
+                self._last_thread = thread
+                trace_file.seek(offset + size)
+                continue
+
+            payload = trace_file.read(size - 1)
+            if len(payload) < size - 1:
+                break
+
+            if kind == RECORD_MODULE:
+                start, end, name_len = _module.unpack_from(payload)
+                name = payload[_module.size : _module.size + name_len].decode("utf-8", errors="replace")
+                self.modules.append((start, end, name))
+            elif kind == RECORD_BLOCK:
+                block_id, pos = _read_varint(payload, 0)
+                block = Block(block_id, *_block.unpack_from(payload, pos))
+                self.blocks[block_id] = block
+                self._by_start[block.start] = block
+            elif kind == RECORD_CRASH:
+                (self.crash_thread,) = _crash.unpack_from(payload)
+            # Unknown record types are skipped, so that newer tracers stay readable.
+
+    ## Decodes a single chunk.
+    #  @return blocks: List[Block] - the blocks that the chunk's thread executed, in order
+    def _decode_chunk(self, offset, size, count, last_target):
+        self._file.seek(offset)
+        payload = self._file.read(size)
+
+        out = []
+        pos = 0
+        bits = []
+        cur = None
+
+        while len(out) < count:
+            # Every chunk starts with an escape, and any block can be left by one. The tracer always
+            # flushes its pending bits before an escape, so there can't be one while we have bits left.
+            if not bits and pos < len(payload) and payload[pos] == TOKEN_ESCAPE:
+                from_id, next_pos = _read_varint(payload, pos + 1)
+                if cur is None or from_id == cur.id:
+                    to_id, pos = _read_varint(payload, next_pos)
+                    cur = self.blocks.get(to_id)
+                    if cur is None:
+                        raise BranchTraceError("escape to undescribed block {}".format(to_id))
+                    out.append(cur)
+                    continue
+
+            if cur is None:
+                raise BranchTraceError("chunk at {:#x} doesn't start with an escape".format(offset))
+
+            if cur.kind == KIND_DIRECT:
+                target = cur.taken
+            elif cur.kind == KIND_CONDITIONAL:
+                if not bits:
+                    if pos >= len(payload) or payload[pos] >= TOKEN_INDIRECT:
+                        raise BranchTraceError("expected branch bits at {:#x}".format(offset + pos))
+                    byte = payload[pos]
+                    pos += 1
+                    bits = [(byte >> i) & 1 for i in range(byte.bit_length() - 2, -1, -1)]
+                target = cur.taken if bits.pop(0) else cur.fallthrough
+            else:
+                if pos >= len(payload) or payload[pos] != TOKEN_INDIRECT:
+                    raise BranchTraceError("expected an indirect target at {:#x}".format(offset + pos))
+                zigzag, pos = _read_varint(payload, pos + 1)
+                last_target = (last_target + ((zigzag >> 1) ^ -(zigzag & 1))) & _MASK64
+                target = last_target
+
+            cur = self._by_start.get(target)
+            if cur is None:
+                raise BranchTraceError("branch to undescribed block at {:#x}".format(target))
+            out.append(cur)
+
+        return out
+
+    ## Symbolizes an address against the trace's modules.
+    #  @return (module, offset): Tuple(str, int) - the module's name (or None) and the offset into it
+    def symbolize(self, address):
+        for start, end, name in self.modules:
+            if start <= address < end:
+                return name, address - start
+        return None, address
+
+    ## Reconstructs the last blocks that a thread executed.
+    #  Only the newest chunks that are needed to cover `count` blocks are decoded.
+    #  @param count: int - the number of blocks to reconstruct
+    #  @param thread: int - the thread ID, or None for the crashing thread (or the last thread traced)
+    #  @return blocks: List[Dict] - each block's "address", "module" and "offset", oldest first
+    def last_blocks(self, count, thread=None):
+        if thread is None:
+            thread = self.crash_thread if self.crash_thread is not None else self._last_thread
+
+        chunks = self.chunks.get(thread, [])
+        needed = []
+        total = 0
+        for chunk in reversed(chunks):
+            needed.append(chunk)
+            total += chunk[2]
+            if total >= count:
+                break
+
+        blocks = []
+        for chunk in reversed(needed):
+            blocks.extend(self._decode_chunk(*chunk))
+
+        result = []
+        for block in blocks[-count:]:
+            module, offset = self.symbolize(block.start)
+            result.append({"address": block.start, "module": module, "offset": offset})
+        return result
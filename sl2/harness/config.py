@@ -23,15 +23,17 @@ CONFIG_SCHEMA = {}
 
 # Increment this version number for any changes that might break backwards compatibilty.
 # This could be database schema changes, paths, file glob patterns, etc..
-VERSION = 12
+VERSION = 14
 
 # Recommended Windows Release. Increment this as new DynamoRIO builds come out.
 RECOMMENDED_WIN10_VERSION = 1803
 
 PATH_KEYS = ["drrun_path", "client_path", "server_path", "wizard_path", "tracer_path", "triager_path"]
 ARGS_KEYS = ["drrun_args", "client_args", "server_args", "target_args"]
-INT_KEYS = ["runs", "simultaneous", "fuzz_timeout", "tracer_timeout", "seed", "verbose", "function_number"]
-FLAG_KEYS = ["debug", "nopersist", "continuous", "exit_early", "inline_stdout", "preserve_runs", "no_server_window"]
+INT_KEYS = ["runs", "simultaneous", "fuzz_timeout", "tracer_timeout", "seed", "verbose", "function_number", "wizard_samples", "taint_last", "crash_sample", "triage_workers", "triage_queue", "dump_cap"]
+FLAG_KEYS = ["debug", "nopersist", "continuous", "exit_early", "inline_stdout", "preserve_runs", "no_server_window", "taint_labels", "branch_trace", "full_dump"]
+# Keys that are passed straight through to the DynamoRIO clients to scope coverage instrumentation.
+COVERAGE_KEYS = ["cov_include", "cov_exclude", "cov_ranges"]
 
 profile = "DEFAULT"
 
@@ -48,9 +50,16 @@ for args in ARGS_KEYS:
 for num in INT_KEYS:
     CONFIG_SCHEMA[num] = {"test": lambda x: type(x) is int, "expected": "integer value", "required": False}
 
+# The triage pool's size and queue length have to be positive; a queue of size 0 would be unbounded.
+for num in ["triage_workers", "triage_queue"]:
+    CONFIG_SCHEMA[num] = {"test": lambda x: type(x) is int and x > 0, "expected": "positive integer", "required": False}
+
 for flag in FLAG_KEYS:
     CONFIG_SCHEMA[flag] = {"test": lambda x: type(x) is bool, "expected": "boolean", "required": False}
 
+for cov in COVERAGE_KEYS:
+    CONFIG_SCHEMA[cov] = {"test": lambda x: type(x) is str, "expected": "semicolon-separated list", "required": False}
+
 # NOTE(ww): Keep these up-to-data with include/server.hpp!
 sl2_server_pipe_path = "\\\\.\\pipe\\fuzz_server"
 ## Path to SL2 data and configuration
@@ -177,6 +186,97 @@ parser.add_argument(
     "-g", "--registry", action="store_true", dest="registry", help="Enable tracking registry calls like RegQuery()"
 )
 
+parser.add_argument(
+    "--wizard_samples",
+    action="store",
+    dest="wizard_samples",
+    type=int,
+    help="Maximum number of calls the wizard reports from each call site (function + return address). \
+    Later calls are only counted, and the last one is reported too. By default, every call is reported.",
+)
+
+parser.add_argument(
+    "--cov_include",
+    action="store",
+    dest="cov_include",
+    type=str,
+    help="Semicolon-separated module globs to collect coverage for (e.g. 'parser.dll;zlib*.dll'). \
+    By default, every module outside of C:\\Windows is instrumented.",
+)
+
+parser.add_argument(
+    "--cov_exclude",
+    action="store",
+    dest="cov_exclude",
+    type=str,
+    help="Semicolon-separated module globs to never collect coverage for. Replaces the default \
+    exclusion of C:\\Windows, so add it back explicitly if you want it.",
+)
+
+parser.add_argument(
+    "--cov_ranges",
+    action="store",
+    dest="cov_ranges",
+    type=str,
+    help="Semicolon-separated address ranges to restrict coverage to, either absolute \
+    (0xSTART-0xEND) or module-relative (parser.dll+0xSTART-0xEND).",
+)
+
+parser.add_argument(
+    "--taint_labels",
+    action="store_true",
+    dest="taint_labels",
+    default=None,
+    help="Have the tracer track which input bytes reach the crash, in addition to plain taint. \
+    Slower, and uses more memory.",
+)
+
+parser.add_argument(
+    "--branch_trace",
+    action="store_true",
+    dest="branch_trace",
+    default=None,
+    help="Have the tracer record a compressed branch trace of the replay in the run's execution.trc. \
+    See sl2/harness/branch_trace.py for reading it back.",
+)
+
+parser.add_argument(
+    "--full_dump",
+    action="store_true",
+    dest="full_dump",
+    default=None,
+    help="Have the tracer write full-memory minidumps of crashes. By default, it only writes what \
+    triage reads: thread contexts, the crashing thread's stack, modules, and memory around registers \
+    and tainted ranges.",
+)
+
+parser.add_argument(
+    "--dump_cap",
+    action="store",
+    dest="dump_cap",
+    type=int,
+    help="Cap, in megabytes, on the memory around registers and tainted ranges that the tracer's \
+    triage-sized minidumps capture. 0 means no cap. Defaults to 32.",
+)
+
+parser.add_argument(
+    "--taint_last",
+    action="store",
+    dest="taint_last",
+    type=int,
+    help="Only taint the input from the last N mutated reads when tracing a crash. \
+    By default, every mutated read is tainted.",
+)
+
+parser.add_argument(
+    "--crash_sample",
+    action="store",
+    dest="crash_sample",
+    type=int,
+    help="Fully dump and triage every Nth repeat of a crash that the server has already seen. \
+    By default, repeats of a known crash are only counted.",
+)
+
 parser.add_argument(
     "-i",
     "--triagetimeout",
@@ -200,6 +300,23 @@ parser.add_argument(
     help="Number of simultaneous instances of the target application to run",
 )
 
+parser.add_argument(
+    "--triage_workers",
+    action="store",
+    dest="triage_workers",
+    type=int,
+    help="Number of crashes to triage at once, independently of the fuzzing instances. Defaults to 1.",
+)
+
+parser.add_argument(
+    "--triage_queue",
+    action="store",
+    dest="triage_queue",
+    type=int,
+    help="Number of crashes that can wait for triage before fuzzing instances block. \
+    Defaults to 4 per triage worker.",
+)
+
 parser.add_argument(
     "-t",
     "--target",
@@ -216,8 +333,9 @@ parser.add_argument(
     action="store",
     dest="stage",
     type=str,
-    choices=["WIZARD", "FUZZER", "TRACER"],
-    help="Synchronously re-run a single stage (for debugging purposes)",
+    choices=["WIZARD", "FUZZER", "TRACER", "INDEX"],
+    help="Synchronously re-run a single stage (for debugging purposes), or INDEX to add crashes stored "
+    "before the crash index existed to it",
 )
 
 parser.add_argument(
@@ -353,6 +471,13 @@ def update_config_from_args():
     if args.registry:
         config["client_args"].append("-registry")
 
+    # Coverage scoping can come from either the config file or the command line,
+    # with the latter taking precedence.
+    for opt in COVERAGE_KEYS:
+        value = getattr(args, opt) if getattr(args, opt) is not None else config.get(opt)
+        if value:
+            config["client_args"].extend(["-" + opt, value])
+
     # Replace any values in the config dict with the optional value from the argument.
     # Note that if you set a default value for an arg, this will overwrite its value in the config
     # file even if the argument is not explicitly set by the user, so make sure you use keys that aren't
@@ -7,8 +7,10 @@
 
 import array
 import hashlib
+import itertools
 import json
 import os
+import queue
 import re
 import shutil
 import signal
@@ -25,6 +27,7 @@ from sl2.db import Crash, Tracer
 from sl2.db.run_block import SessionManager
 from . import config
 from . import named_mutex
+from . import wizard_stream
 from .state import (
     parse_tracer_crash_files,
     generate_run_id,
@@ -38,6 +41,11 @@ from .state import (
 
 print_lock = threading.Lock()
 can_fuzz = True
+triage_queue = None
+# Crashes being traced by the triage workers, as (target slug, fingerprint) -> Event that's set once the
+# trace is finished, so that only one worker taints each new crash
+tracing_lock = threading.Lock()
+tracing = {}
 
 
 ## class Mode
@@ -74,11 +82,15 @@ class DRRun(object):
     Represents the state returned by a call to run_dr.
     """
 
-    def __init__(self, process, seed, run_id, coverage=None):
+    def __init__(self, process, seed, run_id, coverage=None, known_crash=False, crash_hits=None):
         self.process: subprocess.Popen = process
         self.seed: str = seed
         self.run_id: str = run_id
         self.coverage: dict = coverage
+        # Whether the fuzzer found that the crash repeats one that's already been triaged
+        self.known_crash: bool = known_crash
+        # How many times the server has seen the crash's fingerprint, including this one
+        self.crash_hits: int = crash_hits
 
 
 ## Safe printing
@@ -236,27 +248,131 @@ def run_dr(config_dict, verbose=0, timeout=None, run_id=None, tracing=False):
 # Runs the sl2 triager on each of the minidumps generated
 # by a fuzzing run.  The information that gets returned
 # can't be used across threads so we end up fetching it from the db in the gui
+#
+# Triage is tiered: the crash is first replayed without any taint instrumentation, and the
+# (much slower) taint-tracking replay only happens if the crash reproduces and hasn't been seen before.
 # @param cfg Configuration context dictionary
 # @param run_id Run ID (guid)
+# @return dict describing the triaged crash, or None if triage failed. Crashes that are duplicates of an
+# earlier run against the same target aren't traced or stored. They're counted against that run instead,
+# and come back with "duplicate" set.
 def triager_run(cfg, run_id):
-    tracerOutput, _ = tracer_run(cfg, run_id)
+    status = tracer_confirm(cfg, run_id)
+
+    if not status:
+        return None
+
+    fingerprint = status.get("fingerprint")
+    key = (get_target_slug(cfg), fingerprint)
+
+    # If another worker is already tracing the same crash, wait to see whether it gets stored
+    while fingerprint:
+        known = Tracer.find_by_fingerprint(fingerprint, key[0])
+        if known:
+            duplicates = known.add_duplicate()
+            print_l(
+                "Run {} crashed the same way as run {} ({}, {} duplicates), skipping taint".format(
+                    run_id, known.runid, fingerprint, duplicates
+                )
+            )
+            return {
+                "run_id": run_id,
+                "duplicate": True,
+                "duplicateOf": known.runid,
+                "duplicates": duplicates,
+                "fingerprint": fingerprint,
+            }
+
+        with tracing_lock:
+            traced = tracing.get(key)
+            if not traced:
+                tracing[key] = threading.Event()
+                break
+        traced.wait()
+
+    try:
+        return trace_crash(cfg, run_id, status)
+    finally:
+        if fingerprint:
+            with tracing_lock:
+                tracing.pop(key).set()
+
+
+## Runs the taint-tracking tracer on a crash that's been confirmed, and stores it
+# @param cfg Configuration context dictionary
+# @param run_id Run ID (guid)
+# @param status the tracer's exit status from confirming the crash
+# @return dict describing the triaged crash, or None if triage failed
+def trace_crash(cfg, run_id, status):
+    # Only taint the input from the last K reads that the fuzzer mutated.
+    taint_from = 0
+    if cfg.get("taint_last"):
+        taint_from = max(0, status.get("mutations", 0) - cfg["taint_last"])
+
+    tracerOutput, _ = tracer_run(cfg, run_id, taint_from=taint_from)
 
     if tracerOutput:
-        crashInfo = Crash.factory(run_id, get_target_slug(cfg), cfg["target_application_path"])
+        crashInfo = Crash.factory(
+            run_id, get_target_slug(cfg), cfg["target_application_path"], cfg.get("tracer_timeout")
+        )
         return {"run_id": run_id, "tracerOutput": tracerOutput, "crashInfo": crashInfo}
     else:
         return None
 
 
+## Turns the wizard's records into a list of targetable functions.
+#  @param records: Iterable[Dict] - the wizard's map, id and site records, in order
+#  @return wizard_findings: List[Dict] - list of targetable functions
+def collect_wizard_findings(records):
+    wizard_findings = []
+    mem_map = {}
+    sites = {}
+    base_addr = None
+
+    for obj in records:
+        if "map" == obj["type"]:
+            mem_map[(obj["start"], obj["end"])] = obj["mod_name"]
+            if ".exe" in obj["mod_name"]:
+                base_addr = obj["start"]
+        elif "id" == obj["type"]:
+            obj["mode"] = Mode.HIGH_PRECISION
+            obj["selected"] = False
+            ret_addr = obj["retAddrOffset"] + base_addr
+            for addrs in mem_map.keys():
+                if ret_addr in range(*addrs):
+                    obj["called_from"] = mem_map[addrs]
+
+            wizard_findings.append(obj)
+        elif "site" == obj["type"]:
+            sites[(obj["func_name"], obj["retAddrOffset"])] = obj
+
+    # With -wizard_samples, the wizard only reports the first few calls from each call site,
+    # so tell the user how many more there were.
+    for finding in wizard_findings:
+        site = sites.get((finding["func_name"], finding["retAddrOffset"]))
+        if site is not None:
+            finding["siteHits"] = site["hits"]
+
+    return wizard_findings
+
+
 ## Runs the wizard and lets the user select a target function.
 #  @return wizard_findings: List[Dict] - list of targetable functions
 def wizard_run(config_dict):
+    # NOTE(ww): The wizard writes its findings to a binary stream rather than to stderr,
+    # which keeps the output of targets that do millions of small reads manageable.
+    stream_path = os.path.join(get_target_dir(config_dict), "wizard.sl2w")
+    client_args = config_dict["client_args"] + ["-wizard_stream", stream_path]
+
+    if config_dict.get("wizard_samples"):
+        client_args += ["-wizard_samples", str(config_dict["wizard_samples"])]
+
     run = run_dr(
         {
             "drrun_path": config_dict["drrun_path"],
             "drrun_args": config_dict["drrun_args"],
             "client_path": config_dict["wizard_path"],
-            "client_args": config_dict["client_args"],
+            "client_args": client_args,
             "target_application_path": config_dict["target_application_path"],
             "target_args": config_dict["target_args"],
             "inline_stdout": config_dict["inline_stdout"],
@@ -264,10 +380,6 @@ def wizard_run(config_dict):
         verbose=config_dict["verbose"],
     )
 
-    wizard_findings = []
-    mem_map = {}
-    base_addr = None
-
     for line in run.process.stderr.split(b"\n"):
         try:
             line = line.decode("utf-8")
@@ -278,19 +390,8 @@ def wizard_run(config_dict):
 
             obj = json.loads(line)
 
-            if "map" == obj["type"]:
-                mem_map[(obj["start"], obj["end"])] = obj["mod_name"]
-                if ".exe" in obj["mod_name"]:
-                    base_addr = obj["start"]
-            elif "id" == obj["type"]:
-                obj["mode"] = Mode.HIGH_PRECISION
-                obj["selected"] = False
-                ret_addr = obj["retAddrOffset"] + base_addr
-                for addrs in mem_map.keys():
-                    if ret_addr in range(*addrs):
-                        obj["called_from"] = mem_map[addrs]
-
-                wizard_findings.append(obj)
+            if "error" == obj["type"]:
+                pwarning("Wizard error:", obj.get("msg", obj.get("exception")))
         except UnicodeDecodeError:
             if config_dict["verbose"]:
                 pwarning("Not UTF-8:", repr(line))
@@ -299,7 +400,16 @@ def wizard_run(config_dict):
         except Exception as e:
             perror("Unexpected exception:", e)
 
-    return wizard_findings
+    if not os.path.isfile(stream_path):
+        perror("Wizard didn't produce any output:", stream_path)
+        return []
+
+    try:
+        with open(stream_path, "rb") as stream_file:
+            return collect_wizard_findings(wizard_stream.read_records(stream_file))
+    except wizard_stream.WizardStreamError as e:
+        perror("Couldn't read wizard output:", e)
+        return []
 
 
 ## Runs the fuzzer with a given config dict and targets file.
@@ -330,12 +440,16 @@ def fuzzer_run(config_dict, targets_file):
     # Generate a run ID and hand it to the fuzzer.
     run_id = generate_run_id(config_dict)
 
+    client_args = [*config_dict["client_args"], "-r", str(run_id), "-a", arena_id]
+    if config_dict.get("crash_sample"):
+        client_args.extend(["-crash_sample", str(config_dict["crash_sample"])])
+
     run = run_dr(
         {
             "drrun_path": config_dict["drrun_path"],
             "drrun_args": config_dict["drrun_args"],
             "client_path": config_dict["client_path"],
-            "client_args": [*config_dict["client_args"], "-r", str(run_id), "-a", arena_id],
+            "client_args": client_args,
             "target_application_path": config_dict["target_application_path"],
             "target_args": config_dict["target_args"],
             "inline_stdout": config_dict["inline_stdout"],
@@ -348,6 +462,8 @@ def fuzzer_run(config_dict, targets_file):
 
     # Parse crash status from the output.
     crashed = False
+    known_crash = False
+    crash_hits = None
     coverage_info = None
 
     for line in run.process.stderr.split(b"\n"):
@@ -357,6 +473,10 @@ def fuzzer_run(config_dict, targets_file):
             # Identify whether the fuzzing run resulted in a crash
             if not crashed:
                 crashed, exception = check_fuzz_line_for_crash(line)
+                if crashed:
+                    status = json.loads(line)
+                    known_crash = status.get("skip_triage", False)
+                    crash_hits = status.get("hits")
 
             if "#COVERAGE:" in line:
                 coverage_info = json.loads(line.replace("#COVERAGE:", ""))
@@ -364,9 +484,12 @@ def fuzzer_run(config_dict, targets_file):
             if config_dict["verbose"]:
                 perror("Not UTF-8:", repr(line))
 
-    run = DRRun(run.process, run.seed, run.run_id, coverage_info)
+    run = DRRun(run.process, run.seed, run.run_id, coverage_info, known_crash, crash_hits)
 
-    if crashed:
+    if crashed and known_crash:
+        print_l("Fuzzing run %s raised %s, a known crash; skipping triage" % (run_id, exception))
+        write_output_files(run, run_id, "fuzz")
+    elif crashed:
         print_l("Fuzzing run %s returned %s after raising %s" % (run_id, run.process.returncode, exception))
         write_output_files(run, run_id, "fuzz")
     elif config_dict["preserve_runs"]:
@@ -380,17 +503,18 @@ def fuzzer_run(config_dict, targets_file):
     return crashed, run
 
 
-## Runs the triaging tool
-# Triage includes the tracer, exploitability, and crashash generation
+## Replays a run under the tracer
 # @param config_dict Configuration context dictionary
 # @param run_id Run ID (guid)
-def tracer_run(config_dict, run_id):
+# @param client_args Arguments for the tracer
+# @return status: Dict - the tracer's exit status, or None if the replay didn't crash
+def _tracer_replay(config_dict, run_id, client_args):
     run = run_dr(
         {
             "drrun_path": config_dict["drrun_path"],
             "drrun_args": config_dict["drrun_args"],
             "client_path": config_dict["tracer_path"],
-            "client_args": [*config_dict["client_args"], "-r", str(run_id)],
+            "client_args": client_args,
             "target_application_path": config_dict["target_application_path"],
             "target_args": config_dict["target_args"],
             "inline_stdout": config_dict["inline_stdout"],
@@ -403,33 +527,148 @@ def tracer_run(config_dict, run_id):
     # Write stdout and stderr to files
     write_output_files(run, run_id, "trace")
 
-    success = False
-    message = None
+    status = {"success": False, "message": None}
 
     for line in run.process.stderr.split(b"\n"):
         try:
             obj = json.loads(line.decode("utf-8"))
 
             if obj["run_id"] == str(run_id) and "success" in obj:
-                success = obj["success"]
-                message = obj["message"]
+                status = obj
                 break
         except Exception:
             pass
 
-    if success:
+    if not status["success"]:
+        perror("Tracer failure:", status["message"])
+        return None
+
+    return status
+
+
+## Confirms that a run's crash reproduces (tier 0 of triage)
+# Replays the run without any taint instrumentation, which is much faster than a full trace.
+# @param config_dict Configuration context dictionary
+# @param run_id Run ID (guid)
+# @return status: Dict - the tracer's exit status, including the crash's "fingerprint" and the
+#   number of "mutations" replayed, or None if the crash didn't reproduce
+def tracer_confirm(config_dict, run_id):
+    return _tracer_replay(config_dict, run_id, [*config_dict["client_args"], "-r", str(run_id), "-confirm"])
+
+
+## Runs the triaging tool
+# Triage includes the tracer, exploitability, and crashash generation
+# @param config_dict Configuration context dictionary
+# @param run_id Run ID (guid)
+# @param taint_from Index of the first targeted read whose input gets tainted
+def tracer_run(config_dict, run_id, taint_from=0):
+    client_args = [*config_dict["client_args"], "-r", str(run_id)]
+
+    if config_dict.get("taint_labels"):
+        client_args.append("-taint_labels")
+
+    if config_dict.get("branch_trace"):
+        client_args.append("-branch_trace")
+
+    if config_dict.get("full_dump"):
+        client_args.append("-full_dump")
+
+    if config_dict.get("dump_cap") is not None:
+        client_args.extend(["-dump_cap", str(config_dict["dump_cap"])])
+
+    if taint_from:
+        client_args.extend(["-taint_from", str(taint_from)])
+
+    if _tracer_replay(config_dict, run_id, client_args):
         formatted, raw = parse_tracer_crash_files(run_id)
         if raw is not None:
             Tracer.factory(run_id, formatted, raw)
         return formatted, raw
     else:
-        perror("Tracer failure:", message)
         return None, None
 
 
+## A bounded priority queue of crashes waiting for triage, and the pool of threads that triage them.
+# Fuzzing threads only block on the queue when it's full, so a burst of crashes slows fuzzing down
+# instead of stopping it for the length of each tracer replay. Crashes whose fingerprint the fuzzer
+# hasn't seen before go to the front of the queue; sampled repeats of known crashes wait behind them.
+class TriageQueue(object):
+
+    ## @param config_dict Configuration context dictionary
+    #  @raise ValueError if triage_workers or triage_queue is less than 1. (A queue.PriorityQueue of size 0
+    #  or less is unbounded, which would defeat the point.)
+    def __init__(self, config_dict):
+        self.config_dict = config_dict
+        self.workers = config_dict.get("triage_workers")
+        if self.workers is None:
+            self.workers = 1
+        size = config_dict.get("triage_queue")
+        if size is None:
+            size = 4 * self.workers
+
+        if self.workers < 1:
+            raise ValueError("triage_workers must be at least 1, not {}".format(self.workers))
+        if size < 1:
+            raise ValueError("triage_queue must be at least 1, not {}".format(size))
+
+        self._queue = queue.PriorityQueue(size)
+        # Breaks ties in priority, so that crashes of the same novelty are triaged in order
+        self._counter = itertools.count()
+        self._threads = [
+            threading.Thread(target=self._work, name="triage-{}".format(i), daemon=True) for i in range(self.workers)
+        ]
+        for thread in self._threads:
+            thread.start()
+
+    ## Queues a crashing run for triage, blocking while the queue is full.
+    #  @param run: DRRun - the crashing run
+    def put(self, run):
+        priority = run.crash_hits or 1
+        self._queue.put((priority, next(self._counter), run.run_id))
+
+    ## Waits for every queued crash to be triaged, then stops the workers.
+    def close(self):
+        for _ in self._threads:
+            self._queue.put((float("inf"), next(self._counter), None))
+        for thread in self._threads:
+            thread.join()
+
+    def _work(self):
+        while True:
+            _, _, run_id = self._queue.get()
+            if run_id is None:
+                return
+
+            try:
+                triagerInfo = triager_run(self.config_dict, run_id)
+
+                if not triagerInfo:
+                    perror("Triage failure?")
+                elif not triagerInfo.get("duplicate"):
+                    print_l(triagerInfo)
+            except Exception:
+                traceback.print_exc()
+
+
+## Starts the triage workers that fuzz_and_triage hands crashes to.
+# @param config_dict Configuration context dictionary
+def start_triage(config_dict):
+    global triage_queue
+    triage_queue = TriageQueue(config_dict)
+
+
+## Waits for any crashes still queued for triage, then stops the triage workers.
+def finish_triage():
+    global triage_queue
+    if triage_queue is not None:
+        triage_queue.close()
+        triage_queue = None
+
+
 ## Fuzzing run followed by triage
-# Runs the fuzzer (in a loop if continuous is true), then runs the triage
-# tools (DR tracer and breakpad) if a crash is found.
+# Runs the fuzzer (in a loop if continuous is true), then queues the crash for the triage
+# tools (DR tracer and breakpad) if one is found. Without a running triage pool (see start_triage),
+# crashes are triaged inline.
 # @param config_dict Configuration context dictionary
 # @param run_id Run ID (guid)
 def fuzz_and_triage(config_dict):
@@ -444,14 +683,17 @@ def fuzz_and_triage(config_dict):
                 crashed, run = fuzzer_run(config_dict, targets_file)
                 manager.run_complete(run, found_crash=crashed)
 
-                if crashed:
-
-                    triagerInfo = triager_run(config_dict, run.run_id)
+                if crashed and not run.known_crash:
 
-                    if triagerInfo:
-                        print_l(triagerInfo)
+                    if triage_queue is not None:
+                        triage_queue.put(run)
                     else:
-                        perror("Triage failure?")
+                        triagerInfo = triager_run(config_dict, run.run_id)
+
+                        if not triagerInfo:
+                            perror("Triage failure?")
+                        elif not triagerInfo.get("duplicate"):
+                            print_l(triagerInfo)
 
                     if config_dict["exit_early"]:
                         # Prevent other threads from starting new fuzzing runs
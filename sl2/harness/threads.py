@@ -80,16 +80,17 @@ class FuzzerThread(QThread):
                 crashed, run = fuzzer_run(self.config_dict, self.target_file)
                 manager.run_complete(run, found_crash=crashed)
 
-                if crashed:
+                if crashed and not run.known_crash:
                     if self.config_dict["exit_early"]:
                         self.pause()
                     # We can't pass this object to another thread since it's database, so just returning the runid
                     triagerInfo = triager_run(self.config_dict, run.run_id)
 
-                    if triagerInfo:
-                        self.found_crash.emit(self, str(run.run_id))
-                    else:
+                    # Duplicates of an earlier crash aren't stored, so there's nothing new to show
+                    if not triagerInfo:
                         self.tracer_failed.emit()
+                    elif not triagerInfo.get("duplicate"):
+                        self.found_crash.emit(self, str(run.run_id))
 
                 if not self.config_dict["continuous"]:
                     self.pause()
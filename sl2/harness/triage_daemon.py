@@ -0,0 +1,130 @@
+"""
+Client for the resident triager (triager.exe -d).
+
+The daemon is started the first time a crash needs triage and lives as long as the harness does, so
+the cost of starting the triager and loading symbols is paid once instead of once per crash. Requests
+are minidump paths written to its stdin, one per line; answers are single lines of JSON on its stdout,
+matched back to their requests by "minidumpPath". (The daemon can also write a result straight to a file,
+given "<minidump><TAB><file>" as the request, in which case it only answers with "resultPath"; this client
+doesn't use that.)
+"""
+import atexit
+import json
+import subprocess
+import threading
+from concurrent.futures import Future, TimeoutError
+
+
+class TriageDaemonError(Exception):
+    pass
+
+
+## A running triager daemon.
+class TriageDaemon(object):
+
+    ## Starts a triager daemon.
+    #  @param triager_path: str - path to triager.exe
+    def __init__(self, triager_path):
+        self.triager_path = triager_path
+        self._lock = threading.Lock()
+        ## Dict[str, Future] - outstanding requests, by minidump path
+        self._pending = {}
+
+        try:
+            self._process = subprocess.Popen(
+                [triager_path, "-d"],
+                stdin=subprocess.PIPE,
+                stdout=subprocess.PIPE,
+                stderr=subprocess.DEVNULL,
+                universal_newlines=True,
+                encoding="utf-8",
+                bufsize=1,
+            )
+        except OSError as e:
+            raise TriageDaemonError("couldn't start the triager daemon: {}".format(e))
+
+        self._reader = threading.Thread(target=self._read, name="triage-daemon", daemon=True)
+        self._reader.start()
+
+    ## Whether the daemon is still running.
+    @property
+    def alive(self):
+        return self._process.poll() is None
+
+    def _read(self):
+        for line in self._process.stdout:
+            try:
+                result = json.loads(line)
+            except json.JSONDecodeError:
+                continue
+
+            with self._lock:
+                future = self._pending.pop(result.get("minidumpPath"), None)
+
+            if future is not None:
+                future.set_result(result)
+
+        # The daemon went away; nothing outstanding is ever going to be answered.
+        with self._lock:
+            pending, self._pending = self._pending, {}
+
+        for future in pending.values():
+            future.set_exception(TriageDaemonError("the triager daemon exited"))
+
+    ## Triages a minidump. Safe to call from several threads at once.
+    #  @param dump_path: str - path to the minidump
+    #  @param timeout: float - seconds to wait for an answer, or None to wait forever
+    #  @return result: Dict - the triager's JSON result, which has an "error" key if triage failed
+    #  @raise TriageDaemonError if the daemon can't be reached, exits, or doesn't answer in time
+    def triage(self, dump_path, timeout=None):
+        with self._lock:
+            future = self._pending.get(dump_path)
+            if future is None:
+                future = Future()
+                self._pending[dump_path] = future
+                try:
+                    self._process.stdin.write(dump_path + "\n")
+                    self._process.stdin.flush()
+                except OSError as e:
+                    del self._pending[dump_path]
+                    raise TriageDaemonError("couldn't talk to the triager daemon: {}".format(e))
+
+        try:
+            return future.result(timeout)
+        except TimeoutError:
+            raise TriageDaemonError("no answer for {} after {} seconds".format(dump_path, timeout))
+
+    ## Asks the daemon to exit once it's answered everything outstanding.
+    def close(self):
+        try:
+            self._process.stdin.close()
+        except OSError:
+            pass
+
+
+_daemon = None
+_daemon_lock = threading.Lock()
+
+
+## Triages a minidump with the shared triager daemon, starting (or restarting) it if necessary.
+#  @param triager_path: str - path to triager.exe
+#  @param dump_path: str - path to the minidump
+#  @param timeout: float - seconds to wait for an answer, or None to wait forever
+#  @return result: Dict - the triager's JSON result, which has an "error" key if triage failed
+def triage(triager_path, dump_path, timeout=None):
+    global _daemon
+
+    with _daemon_lock:
+        if _daemon is None or not _daemon.alive or _daemon.triager_path != triager_path:
+            if _daemon is not None:
+                _daemon.close()
+            _daemon = TriageDaemon(triager_path)
+        daemon = _daemon
+
+    return daemon.triage(dump_path, timeout)
+
+
+@atexit.register
+def _shutdown():
+    if _daemon is not None:
+        _daemon.close()
@@ -0,0 +1,116 @@
+"""
+Incremental reader for the wizard's binary record stream (see -wizard_stream in
+include/common/sl2_dr_client_options.hpp).
+"""
+import struct
+
+# NOTE(ww): Keep these up-to-date with wizard/wizard.cpp!
+WIZARD_STREAM_MAGIC = 0x57324C53
+WIZARD_STREAM_VERSION = 1
+
+RECORD_FUNCTIONS = 1
+RECORD_MAP = 2
+RECORD_ID = 3
+RECORD_SITE = 4
+
+HAS_SOURCE = 0x1
+LAST_SAMPLE = 0x2
+
+_header = struct.Struct("<II")
+_size = struct.Struct("<I")
+_id = struct.Struct("<BQQQQBQQ")
+_map = struct.Struct("<QQ")
+_site = struct.Struct("<BQQQ")
+_u8 = struct.Struct("<B")
+_u16 = struct.Struct("<H")
+
+
+class WizardStreamError(Exception):
+    pass
+
+
+## Reads a 16-bit length-prefixed string from a record.
+#  @return (string, offset): Tuple(str, int) - the decoded string and the offset just past it
+def _read_str(payload, offset):
+    (length,) = _u16.unpack_from(payload, offset)
+    offset += _u16.size
+    return payload[offset : offset + length].decode("utf-8", errors="replace"), offset + length
+
+
+## Yields each record in a wizard stream as a dict, in the same shape as the wizard's JSONL output.
+#  Records are read one at a time, so arbitrarily large streams never need to fit in memory.
+#  A truncated final record (e.g. from a target that was killed mid-write) ends the stream.
+#  @param stream_file: file - a binary file object positioned at the start of the stream
+def read_records(stream_file):
+    header = stream_file.read(_header.size)
+    if len(header) < _header.size:
+        return
+
+    magic, version = _header.unpack(header)
+    if magic != WIZARD_STREAM_MAGIC:
+        raise WizardStreamError("bad wizard stream magic: {:#x}".format(magic))
+    if version != WIZARD_STREAM_VERSION:
+        raise WizardStreamError("unsupported wizard stream version: {}".format(version))
+
+    func_names = []
+
+    while True:
+        size = stream_file.read(_size.size)
+        if len(size) < _size.size:
+            return
+
+        (size,) = _size.unpack(size)
+        payload = stream_file.read(size)
+        if len(payload) < size:
+            return
+
+        kind = payload[0]
+        offset = 1
+
+        if kind == RECORD_FUNCTIONS:
+            (count,) = _u8.unpack_from(payload, offset)
+            offset += _u8.size
+            for _ in range(count):
+                name, offset = _read_str(payload, offset)
+                func_names.append(name)
+        elif kind == RECORD_MAP:
+            start, end = _map.unpack_from(payload, offset)
+            mod_name, _ = _read_str(payload, offset + _map.size)
+            yield {"type": "map", "start": start, "end": end, "mod_name": mod_name}
+        elif kind == RECORD_ID:
+            (function, call_count, ret_addr_count, ret_addr_offset, arg_hash, flags, start, end) = _id.unpack_from(
+                payload, offset
+            )
+            source, offset = _read_str(payload, offset + _id.size)
+            (buffer_size,) = _u8.unpack_from(payload, offset)
+            offset += _u8.size
+
+            obj = {
+                "type": "id",
+                "callCount": call_count,
+                "retAddrCount": ret_addr_count,
+                "retAddrOffset": ret_addr_offset,
+                "func_name": func_names[function],
+                "argHash": "{:016x}".format(arg_hash),
+                "buffer": list(payload[offset : offset + buffer_size]),
+            }
+
+            if flags & HAS_SOURCE:
+                obj["source"] = source
+                obj["start"] = start
+                obj["end"] = end
+
+            if flags & LAST_SAMPLE:
+                obj["lastSample"] = True
+
+            yield obj
+        elif kind == RECORD_SITE:
+            function, ret_addr_offset, hits, dropped = _site.unpack_from(payload, offset)
+            yield {
+                "type": "site",
+                "func_name": func_names[function],
+                "retAddrOffset": ret_addr_offset,
+                "hits": hits,
+                "dropped": dropped,
+            }
+        # Unknown record types are skipped, so that newer wizards stay readable.
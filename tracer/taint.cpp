@@ -0,0 +1,950 @@
+#include <algorithm>
+#include <cstring>
+#include <intrin.h>
+#include <unordered_set>
+
+#include "drmgr.h"
+
+#include "tracer_taint.hpp"
+
+/** The number of union labels allocated at once. */
+#define SL2_TAINT_UNION_CHUNK (1 << 16)
+
+/** A thread's tainted registers, and (in label mode) their labels. */
+struct sl2_reg_taint {
+  uint64_t bits[SL2_TAINT_REG_WORDS];
+  uint32_t count;
+  uint32_t suspended;
+  sl2_label labels[DR_REG_LAST_ENUM + 1];
+};
+
+/** One bit of taint per byte of a page of application memory. */
+struct sl2_shadow_page {
+  volatile LONG64 bits[SL2_TAINT_PAGE_WORDS];
+};
+
+/**
+ * A shadow page directory slot. `key` is the page number plus one (so that zero means empty),
+ * and is claimed before `page` is published. `labels` is only allocated in label mode, the first
+ * time a labeled byte lands on the page.
+ */
+struct sl2_shadow_slot {
+  volatile LONG64 key;
+  sl2_shadow_page *volatile page;
+  sl2_label *volatile labels;
+};
+
+/** The input bytes from a single targeted read, which own a contiguous block of labels. */
+struct sl2_label_segment {
+  sl2_label first;
+  uint32_t read;
+  uint64_t offset;
+  uint64_t size;
+};
+
+/** The two labels that a union label combines. */
+struct sl2_union_node {
+  sl2_label l1;
+  sl2_label l2;
+};
+
+/**
+ * An open-addressed table memoizing unions. Lookups don't take the label lock: a value is written
+ * before its key is published, and a table is never freed while the tracer is running, so a reader
+ * that races with an insert or a grow just misses and falls back to the locked path.
+ */
+struct sl2_union_memo {
+  size_t cap;
+  volatile LONG64 *keys;
+  sl2_label *vals;
+  /*! The table this one replaced, kept around for readers that may still be probing it */
+  sl2_union_memo *prev;
+};
+
+/*! TLS slot holding each thread's sl2_reg_taint */
+static int reg_tls_idx = -1;
+/*! The shadow page directory */
+static sl2_shadow_slot *shadow_dir = NULL;
+/*! The number of tainted bytes of application memory */
+static volatile LONG64 shadow_count = 0;
+/*! Whether we've already complained about running out of directory slots */
+static bool shadow_dir_full = false;
+
+/*! Whether we're tracking labels, in addition to plain taint */
+static bool taint_labels = false;
+/*! Guards everything below, except for lock-free lookups in the union memo */
+static void *label_lock = NULL;
+/*! Every targeted read's block of input labels, in ascending order */
+static std::vector<sl2_label_segment, sl2_slab_allocator<sl2_label_segment>> label_segments;
+/*! The next unused input label. 0 is reserved for "no provenance". */
+static sl2_label next_input_label = 1;
+/*! The union label table, allocated SL2_TAINT_UNION_CHUNK nodes at a time */
+static sl2_union_node *union_chunks[SL2_TAINT_MAX_UNIONS / SL2_TAINT_UNION_CHUNK];
+static uint32_t union_count = 0;
+/*! Memoizes unions, so that combining the same two labels twice yields the same label */
+static sl2_union_memo *volatile union_memo = NULL;
+/*! Whether we've already complained about running out of labels */
+static bool labels_full = false;
+
+/**
+ * Gets a thread's register taint, creating it on first use.
+ * @param drcontext the thread's DynamoRIO context
+ * @return the thread's register taint
+ */
+static sl2_reg_taint *get_reg_taint(void *drcontext) {
+  sl2_reg_taint *taint = (sl2_reg_taint *)drmgr_get_tls_field(drcontext, reg_tls_idx);
+
+  if (!taint) {
+    taint = (sl2_reg_taint *)dr_thread_alloc(drcontext, sizeof(sl2_reg_taint));
+    memset(taint, 0, sizeof(sl2_reg_taint));
+    drmgr_set_tls_field(drcontext, reg_tls_idx, taint);
+  }
+
+  return taint;
+}
+
+static void on_taint_thread_exit(void *drcontext) {
+  sl2_reg_taint *taint = (sl2_reg_taint *)drmgr_get_tls_field(drcontext, reg_tls_idx);
+
+  if (taint) {
+    drmgr_set_tls_field(drcontext, reg_tls_idx, NULL);
+    dr_thread_free(drcontext, taint, sizeof(sl2_reg_taint));
+  }
+}
+
+/**
+ * Finds the directory slot for a page of application memory.
+ * @param pageno the application page number, i.e. the address >> SL2_TAINT_PAGE_BITS
+ * @param create whether to create the shadow page if it doesn't exist yet
+ * @return the slot (whose shadow page has been published), or NULL if it doesn't exist (or the
+ *         directory is full)
+ */
+static sl2_shadow_slot *find_shadow_slot(uint64_t pageno, bool create) {
+  LONG64 key = (LONG64)(pageno + 1);
+  size_t mask = SL2_TAINT_DIR_SIZE - 1;
+  size_t idx = (size_t)((pageno * 0x9E3779B97F4A7C15ULL) >> (64 - SL2_TAINT_DIR_BITS));
+
+  for (size_t probe = 0; probe < SL2_TAINT_DIR_SIZE; probe++) {
+    sl2_shadow_slot *slot = &shadow_dir[(idx + probe) & mask];
+    LONG64 slot_key = slot->key;
+
+    if (!slot_key) {
+      if (!create) {
+        return NULL;
+      }
+
+      slot_key = InterlockedCompareExchange64(&slot->key, key, 0);
+
+      if (!slot_key) {
+        sl2_shadow_page *page = (sl2_shadow_page *)sl2_slab_alloc(sizeof(sl2_shadow_page));
+        memset(page, 0, sizeof(sl2_shadow_page));
+        InterlockedExchangePointer((PVOID volatile *)&slot->page, page);
+        return slot;
+      }
+
+      // NOTE(ww): Another thread beat us to this slot; fall through and check whether it
+      // claimed it for the same page that we're looking for.
+    }
+
+    if (slot_key == key) {
+      sl2_shadow_page *page = slot->page;
+
+      // The slot's been claimed, but the claiming thread hasn't published its page yet.
+      while (!page && create) {
+        YieldProcessor();
+        page = slot->page;
+      }
+
+      return page ? slot : NULL;
+    }
+  }
+
+  if (!shadow_dir_full) {
+    shadow_dir_full = true;
+    dr_fprintf(STDERR, "sl2_taint: shadow directory is full, dropping memory taint!\n");
+  }
+
+  return NULL;
+}
+
+/**
+ * Gets a slot's label page, creating it on first use.
+ * @param slot the directory slot
+ * @return the label page, with one label per byte of the application page
+ */
+static sl2_label *get_shadow_labels(sl2_shadow_slot *slot) {
+  sl2_label *labels = slot->labels;
+
+  if (!labels) {
+    size_t size = SL2_TAINT_PAGE_SIZE * sizeof(sl2_label);
+    sl2_label *fresh = (sl2_label *)dr_global_alloc(size);
+    memset(fresh, 0, size);
+
+    labels = (sl2_label *)InterlockedCompareExchangePointer((PVOID volatile *)&slot->labels,
+                                                            fresh, NULL);
+
+    if (labels) {
+      dr_global_free(fresh, size);
+    } else {
+      labels = fresh;
+    }
+  }
+
+  return labels;
+}
+
+/** The operations that walk_shadow can apply to each word of a range. */
+enum class ShadowOp {
+  Test,
+  Set,
+  Clear,
+};
+
+/**
+ * Applies an operation to the shadow bits of a range of application memory, a word at a time.
+ * @param addr the start of the range
+ * @param size the size of the range, in bytes
+ * @param op the operation to apply
+ * @param label for Set in label mode, the label to give each byte (or the first byte's label)
+ * @param sequential for Set in label mode, whether each byte gets the label after the previous
+ *        byte's, rather than all of them getting the same label
+ * @return for Test, whether any byte is tainted; for Clear, whether any byte was tainted
+ */
+static bool walk_shadow(app_pc addr, size_t size, ShadowOp op, sl2_label label = 0,
+                        bool sequential = false) {
+  uint64_t cur = (uint64_t)addr;
+  bool result = false;
+
+  while (size) {
+    uint64_t pageno = cur >> SL2_TAINT_PAGE_BITS;
+    size_t offset = (size_t)(cur & (SL2_TAINT_PAGE_SIZE - 1));
+    size_t span = std::min(size, (size_t)SL2_TAINT_PAGE_SIZE - offset);
+    sl2_shadow_slot *slot = find_shadow_slot(pageno, op == ShadowOp::Set);
+    sl2_shadow_page *page = slot ? slot->page : NULL;
+
+    if (op == ShadowOp::Set && taint_labels && label) {
+      if (page) {
+        sl2_label *labels = get_shadow_labels(slot);
+
+        for (size_t i = 0; i < span; i++) {
+          labels[offset + i] = sequential ? label + (sl2_label)i : label;
+        }
+      }
+
+      if (sequential) {
+        label += (sl2_label)span;
+      }
+    }
+
+    for (size_t done = 0; page && done < span;) {
+      size_t word = (offset + done) / 64;
+      size_t bit = (offset + done) % 64;
+      size_t nbits = std::min(span - done, 64 - bit);
+      uint64_t mask = (nbits == 64 ? ~0ULL : ((1ULL << nbits) - 1)) << bit;
+
+      switch (op) {
+      case ShadowOp::Test:
+        if (page->bits[word] & mask) {
+          return true;
+        }
+        break;
+      case ShadowOp::Set: {
+        uint64_t old = (uint64_t)InterlockedOr64(&page->bits[word], (LONG64)mask);
+        uint64_t added = mask & ~old;
+
+        if (added) {
+          InterlockedAdd64(&shadow_count, (LONG64)__popcnt64(added));
+        }
+        break;
+      }
+      case ShadowOp::Clear: {
+        if (!(page->bits[word] & mask)) {
+          break;
+        }
+
+        uint64_t old = (uint64_t)InterlockedAnd64(&page->bits[word], (LONG64)~mask);
+        uint64_t removed = mask & old;
+
+        if (removed) {
+          InterlockedAdd64(&shadow_count, -(LONG64)__popcnt64(removed));
+          result = true;
+        }
+        break;
+      }
+      }
+
+      done += nbits;
+    }
+
+    cur += span;
+    size -= span;
+  }
+
+  return result;
+}
+
+/**
+ * Copies the taint bits (and labels) of a range of application memory out of the shadow.
+ * @param addr the start of the range
+ * @param size the size of the range, in bytes
+ * @param taint filled with one byte per application byte, nonzero if the byte is tainted
+ * @param labels filled with each application byte's label, or 0
+ */
+static void read_shadow(uint64_t addr, size_t size, uint8_t *taint, sl2_label *labels) {
+  size_t done = 0;
+
+  while (done < size) {
+    uint64_t cur = addr + done;
+    size_t offset = (size_t)(cur & (SL2_TAINT_PAGE_SIZE - 1));
+    size_t span = std::min(size - done, (size_t)SL2_TAINT_PAGE_SIZE - offset);
+    sl2_shadow_slot *slot = find_shadow_slot(cur >> SL2_TAINT_PAGE_BITS, false);
+
+    for (size_t i = 0; i < span; i++) {
+      size_t idx = offset + i;
+      bool tainted = slot && ((slot->page->bits[idx / 64] >> (idx % 64)) & 1);
+
+      taint[done + i] = tainted;
+      labels[done + i] = (tainted && slot->labels) ? slot->labels[idx] : 0;
+    }
+
+    done += span;
+  }
+}
+
+/**
+ * Overwrites the taint bits (and labels) of a range of application memory.
+ * @param addr the start of the range
+ * @param size the size of the range, in bytes
+ * @param taint one byte per application byte, nonzero if the byte should be tainted
+ * @param labels each application byte's new label
+ */
+static void write_shadow(uint64_t addr, size_t size, const uint8_t *taint,
+                         const sl2_label *labels) {
+  size_t done = 0;
+
+  while (done < size) {
+    uint64_t cur = addr + done;
+    size_t offset = (size_t)(cur & (SL2_TAINT_PAGE_SIZE - 1));
+    size_t span = std::min(size - done, (size_t)SL2_TAINT_PAGE_SIZE - offset);
+    bool any = false;
+
+    for (size_t i = 0; i < span && !any; i++) {
+      any = taint[done + i];
+    }
+
+    sl2_shadow_slot *slot = find_shadow_slot(cur >> SL2_TAINT_PAGE_BITS, any);
+
+    for (size_t i = 0; slot && i < span;) {
+      size_t word = (offset + i) / 64;
+      size_t bit = (offset + i) % 64;
+      size_t nbits = std::min(span - i, 64 - bit);
+      uint64_t set = 0;
+      uint64_t clear = 0;
+
+      for (size_t k = 0; k < nbits; k++) {
+        if (taint[done + i + k]) {
+          set |= 1ULL << (bit + k);
+        } else {
+          clear |= 1ULL << (bit + k);
+        }
+      }
+
+      if (set) {
+        uint64_t old = (uint64_t)InterlockedOr64(&slot->page->bits[word], (LONG64)set);
+        uint64_t added = set & ~old;
+
+        if (added) {
+          InterlockedAdd64(&shadow_count, (LONG64)__popcnt64(added));
+        }
+      }
+
+      if (clear && (slot->page->bits[word] & clear)) {
+        uint64_t old = (uint64_t)InterlockedAnd64(&slot->page->bits[word], (LONG64)~clear);
+        uint64_t removed = clear & old;
+
+        if (removed) {
+          InterlockedAdd64(&shadow_count, -(LONG64)__popcnt64(removed));
+        }
+      }
+
+      i += nbits;
+    }
+
+    if (slot && any && taint_labels) {
+      sl2_label *page_labels = get_shadow_labels(slot);
+
+      for (size_t i = 0; i < span; i++) {
+        if (taint[done + i]) {
+          page_labels[offset + i] = labels[done + i];
+        }
+      }
+    }
+
+    done += span;
+  }
+}
+
+/**
+ * Sets up the register and memory taint state. Must be called after drmgr_init.
+ * @return success
+ */
+bool sl2_taint_init(bool labels) {
+  taint_labels = labels;
+  label_lock = dr_mutex_create();
+  reg_tls_idx = drmgr_register_tls_field();
+
+  if (reg_tls_idx == -1) {
+    return false;
+  }
+
+  shadow_dir = (sl2_shadow_slot *)dr_raw_mem_alloc(SL2_TAINT_DIR_SIZE * sizeof(sl2_shadow_slot),
+                                                   DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+
+  if (!shadow_dir) {
+    return false;
+  }
+
+  return drmgr_register_thread_exit_event(on_taint_thread_exit);
+}
+
+/**
+ * Tears down the taint state. Must be called before drmgr_exit.
+ * NOTE(ww): Like the slab allocator's chunks, the shadow pages themselves go away with the process.
+ */
+void sl2_taint_exit() {
+  if (reg_tls_idx != -1) {
+    drmgr_unregister_thread_exit_event(on_taint_thread_exit);
+    drmgr_unregister_tls_field(reg_tls_idx);
+    reg_tls_idx = -1;
+  }
+
+  if (shadow_dir) {
+    for (size_t i = 0; i < SL2_TAINT_DIR_SIZE; i++) {
+      if (shadow_dir[i].labels) {
+        dr_global_free(shadow_dir[i].labels, SL2_TAINT_PAGE_SIZE * sizeof(sl2_label));
+      }
+    }
+
+    dr_raw_mem_free(shadow_dir, SL2_TAINT_DIR_SIZE * sizeof(sl2_shadow_slot));
+    shadow_dir = NULL;
+  }
+
+  for (size_t i = 0; i < union_count; i += SL2_TAINT_UNION_CHUNK) {
+    dr_raw_mem_free(union_chunks[i / SL2_TAINT_UNION_CHUNK],
+                    SL2_TAINT_UNION_CHUNK * sizeof(sl2_union_node));
+  }
+
+  while (union_memo) {
+    sl2_union_memo *memo = union_memo;
+
+    union_memo = memo->prev;
+    dr_global_free((void *)memo->keys, memo->cap * sizeof(LONG64));
+    dr_global_free(memo->vals, memo->cap * sizeof(sl2_label));
+    dr_global_free(memo, sizeof(sl2_union_memo));
+  }
+
+  if (label_lock) {
+    dr_mutex_destroy(label_lock);
+    label_lock = NULL;
+  }
+}
+
+/*! @return whether we're tracking labels */
+bool sl2_taint_labels_enabled() {
+  return taint_labels;
+}
+
+/**
+ * Checks whether a register is tainted on the calling thread.
+ * @param drcontext the thread's DynamoRIO context
+ * @param reg the full-width register (or DR_REG_NULL, for the program counter)
+ * @return whether the register is tainted
+ */
+bool sl2_taint_reg_is_tainted(void *drcontext, reg_id_t reg) {
+  sl2_reg_taint *taint = get_reg_taint(drcontext);
+  return (taint->bits[reg / 64] >> (reg % 64)) & 1;
+}
+
+/**
+ * Taints a register on the calling thread.
+ * @param drcontext the thread's DynamoRIO context
+ * @param reg the full-width register (or DR_REG_NULL, for the program counter)
+ * @param label in label mode, the register's new label
+ */
+void sl2_taint_reg_set(void *drcontext, reg_id_t reg, sl2_label label) {
+  sl2_reg_taint *taint = get_reg_taint(drcontext);
+  uint64_t bit = 1ULL << (reg % 64);
+
+  taint->labels[reg] = label;
+
+  if (!(taint->bits[reg / 64] & bit)) {
+    taint->bits[reg / 64] |= bit;
+    taint->count++;
+  }
+}
+
+/**
+ * Untaints a register on the calling thread.
+ * @param drcontext the thread's DynamoRIO context
+ * @param reg the full-width register (or DR_REG_NULL, for the program counter)
+ * @return whether the register was tainted
+ */
+bool sl2_taint_reg_clear(void *drcontext, reg_id_t reg) {
+  sl2_reg_taint *taint = get_reg_taint(drcontext);
+  uint64_t bit = 1ULL << (reg % 64);
+
+  if (taint->bits[reg / 64] & bit) {
+    taint->bits[reg / 64] &= ~bit;
+    taint->count--;
+    return true;
+  }
+
+  return false;
+}
+
+/**
+ * @param drcontext the thread's DynamoRIO context
+ * @return whether any register is tainted on the calling thread
+ */
+bool sl2_taint_reg_any(void *drcontext) {
+  return get_reg_taint(drcontext)->count > 0;
+}
+
+/**
+ * Gets a register's label on the calling thread.
+ * @param drcontext the thread's DynamoRIO context
+ * @param reg the full-width register (or DR_REG_NULL, for the program counter)
+ * @return the register's label, or 0 if it's untainted (or we're not tracking labels)
+ */
+sl2_label sl2_taint_reg_label(void *drcontext, reg_id_t reg) {
+  sl2_reg_taint *taint = get_reg_taint(drcontext);
+
+  if (!((taint->bits[reg / 64] >> (reg % 64)) & 1)) {
+    return 0;
+  }
+
+  return taint->labels[reg];
+}
+
+/**
+ * Checks whether any byte in a range of application memory is tainted.
+ * @param addr the start of the range
+ * @param size the size of the range, in bytes
+ * @return whether any byte is tainted
+ */
+bool sl2_taint_mem_is_tainted(app_pc addr, size_t size) {
+  if (!shadow_count) {
+    return false;
+  }
+
+  return walk_shadow(addr, size, ShadowOp::Test);
+}
+
+/**
+ * Taints a range of application memory.
+ * @param addr the start of the range
+ * @param size the size of the range, in bytes
+ * @param label in label mode, the label to give every byte in the range
+ */
+void sl2_taint_mem_set(app_pc addr, size_t size, sl2_label label) {
+  walk_shadow(addr, size, ShadowOp::Set, label);
+}
+
+/**
+ * Untaints a range of application memory.
+ * @param addr the start of the range
+ * @param size the size of the range, in bytes
+ * @return whether any byte in the range was tainted
+ */
+bool sl2_taint_mem_clear(app_pc addr, size_t size) {
+  if (!shadow_count) {
+    return false;
+  }
+
+  return walk_shadow(addr, size, ShadowOp::Clear);
+}
+
+/*! @return the number of tainted bytes of application memory */
+uint64_t sl2_taint_mem_count() {
+  return (uint64_t)shadow_count;
+}
+
+/**
+ * Collects every tainted range of application memory, in ascending order. This walks the whole
+ * shadow directory, so it's only meant for reporting.
+ * @param ranges the vector to fill
+ */
+void sl2_taint_mem_ranges(sl2_taint_range_vec *ranges) {
+  std::vector<std::pair<uint64_t, sl2_shadow_page *>,
+              sl2_slab_allocator<std::pair<uint64_t, sl2_shadow_page *>>>
+      pages;
+
+  for (size_t i = 0; i < SL2_TAINT_DIR_SIZE; i++) {
+    if (shadow_dir[i].key && shadow_dir[i].page) {
+      pages.push_back(std::make_pair((uint64_t)(shadow_dir[i].key - 1), shadow_dir[i].page));
+    }
+  }
+
+  std::sort(pages.begin(), pages.end());
+
+  for (auto &entry : pages) {
+    uint64_t base = entry.first << SL2_TAINT_PAGE_BITS;
+
+    for (size_t word = 0; word < SL2_TAINT_PAGE_WORDS; word++) {
+      uint64_t bits = (uint64_t)entry.second->bits[word];
+
+      for (size_t bit = 0; bits && bit < 64; bit++, bits >>= 1) {
+        if (!(bits & 1)) {
+          continue;
+        }
+
+        uint64_t addr = base + word * 64 + bit;
+
+        if (!ranges->empty() && ranges->back().start + ranges->back().size == addr) {
+          ranges->back().size++;
+        } else {
+          ranges->push_back({addr, 1});
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Combines the labels of every tainted byte in a range of application memory.
+ * @param addr the start of the range
+ * @param size the size of the range, in bytes
+ * @return the union of the bytes' labels, or 0 if none of them are labeled
+ */
+sl2_label sl2_taint_mem_label(app_pc addr, size_t size) {
+  uint64_t cur = (uint64_t)addr;
+  sl2_label label = 0;
+
+  if (!taint_labels || !shadow_count) {
+    return 0;
+  }
+
+  while (size) {
+    uint64_t pageno = cur >> SL2_TAINT_PAGE_BITS;
+    size_t offset = (size_t)(cur & (SL2_TAINT_PAGE_SIZE - 1));
+    size_t span = std::min(size, (size_t)SL2_TAINT_PAGE_SIZE - offset);
+    sl2_shadow_slot *slot = find_shadow_slot(pageno, false);
+
+    if (slot && slot->labels) {
+      for (size_t i = offset; i < offset + span; i++) {
+        if ((slot->page->bits[i / 64] >> (i % 64)) & 1) {
+          label = sl2_taint_union(label, slot->labels[i]);
+        }
+      }
+    }
+
+    cur += span;
+    size -= span;
+  }
+
+  return label;
+}
+
+/**
+ * Taints the buffer filled by a targeted read. In label mode, each byte gets its own input label,
+ * so that anything derived from it can be traced back to its offset in the input.
+ * @param addr the start of the buffer
+ * @param size the size of the buffer, in bytes
+ * @param read the index of the targeted read (i.e., the mutation count)
+ * @param offset the buffer's offset within its source (e.g., the file position)
+ */
+void sl2_taint_mem_set_input(app_pc addr, size_t size, uint32_t read, uint64_t offset) {
+  sl2_label first = 0;
+
+  if (taint_labels && size) {
+    dr_mutex_lock(label_lock);
+
+    if ((uint64_t)next_input_label + size < SL2_TAINT_UNION_BIT) {
+      first = next_input_label;
+      next_input_label += (sl2_label)size;
+      label_segments.push_back({first, read, offset, size});
+    } else if (!labels_full) {
+      labels_full = true;
+      dr_fprintf(STDERR, "sl2_taint: out of input labels, dropping provenance!\n");
+    }
+
+    dr_mutex_unlock(label_lock);
+  }
+
+  walk_shadow(addr, size, ShadowOp::Set, first, true);
+}
+
+/**
+ * Finds the slot for a union in a memo table.
+ * @param memo the table to probe
+ * @param key the union's key, from its two (ordered) labels
+ * @return the index of the slot holding the key, or of the empty slot where it belongs
+ */
+static size_t probe_union_memo(sl2_union_memo *memo, uint64_t key) {
+  size_t idx = (size_t)(key * 0x9E3779B97F4A7C15ULL) & (memo->cap - 1);
+  LONG64 slot_key;
+
+  while ((slot_key = memo->keys[idx]) && (uint64_t)slot_key != key) {
+    idx = (idx + 1) & (memo->cap - 1);
+  }
+
+  return idx;
+}
+
+/**
+ * Grows the union memo table. Must be called with the label lock held.
+ */
+static void grow_union_memo() {
+  sl2_union_memo *old_memo = union_memo;
+  sl2_union_memo *memo = (sl2_union_memo *)dr_global_alloc(sizeof(sl2_union_memo));
+
+  memo->cap = old_memo ? old_memo->cap * 2 : 4096;
+  memo->keys = (volatile LONG64 *)dr_global_alloc(memo->cap * sizeof(LONG64));
+  memo->vals = (sl2_label *)dr_global_alloc(memo->cap * sizeof(sl2_label));
+  memo->prev = old_memo;
+  memset((void *)memo->keys, 0, memo->cap * sizeof(LONG64));
+
+  for (size_t i = 0; old_memo && i < old_memo->cap; i++) {
+    if (!old_memo->keys[i]) {
+      continue;
+    }
+
+    size_t idx = probe_union_memo(memo, (uint64_t)old_memo->keys[i]);
+
+    memo->vals[idx] = old_memo->vals[i];
+    memo->keys[idx] = old_memo->keys[i];
+  }
+
+  // NOTE: The old table stays allocated until sl2_taint_exit, since lock-free readers may still be
+  // probing it.
+  InterlockedExchangePointer((PVOID volatile *)&union_memo, memo);
+}
+
+/**
+ * Handles running out of room for union labels. Must be called with the label lock held.
+ * @param l2 the (larger) label being combined
+ * @return the label to use instead of a new union
+ */
+static sl2_label union_labels_full(sl2_label l2) {
+  // NOTE: The best we can do is keep one side's provenance.
+  if (!labels_full) {
+    labels_full = true;
+    dr_fprintf(STDERR, "sl2_taint: out of union labels, dropping provenance!\n");
+  }
+
+  return l2;
+}
+
+/**
+ * Combines two labels.
+ * @param l1 the first label
+ * @param l2 the second label
+ * @return a label whose provenance is that of both l1 and l2
+ */
+sl2_label sl2_taint_union(sl2_label l1, sl2_label l2) {
+  if (!l1 || l1 == l2) {
+    return l2;
+  }
+
+  if (!l2) {
+    return l1;
+  }
+
+  if (l1 > l2) {
+    std::swap(l1, l2);
+  }
+
+  uint64_t key = ((uint64_t)l1 << 32) | l2;
+  sl2_union_memo *memo = union_memo;
+  sl2_label label;
+
+  // Most unions have been seen before, so check the memo without the lock first.
+  if (memo) {
+    size_t idx = probe_union_memo(memo, key);
+
+    if (memo->keys[idx]) {
+      return memo->vals[idx];
+    }
+  }
+
+  dr_mutex_lock(label_lock);
+
+  if (!union_memo || union_count * 2 >= union_memo->cap) {
+    grow_union_memo();
+  }
+
+  memo = union_memo;
+  size_t idx = probe_union_memo(memo, key);
+
+  if (memo->keys[idx]) {
+    label = memo->vals[idx];
+  } else if (union_count < SL2_TAINT_MAX_UNIONS) {
+    size_t chunk = union_count / SL2_TAINT_UNION_CHUNK;
+
+    if (!union_chunks[chunk]) {
+      union_chunks[chunk] = (sl2_union_node *)dr_raw_mem_alloc(
+          SL2_TAINT_UNION_CHUNK * sizeof(sl2_union_node), DR_MEMPROT_READ | DR_MEMPROT_WRITE,
+          NULL);
+    }
+
+    if (union_chunks[chunk]) {
+      union_chunks[chunk][union_count % SL2_TAINT_UNION_CHUNK] = {l1, l2};
+      label = SL2_TAINT_UNION_BIT | union_count++;
+
+      memo->vals[idx] = label;
+      InterlockedExchange64(&memo->keys[idx], (LONG64)key);
+    } else {
+      label = union_labels_full(l2);
+    }
+  } else {
+    label = union_labels_full(l2);
+  }
+
+  dr_mutex_unlock(label_lock);
+
+  return label;
+}
+
+/**
+ * Resolves a label to the input offsets that it was derived from.
+ * @param label the label to resolve
+ * @param offsets the vector to fill with the label's input offsets, in ascending order
+ * @return false if the label's provenance was too large to walk completely
+ */
+bool sl2_taint_label_offsets(sl2_label label, sl2_taint_offsets_vec *offsets) {
+  std::vector<sl2_label, sl2_slab_allocator<sl2_label>> stack;
+  std::vector<sl2_label, sl2_slab_allocator<sl2_label>> inputs;
+  std::unordered_set<sl2_label, std::hash<sl2_label>, std::equal_to<sl2_label>,
+                     sl2_slab_allocator<sl2_label>>
+      visited;
+  bool complete = true;
+
+  if (!label) {
+    return true;
+  }
+
+  dr_mutex_lock(label_lock);
+
+  stack.push_back(label);
+
+  while (!stack.empty()) {
+    sl2_label cur = stack.back();
+    stack.pop_back();
+
+    if (!(cur & SL2_TAINT_UNION_BIT)) {
+      inputs.push_back(cur);
+      continue;
+    }
+
+    if (!visited.insert(cur).second) {
+      continue;
+    }
+
+    if (visited.size() > SL2_TAINT_MAX_WALK) {
+      complete = false;
+      break;
+    }
+
+    uint32_t idx = cur & ~SL2_TAINT_UNION_BIT;
+    sl2_union_node node = union_chunks[idx / SL2_TAINT_UNION_CHUNK][idx % SL2_TAINT_UNION_CHUNK];
+    stack.push_back(node.l1);
+    stack.push_back(node.l2);
+  }
+
+  std::sort(inputs.begin(), inputs.end());
+  inputs.erase(std::unique(inputs.begin(), inputs.end()), inputs.end());
+
+  for (sl2_label input : inputs) {
+    auto seg = std::upper_bound(
+        label_segments.begin(), label_segments.end(), input,
+        [](sl2_label l, const sl2_label_segment &segment) { return l < segment.first; });
+
+    if (seg == label_segments.begin()) {
+      continue;
+    }
+
+    seg--;
+
+    uint64_t offset = seg->offset + (input - seg->first);
+
+    if (!offsets->empty() && offsets->back().read == seg->read &&
+        offsets->back().start + offsets->back().size == offset) {
+      offsets->back().size++;
+    } else {
+      offsets->push_back({seg->read, offset, 1});
+    }
+  }
+
+  dr_mutex_unlock(label_lock);
+
+  return complete;
+}
+
+/**
+ * Copies the taint (and labels) of one range of application memory onto another, with memmove
+ * semantics, a shadow page's worth at a time.
+ * @param dst the start of the destination range
+ * @param src the start of the source range
+ * @param size the size of both ranges, in bytes
+ */
+void sl2_taint_mem_copy(app_pc dst, app_pc src, size_t size) {
+  if (!size || dst == src) {
+    return;
+  }
+
+  // Most copies don't involve tainted data at all.
+  if (!sl2_taint_mem_is_tainted(src, size)) {
+    sl2_taint_mem_clear(dst, size);
+    return;
+  }
+
+  void *drcontext = dr_get_current_drcontext();
+  uint8_t *taint = (uint8_t *)dr_thread_alloc(drcontext, SL2_TAINT_PAGE_SIZE);
+  sl2_label *labels =
+      (sl2_label *)dr_thread_alloc(drcontext, SL2_TAINT_PAGE_SIZE * sizeof(sl2_label));
+
+  // Like memmove, copy back-to-front when the destination overlaps the end of the source.
+  bool backward = dst > src && dst < src + size;
+
+  for (size_t done = 0; done < size;) {
+    size_t n = std::min(size - done, (size_t)SL2_TAINT_PAGE_SIZE);
+    size_t off = backward ? size - done - n : done;
+
+    read_shadow((uint64_t)(src + off), n, taint, labels);
+    write_shadow((uint64_t)(dst + off), n, taint, labels);
+
+    done += n;
+  }
+
+  dr_thread_free(drcontext, taint, SL2_TAINT_PAGE_SIZE);
+  dr_thread_free(drcontext, labels, SL2_TAINT_PAGE_SIZE * sizeof(sl2_label));
+}
+
+/**
+ * Suspends instruction-level propagation on the calling thread, e.g. while it's inside a function
+ * whose effect on taint has already been applied in bulk. Suspensions nest.
+ * @param drcontext the thread's DynamoRIO context
+ */
+void sl2_taint_suspend(void *drcontext) {
+  get_reg_taint(drcontext)->suspended++;
+}
+
+/**
+ * Undoes one call to `sl2_taint_suspend`.
+ * @param drcontext the thread's DynamoRIO context
+ */
+void sl2_taint_resume(void *drcontext) {
+  sl2_reg_taint *taint = get_reg_taint(drcontext);
+
+  if (taint->suspended) {
+    taint->suspended--;
+  }
+}
+
+/**
+ * @param drcontext the thread's DynamoRIO context
+ * @return whether instruction-level propagation is suspended on the calling thread
+ */
+bool sl2_taint_suspended(void *drcontext) {
+  return get_reg_taint(drcontext)->suspended > 0;
+}
@@ -0,0 +1,565 @@
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "drmgr.h"
+
+#include "common/sl2_dr_slab.hpp"
+#include "tracer_trace.hpp"
+
+/** The size of a chunk record's header: size, type, thread, blocks, last indirect target. */
+#define SL2_TRACE_CHUNK_HEADER (4 + 1 + 4 + 4 + 8)
+
+/** The most that encoding a single block can add to a chunk: a bits byte, then an escape. */
+#define SL2_TRACE_TOKEN_MAX (1 + 1 + 10 + 10)
+
+/** A thread's branch trace encoder state, and the chunk that it's currently filling. */
+struct sl2_trace_thread {
+  uint32_t thread_id;
+  uint32_t blocks;
+  uint64_t chunk_target;
+  uint64_t last_target;
+  sl2_trace_block *prev;
+  bool need_sync;
+  uint8_t bits;
+  size_t pos;
+  uint8_t buf[SL2_TRACE_CHUNK_SIZE];
+};
+
+typedef std::map<app_pc, sl2_trace_block *, std::less<app_pc>,
+                 sl2_bump_allocator<std::pair<const app_pc, sl2_trace_block *>>>
+    sl2_trace_block_map;
+
+/*! TLS slot holding each thread's sl2_trace_thread */
+static int trace_tls_idx = -1;
+/*! The trace file */
+static file_t trace_file = INVALID_FILE;
+
+/*! Guards the block map, the thread list, and the active output buffer */
+static void *trace_lock = NULL;
+/*! Holds the block map and the blocks in it, none of which are freed until the trace is closed */
+static sl2_bump_arena *trace_arena = NULL;
+/*! Every block that we've described to the trace, by start address */
+static sl2_trace_block_map *trace_blocks = NULL;
+static uint32_t next_block_id = 1;
+/*! Every live thread's encoder state, so that we can flush them all at exit */
+static std::vector<sl2_trace_thread *, sl2_slab_allocator<sl2_trace_thread *>> trace_threads;
+
+/*! The writer's two output buffers; threads fill `write_bufs[active_buf]` */
+static uint8_t *write_bufs[2] = {NULL, NULL};
+static int active_buf = 0;
+static size_t active_fill = 0;
+/*! The buffer that the writer thread is (or is about to be) writing out */
+static uint8_t *pending_buf = NULL;
+static size_t pending_size = 0;
+/*! Signaled when there's a pending buffer, and when the writer thread is idle, respectively */
+static void *pending_event = NULL;
+static void *idle_event = NULL;
+/*! Signaled by the writer thread just before it exits */
+static void *stopped_event = NULL;
+static volatile bool writer_stopping = false;
+static bool writer_running = false;
+
+/**
+ * Writes a varint (LEB128) to a buffer.
+ * @return the number of bytes written
+ */
+static size_t put_varint(uint8_t *out, uint64_t value) {
+  size_t n = 0;
+
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    out[n++] = byte | (value ? 0x80 : 0);
+  } while (value);
+
+  return n;
+}
+
+/**
+ * Waits for buffers to fill, and writes them out to the trace file.
+ */
+static void trace_writer(void *arg) {
+  while (true) {
+    dr_event_wait(pending_event);
+    dr_event_reset(pending_event);
+
+    if (writer_stopping) {
+      break;
+    }
+
+    dr_write_file(trace_file, pending_buf, pending_size);
+    dr_event_signal(idle_event);
+  }
+
+  dr_event_signal(stopped_event);
+}
+
+/**
+ * Copies a record into the active output buffer, handing the buffer off to the writer thread
+ * (and switching to the other one) first if it's full. The caller must hold trace_lock.
+ * @param record the record, including its size prefix
+ * @param size the size of the record
+ */
+static void submit_record_locked(const uint8_t *record, size_t size) {
+  if (active_fill + size > SL2_TRACE_WRITE_SIZE) {
+    // NOTE(ww): This only blocks if the writer hasn't caught up with the other buffer yet.
+    dr_event_wait(idle_event);
+    dr_event_reset(idle_event);
+
+    pending_buf = write_bufs[active_buf];
+    pending_size = active_fill;
+    dr_event_signal(pending_event);
+
+    active_buf ^= 1;
+    active_fill = 0;
+  }
+
+  memcpy(write_bufs[active_buf] + active_fill, record, size);
+  active_fill += size;
+}
+
+/**
+ * Like submit_record_locked, but takes trace_lock itself.
+ */
+static void submit_record(const uint8_t *record, size_t size) {
+  dr_mutex_lock(trace_lock);
+  submit_record_locked(record, size);
+  dr_mutex_unlock(trace_lock);
+}
+
+/** Emits a thread's pending taken/not-taken bits, if it has any. */
+static void flush_bits(sl2_trace_thread *thread) {
+  if (thread->bits) {
+    thread->buf[thread->pos++] = thread->bits;
+    thread->bits = 0;
+  }
+}
+
+/**
+ * Records a taken/not-taken bit. Bits are packed (oldest first) beneath a leading sentinel bit,
+ * six to a byte, so that a bits byte is always below 0x80 and never 0.
+ */
+static void put_bit(sl2_trace_thread *thread, bool taken) {
+  if (!thread->bits) {
+    thread->bits = 1;
+  }
+
+  thread->bits = (uint8_t)((thread->bits << 1) | taken);
+
+  if (thread->bits & 0x40) {
+    flush_bits(thread);
+  }
+}
+
+/**
+ * Finishes a thread's current chunk and submits it to the writer. The next block the thread
+ * executes starts a new chunk with an escape, so that the chunk can be decoded on its own.
+ */
+static void flush_chunk(sl2_trace_thread *thread) {
+  flush_bits(thread);
+
+  if (thread->blocks) {
+    uint8_t *header = thread->buf;
+    uint32_t size = (uint32_t)(thread->pos - 4);
+
+    memcpy(header, &size, sizeof(size));
+    header[4] = (uint8_t)TraceRecord::Chunk;
+    memcpy(header + 5, &thread->thread_id, sizeof(thread->thread_id));
+    memcpy(header + 9, &thread->blocks, sizeof(thread->blocks));
+    memcpy(header + 13, &thread->chunk_target, sizeof(thread->chunk_target));
+
+    submit_record(thread->buf, thread->pos);
+  }
+
+  thread->pos = SL2_TRACE_CHUNK_HEADER;
+  thread->blocks = 0;
+  thread->chunk_target = thread->last_target;
+  thread->need_sync = true;
+}
+
+/**
+ * Gets a thread's encoder state, creating it on first use.
+ * @param drcontext the thread's DynamoRIO context
+ */
+static sl2_trace_thread *get_trace_thread(void *drcontext) {
+  sl2_trace_thread *thread = (sl2_trace_thread *)drmgr_get_tls_field(drcontext, trace_tls_idx);
+
+  if (!thread) {
+    thread = (sl2_trace_thread *)dr_thread_alloc(drcontext, sizeof(sl2_trace_thread));
+    memset(thread, 0, offsetof(sl2_trace_thread, buf));
+    thread->thread_id = (uint32_t)dr_get_thread_id(drcontext);
+    thread->pos = SL2_TRACE_CHUNK_HEADER;
+    thread->need_sync = true;
+    drmgr_set_tls_field(drcontext, trace_tls_idx, thread);
+
+    dr_mutex_lock(trace_lock);
+    trace_threads.push_back(thread);
+    dr_mutex_unlock(trace_lock);
+  }
+
+  return thread;
+}
+
+static void on_trace_thread_exit(void *drcontext) {
+  sl2_trace_thread *thread = (sl2_trace_thread *)drmgr_get_tls_field(drcontext, trace_tls_idx);
+
+  if (!thread) {
+    return;
+  }
+
+  flush_chunk(thread);
+
+  dr_mutex_lock(trace_lock);
+  for (auto it = trace_threads.begin(); it != trace_threads.end(); it++) {
+    if (*it == thread) {
+      trace_threads.erase(it);
+      break;
+    }
+  }
+  dr_mutex_unlock(trace_lock);
+
+  drmgr_set_tls_field(drcontext, trace_tls_idx, NULL);
+  dr_thread_free(drcontext, thread, sizeof(sl2_trace_thread));
+}
+
+/**
+ * Called at the top of every block. Encodes the transfer from the thread's previous block.
+ * @param cur the block being entered
+ */
+static void trace_block(sl2_trace_block *cur) {
+  sl2_trace_thread *thread = get_trace_thread(dr_get_current_drcontext());
+  sl2_trace_block *prev = thread->prev;
+  bool escape = !prev || thread->need_sync;
+
+  if (thread->pos > SL2_TRACE_CHUNK_SIZE - SL2_TRACE_TOKEN_MAX) {
+    flush_chunk(thread);
+    escape = true;
+  }
+
+  if (!escape) {
+    switch (prev->kind) {
+    case TraceBlockKind::Direct:
+      escape = cur->start != prev->taken;
+      break;
+    case TraceBlockKind::Conditional:
+      if (cur->start == prev->taken) {
+        put_bit(thread, true);
+      } else if (cur->start == prev->fallthrough) {
+        put_bit(thread, false);
+      } else {
+        escape = true;
+      }
+      break;
+    case TraceBlockKind::Indirect: {
+      int64_t delta = (int64_t)((uint64_t)cur->start - thread->last_target);
+
+      flush_bits(thread);
+      thread->buf[thread->pos++] = (uint8_t)TraceToken::Indirect;
+      thread->pos +=
+          put_varint(thread->buf + thread->pos, (uint64_t)((delta << 1) ^ (delta >> 63)));
+      thread->last_target = (uint64_t)cur->start;
+      break;
+    }
+    }
+  }
+
+  if (escape) {
+    flush_bits(thread);
+    thread->buf[thread->pos++] = (uint8_t)TraceToken::Escape;
+    thread->pos += put_varint(thread->buf + thread->pos, prev ? prev->id : 0);
+    thread->pos += put_varint(thread->buf + thread->pos, cur->id);
+    thread->need_sync = false;
+  }
+
+  thread->prev = cur;
+  thread->blocks++;
+}
+
+/**
+ * Finds (or creates, and describes to the trace) the block for a basic block's instructions.
+ * @return the block
+ */
+static sl2_trace_block *define_block(void *drcontext, app_pc start, instrlist_t *bb) {
+  instr_t *last = instrlist_last_app(bb);
+
+  if (!last) {
+    return NULL;
+  }
+
+  sl2_trace_block block = {0};
+  block.start = start;
+  block.fallthrough = instr_get_app_pc(last) + instr_length(drcontext, last);
+  block.taken = block.fallthrough;
+  block.kind = TraceBlockKind::Direct;
+
+  if (instr_is_cbr(last) || instr_is_ubr(last) || instr_is_call_direct(last)) {
+    opnd_t target = instr_get_target(last);
+
+    if (opnd_is_pc(target)) {
+      block.taken = opnd_get_pc(target);
+    }
+
+    if (instr_is_cbr(last)) {
+      block.kind = TraceBlockKind::Conditional;
+    }
+  } else if (instr_is_mbr(last)) {
+    block.kind = TraceBlockKind::Indirect;
+  }
+
+  dr_mutex_lock(trace_lock);
+
+  // NOTE(ww): DR rebuilds blocks when it builds traces and when it translates faults, so
+  // most of the time we've already seen this one.
+  sl2_trace_block_map::iterator it = trace_blocks->find(start);
+  sl2_trace_block *found = it != trace_blocks->end() ? it->second : NULL;
+
+  if (found && found->kind == block.kind && found->taken == block.taken &&
+      found->fallthrough == block.fallthrough) {
+    dr_mutex_unlock(trace_lock);
+    return found;
+  }
+
+  // NOTE: A block that gets redescribed is left in the arena, since instrumentation built for
+  // the old version may still refer to it.
+  sl2_trace_block *created =
+      (sl2_trace_block *)trace_arena->alloc(sizeof(sl2_trace_block), alignof(sl2_trace_block));
+  *created = block;
+  created->id = next_block_id++;
+  (*trace_blocks)[start] = created;
+
+  uint8_t record[64];
+  size_t pos = 4;
+  record[pos++] = (uint8_t)TraceRecord::Block;
+  pos += put_varint(record + pos, created->id);
+  memcpy(record + pos, &created->start, sizeof(uint64_t));
+  memcpy(record + pos + 8, &created->taken, sizeof(uint64_t));
+  memcpy(record + pos + 16, &created->fallthrough, sizeof(uint64_t));
+  pos += 24;
+  record[pos++] = (uint8_t)created->kind;
+
+  uint32_t size = (uint32_t)(pos - 4);
+  memcpy(record, &size, sizeof(size));
+
+  // Blocks are always described before any chunk that refers to them can be submitted: the
+  // description goes out before trace_lock is released, and no other thread can see the block
+  // until then.
+  submit_record_locked(record, pos);
+
+  dr_mutex_unlock(trace_lock);
+
+  return created;
+}
+
+static dr_emit_flags_t on_trace_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
+                                            bool for_trace, bool translating,
+                                            OUT void **user_data) {
+  *user_data = define_block(drcontext, dr_fragment_app_pc(tag), bb);
+  return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t on_trace_bb_insert(void *drcontext, void *tag, instrlist_t *bb,
+                                          instr_t *instr, bool for_trace, bool translating,
+                                          void *user_data) {
+  if (!user_data || !drmgr_is_first_instr(drcontext, instr)) {
+    return DR_EMIT_DEFAULT;
+  }
+
+  dr_insert_clean_call(drcontext, bb, instr, (void *)trace_block, false, 1,
+                       OPND_CREATE_INTPTR(user_data));
+
+  return DR_EMIT_DEFAULT;
+}
+
+/**
+ * Stops the writer thread, if it's running, and waits for it to exit.
+ */
+static void stop_writer() {
+  if (!writer_running) {
+    return;
+  }
+
+  writer_stopping = true;
+  dr_event_signal(pending_event);
+  dr_event_wait(stopped_event);
+  writer_running = false;
+}
+
+/**
+ * Stops the writer thread and releases everything sl2_trace_init set up, however far it got.
+ */
+static void trace_cleanup() {
+  stop_writer();
+
+  if (trace_file != INVALID_FILE) {
+    dr_close_file(trace_file);
+    trace_file = INVALID_FILE;
+  }
+
+  if (trace_tls_idx != -1) {
+    drmgr_unregister_tls_field(trace_tls_idx);
+    trace_tls_idx = -1;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    if (write_bufs[i]) {
+      dr_global_free(write_bufs[i], SL2_TRACE_WRITE_SIZE);
+      write_bufs[i] = NULL;
+    }
+  }
+
+  // NOTE: The block map lives in the arena too, and its nodes are never freed one at a time,
+  // so there's nothing to destroy before releasing the whole thing.
+  if (trace_arena) {
+    trace_blocks = NULL;
+    trace_arena->~sl2_bump_arena();
+    sl2_slab_free(trace_arena, sizeof(sl2_bump_arena));
+    trace_arena = NULL;
+  }
+
+  void **events[] = {&pending_event, &idle_event, &stopped_event};
+  for (void **event : events) {
+    if (*event) {
+      dr_event_destroy(*event);
+      *event = NULL;
+    }
+  }
+
+  if (trace_lock) {
+    dr_mutex_destroy(trace_lock);
+    trace_lock = NULL;
+  }
+}
+
+/**
+ * Opens the trace file, and starts tracing every block that gets built from here on.
+ * @param path the trace file's path
+ * @return whether initialization succeeded
+ */
+bool sl2_trace_init(const char *path) {
+  trace_file = dr_open_file(path, DR_FILE_WRITE_OVERWRITE);
+
+  if (trace_file == INVALID_FILE) {
+    dr_fprintf(STDERR, "sl2_trace: couldn't open %s\n", path);
+    return false;
+  }
+
+  uint32_t header[2] = {SL2_TRACE_MAGIC, SL2_TRACE_VERSION};
+  dr_write_file(trace_file, header, sizeof(header));
+
+  trace_lock = dr_mutex_create();
+  trace_arena = new (sl2_slab_alloc(sizeof(sl2_bump_arena))) sl2_bump_arena();
+  trace_blocks =
+      new (trace_arena->alloc(sizeof(sl2_trace_block_map), alignof(sl2_trace_block_map)))
+          sl2_trace_block_map(sl2_trace_block_map::allocator_type(trace_arena));
+  write_bufs[0] = (uint8_t *)dr_global_alloc(SL2_TRACE_WRITE_SIZE);
+  write_bufs[1] = (uint8_t *)dr_global_alloc(SL2_TRACE_WRITE_SIZE);
+  pending_event = dr_event_create();
+  idle_event = dr_event_create();
+  stopped_event = dr_event_create();
+  dr_event_signal(idle_event);
+
+  trace_tls_idx = drmgr_register_tls_field();
+
+  if (trace_tls_idx == -1 || !dr_create_client_thread(trace_writer, NULL)) {
+    trace_cleanup();
+    return false;
+  }
+
+  writer_running = true;
+
+  if (!drmgr_register_thread_exit_event(on_trace_thread_exit)) {
+    trace_cleanup();
+    return false;
+  }
+
+  if (!drmgr_register_bb_instrumentation_event(on_trace_bb_analysis, on_trace_bb_insert, NULL)) {
+    drmgr_unregister_thread_exit_event(on_trace_thread_exit);
+    trace_cleanup();
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Flushes every thread's chunk, waits for the writer thread, and closes the trace file.
+ * Must be called before drmgr_exit.
+ */
+void sl2_trace_exit() {
+  if (trace_tls_idx == -1) {
+    return;
+  }
+
+  drmgr_unregister_bb_instrumentation_event(on_trace_bb_analysis);
+  drmgr_unregister_thread_exit_event(on_trace_thread_exit);
+
+  // NOTE(ww): The other application threads are suspended by now, so their chunks are stable.
+  while (!trace_threads.empty()) {
+    flush_chunk(trace_threads.back());
+    trace_threads.pop_back();
+  }
+
+  dr_mutex_lock(trace_lock);
+  dr_event_wait(idle_event);
+  dr_write_file(trace_file, write_bufs[active_buf], active_fill);
+  active_fill = 0;
+  dr_mutex_unlock(trace_lock);
+
+  trace_cleanup();
+}
+
+/**
+ * Describes a module's address range to the trace, so that readers can symbolize blocks.
+ */
+void sl2_trace_module(const module_data_t *mod) {
+  if (trace_file == INVALID_FILE) {
+    return;
+  }
+
+  const char *name = dr_module_preferred_name(mod);
+
+  if (!name) {
+    name = "";
+  }
+
+  uint16_t name_len = (uint16_t)strnlen(name, MAX_PATH);
+  uint8_t record[4 + 1 + 16 + 2 + MAX_PATH];
+  size_t pos = 4;
+
+  record[pos++] = (uint8_t)TraceRecord::Module;
+  memcpy(record + pos, &mod->start, sizeof(uint64_t));
+  memcpy(record + pos + 8, &mod->end, sizeof(uint64_t));
+  memcpy(record + pos + 16, &name_len, sizeof(name_len));
+  pos += 18;
+  memcpy(record + pos, name, name_len);
+  pos += name_len;
+
+  uint32_t size = (uint32_t)(pos - 4);
+  memcpy(record, &size, sizeof(size));
+
+  submit_record(record, pos);
+}
+
+/**
+ * Marks the calling thread as the one that crashed, after flushing its chunk.
+ * @param drcontext the crashing thread's DynamoRIO context
+ */
+void sl2_trace_crash(void *drcontext) {
+  if (trace_file == INVALID_FILE) {
+    return;
+  }
+
+  sl2_trace_thread *thread = get_trace_thread(drcontext);
+  flush_chunk(thread);
+
+  uint8_t record[4 + 1 + 4];
+  uint32_t size = 1 + 4;
+
+  memcpy(record, &size, sizeof(size));
+  record[4] = (uint8_t)TraceRecord::Crash;
+  memcpy(record + 5, &thread->thread_id, sizeof(thread->thread_id));
+
+  submit_record(record, sizeof(record));
+}
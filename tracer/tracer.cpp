@@ -1,5 +1,6 @@
+#include <algorithm>
 #include <map>
-#include <set>
+#include <vector>
 
 #include "vendor/picosha2.h"
 
@@ -8,6 +9,8 @@ extern "C" {
 }
 
 #include "server.hpp"
+#include "tracer_taint.hpp"
+#include "tracer_trace.hpp"
 
 #include "common/sl2_server_api.hpp"
 #include "common/sl2_dr_client.hpp"
@@ -24,11 +27,12 @@ static bool replay = false;
 static bool no_mutate = false;
 static bool crashed = false;
 static uint32_t mutate_count = 0;
-
-/*! Set that tracks over time which registers have become tainted */
-static std::set<reg_id_t, std::less<reg_id_t>, sl2_dr_allocator<reg_id_t>> tainted_regs;
-/*! Set that tracks over time which memory addresses have become tainted */
-static std::set<app_pc, std::less<app_pc>, sl2_dr_allocator<app_pc>> tainted_mems;
+/*! Whether to instrument every instruction for taint propagation */
+static bool taint_instructions = true;
+/*! The first targeted read (by mutation count) whose input gets tainted */
+static uint32_t taint_from = 0;
+/*! Identifies the crash, for the harness' deduplication */
+static std::string crash_fingerprint;
 
 #define LAST_COUNT 5 // WARNING: If you change this, you need to update the database schema
 
@@ -58,6 +62,113 @@ static droption_t<std::string> op_replay(DROPTION_SCOPE_CLIENT, "r", "", "replay
 static droption_t<bool> op_no_mutate(DROPTION_SCOPE_CLIENT, "nm", false, "no-mutate",
                                      "Don't use the mutated buffer when replaying.");
 
+/** Track which input bytes each tainted byte and register came from, not just whether it's tainted */
+static droption_t<bool> op_taint_labels(DROPTION_SCOPE_CLIENT, "taint_labels", false,
+                                        "Track byte provenance",
+                                        "Label each tainted byte with the input offsets it was "
+                                        "derived from, and report them in the crash JSON.");
+
+/**
+ * Tier 0 of a tiered replay: replay the mutations with no instruction-level instrumentation at
+ * all, just to confirm that the crash reproduces and to fingerprint it.
+ */
+static droption_t<bool> op_confirm(DROPTION_SCOPE_CLIENT, "confirm", false,
+                                   "Confirm the crash without taint",
+                                   "Replay without taint tracking, and report only whether the "
+                                   "target crashed and a fingerprint of the crash.");
+
+/**
+ * Tier 1 of a tiered replay: only taint the input from the later targeted reads, since the
+ * earlier ones rarely matter to the crash.
+ */
+static droption_t<unsigned int> op_taint_from(DROPTION_SCOPE_CLIENT, "taint_from", 0,
+                                              "First read to taint",
+                                              "Only taint the input from this targeted read "
+                                              "(counting from 0) onwards.");
+
+/** Record a compressed trace of every block executed, for reconstructing the path to the crash */
+static droption_t<bool> op_branch_trace(DROPTION_SCOPE_CLIENT, "branch_trace", false,
+                                        "Record a branch trace",
+                                        "Record a compressed per-thread branch trace of the "
+                                        "replay in the run's execution.trc.");
+
+/**
+ * Write the old full-memory minidumps instead of triage-sized ones. Triage only reads a sliver of
+ * the process, but a full dump is still the thing to have when debugging a crash by hand.
+ */
+static droption_t<bool> op_full_dump(DROPTION_SCOPE_CLIENT, "full_dump", false,
+                                     "Write full-memory minidumps",
+                                     "Write every page of the target's memory into the crash's "
+                                     "minidump, instead of only what triage reads.");
+
+/** Caps the memory that a triage-sized minidump captures beyond the crashing thread's stack */
+static droption_t<unsigned int> op_dump_cap(DROPTION_SCOPE_CLIENT, "dump_cap", 32,
+                                            "Triage-sized minidump memory cap, in MB",
+                                            "The most memory, in megabytes, that a triage-sized "
+                                            "minidump captures around registers and tainted "
+                                            "ranges. 0 means no cap.");
+
+/** The bulk effects on taint that SL2_TAINT_MODEL_TABLE can give a function. */
+enum class TaintModel {
+  Copy,    // (dst, src, size): dst takes on src's taint
+  Fill,    // (dst, value, size): dst takes on value's taint
+  RtlFill, // (dst, size, value): as above, with RtlFillMemory's argument order
+  Zero,    // (dst, size): dst is untainted
+  Strlen,  // (str): the return value takes on the taint of the string, including its terminator
+  Strcpy,  // (dst, src): dst takes on src's taint, up to and including src's terminator
+};
+
+/** A function whose effect on taint is applied all at once, instead of instruction-by-instruction */
+struct sl2_taint_model {
+  const char *func;
+  const char *mod;
+  TaintModel model;
+};
+
+/** Maps hot library routines (and the DLLs we expect them in) to their taint models */
+static sl2_taint_model SL2_TAINT_MODEL_TABLE[] = {
+    {"memcpy", "VCRUNTIME140.DLL", TaintModel::Copy},
+    {"memcpy", "VCRUNTIME140D.DLL", TaintModel::Copy},
+    {"memcpy", "MSVCRT.DLL", TaintModel::Copy},
+    {"memcpy", "NTDLL.DLL", TaintModel::Copy},
+    {"memmove", "VCRUNTIME140.DLL", TaintModel::Copy},
+    {"memmove", "VCRUNTIME140D.DLL", TaintModel::Copy},
+    {"memmove", "MSVCRT.DLL", TaintModel::Copy},
+    {"memmove", "NTDLL.DLL", TaintModel::Copy},
+    {"RtlMoveMemory", "NTDLL.DLL", TaintModel::Copy},
+    {"memset", "VCRUNTIME140.DLL", TaintModel::Fill},
+    {"memset", "VCRUNTIME140D.DLL", TaintModel::Fill},
+    {"memset", "MSVCRT.DLL", TaintModel::Fill},
+    {"memset", "NTDLL.DLL", TaintModel::Fill},
+    {"RtlFillMemory", "NTDLL.DLL", TaintModel::RtlFill},
+    {"RtlZeroMemory", "NTDLL.DLL", TaintModel::Zero},
+    {"strlen", "UCRTBASE.DLL", TaintModel::Strlen},
+    {"strlen", "UCRTBASED.DLL", TaintModel::Strlen},
+    {"strlen", "MSVCRT.DLL", TaintModel::Strlen},
+    {"strlen", "NTDLL.DLL", TaintModel::Strlen},
+    {"strcpy", "UCRTBASE.DLL", TaintModel::Strcpy},
+    {"strcpy", "UCRTBASED.DLL", TaintModel::Strcpy},
+    {"strcpy", "MSVCRT.DLL", TaintModel::Strcpy},
+    {"strcpy", "NTDLL.DLL", TaintModel::Strcpy},
+};
+
+#define SL2_TAINT_MODEL_TABLE_SIZE (sizeof(SL2_TAINT_MODEL_TABLE) / sizeof(SL2_TAINT_MODEL_TABLE[0]))
+
+/** The state that a modeled call carries from its pre-hook to its post-hook */
+struct sl2_taint_model_call {
+  const sl2_taint_model *model;
+  app_pc dst;
+  app_pc src;
+  bool ret_tainted;
+  sl2_label ret_label;
+};
+
+/** The caller-saved registers, whose taint is meaningless once a modeled call returns */
+static const reg_id_t SL2_TAINT_VOLATILE_REGS[] = {
+    DR_REG_RAX,  DR_REG_RCX,  DR_REG_RDX,  DR_REG_R8,   DR_REG_R9,   DR_REG_R10,  DR_REG_R11,
+    DR_REG_XMM0, DR_REG_XMM1, DR_REG_XMM2, DR_REG_XMM3, DR_REG_XMM4, DR_REG_XMM5,
+};
+
 /** Currently unused as this runs on 64 bit applications */
 static reg_id_t reg_to_full_width32(reg_id_t reg) {
   switch (reg) {
@@ -162,15 +273,29 @@ static reg_id_t reg_to_full_width64(reg_id_t reg) {
   }
 }
 
-/** Check whether and operand is tainted */
-static bool is_tainted(void *drcontext, opnd_t opnd) {
+/**
+ * Check whether an operand is tainted.
+ * @param drcontext DynamoRIO context
+ * @param opnd the operand to check
+ * @param label if non-NULL, every tainted part of the operand is checked (rather than stopping at
+ *        the first), and their labels are combined into *label
+ * @return whether any part of the operand is tainted
+ */
+static bool is_tainted(void *drcontext, opnd_t opnd, sl2_label *label = NULL) {
+  bool tainted = false;
+
   if (opnd_is_reg(opnd)) {
-    /** Check if a register is in tainted_regs */
+    /** Check if a register is tainted on this thread */
     reg_id_t reg = opnd_get_reg(opnd);
     reg = reg_to_full_width64(reg);
 
-    if (tainted_regs.find(reg) != tainted_regs.end()) {
-      return true;
+    if (sl2_taint_reg_is_tainted(drcontext, reg)) {
+      if (!label) {
+        return true;
+      }
+
+      tainted = true;
+      *label = sl2_taint_union(*label, sl2_taint_reg_label(drcontext, reg));
     }
   } else if (opnd_is_memory_reference(opnd)) {
     dr_mcontext_t mc = {sizeof(mc), DR_MC_ALL};
@@ -180,31 +305,35 @@ static bool is_tainted(void *drcontext, opnd_t opnd) {
     /* Check if a memory region overlaps a tainted address */
     opnd_size_t dr_size = opnd_get_size(opnd);
     uint size = opnd_size_in_bytes(dr_size);
-    for (uint i = 0; i < size; i++) {
-      if (tainted_mems.find(addr + i) != tainted_mems.end()) {
+    if (sl2_taint_mem_is_tainted(addr, size)) {
+      if (!label) {
         return true;
       }
+
+      tainted = true;
+      *label = sl2_taint_union(*label, sl2_taint_mem_label(addr, size));
     }
 
     /* Check if a register used in calculating an address is tainted */
+    // NOTE(ww): The displacement is an immediate, not a register, so there's nothing to check.
     if (opnd_is_base_disp(opnd)) {
-      reg_id_t reg_base = opnd_get_base(opnd);
-      reg_id_t reg_disp = opnd_get_disp(opnd);
-      reg_id_t reg_indx = opnd_get_index(opnd);
+      reg_id_t addr_regs[2] = {opnd_get_base(opnd), opnd_get_index(opnd)};
 
-      if (reg_base != NULL &&
-          tainted_regs.find(reg_to_full_width64(reg_base)) != tainted_regs.end()) {
-        return true;
-      }
+      for (int i = 0; i < 2; i++) {
+        if (addr_regs[i] == DR_REG_NULL) {
+          continue;
+        }
 
-      if (reg_disp != NULL &&
-          tainted_regs.find(reg_to_full_width64(reg_disp)) != tainted_regs.end()) {
-        return true;
-      }
+        reg_id_t reg = reg_to_full_width64(addr_regs[i]);
 
-      if (reg_indx != NULL &&
-          tainted_regs.find(reg_to_full_width64(reg_indx)) != tainted_regs.end()) {
-        return true;
+        if (sl2_taint_reg_is_tainted(drcontext, reg)) {
+          if (!label) {
+            return true;
+          }
+
+          tainted = true;
+          *label = sl2_taint_union(*label, sl2_taint_reg_label(drcontext, reg));
+        }
       }
     }
   }
@@ -213,38 +342,17 @@ static bool is_tainted(void *drcontext, opnd_t opnd) {
   // } else if(opnd_is_abs_addr(opnd)) {
   //     opnd_get_addr(opnd);
   // }
-  return false;
+  return tainted;
 }
 
-/** Mark a memory address as tainted */
-static void taint_mem(app_pc addr, size_t size) {
-  for (size_t i = 0; i < size; i++) {
-    tainted_mems.insert(addr + i);
-  }
-}
-
-/** Unmark a memory address as tainted */
-static bool untaint_mem(app_pc addr, uint size) {
-  bool untainted = false;
-  for (uint i = 0; i < size; i++) {
-    size_t n = tainted_mems.erase(addr + i);
-    if (n) {
-      untainted = true;
-    }
-    if (untainted) {
-      // TODO(ww): Why is this branch here?
-    }
-  }
-  return untainted;
-}
-
-/** Mark an operand as tainted. Could be a register or memory reference. */
-static void taint(void *drcontext, opnd_t opnd) {
+/** Mark an operand as tainted (with the given label, in label mode). Could be a register or memory
+ * reference. */
+static void taint(void *drcontext, opnd_t opnd, sl2_label label = 0) {
   if (opnd_is_reg(opnd)) {
     reg_id_t reg = opnd_get_reg(opnd);
     reg = reg_to_full_width64(reg);
 
-    tainted_regs.insert(reg);
+    sl2_taint_reg_set(drcontext, reg, label);
 
     // char buf[100];
     // opnd_disassemble_to_buffer(drcontext, opnd, buf, 100);
@@ -257,8 +365,7 @@ static void taint(void *drcontext, opnd_t opnd) {
     opnd_size_t dr_size = opnd_get_size(opnd);
     // opnd size in bytes
     uint size = opnd_size_in_bytes(dr_size);
-    // loop insert
-    taint_mem(addr, size);
+    sl2_taint_mem_set(addr, size, label);
   }
   // else if(opnd_is_pc(opnd)) {
   //     opnd_get_pc(opnd);
@@ -276,12 +383,7 @@ static bool untaint(void *drcontext, opnd_t opnd) {
     reg_id_t reg = opnd_get_reg(opnd);
     reg = reg_to_full_width64(reg);
 
-    size_t n = tainted_regs.erase(reg);
-    if (n) {
-      // char buf[100];
-      // opnd_disassemble_to_buffer(drcontext, opnd, buf, 100);
-      untainted = true;
-    }
+    untainted = sl2_taint_reg_clear(drcontext, reg);
   } else if (opnd_is_memory_reference(opnd)) {
     dr_mcontext_t mc = {sizeof(mc), DR_MC_ALL};
     dr_get_mcontext(drcontext, &mc);
@@ -291,8 +393,7 @@ static bool untaint(void *drcontext, opnd_t opnd) {
     opnd_size_t dr_size = opnd_get_size(opnd);
     // opnd size in bytes
     uint size = opnd_size_in_bytes(dr_size);
-    // loop insert
-    untainted = untaint_mem(addr, size);
+    untainted = sl2_taint_mem_clear(addr, size);
   }
   // else if(opnd_is_pc(opnd)) {
   //     opnd_get_pc(opnd);
@@ -317,11 +418,7 @@ static bool handle_xor(void *drcontext, instr_t *instr) {
       reg_id_t reg_1 = reg_to_full_width64(opnd_get_reg(opnd_1));
 
       if (reg_0 == reg_1) {
-        size_t n = tainted_regs.erase(reg_0);
-        // if(n) {
-        //     char buf[100];
-        //     opnd_disassemble_to_buffer(drcontext, opnd_0, buf, 100);
-        // }
+        sl2_taint_reg_clear(drcontext, reg_0);
         result = true;
       }
     }
@@ -334,11 +431,13 @@ static bool handle_xor(void *drcontext, instr_t *instr) {
 static void handle_push_pop(void *drcontext, instr_t *instr) {
   int src_count = instr_num_srcs(instr);
   bool tainted = false;
+  sl2_label label = 0;
+  sl2_label *labelp = sl2_taint_labels_enabled() ? &label : NULL;
 
   // check sources for taint
-  for (int i = 0; i < src_count && !tainted; i++) {
+  for (int i = 0; i < src_count && (!tainted || labelp); i++) {
     opnd_t opnd = instr_get_src(instr, i);
-    tainted |= is_tainted(drcontext, opnd);
+    tainted |= is_tainted(drcontext, opnd, labelp);
   }
 
   // if tainted
@@ -355,7 +454,7 @@ static void handle_push_pop(void *drcontext, instr_t *instr) {
       }
     }
 
-    taint(drcontext, opnd);
+    taint(drcontext, opnd, label);
   }
 
   // if not tainted
@@ -395,16 +494,18 @@ static bool handle_xchg(void *drcontext, instr_t *instr) {
       reg_id_t reg_0 = reg_to_full_width64(opnd_get_reg(opnd_0));
       reg_id_t reg_1 = reg_to_full_width64(opnd_get_reg(opnd_1));
 
-      bool reg_0_tainted = tainted_regs.find(reg_0) != tainted_regs.end();
-      bool reg_1_tainted = tainted_regs.find(reg_1) != tainted_regs.end();
+      bool reg_0_tainted = sl2_taint_reg_is_tainted(drcontext, reg_0);
+      bool reg_1_tainted = sl2_taint_reg_is_tainted(drcontext, reg_1);
 
       if (reg_0_tainted && !reg_1_tainted) {
-        tainted_regs.erase(reg_0);
-        tainted_regs.insert(reg_1);
+        sl2_label label = sl2_taint_reg_label(drcontext, reg_0);
+        sl2_taint_reg_clear(drcontext, reg_0);
+        sl2_taint_reg_set(drcontext, reg_1, label);
         result = true;
       } else if (reg_1_tainted && !reg_0_tainted) {
-        tainted_regs.erase(reg_1);
-        tainted_regs.insert(reg_0);
+        sl2_label label = sl2_taint_reg_label(drcontext, reg_1);
+        sl2_taint_reg_clear(drcontext, reg_1);
+        sl2_taint_reg_set(drcontext, reg_0, label);
         result = true;
       }
     }
@@ -427,7 +528,7 @@ static bool handle_branches(void *drcontext, instr_t *instr) {
 
   reg_id_t reg_pc = reg_to_full_width64(DR_REG_NULL);
   reg_id_t reg_stack = reg_to_full_width64(DR_REG_ESP);
-  bool pc_tainted = tainted_regs.find(reg_pc) != tainted_regs.end();
+  bool pc_tainted = sl2_taint_reg_is_tainted(drcontext, reg_pc);
 
   bool result = false;
   int src_count = instr_num_srcs(instr);
@@ -440,7 +541,7 @@ static bool handle_branches(void *drcontext, instr_t *instr) {
       for (int i = 0; i < dst_count; i++) {
         opnd_t opnd = instr_get_dst(instr, i);
         if (opnd_is_memory_reference(opnd)) {
-          taint(drcontext, opnd);
+          taint(drcontext, opnd, sl2_taint_reg_label(drcontext, reg_pc));
           break;
         }
       }
@@ -451,7 +552,7 @@ static bool handle_branches(void *drcontext, instr_t *instr) {
   if (is_direct) {
     if (pc_tainted) {
       // untaint pc
-      tainted_regs.erase(reg_pc);
+      sl2_taint_reg_clear(drcontext, reg_pc);
     }
   }
 
@@ -462,9 +563,9 @@ static bool handle_branches(void *drcontext, instr_t *instr) {
 
       if (opnd_is_reg(opnd)) {
         reg_id_t reg = reg_to_full_width64(opnd_get_reg(opnd));
-        if (reg != reg_stack && tainted_regs.find(reg) != tainted_regs.end()) {
+        if (reg != reg_stack && sl2_taint_reg_is_tainted(drcontext, reg)) {
           // taint pc
-          tainted_regs.insert(reg_pc);
+          sl2_taint_reg_set(drcontext, reg_pc, sl2_taint_reg_label(drcontext, reg));
         }
       }
     }
@@ -475,23 +576,86 @@ static bool handle_branches(void *drcontext, instr_t *instr) {
   // ret
   if (is_ret) {
     bool tainted = false;
-    for (int i = 0; i < src_count; i++) {
+    sl2_label label = 0;
+    sl2_label *labelp = sl2_taint_labels_enabled() ? &label : NULL;
+
+    for (int i = 0; i < src_count && (!tainted || labelp); i++) {
       opnd_t opnd = instr_get_src(instr, i);
-      if (is_tainted(drcontext, opnd)) {
-        tainted = true;
-        break;
-      }
+      tainted |= is_tainted(drcontext, opnd, labelp);
     }
 
     if (tainted) {
       // taint pc
-      tainted_regs.insert(reg_pc);
+      sl2_taint_reg_set(drcontext, reg_pc, label);
     } else {
       // untaint pc
-      tainted_regs.erase(reg_pc);
+      sl2_taint_reg_clear(drcontext, reg_pc);
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Applies the whole of a rep movs or rep stos to the shadow at once. Otherwise, we'd only see the
+ * first element's worth of the (single-byte, etc.) memory operands.
+ */
+static bool handle_rep_string(void *drcontext, instr_t *instr) {
+  opnd_t dst = opnd_create_null();
+  opnd_t src = opnd_create_null();
+
+  for (int i = 0; i < instr_num_dsts(instr) && opnd_is_null(dst); i++) {
+    if (opnd_is_memory_reference(instr_get_dst(instr, i))) {
+      dst = instr_get_dst(instr, i);
+    }
+  }
+
+  for (int i = 0; i < instr_num_srcs(instr) && opnd_is_null(src); i++) {
+    if (opnd_is_memory_reference(instr_get_src(instr, i))) {
+      src = instr_get_src(instr, i);
+    }
+  }
+
+  if (opnd_is_null(dst)) {
+    return false;
+  }
+
+  dr_mcontext_t mc = {sizeof(mc), DR_MC_ALL};
+  dr_get_mcontext(drcontext, &mc);
+
+  size_t elem_size = opnd_size_in_bytes(opnd_get_size(dst));
+  size_t size = mc.xcx * elem_size;
+
+  if (!size) {
+    return true;
+  }
+
+  app_pc dst_addr = opnd_compute_address(dst, &mc);
+
+  // With the direction flag set, the instruction walks downwards from its starting operands.
+  bool backward = (mc.xflags & EFLAGS_DF) != 0;
+
+  if (backward) {
+    dst_addr -= size - elem_size;
+  }
+
+  if (instr_get_opcode(instr) == OP_rep_movs && !opnd_is_null(src)) {
+    app_pc src_addr = opnd_compute_address(src, &mc);
+
+    if (backward) {
+      src_addr -= size - elem_size;
     }
+
+    sl2_taint_mem_copy(dst_addr, src_addr, size);
+  } else if (sl2_taint_reg_is_tainted(drcontext, DR_REG_RAX)) {
+    sl2_taint_mem_set(dst_addr, size, sl2_taint_reg_label(drcontext, DR_REG_RAX));
+  } else {
+    sl2_taint_mem_clear(dst_addr, size);
   }
 
+  // The counter always ends up zero.
+  sl2_taint_reg_clear(drcontext, DR_REG_RCX);
+
   return true;
 }
 
@@ -517,6 +681,10 @@ static bool handle_specific(void *drcontext, instr_t *instr) {
   case OP_xchg:
     result = handle_xchg(drcontext, instr);
     return result;
+  case OP_rep_movs:
+  case OP_rep_stos:
+    result = handle_rep_string(drcontext, instr);
+    return result;
   default:
     return false;
   }
@@ -532,11 +700,17 @@ static void propagate_taint(app_pc pc) {
     last_insn_idx %= LAST_COUNT;
   }
 
-  if (tainted_mems.size() == 0 && tainted_regs.size() == 0) {
+  void *drcontext = dr_get_current_drcontext();
+
+  if (!sl2_taint_mem_count() && !sl2_taint_reg_any(drcontext)) {
+    return;
+  }
+
+  // We're inside a modeled function, whose effect on taint has already been applied.
+  if (sl2_taint_suspended(drcontext)) {
     return;
   }
 
-  void *drcontext = dr_get_current_drcontext();
   instr_t instr;
   instr_init(drcontext, &instr);
   decode(drcontext, pc, &instr);
@@ -557,7 +731,7 @@ static void propagate_taint(app_pc pc) {
     }
   }
 
-  // if(tainted_mems.size() > 0) {
+  // if(sl2_taint_mem_count() > 0) {
   //     char buf[100];
   //     instr_disassemble_to_buffer(drcontext, &instr, buf, 100);
   //     dr_printf("%s\n", buf);
@@ -572,17 +746,19 @@ static void propagate_taint(app_pc pc) {
   /* Check if sources are tainted */
   int src_count = instr_num_srcs(&instr);
   bool tainted = false;
+  sl2_label label = 0;
+  sl2_label *labelp = sl2_taint_labels_enabled() ? &label : NULL;
 
-  for (int i = 0; i < src_count && !tainted; i++) {
+  for (int i = 0; i < src_count && (!tainted || labelp); i++) {
     opnd_t opnd = instr_get_src(&instr, i);
-    tainted |= is_tainted(drcontext, opnd);
+    tainted |= is_tainted(drcontext, opnd, labelp);
   }
 
   /* If tainted sources, taint destinations */
   int dst_count = instr_num_dsts(&instr);
   for (int i = 0; i < dst_count && tainted; i++) {
     opnd_t opnd = instr_get_dst(&instr, i);
-    taint(drcontext, opnd);
+    taint(drcontext, opnd, label);
   }
 
   /* If not tainted sources, untaint destinations*/
@@ -637,11 +813,13 @@ static void on_dr_exit(void) {
     j["message"] = "replay did not cause a crash";
   } else {
     j["message"] = "replay caused a crash";
+    j["fingerprint"] = crash_fingerprint;
+    j["mutations"] = mutate_count;
   }
 
   SL2_LOG_JSONL(j);
 
-  if (!op_no_taint.get_value()) {
+  if (taint_instructions) {
     if (!drmgr_unregister_bb_insertion_event(on_bb_instrument)) {
       DR_ASSERT(false);
     }
@@ -654,6 +832,10 @@ static void on_dr_exit(void) {
 
   sl2_conn_close(&sl2_conn);
 
+  client.exit_call_records();
+  sl2_trace_exit();
+  sl2_taint_exit();
+  sl2_slab_exit();
   drmgr_exit();
 }
 
@@ -665,18 +847,8 @@ static void dump_regs(void *drcontext, app_pc exception_address) {
       DR_REG_R12, DR_REG_R13, DR_REG_R14, DR_REG_R15,
   };
 
-  std::set<reg_id_t>::iterator reg_it;
-  for (reg_it = tainted_regs.begin(); reg_it != tainted_regs.end(); reg_it++) {
-    // TODO(ww): Implement.
-  }
-
-  std::set<app_pc>::iterator mem_it;
-  for (mem_it = tainted_mems.begin(); mem_it != tainted_mems.end(); mem_it++) {
-    // TODO(ww): Implement.
-  }
-
   for (int i = 0; i < 16; i++) {
-    bool tainted = tainted_regs.find(regs[i]) != tainted_regs.end();
+    bool tainted = sl2_taint_reg_is_tainted(drcontext, regs[i]);
     dr_mcontext_t mc = {sizeof(mc), DR_MC_ALL};
     dr_get_mcontext(drcontext, &mc);
     if (tainted) {
@@ -686,7 +858,7 @@ static void dump_regs(void *drcontext, app_pc exception_address) {
     }
   }
 
-  bool tainted = tainted_regs.find(DR_REG_NULL) != tainted_regs.end();
+  bool tainted = sl2_taint_reg_is_tainted(drcontext, DR_REG_NULL);
   if (tainted) {
     // TODO(ww): Implement.
   } else {
@@ -694,6 +866,84 @@ static void dump_regs(void *drcontext, app_pc exception_address) {
   }
 }
 
+/**
+ * Resolves a label to the input offsets it was derived from, as JSON.
+ * @param label the label to resolve
+ * @param complete set to false if the label's provenance was too large to resolve completely
+ * @return a list of {read, start, size} objects
+ */
+static json label_to_json(sl2_label label, bool *complete) {
+  sl2_taint_offsets_vec offsets;
+  json j = json::array();
+
+  *complete &= sl2_taint_label_offsets(label, &offsets);
+
+  for (auto &off : offsets) {
+    j.push_back({{"read", off.read}, {"start", off.start}, {"size", off.size}});
+  }
+
+  return j;
+}
+
+/**
+ * Reports which input offsets flowed into the crashing PC, the faulting instruction's memory
+ * address(es), and each general-purpose register.
+ */
+static json dump_provenance(void *drcontext, dr_exception_t *excpt) {
+  app_pc exception_address = (app_pc)excpt->record->ExceptionAddress;
+  bool complete = true;
+  sl2_label address_label = 0;
+  json j;
+
+  j["pc"] = label_to_json(sl2_taint_reg_label(drcontext, DR_REG_NULL), &complete);
+
+  if (!IsBadReadPtr(exception_address, 1)) {
+    instr_t instr;
+    instr_init(drcontext, &instr);
+    decode(drcontext, exception_address, &instr);
+
+    for (int i = 0; i < instr_num_srcs(&instr) + instr_num_dsts(&instr); i++) {
+      opnd_t opnd = i < instr_num_srcs(&instr) ? instr_get_src(&instr, i)
+                                               : instr_get_dst(&instr, i - instr_num_srcs(&instr));
+
+      if (!opnd_is_base_disp(opnd)) {
+        continue;
+      }
+
+      reg_id_t addr_regs[2] = {opnd_get_base(opnd), opnd_get_index(opnd)};
+      for (int k = 0; k < 2; k++) {
+        if (addr_regs[k] != DR_REG_NULL) {
+          address_label = sl2_taint_union(
+              address_label, sl2_taint_reg_label(drcontext, reg_to_full_width64(addr_regs[k])));
+        }
+      }
+    }
+
+    instr_free(drcontext, &instr);
+  }
+
+  j["address"] = label_to_json(address_label, &complete);
+
+  reg_id_t regs[16] = {
+      DR_REG_RAX, DR_REG_RBX, DR_REG_RCX, DR_REG_RDX, DR_REG_RSP, DR_REG_RBP,
+      DR_REG_RSI, DR_REG_RDI, DR_REG_R8,  DR_REG_R9,  DR_REG_R10, DR_REG_R11,
+      DR_REG_R12, DR_REG_R13, DR_REG_R14, DR_REG_R15,
+  };
+
+  j["regs"] = json::object();
+  for (int i = 0; i < 16; i++) {
+    sl2_label label = sl2_taint_reg_label(drcontext, regs[i]);
+
+    if (label) {
+      j["regs"][get_register_name(regs[i])] = label_to_json(label, &complete);
+    }
+  }
+
+  j["complete"] = complete;
+
+  return j;
+}
+
 /** Get crash info as JSON for dumping to stderr */
 std::string dump_json(void *drcontext, uint8_t score, std::string reason, dr_exception_t *excpt,
                       std::string disassembly, bool pc_tainted, bool stack_tainted, bool is_ret,
@@ -706,6 +956,7 @@ std::string dump_json(void *drcontext, uint8_t score, std::string reason, dr_exc
 
   j["score"] = score;
   j["reason"] = reason;
+  j["fingerprint"] = crash_fingerprint;
   j["exception"] = client.exception_to_string(exception_code);
   j["location"] = (uint64_t)exception_address;
   j["instruction"] = disassembly;
@@ -728,14 +979,14 @@ std::string dump_json(void *drcontext, uint8_t score, std::string reason, dr_exc
   };
 
   for (int i = 0; i < 16; i++) {
-    bool tainted = tainted_regs.find(regs[i]) != tainted_regs.end();
+    bool tainted = sl2_taint_reg_is_tainted(drcontext, regs[i]);
     json reg = {{"reg", get_register_name(regs[i])},
                 {"value", reg_get_value(regs[i], excpt->mcontext)},
                 {"tainted", tainted}};
     j["regs"].push_back(reg);
   }
 
-  bool tainted = tainted_regs.find(DR_REG_NULL) != tainted_regs.end();
+  bool tainted = sl2_taint_reg_is_tainted(drcontext, DR_REG_NULL);
   json rip = {{"reg", "rip"}, {"value", (uint64_t)exception_address}, {"tainted", tainted}};
   j["regs"].push_back(rip);
 
@@ -754,29 +1005,150 @@ std::string dump_json(void *drcontext, uint8_t score, std::string reason, dr_exc
   }
 
   j["tainted_addrs"] = json::array();
-  if (tainted_mems.size() > 0) {
-    std::set<app_pc>::iterator mit = tainted_mems.begin();
-    uint64_t start = (uint64_t)*mit;
-    uint64_t size = 1;
-
-    mit++;
-    for (; mit != tainted_mems.end(); mit++) {
-      uint64_t curr = (uint64_t)*mit;
-      if (curr > (start + size)) {
-        json addr = {{"start", start}, {"size", size}};
-        j["tainted_addrs"].push_back(addr);
-
-        start = curr;
-        size = 0;
+  sl2_taint_range_vec ranges;
+  sl2_taint_mem_ranges(&ranges);
+  for (auto &range : ranges) {
+    json addr = {{"start", range.start}, {"size", range.size}};
+    j["tainted_addrs"].push_back(addr);
+  }
+
+  if (sl2_taint_labels_enabled()) {
+    j["input_offsets"] = dump_provenance(drcontext, excpt);
+  }
+
+  return j.dump();
+}
+
+/** How much memory on each side of an interesting address a triage-sized minidump captures. */
+#define TRIAGE_DUMP_WINDOW 0x1000
+
+/** The memory that a triage-sized minidump captures, as handed to its MiniDumpWriteDump callback. */
+struct sl2_triage_dump {
+  /*! The crashing thread, whose stack is kept */
+  DWORD crash_thread_id;
+  /*! Extra memory to capture, as sorted, non-overlapping (base, size) pairs */
+  std::vector<std::pair<ULONG64, ULONG>> ranges;
+  /*! The next entry of ranges to hand to MiniDumpWriteDump */
+  size_t next;
+};
+
+/**
+ * Collects the memory that triage reads from a crash, in order of importance: the pages around
+ * the faulting address and the program counter, around every register's target, and then the
+ * tainted ranges. Anything past the cap set by -dump_cap is left out.
+ */
+static void triage_dump_ranges(dr_exception_t *excpt, sl2_triage_dump *dump) {
+  std::vector<std::pair<uint64_t, uint64_t>> wanted;
+  dr_mcontext_t *mc = excpt->mcontext;
+  uint64_t cap = (uint64_t)op_dump_cap.get_value() << 20;
+  uint64_t total = 0;
+
+  auto add = [&](uint64_t start, uint64_t size) {
+    if (cap) {
+      if (total >= cap) {
+        return;
       }
-      size++;
+      size = std::min(size, cap - total);
     }
 
-    json addr = {{"start", start}, {"size", size}};
-    j["tainted_addrs"].push_back(addr);
+    total += size;
+    wanted.push_back(std::make_pair(start, start + size));
+  };
+
+  auto add_window = [&](uint64_t addr) {
+    // Small values are lengths, flags, and so on, not pointers. Nothing's mapped there.
+    if (addr < 0x10000 || addr > UINT64_MAX - 2 * TRIAGE_DUMP_WINDOW) {
+      return;
+    }
+
+    uint64_t page = addr & ~(uint64_t)(TRIAGE_DUMP_WINDOW - 1);
+    add(page - TRIAGE_DUMP_WINDOW, 3 * TRIAGE_DUMP_WINDOW);
+  };
+
+  if (excpt->record->ExceptionCode == EXCEPTION_ACCESS_VIOLATION &&
+      excpt->record->NumberParameters >= 2) {
+    add_window(excpt->record->ExceptionInformation[1]);
   }
 
-  return j.dump();
+  add_window((uint64_t)mc->pc);
+
+  reg_t regs[] = {mc->xax, mc->xbx, mc->xcx, mc->xdx, mc->xsi, mc->xdi, mc->xbp, mc->xsp,
+                  mc->r8,  mc->r9,  mc->r10, mc->r11, mc->r12, mc->r13, mc->r14, mc->r15};
+  for (reg_t reg : regs) {
+    add_window((uint64_t)reg);
+  }
+
+  sl2_taint_range_vec ranges;
+  sl2_taint_mem_ranges(&ranges);
+  for (auto &range : ranges) {
+    add(range.start, range.size);
+  }
+
+  // MiniDumpWriteDump doesn't mind overlapping ranges, but it does write them twice.
+  std::sort(wanted.begin(), wanted.end());
+
+  for (auto &range : wanted) {
+    if (!dump->ranges.empty()) {
+      auto &last = dump->ranges.back();
+      uint64_t last_end = last.first + last.second;
+
+      // Each range's size has to fit in a ULONG, so don't merge past that.
+      if (range.first <= last_end && range.second - last.first <= MAXULONG) {
+        if (range.second > last_end) {
+          last.second = (ULONG)(range.second - last.first);
+        }
+        continue;
+      }
+    }
+
+    dump->ranges.push_back(std::make_pair(
+        range.first, (ULONG)std::min<uint64_t>(range.second - range.first, MAXULONG)));
+  }
+}
+
+/**
+ * MiniDumpWriteDump callback for triage-sized minidumps. Keeps every thread's context but only the
+ * crashing thread's stack, and adds the memory collected by triage_dump_ranges. The module list
+ * is written as usual.
+ */
+static BOOL CALLBACK triage_dump_callback(PVOID param, const PMINIDUMP_CALLBACK_INPUT input,
+                                          PMINIDUMP_CALLBACK_OUTPUT output) {
+  sl2_triage_dump *dump = (sl2_triage_dump *)param;
+
+  switch (input->CallbackType) {
+  case ThreadCallback:
+    if (input->Thread.ThreadId != dump->crash_thread_id) {
+      output->ThreadWriteFlags &= ~ThreadWriteStack;
+    }
+    break;
+  case ThreadExCallback:
+    if (input->ThreadEx.ThreadId != dump->crash_thread_id) {
+      output->ThreadWriteFlags &= ~(ThreadWriteStack | ThreadWriteBackingStore);
+    }
+    break;
+  case MemoryCallback:
+    if (dump->next >= dump->ranges.size()) {
+      return FALSE;
+    }
+
+    output->MemoryBase = dump->ranges[dump->next].first;
+    output->MemorySize = dump->ranges[dump->next].second;
+    dump->next++;
+    break;
+  case ReadMemoryFailureCallback:
+    // Register windows and tainted ranges can run into unmapped pages. Leave those
+    // pages out instead of failing the whole dump.
+    output->Status = S_OK;
+    break;
+  case CancelCallback:
+    output->Cancel = FALSE;
+    output->CheckCancel = FALSE;
+    break;
+  default:
+    break;
+  }
+
+  return TRUE;
 }
 
 /** Get Run ID and dump crash info into JSON file in the run folder. */
@@ -827,12 +1199,32 @@ static void dump_crash(void *drcontext, dr_exception_t *excpt, std::string reaso
     mdump_info.ExceptionPointers = &exception_pointers;
     mdump_info.ClientPointers = true;
 
+    // Unless asked for everything, only write what triage reads: thread contexts, the crashing
+    // thread's stack, the module lists, and the memory collected by triage_dump_ranges.
+    MINIDUMP_TYPE dump_type = MiniDumpWithFullMemory;
+    MINIDUMP_CALLBACK_INFORMATION callback_info = {0};
+    sl2_triage_dump triage_dump;
+
+    if (!op_full_dump.get_value()) {
+      dump_type = (MINIDUMP_TYPE)(MiniDumpNormal | MiniDumpWithUnloadedModules);
+
+      triage_dump.crash_thread_id = trace_exception_ctx.thread_id;
+      triage_dump.next = 0;
+      triage_dump_ranges(excpt, &triage_dump);
+
+      callback_info.CallbackRoutine = triage_dump_callback;
+      callback_info.CallbackParam = &triage_dump;
+    }
+
     // NOTE(ww): Switching back to the application's state is necessary, as we don't want
     // parts of the instrumentation showing up in our memory dump.
     dr_switch_to_app_state(drcontext);
 
-    MiniDumpWriteDump(GetCurrentProcess(), GetCurrentProcessId(), hDumpFile, MiniDumpWithFullMemory,
-                      &mdump_info, NULL, NULL);
+    if (!MiniDumpWriteDump(GetCurrentProcess(), GetCurrentProcessId(), hDumpFile, dump_type,
+                           &mdump_info, NULL,
+                           op_full_dump.get_value() ? NULL : &callback_info)) {
+      SL2_DR_DEBUG("tracer#dump_crash: MiniDumpWriteDump failed (GLE=%d)\n", GetLastError());
+    }
 
     dr_switch_to_dr_state(drcontext);
 
@@ -842,10 +1234,32 @@ static void dump_crash(void *drcontext, dr_exception_t *excpt, std::string reaso
   dr_exit_process(1);
 }
 
+/**
+ * Fingerprints a crash the same way the fuzzer does (see SL2Client::fingerprint_crash), so that
+ * the harness can recognize crashes that it's already traced.
+ * @return the fingerprint, hex-encoded
+ */
+static std::string fingerprint_crash(void *drcontext, dr_exception_t *excpt) {
+  char fingerprint[17] = {0};
+
+  dr_snprintf(fingerprint, sizeof(fingerprint) - 1, "%016llx",
+              client.fingerprint_crash(drcontext, excpt));
+
+  return fingerprint;
+}
+
 /** Scoring function. Checks exception code, then checks taint state in order to calculate the
  * severity score */
 static bool on_exception(void *drcontext, dr_exception_t *excpt) {
   crashed = true;
+  crash_fingerprint = fingerprint_crash(drcontext, excpt);
+  sl2_trace_crash(drcontext);
+
+  // When confirming, all we need is the fingerprint; on_dr_exit reports it.
+  if (op_confirm.get_value()) {
+    dr_exit_process(1);
+  }
+
   DWORD exception_code = excpt->record->ExceptionCode;
 
   dr_switch_to_app_state(drcontext);
@@ -858,8 +1272,8 @@ static bool on_exception(void *drcontext, dr_exception_t *excpt) {
 
   reg_id_t reg_pc = reg_to_full_width64(DR_REG_NULL);
   reg_id_t reg_stack = reg_to_full_width64(DR_REG_ESP);
-  bool pc_tainted = tainted_regs.find(reg_pc) != tainted_regs.end();
-  bool stack_tainted = tainted_regs.find(reg_stack) != tainted_regs.end();
+  bool pc_tainted = sl2_taint_reg_is_tainted(drcontext, reg_pc);
+  bool stack_tainted = sl2_taint_reg_is_tainted(drcontext, reg_stack);
 
   // catch-all result
   app_pc exception_address = (app_pc)(excpt->record->ExceptionAddress);
@@ -1037,6 +1451,121 @@ static void wrap_pre_VerifierStopMessage(void *wrapcxt, OUT void **user_data) {
   client.wrap_pre_VerifierStopMessage(wrapcxt, user_data, on_exception);
 }
 
+/**
+ * Applies a modeled function's effect on memory taint (or as much of it as we know on entry),
+ * and suspends instruction-level propagation until it returns.
+ */
+static void wrap_pre_taint_model(void *wrapcxt, OUT void **user_data) {
+  void *drcontext = drwrap_get_drcontext(wrapcxt);
+  const sl2_taint_model *model = (const sl2_taint_model *)*user_data;
+  sl2_taint_model_call *call =
+      (sl2_taint_model_call *)dr_thread_alloc(drcontext, sizeof(sl2_taint_model_call));
+
+  call->model = model;
+  call->dst = (app_pc)drwrap_get_arg(wrapcxt, 0);
+  call->src = (app_pc)drwrap_get_arg(wrapcxt, 1);
+
+  // Everything but strlen returns its destination pointer.
+  call->ret_tainted = sl2_taint_reg_is_tainted(drcontext, DR_REG_RCX);
+  call->ret_label = sl2_taint_reg_label(drcontext, DR_REG_RCX);
+
+  switch (model->model) {
+  case TaintModel::Copy:
+    sl2_taint_mem_copy(call->dst, call->src, (size_t)drwrap_get_arg(wrapcxt, 2));
+    break;
+  case TaintModel::Fill:
+  case TaintModel::RtlFill: {
+    reg_id_t value = model->model == TaintModel::Fill ? DR_REG_RDX : DR_REG_R8;
+    size_t size = (size_t)drwrap_get_arg(wrapcxt, model->model == TaintModel::Fill ? 2 : 1);
+
+    if (sl2_taint_reg_is_tainted(drcontext, value)) {
+      sl2_taint_mem_set(call->dst, size, sl2_taint_reg_label(drcontext, value));
+    } else {
+      sl2_taint_mem_clear(call->dst, size);
+    }
+    break;
+  }
+  case TaintModel::Zero:
+    sl2_taint_mem_clear(call->dst, (size_t)drwrap_get_arg(wrapcxt, 1));
+    break;
+  case TaintModel::Strlen:
+  case TaintModel::Strcpy:
+    // NOTE(ww): We don't know the length until the function's found it for us.
+    break;
+  }
+
+  sl2_taint_suspend(drcontext);
+  *user_data = call;
+}
+
+/**
+ * Applies the rest of a modeled function's effect on taint, now that its return value is known,
+ * and resumes instruction-level propagation.
+ */
+static void wrap_post_taint_model(void *wrapcxt, void *user_data) {
+  sl2_taint_model_call *call = (sl2_taint_model_call *)user_data;
+
+  // NOTE(ww): A NULL wrapcxt means that the function was unwound by an exception;
+  // we don't know how far it got, so leave its taint alone.
+  void *drcontext = wrapcxt ? drwrap_get_drcontext(wrapcxt) : dr_get_current_drcontext();
+
+  sl2_taint_resume(drcontext);
+
+  if (wrapcxt) {
+    for (reg_id_t reg : SL2_TAINT_VOLATILE_REGS) {
+      sl2_taint_reg_clear(drcontext, reg);
+    }
+
+    switch (call->model->model) {
+    case TaintModel::Strlen: {
+      size_t size = (size_t)drwrap_get_retval(wrapcxt) + 1;
+
+      if (sl2_taint_mem_is_tainted(call->dst, size)) {
+        sl2_taint_reg_set(drcontext, DR_REG_RAX, sl2_taint_mem_label(call->dst, size));
+      }
+      break;
+    }
+    case TaintModel::Strcpy:
+      // The copy's just been made, so the destination is guaranteed to be terminated.
+      sl2_taint_mem_copy(call->dst, call->src, strlen((char *)call->dst) + 1);
+      // fall through
+    default:
+      if (call->ret_tainted) {
+        sl2_taint_reg_set(drcontext, DR_REG_RAX, call->ret_label);
+      }
+      break;
+    }
+  }
+
+  dr_thread_free(drcontext, call, sizeof(sl2_taint_model_call));
+}
+
+/**
+ * Wraps each function in SL2_TAINT_MODEL_TABLE that lives in the given module.
+ */
+static void wrap_taint_models(const module_data_t *mod, const char *mod_name) {
+  for (size_t i = 0; i < SL2_TAINT_MODEL_TABLE_SIZE; i++) {
+    sl2_taint_model *model = &SL2_TAINT_MODEL_TABLE[i];
+
+    if (!STREQI(mod_name, model->mod)) {
+      continue;
+    }
+
+    app_pc towrap = (app_pc)dr_get_proc_address(mod->handle, model->func);
+
+    if (towrap == NULL) {
+      continue;
+    }
+
+    // NOTE(ww): Several exports (e.g. memcpy and memmove) can share an implementation, so
+    // failing here just means that we've already modeled it.
+    if (drwrap_wrap_ex(towrap, wrap_pre_taint_model, wrap_post_taint_model, model,
+                       DRWRAP_UNWIND_ON_EXCEPTION)) {
+      SL2_DR_DEBUG("<modeled %s!%s @ 0x%p>\n", mod_name, model->func, towrap);
+    }
+  }
+}
+
 /*
 *
   Large block of pre-function callbacks that collect metadata about the target call
@@ -1136,9 +1665,11 @@ static void wrap_post_Generic(void *wrapcxt, void *user_data) {
   bool targeted = client.is_function_targeted(info);
   client.increment_call_count(info->function);
 
-  // Mark the targeted memory as tainted
-  if (targeted) {
-    taint_mem((app_pc)info->lpBuffer, info->nNumberOfBytesToRead);
+  // Mark the targeted memory as tainted. The mutation count doubles as the index of this read,
+  // for the purposes of byte provenance.
+  if (targeted && mutate_count >= taint_from) {
+    sl2_taint_mem_set_input((app_pc)info->lpBuffer, info->nNumberOfBytesToRead, mutate_count,
+                            info->position);
   }
 
   // Talk to the server, get the stored mutation from the fuzzing run, and write it into memory.
@@ -1158,11 +1689,7 @@ static void wrap_post_Generic(void *wrapcxt, void *user_data) {
 
 cleanup:
 
-  if (info->argHash) {
-    dr_thread_free(drcontext, info->argHash, SL2_HASH_LEN + 1);
-  }
-
-  dr_thread_free(drcontext, info, sizeof(client_read_info));
+  client.free_call_record(drcontext, (client_read_info *)user_data);
 }
 
 /**
@@ -1201,13 +1728,14 @@ static void wrap_post_MapViewOfFile(void *wrapcxt, void *user_data) {
   }
 
   // Create the argHash, now that we have the correct source and nNumberOfBytesToRead.
-  client.hash_args(info->argHash, &hash_ctx);
+  client.hash_args(info, &hash_ctx);
 
   bool targeted = client.is_function_targeted(info);
   client.increment_call_count(info->function);
 
-  if (targeted) {
-    taint_mem((app_pc)info->lpBuffer, info->nNumberOfBytesToRead);
+  if (targeted && mutate_count >= taint_from) {
+    sl2_taint_mem_set_input((app_pc)info->lpBuffer, info->nNumberOfBytesToRead, mutate_count,
+                            info->position);
   }
 
   // Talk to the server, get the stored mutation from the fuzzing run, and write it into memory.
@@ -1228,8 +1756,7 @@ static void wrap_post_MapViewOfFile(void *wrapcxt, void *user_data) {
 #pragma warning(suppress : 4533)
 cleanup:
 
-  dr_thread_free(drcontext, info->argHash, SL2_HASH_LEN + 1);
-  dr_thread_free(drcontext, info, sizeof(client_read_info));
+  client.free_call_record(drcontext, (client_read_info *)user_data);
 }
 
 /** Register function pre/post callbacks in each module */
@@ -1241,6 +1768,8 @@ static void on_module_load(void *drcontext, const module_data_t *mod, bool loade
   const char *mod_name = dr_module_preferred_name(mod);
   app_pc towrap;
 
+  sl2_trace_module(mod);
+
   sl2_pre_proto_map pre_hooks;
   SL2_PRE_HOOK1(pre_hooks, ReadFile);
   SL2_PRE_HOOK1(pre_hooks, InternetReadFile);
@@ -1307,6 +1836,11 @@ static void on_module_load(void *drcontext, const module_data_t *mod, bool loade
     drwrap_wrap(towrap, wrap_pre_VerifierStopMessage, NULL);
   }
 
+  // Summarize hot memory routines instead of propagating through every instruction in them.
+  if (taint_instructions) {
+    wrap_taint_models(mod, mod_name);
+  }
+
   // TODO(ww): Wrap DllDebugObjectRpcHook.
   if (STREQ(mod_name, "OLE32.DLL")) {
     SL2_DR_DEBUG("OLE32.DLL loaded, but we don't have an DllDebugObjectRpcHook mitigation yet!\n");
@@ -1400,7 +1934,8 @@ DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
   drreg_options_t ops = {sizeof(ops), 3, false};
   dr_set_client_name("Tracer", "https://github.com/trailofbits/sienna-locomotive");
 
-  if (!drmgr_init() || !drwrap_init() || drreg_init(&ops) != DRREG_SUCCESS) {
+  if (!drmgr_init() || !drwrap_init() || drreg_init(&ops) != DRREG_SUCCESS ||
+      !client.init_call_records() || !sl2_slab_init() || !sl2_taint_init(op_taint_labels.get_value())) {
     DR_ASSERT(false);
   }
 
@@ -1412,17 +1947,31 @@ DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
   }
 
   no_mutate = op_no_mutate.get_value();
+  taint_instructions = !op_no_taint.get_value() && !op_confirm.get_value();
+  taint_from = op_taint_from.get_value();
 
   sl2_string_to_uuid(run_id_s.c_str(), &run_id);
   sl2_conn_assign_run_id(&sl2_conn, run_id);
 
   sl2_conn_register_pid(&sl2_conn, dr_get_process_id(), true);
 
+  if (op_branch_trace.get_value() && replay) {
+    sl2_crash_paths crash_paths = {0};
+    char trace_path[MAX_PATH + 1] = {0};
+
+    sl2_conn_request_crash_paths(&sl2_conn, dr_get_process_id(), &crash_paths);
+    dr_snprintf(trace_path, MAX_PATH, "%S", crash_paths.trace_path);
+
+    if (!sl2_trace_init(trace_path)) {
+      SL2_DR_DEBUG("tracer#main: couldn't start the branch trace, continuing without it\n");
+    }
+  }
+
   mutatex = dr_mutex_create();
   dr_register_exit_event(on_dr_exit);
 
   // If taint tracing is enabled, register the propagate_taint callback
-  if (!op_no_taint.get_value()) {
+  if (taint_instructions) {
     // http://dynamorio.org/docs/group__drmgr.html#ga83a5fc96944e10bd7356e0c492c93966
     if (!drmgr_register_bb_instrumentation_event(NULL, on_bb_instrument, NULL)) {
       DR_ASSERT(false);
@@ -3,6 +3,7 @@
 
 #include "Xploitability.h"
 
+#include <algorithm>
 #include <string>
 
 using namespace std;
@@ -46,6 +47,19 @@ string Xploitability::str() const {
 }
 
 
+/*! @return whether a byte is an x86 lock, rep, segment override, operand size or address size prefix */
+static bool isLegacyPrefix( uint8_t byte ) {
+    switch( byte ) {
+        case 0xf0: case 0xf2: case 0xf3:
+        case 0x2e: case 0x36: case 0x3e: case 0x26: case 0x64: case 0x65:
+        case 0x66: case 0x67:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
 static string polybase( uint64_t addr ) {
     ostringstream oss;
     oss << "0x" << hex << addr;
@@ -80,7 +94,7 @@ Xploitability::Xploitability( Minidump* dmp, ProcessState* state, const string m
 
     MinidumpException* exception = dump_->GetException();
     if (!exception) {
-        cout << " no exc rec" << endl;
+        cerr << " no exc rec" << endl;
         throw "No Exception record";
     }
 
@@ -128,10 +142,27 @@ Xploitability::Xploitability( Minidump* dmp, ProcessState* state, const string m
         return;
 
 
-    const uint8_t *rawMem = instrRegion->GetMemory() + bufsz;
-    if(!rawMem)
+    // Triage-sized dumps only capture a few pages around the instruction pointer, so the faulting
+    // instruction can run off the end of the region.
+    const uint8_t *regionMem = instrRegion->GetMemory();
+    if(!regionMem)
         return;
-    disassembler_ = make_unique<DisassemblerX86>(rawMem, bufsz,  instructionPtr_);
+
+    const uint64_t offset = instructionPtr_ - instrRegion->GetBase();
+    const uint8_t *rawMem = regionMem + offset;
+    const uint8_t *rawEnd = rawMem + min<uint64_t>(bufsz, instrRegion->GetSize() - offset);
+
+    // libdisasm only decodes 32-bit x86, where a REX prefix is an inc or dec of its own.  Drop it
+    // so that the instruction it modifies is decoded instead; the register sizes come out wrong,
+    // but the kind of instruction, which is all the rules look at, doesn't.
+    const uint8_t *opcode = find_if_not(rawMem, rawEnd, isLegacyPrefix);
+    instructionBytes_.assign(rawMem, opcode);
+    if( context_->GetContextCPU()==MD_CONTEXT_AMD64 && opcode!=rawEnd && (*opcode & 0xf0)==0x40 ) {
+        opcode++;
+    }
+    instructionBytes_.insert(instructionBytes_.end(), opcode, rawEnd);
+
+    disassembler_ = make_unique<DisassemblerX86>(instructionBytes_.data(), instructionBytes_.size(), instructionPtr_);
 
 }
 
@@ -6,6 +6,7 @@
 #include <string>
 #include <sstream>
 #include <memory>
+#include <vector>
 
 #include "google_breakpad/common/breakpad_types.h"
 #include "google_breakpad/processor/exploitability.h"
@@ -86,6 +87,7 @@ protected:
     uint32_t                        exceptionCode_      = 0;
     uint64_t                        instructionPtr_     = 0;
     uint64_t                        stackPtr_           = 0;
+    vector<uint8_t>                 instructionBytes_;
     unique_ptr<DisassemblerX86>     disassembler_       = nullptr;
 };
 
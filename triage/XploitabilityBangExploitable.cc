@@ -6,14 +6,736 @@
 #include "Xploitability.h"
 #include "XploitabilityBangExploitable.h"
 #include "google_breakpad/common/minidump_exception_win32.h"
+#include <chrono>
 #include <cstdlib>
-#include <functional>
+#include <iostream>
 #include <unordered_set>
 
 using namespace std;
+using namespace std::chrono;
 
 namespace sl2 {
 
+
+/**
+ * These is the structure of the rules as implemented for !exploitable
+ * The rules are a series of checks that depend on processor mode, exception address,
+ * and exception type and subtype, plus one fact about the crash.  The first final rule
+ * that matches gives the exploitability.
+ */
+static const vector<BangRule> bangRules = {
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        DONT_CARE_EXCEPTION_TYPE,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,        
+        FACT_NOT_AN_EXCEPTION,
+        NOT_AN_EXCEPTION,
+        "",
+        "NotException",
+        "The current event is not an exception. No further analysis will be done.",
+        true,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_WAKE_SYSTEM_DEBUGGER,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        UNKNOWN,
+        "",
+        "DebuggerWakeEvent",
+        "The application has requested a Debugger Wake event. This should not happen during normal operations, and should be investigated.",
+        true,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        DONT_CARE_EXCEPTION_TYPE,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_INSTRUCTION_ON_STACK,
+        EXPLOITABLE,
+        "Exception generated by code running in the Stack",
+        "StackCodeExecution",
+        "Code execution from the stack is considered exploitable",
+        true,
+    },
+
+    {
+        KERNEL,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        DONT_CARE_EXCEPTION_TYPE,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_INSTRUCTION_IN_USERLAND,
+        EXPLOITABLE,
+        "Kernel Exception in Userland",
+        "KernelExceptionInUserland",
+        "Any exception occurring in kernel mode where the code is in Userland is considered exploitable",
+        true,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ILLEGAL_INSTRUCTION,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        EXPLOITABLE,
+        "Illegal Instruction Violation",
+        "IllegalInstruction",
+        "An illegal instruction exception indicates that the attacker controls execution flow.",
+        true,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_PRIVILEGED_INSTRUCTION,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        EXPLOITABLE,
+        "Privileged Instruction Violation",
+        "PrivilegedInstruction",
+        "A privileged instruction exception indicates that the attacker controls execution flow.",
+        true,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_GUARD_PAGE_VIOLATION,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        EXPLOITABLE,
+        "Guard Page Violation",
+        "GuardPage",
+        "",
+        true,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_STACK_BUFFER_OVERRUN,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        EXPLOITABLE,
+        "Stack Buffer Overrun (/GS Exception)",
+        "GSViolation",
+        "An overrun of a protected stack buffer has been detected. This is considered exploitable, and must be fixed.",
+        true,
+    },
+
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_HEAP_CORRUPTION,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        EXPLOITABLE,
+        "Heap Corruption",
+        "HeapCorruption",
+        "Heap Corruption has been detected. This is considered exploitable, and must be fixed.",
+        true,
+    },
+
+    {
+        KERNEL,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_DEP,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        EXPLOITABLE,
+        "Kernel Mode Data Execution Prevention Violation",
+        "DEPViolation",
+        "All kernel mode DEP access violations are exploitable.",
+        true,
+    },
+
+    {
+        USER,
+        NOT_NEAR_NULL,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_DEP,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        EXPLOITABLE,
+        "Data Execution Prevention Violation",
+        "DEPViolation",
+        "User mode DEP access violations are exploitable.",
+        true,
+    },
+
+    {
+        KERNEL,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_EXCEPTION_ADDRESS_IS_INSTRUCTION_POINTER,
+        EXPLOITABLE,
+        "Kernel Mode Read Access Violation at the Instruction Pointer",
+        "ReadAVonIP",
+        "All kernel access violations at the instruction pointer are exploitable.",
+        true,
+    },
+
+    {
+        USER,
+        NOT_NEAR_NULL,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_EXCEPTION_ADDRESS_IS_INSTRUCTION_POINTER,
+        EXPLOITABLE,
+        "Read Access Violation at the Instruction Pointer",
+        "ReadAVonIP",
+        "Access violations at the instruction pointer are exploitable if not near NULL.",
+        true,
+    },
+
+    {
+        USER,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        DONT_CARE_EXCEPTION_TYPE,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_EXCEPTION_HANDLER_CHAIN_CORRUPTED,
+        EXPLOITABLE,
+        "Exception Handler Chain Corrupted",
+        "ExceptionHandlerCorrupted",
+        "Corruption of the exception handler chain is considered exploitable",
+        true,
+    },
+
+    {
+        USER,
+        NEAR_NULL,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_DEP,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        PROBABLY_EXPLOITABLE,
+        "Data Execution Prevention Violation near NUL",
+        "DEPViolation",
+        "User mode DEP access violations are probably exploitable if near NULL.",
+        true,
+    },
+
+    {
+        USER,
+        NEAR_NULL,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_EXCEPTION_ADDRESS_IS_INSTRUCTION_POINTER,
+        PROBABLY_EXPLOITABLE,
+        "Read Access Violation Near Null at the Instruction Pointer",
+        "ReadAVonIP",
+        "Access violations at the instruction pointer are probably exploitable if near NULL.",
+        true,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_INSTRUCTION_NOT_DISASSEMBLED,
+        PROBABLY_EXPLOITABLE,
+        "Cannot disassemble instruction",
+        "ReadAvOnIP",
+        "There is no memory backing the instruction pointer. Disassembly of instruction failed.",
+        true,
+    },
+
+    {
+        USER,
+        NOT_NEAR_NULL,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_WRITE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        EXPLOITABLE,
+        "User Mode Write AV",
+        "WriteAV",
+        "User mode write access violations that are not near NULL are exploitable.",
+        true,
+    },
+
+    {
+        KERNEL,
+        IN_KERNEL_MEMORY,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_WRITE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        EXPLOITABLE,
+        "Write Access Violation in Kernel Memory",
+        "WriteAV",
+        "All kernel mode write access violations in kernel memory are exploitable.",
+        true,
+    },
+
+    {
+        KERNEL,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_WRITE,
+        SECOND_CHANCE,
+        DONT_CARE_FACT,
+        EXPLOITABLE,
+        "Write Access Violation in Kernel Mode",
+        "WriteAV",
+        "All kernel mode second chance write access violations are exploitable.",
+        true,
+    },
+
+    {
+        KERNEL,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_INSTRUCTION_CONTROL_FLOW,
+        EXPLOITABLE,
+        "Kernel Read Access Violation on Control Flow",
+        "ReadAVonControlFlow",
+        "All kernel access violations in control flow instructions are considered exploitable.",
+        true,
+    },
+
+    {
+        USER,
+        NOT_NEAR_NULL,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_INSTRUCTION_CONTROL_FLOW,
+        EXPLOITABLE,
+        "Read Access Violation on Control Flow",
+        "ReadAVonControlFlow",
+        "Access violations not near null in control flow instructions are considered exploitable.",
+        true,
+    },
+
+    {
+        USER,
+        NEAR_NULL,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_INSTRUCTION_CONTROL_FLOW,
+        PROBABLY_EXPLOITABLE,
+        "Read Access Violation on Control Flow",
+        "ReadAVonControlFlow",
+        "Access violations near null in control flow instructions are considered probably exploitable.",
+        true,
+    },
+
+    {
+        USER,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_INSTRUCTION_BLOCK_DATA_MOVE,
+        PROBABLY_EXPLOITABLE,
+        "Read Access Violation on Block Data Move",
+        "ReadAVonBlockMove",
+        "This is a read access violation in a block data move, and is therefore classified as probably exploitable.",
+        true,
+    },
+
+    {
+        KERNEL,
+        IN_KERNEL_MEMORY,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_INSTRUCTION_BLOCK_DATA_MOVE,
+        PROBABLY_EXPLOITABLE,
+        "Kernel Memory Read Access Violation on Block Data Move",
+        "ReadAVonBlockMove",
+        "This is a read access violation in a kernel memory block data move, and is therefore classified as probably exploitable.",
+        true,
+    },
+
+    {
+        KERNEL,
+        IN_USER_MEMORY,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        SECOND_CHANCE,
+        FACT_INSTRUCTION_BLOCK_DATA_MOVE,
+        PROBABLY_EXPLOITABLE,
+        "Memory Read Access Violation on Block Data Move",
+        "ReadAVonBlockMove",
+        "This is a second chance read access violation in a kernel mode block data move, and is therefore classified as probably exploitable.",
+        true,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_TAINT_CONTROLS_BRANCH_TARGET,
+        PROBABLY_EXPLOITABLE,
+        "Data from Faulting Address controls Code Flow",
+        "TaintedDataControlsCodeFlow",
+        "The data from the faulting address is later used as the target for a branch.",
+        true,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_TAINT_CONTROLS_WRITE_ADDRESS,
+        PROBABLY_EXPLOITABLE,
+        "Data from Faulting Address controls subsequent Write Address",
+        "TaintedDataControlsWriteAddress",
+        "The data from the faulting address is later used as the target for a later write.",
+        true,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        DONT_CARE_EXCEPTION_TYPE,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_APPLICATION_VERIFIER_STOP,
+        UNKNOWN,
+        "Application Verifier Stop",
+        "AppVerifierStop",
+        "An Application Verifier Stop was detected, but no additional security details could be determined. This fault must be manually investigated.",
+        true,
+    },
+
+    {
+        USER,
+        NEAR_NULL,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        NOT_LIKELY_EXPLOITABLE,
+        "Read Access Violation near NUL",
+        "ReadAVNearNull",
+        "This is a user mode read access violation near null, and is probably not exploitable.",
+        true,
+    },
+
+    {
+        KERNEL,
+        IN_USER_MEMORY,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        FIRST_CHANCE,
+        DONT_CARE_FACT,
+        NOT_LIKELY_EXPLOITABLE,
+        "First Chance Kernel Read Access Violation in User Memory",
+        "ReadAV",
+        "This is a kernel mode first chance read access violation in user memory, and is probably not exploitable.",
+        false,
+    },
+
+    {
+        KERNEL,
+        IN_USER_MEMORY,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_WRITE,
+        FIRST_CHANCE,
+        DONT_CARE_FACT,
+        NOT_LIKELY_EXPLOITABLE,
+        "First Chance Kernel Write Access Violation in User Memory",
+        "WriteAV",
+        "This is a kernel mode first chance write access violation in user memory, and is probably not exploitable.",
+        false,
+    },
+
+    {
+        USER,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_INTEGER_DIVIDE_BY_ZERO,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        NOT_LIKELY_EXPLOITABLE,
+        "Integer Divide By Zero",
+        "DivideByZero",
+        "This is a divide by zero, and is probably not exploitable.",
+        false,
+    },
+
+    {
+        USER,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_FLOAT_DIVIDE_BY_ZERO,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        NOT_LIKELY_EXPLOITABLE,
+        "Float Divide By Zero",
+        "DivideByZero",
+        "This is a divide by zero, and is probably not exploitable.",
+        false,
+    },
+
+    {
+        USER,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_STACK_OVERFLOW,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        NOT_LIKELY_EXPLOITABLE,
+        "Stack Exhaustion",
+        "StackExhaustion",
+        "Stack Exhaustion is considered to be probably not exploitable.",
+        false,
+    },
+
+    {
+        USER,
+        NEAR_NULL,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_WRITE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        UNKNOWN,
+        "User Mode Write AV near NUL",
+        "WriteAVNearNull",
+        "User mode write access violations that are near NULL are unknown.",
+        false,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_WX86_BREAKPOINT,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        UNKNOWN,
+        "Breakpoint",
+        "Breakpoint",
+        "While a breakpoint itself is probably not exploitable, it may also be an indication that an attacker is testing a target. In either case breakpoints should not exist in production code.",
+        false,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_BREAKPOINT,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        UNKNOWN,
+        "Breakpoint",
+        "Breakpoint",
+        "While a breakpoint itself is probably not exploitable, it may also be an indication that an attacker is testing a target. In either case breakpoints should not exist in production code.",
+        false,
+    },
+
+    {
+        KERNEL,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_BREAKPOINT,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_BUG_CHECK,
+        UNKNOWN,
+        "BugCheck",
+        "BugCheck",
+        "A BugCheck was detected, but no further information about the severity could be determined.",
+        false,
+    },
+
+    {
+        USER,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        DONT_CARE_EXCEPTION_TYPE,
+        DONT_CARE_EXCEPTION_SUBTYPE,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_STACK_HAS_UNKNOWN_FUNCTIONS,
+        UNKNOWN,
+        "Possible Stack Corruption",
+        "PossibleStackCorruption",
+        "The stack trace contains one or more locations for which no symbol or module could be found. This may be a sign of stack corruption.",
+        false,
+    },
+
+    {
+        KERNEL,
+        NEAR_NULL,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        UNKNOWN,
+        "Kernel Read Access Violation near NUL",
+        "ReadAVNearNull",
+        "This is a kernel mode read access violation near null.",
+        false,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_TAINT_USED_IN_BLOCK_DATA_MOVE,
+        UNKNOWN,
+        "Data from Faulting Address is used in a subsequent Block Data Move",
+        "TaintedDataUsedInBlockMove",
+        "The data from the faulting address is later used as the input for a later block data move.",
+        false,
+    },
+
+    {
+        KERNEL,
+        IN_USER_MEMORY,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        FIRST_CHANCE,
+        FACT_INSTRUCTION_BLOCK_DATA_MOVE,
+        UNKNOWN,
+        "Memory Read Access Violation on Block Data Move",
+        "ReadAVonBlockMove",
+        "This is a first chance read access violation in a kernel mode block data move. If the attacker controls the size of the move, this may represent a security issue.",
+        false,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_TAINT_PASSED_TO_FUNCTION,
+        UNKNOWN,
+        "Data from Faulting Address is used as one or more arguments in a subsequent Function Call",
+        "TaintedDataPassedToFunction",
+        "The data from the faulting address is later used as one or more of the arguments to a function call.",
+        false,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_TAINT_RETURNED_FROM_FUNCTION,
+        UNKNOWN,
+        "Data from Faulting Address may be used as a return value",
+        "TaintedDataReturnedFromFunction",
+        "The data from the faulting address may later be used as a return value from this function.",
+        false,
+    },
+
+    {
+        DONT_CARE_PROCESSOR_MODE,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        FACT_TAINT_CONTROLS_BRANCH_SELECTION,
+        UNKNOWN,
+        "Data from Faulting Address controls Branch Selection",
+        "TaintedDataControlsBranchSelection",
+        "The data from the faulting address is later used to determine whether or not a branch is taken.",
+        false,
+    },
+
+    {
+        USER,
+        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+        STATUS_ACCESS_VIOLATION,
+        ACCESS_VIOLATION_TYPE_READ,
+        DONT_CARE_EXCEPTION_LEVEL,
+        DONT_CARE_FACT,
+        UNKNOWN,
+        "Read Access Violation",
+        "ReadAV",
+        "This is a read access violation that nothing else about the crash explains. Further analysis is required to tell whether it is exploitable.",
+        true,
+    }
+};
+
+
+/*! What we say when no rule matches */
+static const BangRule unknownRule = {
+    DONT_CARE_PROCESSOR_MODE,
+    DONT_CARE_EXCEPTION_ADDRESS_RANGE,
+    DONT_CARE_EXCEPTION_TYPE,
+    DONT_CARE_EXCEPTION_SUBTYPE,
+    DONT_CARE_EXCEPTION_LEVEL,
+    DONT_CARE_FACT,
+    NOT_AN_EXCEPTION,
+    "Unknown",
+    "Unknown",
+    "Nothing matched",
+    true,
+};
+
+
+/*! Names for the facts in trace output, in BangFact order */
+static const char* const factNames[FACT_COUNT] = {
+    "",
+    "NotAnException",
+    "InstructionOnStack",
+    "InstructionInUserland",
+    "ExceptionAddressIsInstructionPointer",
+    "InstructionNotDisassembled",
+    "InstructionControlFlow",
+    "InstructionBlockDataMove",
+    "ExceptionHandlerChainCorrupted",
+    "ApplicationVerifierStop",
+    "BugCheck",
+    "StackHasUnknownFunctions",
+    "TaintControlsBranchTarget",
+    "TaintControlsWriteAddress",
+    "TaintUsedInBlockDataMove",
+    "TaintPassedToFunction",
+    "TaintReturnedFromFunction",
+    "TaintControlsBranchSelection",
+};
+
+
+bool XploitabilityBangExploitable::traceRules_ = false;
+
+
+/**
+ * Turns on printing how long each fact took to work out, and each rule's result, to stderr for every
+ * minidump processed from then on.
+ */
+void XploitabilityBangExploitable::setTraceRules( bool trace ) {
+    traceRules_ = trace;
+}
+
+
 /**
  * XploitabilityBangExploitable
  * @param dump
@@ -24,20 +746,6 @@ XploitabilityBangExploitable::XploitabilityBangExploitable(Minidump *dump,
         : Xploitability(dump, process_state, "!exploitable") {
 }
 
-/**
- * @return false if we can disassemble at pc
- */
-const bool XploitabilityBangExploitable::canFaultingInstructionNotBeDisassebled() const { 
-
-    if(!memoryAvailable_)
-        return false;
-    if(!disassembler_)
-        return false;    
-    
-    return !disassembler_->currentInstructionValid();
-    
-}
-
 /**
  * This information isn't easily available in breakpad
  */
@@ -50,7 +758,7 @@ const bool XploitabilityBangExploitable::doesStackTraceContainUnknownFunctions()
  * @return whether we found the exception code
  */
 const bool XploitabilityBangExploitable::isEventNotAnException() const { 
-    unordered_set<MDExceptionCodeWin> validExceptions = {
+    static const unordered_set<uint32_t> validExceptions = {
         MD_EXCEPTION_CODE_WIN_CONTROL_C,
         MD_EXCEPTION_CODE_WIN_GUARD_PAGE_VIOLATION,
         MD_EXCEPTION_CODE_WIN_ACCESS_VIOLATION,
@@ -81,12 +789,7 @@ const bool XploitabilityBangExploitable::isEventNotAnException() const {
         MD_EXCEPTION_OUT_OF_MEMORY
     };
 
-    for( auto exc : validExceptions ) {
-        if( exc==exceptionCode_ ) {
-            return false;
-        }
-    }
-    return true;
+    return validExceptions.count(exceptionCode_)==0;
 }
 
 /**
@@ -96,39 +799,6 @@ const bool XploitabilityBangExploitable::isFaultingAddressInstructionPointer() c
     return instructionPtr_ == process_state_->crash_address();
 }
 
-/**
- * They call a "block data move" a move with a rep (on x86)
- */
-const bool XploitabilityBangExploitable::isFaultingInstructionBlockDataMove() const { 
-    if(!disassembler_)
-        return false;
-    auto instr = disassembler_->currentInstruction();
-    if( nullptr == instr )
-        return false;
-
-    auto group = disassembler_->currentInstructionGroup() ;
-    return group == libdis::insn_move &&    
-            (
-                (instr->prefix & libdis::insn_rep_zero) ||
-                (instr->prefix & libdis::insn_rep_notzero)
-            );        
-}
-
-/**
- * @return True if faulting instruction is a control flow instruction
- */
-const bool XploitabilityBangExploitable::isFaultingInstructionControlFlow() const { 
-    if(!disassembler_)
-        return false;
-    auto instr = disassembler_->currentInstruction();
-    if( nullptr == instr )
-        return false;
-
-    auto group = disassembler_->currentInstructionGroup() ;
-
-    return group == libdis::insn_controlflow; 
-}
-
 /**
  * @return True if instruction is in userland (64bit only)
  */
@@ -197,7 +867,7 @@ const bool XploitabilityBangExploitable::WasExceptionHandlerChainCorrupted() con
 /**
  * Converts breakpad exceptionCode to !exploitable exception type
  */
-ExceptionType XploitabilityBangExploitable::exceptionType() {
+ExceptionType XploitabilityBangExploitable::exceptionType() const {
 
     switch(exceptionCode_) {
         case MD_EXCEPTION_CODE_WIN_CONTROL_C:
@@ -269,7 +939,7 @@ ExceptionType XploitabilityBangExploitable::exceptionType() {
 /**
  * Converts breakpad to !exploitable subtype
  */
-ExceptionSubtype XploitabilityBangExploitable::exceptionSubtype() {
+ExceptionSubtype XploitabilityBangExploitable::exceptionSubtype() const {
 
     if( rawException_->exception_record.number_parameters < 1)
         return DONT_CARE_EXCEPTION_SUBTYPE;
@@ -290,734 +960,150 @@ ExceptionSubtype XploitabilityBangExploitable::exceptionSubtype() {
 }
 
 /**
- * These is the structure of the rules as implemented for !exploitable
- * The rules are a series of checks that depend on processor mode, exception address,
- * and exception type and subtype.  Analysis functions are called and eventually
- * an exploitability is returned
- * @return rule describing current exception
+ * Checks a rule against the facts gathered for this minidump
+ * @return whether the rule matches
  */
-BangRule XploitabilityBangExploitable::processRules() {
-
-    vector<BangRule> rules = {    
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            DONT_CARE_EXCEPTION_TYPE,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,        
-            bind( &XploitabilityBangExploitable::isEventNotAnException, this ),
-            NOT_AN_EXCEPTION,
-            "",
-            "NotException",
-            "The current event is not an exception. No further analysis will be done.",
-            true,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_WAKE_SYSTEM_DEBUGGER,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            UNKNOWN,
-            "",
-            "DebuggerWakeEvent",
-            "The application has requested a Debugger Wake event. This should not happen during normal operations, and should be investigated.",
-            true,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            DONT_CARE_EXCEPTION_TYPE,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isFaultingInstructionOnStack, this ),
-            EXPLOITABLE,
-            "Exception generated by code running in the Stack",
-            "StackCodeExecution",
-            "Code execution from the stack is considered exploitable",
-            true,
-        },
-
-        {
-            KERNEL,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            DONT_CARE_EXCEPTION_TYPE,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isFaultingInstructionInUserland, this ),
-            EXPLOITABLE,
-            "Kernel Exception in Userland",
-            "KernelExceptionInUserland",
-            "Any exception occurring in kernel mode where the code is in Userland is considered exploitable",
-            true,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ILLEGAL_INSTRUCTION,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            EXPLOITABLE,
-            "Illegal Instruction Violation",
-            "IllegalInstruction",
-            "An illegal instruction exception indicates that the attacker controls execution flow.",
-            true,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_PRIVILEGED_INSTRUCTION,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            EXPLOITABLE,
-            "Privileged Instruction Violation",
-            "PrivilegedInstruction",
-            "A privileged instruction exception indicates that the attacker controls execution flow.",
-            true,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_GUARD_PAGE_VIOLATION,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            EXPLOITABLE,
-            "Guard Page Violation",
-            "GuardPage",
-            "",
-            true,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_STACK_BUFFER_OVERRUN,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            EXPLOITABLE,
-            "Stack Buffer Overrun (/GS Exception)",
-            "GSViolation",
-            "An overrun of a protected stack buffer has been detected. This is considered exploitable, and must be fixed.",
-            true,
-        },
-
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_HEAP_CORRUPTION,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            EXPLOITABLE,
-            "Heap Corruption",
-            "HeapCorruption",
-            "Heap Corruption has been detected. This is considered exploitable, and must be fixed.",
-            true,
-        },
-
-        {
-            KERNEL,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_DEP,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            EXPLOITABLE,
-            "Kernel Mode Data Execution Prevention Violation",
-            "DEPViolation",
-            "All kernel mode DEP access violations are exploitable.",
-            true,
-        },
-
-        {
-            USER,
-            NOT_NEAR_NULL,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_DEP,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            EXPLOITABLE,
-            "Data Execution Prevention Violation",
-            "DEPViolation",
-            "User mode DEP access violations are exploitable.",
-            true,
-        },
-
-        {
-            KERNEL,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isFaultingAddressInstructionPointer, this ),
-            EXPLOITABLE,
-            "Kernel Mode Read Access Violation at the Instruction Pointer",
-            "ReadAVonIP",
-            "All kernel access violations at the instruction pointer are exploitable.",
-            true,
-        },
-
-        {
-            USER,
-            NOT_NEAR_NULL,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isFaultingAddressInstructionPointer, this ),
-            EXPLOITABLE,
-            "Read Access Violation at the Instruction Pointer",
-            "ReadAVonIP",
-            "Access violations at the instruction pointer are exploitable if not near NULL.",
-            true,
-        },
-
-        {
-            USER,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            DONT_CARE_EXCEPTION_TYPE,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::WasExceptionHandlerChainCorrupted, this ),
-            EXPLOITABLE,
-            "Exception Handler Chain Corrupted",
-            "ExceptionHandlerCorrupted",
-            "Corruption of the exception handler chain is considered exploitable",
-            true,
-        },
-
-        {
-            USER,
-            NEAR_NULL,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_DEP,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            PROBABLY_EXPLOITABLE,
-            "Data Execution Prevention Violation near NUL",
-            "DEPViolation",
-            "User mode DEP access violations are probably exploitable if near NULL.",
-            true,
-        },
-
-        {
-            USER,
-            NEAR_NULL,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isFaultingAddressInstructionPointer, this ),
-            PROBABLY_EXPLOITABLE,
-            "Read Access Violation Near Null at the Instruction Pointer",
-            "ReadAVonIP",
-            "Access violations at the instruction pointer are probably exploitable if near NULL.",
-            true,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::canFaultingInstructionNotBeDisassebled, this ),
-            PROBABLY_EXPLOITABLE,
-            "Cannot disassemble instruction",
-            "ReadAvOnIP",
-            "There is no memory backing the instruction pointer. Disassembly of instruction failed.",
-            true,
-        },
-
-        {
-            USER,
-            NOT_NEAR_NULL,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_WRITE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            EXPLOITABLE,
-            "User Mode Write AV",
-            "WriteAV",
-            "User mode write access violations that are not near NULL are exploitable.",
-            true,
-        },
-
-        {
-            KERNEL,
-            IN_KERNEL_MEMORY,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_WRITE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            EXPLOITABLE,
-            "Write Access Violation in Kernel Memory",
-            "WriteAV",
-            "All kernel mode write access violations in kernel memory are exploitable.",
-            true,
-        },
-
-        {
-            KERNEL,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_WRITE,
-            SECOND_CHANCE,
-            nullptr,
-            EXPLOITABLE,
-            "Write Access Violation in Kernel Mode",
-            "WriteAV",
-            "All kernel mode second chance write access violations are exploitable.",
-            true,
-        },
-
-        {
-            KERNEL,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isFaultingInstructionControlFlow, this ),
-            EXPLOITABLE,
-            "Kernel Read Access Violation on Control Flow",
-            "ReadAVonControlFlow",
-            "All kernel access violations in control flow instructions are considered exploitable.",
-            true,
-        },
-
-        {
-            USER,
-            NOT_NEAR_NULL,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isFaultingInstructionControlFlow, this ),
-            EXPLOITABLE,
-            "Read Access Violation on Control Flow",
-            "ReadAVonControlFlow",
-            "Access violations not near null in control flow instructions are considered exploitable.",
-            true,
-        },
-
-        {
-            USER,
-            NEAR_NULL,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isFaultingInstructionControlFlow, this ),
-            PROBABLY_EXPLOITABLE,
-            "Read Access Violation on Control Flow",
-            "ReadAVonControlFlow",
-            "Access violations near null in control flow instructions are considered probably exploitable.",
-            true,
-        },
-
-        {
-            USER,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isFaultingInstructionBlockDataMove, this ),
-            PROBABLY_EXPLOITABLE,
-            "Read Access Violation on Block Data Move",
-            "ReadAVonBlockMove",
-            "This is a read access violation in a block data move, and is therefore classified as probably exploitable.",
-            true,
-        },
-
-        {
-            KERNEL,
-            IN_KERNEL_MEMORY,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isFaultingInstructionBlockDataMove, this ),
-            PROBABLY_EXPLOITABLE,
-            "Kernel Memory Read Access Violation on Block Data Move",
-            "ReadAVonBlockMove",
-            "This is a read access violation in a kernel memory block data move, and is therefore classified as probably exploitable.",
-            true,
-        },
-
-        {
-            KERNEL,
-            IN_USER_MEMORY,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            SECOND_CHANCE,
-            bind( &XploitabilityBangExploitable::isFaultingInstructionBlockDataMove, this ),
-            PROBABLY_EXPLOITABLE,
-            "Memory Read Access Violation on Block Data Move",
-            "ReadAVonBlockMove",
-            "This is a second chance read access violation in a kernel mode block data move, and is therefore classified as probably exploitable.",
-            true,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isTaintedDataUsedToDetermineBranchTarget, this ),
-            PROBABLY_EXPLOITABLE,
-            "Data from Faulting Address controls Code Flow",
-            "TaintedDataControlsCodeFlow",
-            "The data from the faulting address is later used as the target for a branch.",
-            true,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isTaintedDataUsedInALaterWrite, this ),
-            PROBABLY_EXPLOITABLE,
-            "Data from Faulting Address controls subsequent Write Address",
-            "TaintedDataControlsWriteAddress",
-            "The data from the faulting address is later used as the target for a later write.",
-            true,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            DONT_CARE_EXCEPTION_TYPE,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::WasApplicationVerifierStopDetected, this ),
-            UNKNOWN,
-            "Application Verifier Stop",
-            "AppVerifierStop",
-            "An Application Verifier Stop was detected, but no additional security details could be determined. This fault must be manually investigated.",
-            true,
-        },
-
-        {
-            USER,
-            NEAR_NULL,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            NOT_LIKELY_EXPLOITABLE,
-            "Read Access Violation near NUL",
-            "ReadAVNearNull",
-            "This is a user mode read access violation near null, and is probably not exploitable.",
-            true,
-        },
-
-        {
-            KERNEL,
-            IN_USER_MEMORY,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            FIRST_CHANCE,
-            nullptr,
-            NOT_LIKELY_EXPLOITABLE,
-            "First Chance Kernel Read Access Violation in User Memory",
-            "ReadAV",
-            "This is a kernel mode first chance read access violation in user memory, and is probably not exploitable.",
-            false,
-        },
-
-        {
-            KERNEL,
-            IN_USER_MEMORY,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_WRITE,
-            FIRST_CHANCE,
-            nullptr,
-            NOT_LIKELY_EXPLOITABLE,
-            "First Chance Kernel Write Access Violation in User Memory",
-            "WriteAV",
-            "This is a kernel mode first chance write access violation in user memory, and is probably not exploitable.",
-            false,
-        },
-
-        {
-            USER,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_INTEGER_DIVIDE_BY_ZERO,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            NOT_LIKELY_EXPLOITABLE,
-            "Integer Divide By Zero",
-            "DivideByZero",
-            "This is a divide by zero, and is probably not exploitable.",
-            false,
-        },
-
-        {
-            USER,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_FLOAT_DIVIDE_BY_ZERO,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            NOT_LIKELY_EXPLOITABLE,
-            "Float Divide By Zero",
-            "DivideByZero",
-            "This is a divide by zero, and is probably not exploitable.",
-            false,
-        },
-
-        {
-            USER,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_STACK_OVERFLOW,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            NOT_LIKELY_EXPLOITABLE,
-            "Stack Exhaustion",
-            "StackExhaustion",
-            "Stack Exhaustion is considered to be probably not exploitable.",
-            false,
-        },
-
-        {
-            USER,
-            NEAR_NULL,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_WRITE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            UNKNOWN,
-            "User Mode Write AV near NUL",
-            "WriteAVNearNull",
-            "User mode write access violations that are near NULL are unknown.",
-            false,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_WX86_BREAKPOINT,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            UNKNOWN,
-            "Breakpoint",
-            "Breakpoint",
-            "While a breakpoint itself is probably not exploitable, it may also be an indication that an attacker is testing a target. In either case breakpoints should not exist in production code.",
-            false,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_BREAKPOINT,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            UNKNOWN,
-            "Breakpoint",
-            "Breakpoint",
-            "While a breakpoint itself is probably not exploitable, it may also be an indication that an attacker is testing a target. In either case breakpoints should not exist in production code.",
-            false,
-        },
-
-        {
-            KERNEL,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_BREAKPOINT,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::WasBugCheckDetected, this ),
-            UNKNOWN,
-            "BugCheck",
-            "BugCheck",
-            "A BugCheck was detected, but no further information about the severity could be determined.",
-            false,
-        },
-
-        {
-            USER,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            DONT_CARE_EXCEPTION_TYPE,
-            DONT_CARE_EXCEPTION_SUBTYPE,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::doesStackTraceContainUnknownFunctions, this ),
-            UNKNOWN,
-            "Possible Stack Corruption",
-            "PossibleStackCorruption",
-            "The stack trace contains one or more locations for which no symbol or module could be found. This may be a sign of stack corruption.",
-            false,
-        },
-
-        {
-            KERNEL,
-            NEAR_NULL,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            nullptr,
-            UNKNOWN,
-            "Kernel Read Access Violation near NUL",
-            "ReadAVNearNull",
-            "This is a kernel mode read access violation near null.",
-            false,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isTaintedDataUsedAsSourceForBlockDataMove, this ),
-            UNKNOWN,
-            "Data from Faulting Address is used in a subsequent Block Data Move",
-            "TaintedDataUsedInBlockMove",
-            "The data from the faulting address is later used as the input for a later block data move.",
-            false,
-        },
-
-        {
-            KERNEL,
-            IN_USER_MEMORY,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            FIRST_CHANCE,
-            bind( &XploitabilityBangExploitable::isFaultingInstructionBlockDataMove, this ),
-            UNKNOWN,
-            "Memory Read Access Violation on Block Data Move",
-            "ReadAVonBlockMove",
-            "This is a first chance read access violation in a kernel mode block data move. If the attacker controls the size of the move, this may represent a security issue.",
-            false,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isTaintedDataUsedAsAFunctionArgument, this ),
-            UNKNOWN,
-            "Data from Faulting Address is used as one or more arguments in a subsequent Function Call",
-            "TaintedDataPassedToFunction",
-            "The data from the faulting address is later used as one or more of the arguments to a function call.",
-            false,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isTaintedDataUsedAsAFunctionRetVal, this ),
-            UNKNOWN,
-            "Data from Faulting Address may be used as a return value",
-            "TaintedDataReturnedFromFunction",
-            "The data from the faulting address may later be used as a return value from this function.",
-            false,
-        },
-
-        {
-            DONT_CARE_PROCESSOR_MODE,
-            DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-            STATUS_ACCESS_VIOLATION,
-            ACCESS_VIOLATION_TYPE_READ,
-            DONT_CARE_EXCEPTION_LEVEL,
-            bind( &XploitabilityBangExploitable::isTaintedDataUsedToDetermineBranchSelection, this ),
-            UNKNOWN,
-            "Data from Faulting Address controls Branch Selection",
-            "TaintedDataControlsBranchSelection",
-            "The data from the faulting address is later used to determine whether or not a branch is taken.",
-            false,
-        }
-    
-    };
+bool BangRule::matches( const BangFacts& facts ) const {
+
+    // We don't care about kernel stuff
+    if( processorMode==KERNEL ) {
+        return false;
+    }
+
+    // Process the area where the exception occurred
+    switch( exceptionAddressRange ) {
+        case IN_KERNEL_MEMORY:
+            if( facts.exceptionAddressInUser )      return false;
+            break;
+        case IN_USER_MEMORY:
+            if( !facts.exceptionAddressInUser )     return false;
+            break;
+        case NEAR_NULL:
+            if( !facts.exceptionAddressNearNull )   return false;
+            break;
+        case NOT_NEAR_NULL:
+            if( facts.exceptionAddressNearNull )    return false;
+            break;
+        default:
+            break;
+    }
 
+    // Check exception type and subtype
+    if( exceptionType!=DONT_CARE_EXCEPTION_TYPE && exceptionType!=facts.exceptionType ) {
+        return false;
+    }
 
-    for( BangRule& rule : rules ) {
+    if( exceptionSubtype!=DONT_CARE_EXCEPTION_SUBTYPE && exceptionSubtype!=facts.exceptionSubtype ) {
+        return false;
+    }
 
-        // We don't care about kernel stuff
-        if( rule.processorMode==KERNEL ) {
-            continue;
-        }
-        
-        // Process the area where the exception occurred
-        if( ( rule.exceptionAddressRange != DONT_CARE_EXCEPTION_ADDRESS_RANGE ) 
-            && 
-                ( ((rule.exceptionAddressRange == IN_KERNEL_MEMORY) 
-                    && isExceptionAddressInUser()) ||
-                ( (rule.exceptionAddressRange  == IN_USER_MEMORY) 
-                    && !isExceptionAddressInUser()) ||
-                ( (rule.exceptionAddressRange  == NEAR_NULL) 
-                    && !isExceptionAddressNearNull()) ||
-                ( (rule.exceptionAddressRange  == NOT_NEAR_NULL) 
-                && isExceptionAddressNearNull()) ) ) {
-            continue;
-        }
+    // Everything passed so far, check the fact the rule depends on
+    return fact==DONT_CARE_FACT || facts.facts[fact];
+}
 
-        // Check exception type
-        if( rule.exceptionType != DONT_CARE_EXCEPTION_TYPE) {            
-            if( rule.exceptionType != exceptionType()  )  {
-                continue;
-            }
-        }
 
-        // Check exception subtype
-        if( (rule.exceptionSubtype != DONT_CARE_EXCEPTION_SUBTYPE ) && 
-                rule.exceptionSubtype != exceptionSubtype() ) {
-            continue;
+/**
+ * Works out everything the rules need to know about the crash.  This is the only place the faulting
+ * instruction is decoded.
+ * @param trace if not NULL, where to write each fact's value and how long it took to work out
+ * @return the facts
+ */
+BangFacts XploitabilityBangExploitable::gatherFacts( ostream* trace ) {
+    BangFacts facts;
+
+    // Runs one predicate, timing it if we're tracing
+    auto gather = [&]( const char* what, auto predicate ) {
+        if( !trace ) {
+            return predicate();
         }
 
-        // Everything passed so far, run the analysis function
-        if( rule.analyzeFunction ) {
-            if( !rule.analyzeFunction() ) {
-                continue;
-            }
+        steady_clock::time_point    start   = steady_clock::now();
+        auto                        value   = predicate();
+
+        *trace << name() << ": " << what << " = " << value
+               << " in " << duration_cast<nanoseconds>( steady_clock::now()-start ).count() << " ns" << endl;
+        return value;
+    };
+
+    // Facts the disassembler doesn't work out
+    auto gatherFact = [&]( BangFact fact, auto predicate ) {
+        facts.facts[fact] = gather( factNames[fact], [&]{ return (this->*predicate)(); } );
+    };
+
+    facts.exceptionType             = gather( "ExceptionType",            [&]{ return exceptionType(); } );
+    facts.exceptionSubtype          = gather( "ExceptionSubtype",         [&]{ return exceptionSubtype(); } );
+    facts.exceptionAddressInUser    = gather( "ExceptionAddressInUser",   [&]{ return isExceptionAddressInUser(); } );
+    facts.exceptionAddressNearNull  = gather( "ExceptionAddressNearNull", [&]{ return isExceptionAddressNearNull(); } );
+
+    gatherFact( FACT_NOT_AN_EXCEPTION,                          &XploitabilityBangExploitable::isEventNotAnException );
+    gatherFact( FACT_INSTRUCTION_ON_STACK,                      &XploitabilityBangExploitable::isFaultingInstructionOnStack );
+    gatherFact( FACT_INSTRUCTION_IN_USERLAND,                   &XploitabilityBangExploitable::isFaultingInstructionInUserland );
+    gatherFact( FACT_EXCEPTION_ADDRESS_IS_INSTRUCTION_POINTER,  &XploitabilityBangExploitable::isFaultingAddressInstructionPointer );
+    gatherFact( FACT_EXCEPTION_HANDLER_CHAIN_CORRUPTED,         &XploitabilityBangExploitable::WasExceptionHandlerChainCorrupted );
+    gatherFact( FACT_APPLICATION_VERIFIER_STOP,                 &XploitabilityBangExploitable::WasApplicationVerifierStopDetected );
+    gatherFact( FACT_BUG_CHECK,                                 &XploitabilityBangExploitable::WasBugCheckDetected );
+    gatherFact( FACT_STACK_HAS_UNKNOWN_FUNCTIONS,               &XploitabilityBangExploitable::doesStackTraceContainUnknownFunctions );
+    gatherFact( FACT_TAINT_CONTROLS_BRANCH_TARGET,              &XploitabilityBangExploitable::isTaintedDataUsedToDetermineBranchTarget );
+    gatherFact( FACT_TAINT_CONTROLS_WRITE_ADDRESS,              &XploitabilityBangExploitable::isTaintedDataUsedInALaterWrite );
+    gatherFact( FACT_TAINT_USED_IN_BLOCK_DATA_MOVE,             &XploitabilityBangExploitable::isTaintedDataUsedAsSourceForBlockDataMove );
+    gatherFact( FACT_TAINT_PASSED_TO_FUNCTION,                  &XploitabilityBangExploitable::isTaintedDataUsedAsAFunctionArgument );
+    gatherFact( FACT_TAINT_RETURNED_FROM_FUNCTION,              &XploitabilityBangExploitable::isTaintedDataUsedAsAFunctionRetVal );
+    gatherFact( FACT_TAINT_CONTROLS_BRANCH_SELECTION,           &XploitabilityBangExploitable::isTaintedDataUsedToDetermineBranchSelection );
+
+    // There's only a disassembler if the dump has memory at the instruction pointer.
+    if( disassembler_ ) {
+        gather( "InstructionDisassembled", [&]{
+            disassembler_->NextInstruction();
+            return disassembler_->currentInstruction()!=nullptr;
+        } );
+
+        const libdis::x86_insn_t* instr = disassembler_->currentInstruction();
+
+        if( !instr ) {
+            facts.facts[FACT_INSTRUCTION_NOT_DISASSEMBLED] = true;
+        } else {
+            // They call a "block data move" a move with a rep (on x86)
+            facts.facts[FACT_INSTRUCTION_CONTROL_FLOW]      = instr->group==libdis::insn_controlflow;
+            facts.facts[FACT_INSTRUCTION_BLOCK_DATA_MOVE]   = instr->group==libdis::insn_move &&
+                                                              ( instr->prefix & (libdis::insn_rep_zero | libdis::insn_rep_notzero) );
         }
+    }
+
+    return facts;
+}
 
-        // This rule is not final, so keep on going
-        if( !rule.isFinal ) {
-            continue;
+
+/**
+ * Finds the first final rule that matches the facts
+ * @param facts the facts gathered for this minidump
+ * @param trace if not NULL, where to write each rule's result
+ * @return rule describing current exception
+ */
+const BangRule& XploitabilityBangExploitable::processRules( const BangFacts& facts, ostream* trace ) const {
+
+    for( size_t i=0; i<bangRules.size(); i++ ) {
+        const BangRule& rule    = bangRules[i];
+        bool            matched = rule.matches(facts);
+
+        if( trace ) {
+            *trace << name() << ": rule " << i << " " << rule << ": "
+                   << ( matched ? (rule.isFinal ? "matched" : "matched (not final)") : "no match" ) << endl;
         }
 
-        return rule;
+        // Non-final rules never decide the result, so keep on going
+        if( matched && rule.isFinal ) {
+            return rule;
+        }
     }
 
     // Couldn't find anything
-    return BangRule {
-        DONT_CARE_PROCESSOR_MODE,
-        DONT_CARE_EXCEPTION_ADDRESS_RANGE,
-        DONT_CARE_EXCEPTION_TYPE,
-        DONT_CARE_EXCEPTION_SUBTYPE,
-        DONT_CARE_EXCEPTION_LEVEL,
-        nullptr,
-        NOT_AN_EXCEPTION,
-        "Unknown",
-        "Unknown",
-        "Nothing matched",
-        true,
-    };
-
-    
+    return unknownRule;
 }
 
 /**
  *  operator<<() - converts between exploitability enum forms
  */
-XploitabilityResult& operator<<( XploitabilityResult& result, BangRule& rule ) {
+XploitabilityResult& operator<<( XploitabilityResult& result, const BangRule& rule ) {
     switch(rule.resultClassification) {
         case EXPLOITABLE:
             result.rank = XploitabilityRank::XPLOITABILITY_HIGH;
@@ -1043,9 +1129,33 @@ XploitabilityResult& operator<<( XploitabilityResult& result, BangRule& rule ) {
  * @return
  */
 XploitabilityResult XploitabilityBangExploitable::process() {    
-    BangRule& rule = processRules();
+    if( !traceRules_ ) {
+        XploitabilityResult result(name());
+        result << processRules( gatherFacts( nullptr ), nullptr );
+        return result;
+    }
+
+    // Everything goes to stderr in one piece, so batch mode doesn't interleave minidumps.
+    ostringstream               trace;
+    steady_clock::time_point    start   = steady_clock::now();
+    BangFacts                   facts   = gatherFacts( &trace );
+
+    const auto elapsed = duration_cast<nanoseconds>( steady_clock::now()-start ).count();
+
+    trace << name() << ": type " << facts.exceptionType << ", subtype " << facts.exceptionSubtype
+          << ( facts.exceptionAddressInUser ? ", user" : ", kernel" )
+          << ( facts.exceptionAddressNearNull ? ", near null" : "" );
+    for( int fact=DONT_CARE_FACT+1; fact<FACT_COUNT; fact++ ) {
+        if( facts.facts[fact] ) {
+            trace << ", " << factNames[fact];
+        }
+    }
+    trace << " gathered in " << elapsed << " ns" << endl;
+
     XploitabilityResult result(name());
-    result << rule;
+    result << processRules( facts, &trace );
+    cerr << trace.str();
+
     return result;
 }
 
@@ -8,7 +8,7 @@
 #define XploitabilityBangExploitable_H
 
 #include "Xploitability.h"
-#include <functional>
+#include <bitset>
 #include <string>
 #include <sstream>
 
@@ -103,9 +103,51 @@ enum ResultClassification {
     UNKNOWN
 };
 
+/*! Facts about the crash, beyond its type and address, that a rule can require */
+enum BangFact {
+    /*! The rule doesn't need anything else */
+    DONT_CARE_FACT = DONT_CARE,
+    /*! The exception code isn't a known Windows exception */
+    FACT_NOT_AN_EXCEPTION,
+    /*! The instruction pointer is near the stack pointer */
+    FACT_INSTRUCTION_ON_STACK,
+    /*! The instruction pointer is in userland */
+    FACT_INSTRUCTION_IN_USERLAND,
+    /*! The exception address is the instruction pointer */
+    FACT_EXCEPTION_ADDRESS_IS_INSTRUCTION_POINTER,
+    /*! There's memory at the instruction pointer, but it doesn't decode */
+    FACT_INSTRUCTION_NOT_DISASSEMBLED,
+    /*! The faulting instruction is a branch, call or return */
+    FACT_INSTRUCTION_CONTROL_FLOW,
+    /*! The faulting instruction is a rep-prefixed move */
+    FACT_INSTRUCTION_BLOCK_DATA_MOVE,
+    FACT_EXCEPTION_HANDLER_CHAIN_CORRUPTED,
+    FACT_APPLICATION_VERIFIER_STOP,
+    FACT_BUG_CHECK,
+    FACT_STACK_HAS_UNKNOWN_FUNCTIONS,
+    FACT_TAINT_CONTROLS_BRANCH_TARGET,
+    FACT_TAINT_CONTROLS_WRITE_ADDRESS,
+    FACT_TAINT_USED_IN_BLOCK_DATA_MOVE,
+    FACT_TAINT_PASSED_TO_FUNCTION,
+    FACT_TAINT_RETURNED_FROM_FUNCTION,
+    FACT_TAINT_CONTROLS_BRANCH_SELECTION,
+    FACT_COUNT
+};
+
+
+/**
+ * Everything the rules look at, gathered once per minidump, so that matching a rule is just a few comparisons
+ */
+class BangFacts {
+public:
+    ExceptionType           exceptionType;
+    ExceptionSubtype        exceptionSubtype;
+    bool                    exceptionAddressInUser;
+    bool                    exceptionAddressNearNull;
+    bitset<FACT_COUNT>      facts;
+};
 
 
-typedef   function<bool()>     AnalyzeFunction;
 /**
  * Used to store a set of characteristics that describe a particualr exception that we can then pattern-match against
  */
@@ -116,7 +158,8 @@ public:
     ExceptionType           exceptionType;              // 3
     ExceptionSubtype        exceptionSubtype;           // 4
     ExceptionLevel          exceptionLevel;             // 5
-    AnalyzeFunction         analyzeFunction;            // 6
+    /*! A fact that must also hold for the rule to match */
+    BangFact                fact;                       // 6
     /*! The final result that describes how exploitable the exception described by parameters 1-6 is likely to be */
     ResultClassification    resultClassification;       // 7
     string                  resultDescription;          // 8
@@ -124,6 +167,8 @@ public:
     string                  resultExplaination;         // 10
     bool                    isFinal;                    // 11
 
+    bool                    matches( const BangFacts& facts ) const;
+
     string                  toString() {
         ostringstream stream;
         stream << this;
@@ -157,21 +202,23 @@ public:
 
     virtual XploitabilityResult                 process();
 
+    static void                                 setTraceRules( bool trace );
+
 
 private:
 
-    BangRule                processRules();
-    ExceptionSubtype        exceptionSubtype();
-    ExceptionType           exceptionType();
+    static bool             traceRules_;
+
+    BangFacts               gatherFacts( ostream* trace );
+    const BangRule&         processRules( const BangFacts& facts, ostream* trace ) const;
+    ExceptionSubtype        exceptionSubtype()                              const;
+    ExceptionType           exceptionType()                                 const;
     const bool              WasApplicationVerifierStopDetected()            const;
     const bool              WasBugCheckDetected()                           const;
     const bool              WasExceptionHandlerChainCorrupted()             const;
-    const bool              canFaultingInstructionNotBeDisassebled()        const;
     const bool              doesStackTraceContainUnknownFunctions()         const;
     const bool              isEventNotAnException()                         const;
     const bool              isFaultingAddressInstructionPointer()           const;
-    const bool              isFaultingInstructionBlockDataMove()            const;
-    const bool              isFaultingInstructionControlFlow()              const;
     const bool              isFaultingInstructionInUserland()               const;
     const bool              isFaultingInstructionOnStack()                  const;
     const bool              isTaintedDataUsedAsAFunctionArgument()          const;
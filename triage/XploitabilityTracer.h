@@ -15,7 +15,7 @@ namespace sl2 {
 
 class XploitabilityTracer : public Xploitability {
 public:
-    XploitabilityTracer::XploitabilityTracer(
+    XploitabilityTracer(
                 Minidump* dump,
                 ProcessState* process_state,
                 const string crashJson );
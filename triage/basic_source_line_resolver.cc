@@ -339,11 +339,20 @@ CFIFrameInfo *BasicSourceLineResolver::Module::FindCFIFrameInfo(
     cfi_delta_rules_.lower_bound(initial_base);
 
   // Apply delta rules up to and including the frame's address.
+  MemAddr range_start = initial_base;
   while (delta != cfi_delta_rules_.end() && delta->first <= address) {
     ParseCFIRuleSet(delta->second, rules.get());
+    range_start = delta->first;
     delta++;
   }
 
+  // The rules hold until the next delta rule, or the end of the initial
+  // rule's range.
+  MemAddr range_end = initial_base + initial_size;
+  if (delta != cfi_delta_rules_.end() && delta->first < range_end)
+    range_end = delta->first;
+  rules->SetRange(range_start, range_end);
+
   return rules.release();
 }
 
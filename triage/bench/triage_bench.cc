@@ -0,0 +1,399 @@
+// XXX_INCLUDE_TOB_COPYRIGHT_HERE
+
+// Throughput benchmark for triage.
+//
+// Builds a synthetic x64 Windows minidump with breakpad's SynthMinidump helpers, then triages it over and
+// over the way batch mode does: analyze() through a shared resolver, then toJson().  Reports the time spent
+// in each stage, dumps/sec and peak RSS as one line of JSON, so that runs before and after a change can be
+// compared.  Builds and runs on Linux; see ../CMakeLists.txt.
+//
+// The crashing thread's stack is a frame pointer chain `depth` frames deep, with return addresses spread
+// across the modules and the rest of the stack filled with words that don't point into any module.  There
+// are no symbols, so the stackwalker recovers frames from frame pointers and falls back to scanning.
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define NOGDI
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "processor/synth_minidump.h"
+#include "shared_resolver.h"
+#include "statz.h"
+#include "triage.h"
+
+using namespace std;
+using namespace google_breakpad;
+namespace synth = google_breakpad::SynthMinidump;
+
+
+// Where the synthetic process keeps things
+static const uint64_t   kModuleBase     = 0x7ff700000000;
+static const uint32_t   kModuleSize     = 0x100000;
+static const uint64_t   kStackBase      = 0x10000000;
+static const uint64_t   kStackSpacing   = 0x1000000;
+static const uint64_t   kHeapBase       = 0x40000000;
+static const uint32_t   kPageSize       = 0x1000;
+
+// The crash: a read access violation at kCrashOffset into the first module
+static const uint32_t   kCrashOffset    = 0x2000;
+static const uint32_t   kAccessViolation = 0xc0000005;
+
+
+/** The shape of the synthetic minidump, and how often to triage it */
+struct BenchOptions {
+    uint32_t    threads     = 8;
+    uint32_t    depth       = 32;
+    uint32_t    modules     = 64;
+    uint32_t    stackKB     = 64;
+    uint32_t    heapKB      = 1024;
+    uint32_t    iterations  = 200;
+    string      path;
+};
+
+
+void usage( char* argv[] ) {
+    cout << "Syntax : " << argv[0] << " [-t threads] [-d depth] [-m modules] [-s stack_kb] [-x heap_kb]" << endl;
+    cout << "         " << "[-n iterations] [-o minidump]" << endl;
+    cout << endl;
+    cout << "  -t threads      threads in the minidump (default: 8)" << endl;
+    cout << "  -d depth        frames on the crashing thread's stack (default: 32)" << endl;
+    cout << "  -m modules      loaded modules (default: 64)" << endl;
+    cout << "  -s stack_kb     size of each thread's stack, in KB (default: 64)" << endl;
+    cout << "  -x heap_kb      memory captured beyond the stacks, in KB (default: 1024)" << endl;
+    cout << "  -n iterations   how many times to triage the minidump (default: 200)" << endl;
+    cout << "  -o minidump     where to write the minidump; it's kept afterwards (default: a temporary file)" << endl;
+}
+
+
+/**
+ * A cheap, deterministic source of stack filler
+ * @param state the generator's state, updated in place
+ * @return the next pseudorandom value
+ */
+static uint64_t xorshift( uint64_t& state ) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+
+/**
+ * @param module a module index
+ * @param offset an offset into that module
+ * @return the address of that offset in the synthetic process
+ */
+static uint64_t moduleAddress( uint32_t module, uint32_t offset ) {
+    return kModuleBase + (uint64_t)module * kModuleSize + offset;
+}
+
+
+/**
+ * Builds a thread's context, with its stack and frame pointers at the bottom of its stack
+ * @param stack the lowest address of the thread's stack
+ * @param rip the thread's instruction pointer
+ */
+static MDRawContextAMD64 threadContext( uint64_t stack, uint64_t rip ) {
+    MDRawContextAMD64 context;
+    memset( &context, 0, sizeof(context) );
+
+    context.context_flags   = MD_CONTEXT_AMD64_FULL;
+    context.cs              = 0x33;
+    context.ss              = 0x2b;
+    context.eflags          = 0x10246;
+    context.rsp             = stack;
+    context.rbp             = stack;
+    context.rip             = rip;
+    context.rcx             = 0x8;      // the bad pointer that the crashing instruction reads through
+    return context;
+}
+
+
+/**
+ * Fills a thread's stack with a chain of `depth` frames, each a saved frame pointer followed by a return
+ * address into one of the modules.  The rest is filler that never points into a module.
+ * @param stack the stack's memory section
+ * @param base the lowest address of the stack
+ * @param size the size of the stack, in bytes
+ * @param depth how many frames to chain together
+ * @param modules how many modules the return addresses are spread over
+ */
+static void fillStack( synth::Memory& stack, uint64_t base, uint32_t size, uint32_t depth, uint32_t modules ) {
+    uint64_t    state       = 0x2545F4914F6CDD1DULL ^ base;
+    uint32_t    words       = size / sizeof(uint64_t);
+    uint32_t    frameWords  = depth ? max( 2u, words / (depth + 1) ) : words;
+
+    for( uint32_t i=0; i<words; i++ ) {
+        uint32_t frame = i / frameWords;
+        uint32_t slot  = i % frameWords;
+
+        if( frame < depth && slot==0 ) {
+            // The saved frame pointer: the next frame, or 0 to end the chain
+            bool last = frame+1==depth || (uint64_t)(frame+1)*frameWords*8 >= size;
+            stack.D64( last ? 0 : base + (uint64_t)(frame+1)*frameWords*8 );
+        } else if( frame < depth && slot==1 ) {
+            stack.D64( moduleAddress(frame % modules, kCrashOffset + 0x10*frame) );
+        } else {
+            // Small enough that it can't be mistaken for a return address
+            stack.D64( xorshift(state) & 0xffffffff );
+        }
+    }
+}
+
+
+/**
+ * Writes a synthetic x64 Windows minidump
+ * @param opts the shape of the minidump
+ * @return the minidump's size in bytes, or 0 if it couldn't be written
+ */
+static size_t writeMinidump( const BenchOptions& opts ) {
+    synth::Dump dump( 0, test_assembler::kLittleEndian );
+
+    MDRawSystemInfo systemInfo          = synth::SystemInfo::windows_x86;
+    systemInfo.processor_architecture   = MD_CPU_ARCHITECTURE_AMD64;
+    systemInfo.major_version            = 10;
+    systemInfo.minor_version            = 0;
+    systemInfo.build_number             = 17763;
+
+    synth::String       csdVersion( dump, "" );
+    synth::SystemInfo   systemInfoStream( dump, systemInfo, csdVersion );
+    dump.Add( &systemInfoStream );
+    dump.Add( &csdVersion );
+
+    // Sections have to outlive dump.Finish(), which is what resolves the references between them.
+    vector< unique_ptr<synth::String> >     names;
+    vector< unique_ptr<synth::Module> >     modules;
+    vector< unique_ptr<synth::Memory> >     memory;
+    vector< unique_ptr<synth::Context> >    contexts;
+    vector< unique_ptr<synth::Thread> >     threads;
+
+    for( uint32_t i=0; i<opts.modules; i++ ) {
+        names.push_back( make_unique<synth::String>(dump, "C:\\Windows\\System32\\module" + to_string(i) + ".dll") );
+        modules.push_back( make_unique<synth::Module>(dump, moduleAddress(i, 0), kModuleSize, *names.back()) );
+        dump.Add( names.back().get() );
+        dump.Add( modules.back().get() );
+    }
+
+    uint32_t stackSize  = opts.stackKB * 1024;
+    uint64_t rip        = moduleAddress( 0, kCrashOffset );
+
+    for( uint32_t i=0; i<opts.threads; i++ ) {
+        uint64_t stack = kStackBase + i*kStackSpacing;
+
+        memory.push_back( make_unique<synth::Memory>(dump, stack) );
+        fillStack( *memory.back(), stack, stackSize, i==0 ? opts.depth : min(opts.depth, 4u), opts.modules );
+        dump.Add( memory.back().get() );
+
+        contexts.push_back( make_unique<synth::Context>(dump, threadContext(stack, rip)) );
+        dump.Add( contexts.back().get() );
+
+        threads.push_back( make_unique<synth::Thread>(dump, 0x1000 + i, *memory.back(), *contexts.back()) );
+        dump.Add( threads.back().get() );
+    }
+
+    // The code around the crash, for the engines to disassemble: mov rax, [rcx], over and over
+    memory.push_back( make_unique<synth::Memory>(dump, rip & ~(uint64_t)(kPageSize-1)) );
+    for( uint32_t i=0; i<kPageSize/3; i++ ) {
+        memory.back()->D8(0x48).D8(0x8b).D8(0x01);
+    }
+    memory.back()->Append( kPageSize % 3, 0x90 );
+    dump.Add( memory.back().get() );
+
+    if( opts.heapKB ) {
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        memory.push_back( make_unique<synth::Memory>(dump, kHeapBase) );
+        for( uint32_t i=0; i<opts.heapKB*1024/8; i++ ) {
+            memory.back()->D64( xorshift(state) );
+        }
+        dump.Add( memory.back().get() );
+    }
+
+    synth::Context      exceptionContext( dump, threadContext(kStackBase, rip) );
+    synth::Exception    exception( dump, exceptionContext, 0x1000, kAccessViolation, 0, rip );
+    dump.Add( &exceptionContext );
+    dump.Add( &exception );
+
+    dump.Finish();
+
+    string contents;
+    if( !dump.GetContents(&contents) ) {
+        return 0;
+    }
+
+    ofstream out( opts.path, ios::out | ios::binary | ios::trunc );
+    out.write( contents.data(), contents.size() );
+    return out ? contents.size() : 0;
+}
+
+
+/**
+ * @return the process's peak resident set size, in bytes
+ */
+static uint64_t peakRss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if( !GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if( getrusage(RUSAGE_SELF, &usage) ) {
+        return 0;
+    }
+    // Linux reports kilobytes
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+
+/**
+ * @param stats a stage's timings, in seconds
+ * @return their mean and standard deviation, in microseconds
+ */
+static json summarize( const sl2::Statz<double>& stats ) {
+    return json{
+        { "mean_us",    stats.mean() * 1e6 },
+        { "stdev_us",   stats.stdev() * 1e6 },
+    };
+}
+
+
+int main( int argc, char* argv[] ) {
+    BenchOptions opts;
+
+    try {
+        for( int i=1; i<argc; i++ ) {
+            string arg(argv[i]);
+
+            if( i+1==argc ) {
+                usage(argv);
+                return -1;
+            }
+
+            if( arg=="-t" ) {
+                opts.threads = stoul(argv[++i]);
+            } else if( arg=="-d" ) {
+                opts.depth = stoul(argv[++i]);
+            } else if( arg=="-m" ) {
+                opts.modules = stoul(argv[++i]);
+            } else if( arg=="-s" ) {
+                opts.stackKB = stoul(argv[++i]);
+            } else if( arg=="-x" ) {
+                opts.heapKB = stoul(argv[++i]);
+            } else if( arg=="-n" ) {
+                opts.iterations = stoul(argv[++i]);
+            } else if( arg=="-o" ) {
+                opts.path = argv[++i];
+            } else {
+                usage(argv);
+                return -1;
+            }
+        }
+    } catch( logic_error& ) {
+        usage(argv);
+        return -1;
+    }
+
+    if( !opts.threads || !opts.modules || !opts.stackKB || !opts.iterations ) {
+        cerr << "threads, modules, stack size and iterations must all be at least 1" << endl;
+        return -1;
+    }
+
+    bool keep = !opts.path.empty();
+    if( !keep ) {
+        opts.path = (fs::temp_directory_path() / "triage_bench.dmp").string();
+    }
+
+    size_t dumpBytes = writeMinidump(opts);
+    if( !dumpBytes ) {
+        cerr << "couldn't write " << opts.path << endl;
+        return -1;
+    }
+
+    sl2::SharedResolver                 resolver;
+    sl2::Statz<double>                  read, process, stackwalk, toJson, total;
+    vector< pair<string, sl2::Statz<double>> > engines;
+    size_t                              frames = 0;
+
+    for( uint32_t i=0; i<opts.iterations; i++ ) {
+        auto start = chrono::steady_clock::now();
+
+        sl2::Triage triage( opts.path, &resolver );
+        if( triage.analyze()!=sl2::GOOD ) {
+            cerr << "couldn't triage " << opts.path << endl;
+            return -1;
+        }
+
+        auto analyzed = chrono::steady_clock::now();
+        json result = triage.toJson();
+        auto end = chrono::steady_clock::now();
+
+        const sl2::StageTimes& times = triage.stageTimes();
+        read.vals.push_back( times.read );
+        process.vals.push_back( times.process );
+        stackwalk.vals.push_back( times.stackwalk );
+        toJson.vals.push_back( chrono::duration<double>(end - analyzed).count() );
+        total.vals.push_back( chrono::duration<double>(end - start).count() );
+
+        engines.resize( times.engines.size() );
+        for( size_t e=0; e<times.engines.size(); e++ ) {
+            engines[e].first = times.engines[e].first;
+            engines[e].second.vals.push_back( times.engines[e].second );
+        }
+
+        frames = result["callStack"].size();
+    }
+
+    if( !keep ) {
+        error_code ec;
+        fs::remove( opts.path, ec );
+    }
+
+    json stages = {
+        { "read",       summarize(read) },
+        { "process",    summarize(process) },
+        { "stackwalk",  summarize(stackwalk) },
+        { "toJson",     summarize(toJson) },
+        { "total",      summarize(total) },
+    };
+    for( auto& engine : engines ) {
+        stages["engine:" + engine.first] = summarize( engine.second );
+    }
+
+    double seconds = 0;
+    for( double t : total.vals ) {
+        seconds += t;
+    }
+
+    cout << json{
+        { "type",           "triage_bench" },
+        { "threads",        opts.threads },
+        { "depth",          opts.depth },
+        { "modules",        opts.modules },
+        { "stack_kb",       opts.stackKB },
+        { "heap_kb",        opts.heapKB },
+        { "dump_bytes",     dumpBytes },
+        { "iterations",     opts.iterations },
+        { "frames",         frames },
+        { "dumps_per_sec",  opts.iterations / seconds },
+        { "peak_rss_bytes", peakRss() },
+        { "stages",         stages },
+    } << endl;
+
+    return 0;
+}
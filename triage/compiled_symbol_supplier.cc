@@ -0,0 +1,331 @@
+// XXX_INCLUDE_TOB_COPYRIGHT_HERE
+
+// A symbol supplier that hands out precompiled symbols, for FastSourceLineResolver.
+// See compiled_symbol_supplier.h.
+
+#include "compiled_symbol_supplier.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define NOGDI
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+
+#include "common/scoped_ptr.h"
+#include "processor/logging.h"
+#include "processor/module_serializer.h"
+
+using namespace std;
+using namespace google_breakpad;
+#ifdef _MSC_VER
+namespace fs = std::experimental::filesystem;
+#else
+namespace fs = std::filesystem;
+#endif
+
+namespace sl2 {
+
+
+// Every .symc file starts with this header, so that a stale or foreign file is recompiled rather
+// than misread.  Bump the version whenever breakpad's serialized module layout changes.
+struct CompiledHeader {
+    uint32_t    magic;
+    uint32_t    version;
+};
+
+static const uint32_t   kCompiledMagic      = 0x43324c53; // "SL2C"
+static const uint32_t   kCompiledVersion    = 1;
+
+
+// Symbol data handed out so far, by .sym path.  Never freed: the fast resolver keeps pointers into it
+// for as long as it has the module loaded, which may be as long as the process runs.  Each entry is
+// filled in by the first thread to ask for that module; the lock only covers the map itself.
+typedef pair<const char*, size_t>                       CompiledSymbols;
+static mutex                                            compiledMutex;
+static map< string, shared_future<CompiledSymbols> >    compiledSymbols;
+
+
+/**
+ * Maps a whole file read-only.  The mapping is never unmapped.
+ * @return the start of the mapping, or NULL on failure
+ */
+static const char* mapFile( const string& path, size_t* size ) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_FLAG_RANDOM_ACCESS, NULL );
+    if( file==INVALID_HANDLE_VALUE ) {
+        return NULL;
+    }
+
+    LARGE_INTEGER fileSize;
+    if( !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart==0 ) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    CloseHandle(file);
+    if( !mapping ) {
+        return NULL;
+    }
+
+    // The view keeps the mapping object alive once its handle is closed.
+    const void* base = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+    CloseHandle(mapping);
+    if( !base ) {
+        return NULL;
+    }
+
+    *size = fileSize.QuadPart;
+#else
+    int fd = open( path.c_str(), O_RDONLY );
+    if( fd==-1 ) {
+        return NULL;
+    }
+
+    struct stat sb;
+    if( fstat(fd, &sb)==-1 || sb.st_size==0 ) {
+        close(fd);
+        return NULL;
+    }
+
+    void* base = mmap( NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close(fd);
+    if( base==MAP_FAILED ) {
+        return NULL;
+    }
+
+    *size = sb.st_size;
+#endif
+
+    return static_cast<const char*>(base);
+}
+
+
+/**
+ * Reads a text .sym file and serializes it into breakpad's fast module format.
+ * @return the serialized module, owned by the caller (delete[]), or NULL if the file couldn't be read
+ * or parsed
+ */
+static char* serialize( const string& symbolPath, unsigned int* size ) {
+    ifstream in( symbolPath, ios::in | ios::binary );
+    if( !in ) {
+        return NULL;
+    }
+
+    ostringstream text;
+    text << in.rdbuf();
+
+    ModuleSerializer serializer;
+    return serializer.SerializeSymbolFileData( text.str(), size );
+}
+
+
+/**
+ * @return whether a compiled symbol file exists, is at least as new as its .sym file, and was
+ * written by this version of the compiler
+ */
+static bool isFresh( const string& symbolPath, const string& compiledPath ) {
+    error_code ec;
+
+    auto compiledTime = fs::last_write_time( compiledPath, ec );
+    if( ec ) {
+        return false;
+    }
+
+    auto symbolTime = fs::last_write_time( symbolPath, ec );
+    if( ec || compiledTime<symbolTime ) {
+        return false;
+    }
+
+    CompiledHeader  header = {};
+    ifstream        in( compiledPath, ios::in | ios::binary );
+    in.read( reinterpret_cast<char*>(&header), sizeof(header) );
+
+    return in && header.magic==kCompiledMagic && header.version==kCompiledVersion;
+}
+
+
+CompiledSymbolSupplier::CompiledSymbolSupplier( const string& path )
+    :   SimpleSymbolSupplier(path) {
+
+}
+
+
+/**
+ * @param symbolPath the path to a text .sym file
+ * @return the path its compiled form is written to
+ */
+string CompiledSymbolSupplier::compiledPath( const string& symbolPath ) {
+    return symbolPath + "c";
+}
+
+
+/**
+ * Compiles a text .sym file into a .symc file next to it.  The file is written under a temporary
+ * name and renamed into place, so concurrent triagers never map a half-written file.
+ * @param symbolPath the path to a text .sym file
+ * @return whether the compiled file was written
+ */
+bool CompiledSymbolSupplier::compile( const string& symbolPath ) {
+    unsigned int size = 0;
+    scoped_array<char> data( serialize(symbolPath, &size) );
+    if( !data.get() ) {
+        BPLOG(ERROR) << "Couldn't parse symbol file " << symbolPath;
+        return false;
+    }
+
+    const string    outPath = compiledPath(symbolPath);
+    const string    tmpPath = outPath + "." + to_string( random_device()() );
+    CompiledHeader  header  = { kCompiledMagic, kCompiledVersion };
+
+    {
+        ofstream out( tmpPath, ios::out | ios::binary | ios::trunc );
+        out.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+        out.write( data.get(), size );
+        if( !out ) {
+            BPLOG(ERROR) << "Couldn't write compiled symbol file " << tmpPath;
+            out.close();
+            error_code ec;
+            fs::remove( tmpPath, ec );
+            return false;
+        }
+    }
+
+    error_code ec;
+    fs::rename( tmpPath, outPath, ec );
+    if( ec ) {
+        // Most likely another triager compiled the same file and has it mapped; theirs is as good as ours.
+        fs::remove( tmpPath, ec );
+        return fs::exists(outPath);
+    }
+
+    return true;
+}
+
+
+/**
+ * Drops a .sym file's entry from the symbols handed out so far
+ */
+static void forget( const string& symbolFile ) {
+    lock_guard<mutex> lock(compiledMutex);
+    compiledSymbols.erase(symbolFile);
+}
+
+
+/**
+ * Loads a .sym file's symbols in compiled form, compiling it first if its .symc file is missing or
+ * out of date.  If the compiled file can't be written or mapped, the symbols are compiled into memory
+ * instead.
+ * @return the symbol data and its size, or NULL data if the symbols couldn't be loaded
+ */
+static CompiledSymbols loadCompiled( const string& symbolFile ) {
+    const string    path    = CompiledSymbolSupplier::compiledPath(symbolFile);
+    const char*     data    = NULL;
+    size_t          size    = 0;
+
+    if( isFresh(symbolFile, path) || ( CompiledSymbolSupplier::compile(symbolFile) && isFresh(symbolFile, path) ) ) {
+        data = mapFile( path, &size );
+        if( data ) {
+            data += sizeof(CompiledHeader);
+            size -= sizeof(CompiledHeader);
+        }
+    }
+
+    if( !data ) {
+        unsigned int serializedSize = 0;
+        data = serialize( symbolFile, &serializedSize );
+        size = serializedSize;
+    }
+
+    return make_pair(data, size);
+}
+
+
+/**
+ * Finds a module's symbols and returns them in compiled form (see loadCompiled).  Only the first
+ * thread to ask for a module loads it; the others wait for its result, without holding up threads
+ * that want other modules.
+ * The supplier keeps ownership of the data, which stays valid until the process exits.
+ */
+SymbolSupplier::SymbolResult CompiledSymbolSupplier::GetCStringSymbolData( const CodeModule* module,
+                                                                           const SystemInfo* system_info,
+                                                                           string* symbol_file,
+                                                                           char** symbol_data,
+                                                                           size_t* symbol_data_size ) {
+    SymbolResult result = GetSymbolFile( module, system_info, symbol_file );
+    if( result!=FOUND ) {
+        return result;
+    }
+
+    promise<CompiledSymbols>        loading;
+    shared_future<CompiledSymbols>  loaded;
+    bool                            loader  = false;
+
+    {
+        lock_guard<mutex> lock(compiledMutex);
+
+        auto it = compiledSymbols.find(*symbol_file);
+        if( it==compiledSymbols.end() ) {
+            loaded = loading.get_future().share();
+            compiledSymbols.insert( make_pair(*symbol_file, loaded) );
+            loader = true;
+        } else {
+            loaded = it->second;
+        }
+    }
+
+    if( loader ) {
+        CompiledSymbols data;
+        try {
+            data = loadCompiled(*symbol_file);
+        } catch(...) {
+            forget(*symbol_file);
+            loading.set_exception( current_exception() );
+            throw;
+        }
+
+        // Failures aren't remembered, so that a later request can try again
+        if( !data.first ) {
+            forget(*symbol_file);
+        }
+        loading.set_value(data);
+    }
+
+    const CompiledSymbols& data = loaded.get();
+    if( !data.first ) {
+        BPLOG(ERROR) << "Couldn't load symbol file " << *symbol_file;
+        return NOT_FOUND;
+    }
+
+    // FastSourceLineResolver only ever reads through this pointer, so a read-only mapping is fine.
+    *symbol_data        = const_cast<char*>(data.first);
+    *symbol_data_size   = data.second;
+    return FOUND;
+}
+
+
+/**
+ * Does nothing: symbol data is shared by every resolver in the process and is never freed.
+ */
+void CompiledSymbolSupplier::FreeSymbolData( const CodeModule* ) {
+}
+
+
+} // namespace
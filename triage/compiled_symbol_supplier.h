@@ -0,0 +1,46 @@
+// XXX_INCLUDE_TOB_COPYRIGHT_HERE
+
+// A symbol supplier that hands out precompiled symbols, for FastSourceLineResolver.
+//
+// Parsing a text .sym file is most of the cost of symbolizing a module, and for big PDB-derived symbol
+// files it takes seconds.  The first time a .sym file is needed it's compiled into breakpad's flat
+// serialized module format (see processor/module_serializer.h) and written next to it as a .symc file;
+// `triager -c` does the same ahead of time.  After that the .symc file is memory-mapped and its sorted
+// function, line, public symbol, STACK WIN and CFI tables are binary-searched in place.
+//
+// Mappings are shared by every Triage in the process and live until it exits, so a SharedResolver can
+// keep using modules that were loaded for a dump that's since been destroyed.
+
+#ifndef CompiledSymbolSupplier_H
+#define CompiledSymbolSupplier_H
+
+#include <string>
+
+#include "google_breakpad/processor/code_module.h"
+#include "google_breakpad/processor/system_info.h"
+#include "simple_symbol_supplier.h"
+
+using namespace std;
+using namespace google_breakpad;
+
+
+namespace sl2 {
+
+class CompiledSymbolSupplier : public SimpleSymbolSupplier {
+
+public:
+    explicit CompiledSymbolSupplier( const string& path );
+
+    SymbolResult        GetCStringSymbolData( const CodeModule* module, const SystemInfo* system_info,
+                                              string* symbol_file, char** symbol_data,
+                                              size_t* symbol_data_size ) override;
+    void                FreeSymbolData( const CodeModule* ) override;
+
+    static bool         compile( const string& symbolPath );
+    static string       compiledPath( const string& symbolPath );
+
+};
+
+} // namespace
+
+#endif
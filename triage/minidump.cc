@@ -43,7 +43,14 @@
 
 #ifdef _WIN32
 #include <io.h>
+#define NOMINMAX
+#define NOGDI
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
 #else  // _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #endif  // _WIN32
 
@@ -1236,7 +1243,8 @@ uint32_t MinidumpMemoryRegion::max_bytes_ = 64 * 1024 * 1024;  // 64MB
 MinidumpMemoryRegion::MinidumpMemoryRegion(Minidump* minidump)
     : MinidumpObject(minidump),
       descriptor_(NULL),
-      memory_(NULL) {
+      memory_(NULL),
+      view_(NULL) {
   hexdump_width_ = minidump_ ? minidump_->HexdumpMode() : 0;
   hexdump_ = hexdump_width_ != 0;
 }
@@ -1262,12 +1270,27 @@ const uint8_t* MinidumpMemoryRegion::GetMemory() const {
     return NULL;
   }
 
+  if (view_) {
+    return view_;
+  }
+
   if (!memory_) {
     if (descriptor_->memory.data_size == 0) {
       BPLOG(ERROR) << "MinidumpMemoryRegion is empty";
       return NULL;
     }
 
+    // A mapped minidump can hand out its memory regions without copying
+    // them, and without the size limit that guards the copy.
+    if (minidump_->mapped()) {
+      view_ = minidump_->MapBytes(descriptor_->memory.rva,
+                                  descriptor_->memory.data_size);
+      if (!view_) {
+        BPLOG(ERROR) << "MinidumpMemoryRegion is out of bounds";
+      }
+      return view_;
+    }
+
     if (!minidump_->SeekSet(descriptor_->memory.rva)) {
       BPLOG(ERROR) << "MinidumpMemoryRegion could not seek to memory region";
       return NULL;
@@ -1318,6 +1341,7 @@ uint32_t MinidumpMemoryRegion::GetSize() const {
 void MinidumpMemoryRegion::FreeMemory() {
   delete memory_;
   memory_ = NULL;
+  view_ = NULL;
 }
 
 
@@ -1389,6 +1413,16 @@ bool MinidumpMemoryRegion::GetMemoryAtAddress(uint64_t  address,
 }
 
 
+const uint8_t* MinidumpMemoryRegion::GetContiguousMemory() const {
+  // GetMemoryAtAddress swaps each value as it reads it; callers reading the
+  // raw bytes would have to do the same, so don't hand them out.
+  if (!valid_ || minidump_->swap())
+    return NULL;
+
+  return GetMemory();
+}
+
+
 void MinidumpMemoryRegion::Print() const {
   if (!valid_) {
     BPLOG(ERROR) << "MinidumpMemoryRegion cannot print invalid data";
@@ -4997,7 +5031,12 @@ Minidump::Minidump(const string& path, bool hexdump, unsigned int hexdump_width)
       swap_(false),
       valid_(false),
       hexdump_(hexdump),
-      hexdump_width_(hexdump_width) {
+      hexdump_width_(hexdump_width),
+      map_requested_(false),
+      map_base_(NULL),
+      map_size_(0),
+      map_offset_(0),
+      map_handle_(NULL) {
 }
 
 Minidump::Minidump(istream& stream)
@@ -5009,22 +5048,119 @@ Minidump::Minidump(istream& stream)
       swap_(false),
       valid_(false),
       hexdump_(false),
-      hexdump_width_(0) {
+      hexdump_width_(0),
+      map_requested_(false),
+      map_base_(NULL),
+      map_size_(0),
+      map_offset_(0),
+      map_handle_(NULL) {
 }
 
 Minidump::~Minidump() {
-  if (stream_) {
+  if (stream_ || map_base_) {
     BPLOG(INFO) << "Minidump closing minidump";
   }
   if (!path_.empty()) {
     delete stream_;
   }
+  // The memory regions in stream_map_ may point into the mapping, so it has
+  // to outlive them.
   delete directory_;
   delete stream_map_;
+  UnmapFile();
+}
+
+
+bool Minidump::MapFile() {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path_.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+
+  // The mapping object keeps the file open; we don't need our handle.
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (!mapping) {
+    return false;
+  }
+
+  const void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!base) {
+    CloseHandle(mapping);
+    return false;
+  }
+
+  map_handle_ = mapping;
+  map_size_ = size.QuadPart;
+#else  // _WIN32
+  int fd = open(path_.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat sb;
+  if (fstat(fd, &sb) == -1 || sb.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  // The mapping keeps the file open; we don't need our descriptor.
+  void* base = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+
+  map_size_ = sb.st_size;
+#endif  // _WIN32
+
+  map_base_ = static_cast<const uint8_t*>(base);
+  map_offset_ = 0;
+  return true;
+}
+
+
+void Minidump::UnmapFile() {
+  if (!map_base_) {
+    return;
+  }
+
+#ifdef _WIN32
+  UnmapViewOfFile(map_base_);
+  CloseHandle(map_handle_);
+#else  // _WIN32
+  munmap(const_cast<uint8_t*>(map_base_), map_size_);
+#endif  // _WIN32
+
+  map_base_ = NULL;
+  map_handle_ = NULL;
+  map_size_ = 0;
+  map_offset_ = 0;
 }
 
 
 bool Minidump::Open() {
+  if (map_base_) {
+    return SeekSet(0);
+  }
+
+  if (map_requested_ && !path_.empty() && stream_ == NULL) {
+    if (MapFile()) {
+      BPLOG(INFO) << "Minidump mapped minidump " << path_;
+      return true;
+    }
+
+    BPLOG(INFO) << "Minidump could not map " << path_ << ", reading it instead";
+  }
+
   if (stream_ != NULL) {
     BPLOG(INFO) << "Minidump reopening minidump " << path_;
 
@@ -5484,6 +5620,18 @@ const MDRawDirectory* Minidump::GetDirectoryEntryAtIndex(unsigned int index)
 bool Minidump::ReadBytes(void* bytes, size_t count) {
   // Can't check valid_ because Read needs to call this method before
   // validity can be determined.
+  if (map_base_) {
+    if (count > map_size_ - map_offset_) {
+      BPLOG(ERROR) << "ReadBytes: read " << map_size_ - map_offset_ << "/" <<
+                      count;
+      return false;
+    }
+
+    memcpy(bytes, map_base_ + map_offset_, count);
+    map_offset_ += count;
+    return true;
+  }
+
   if (!stream_) {
     return false;
   }
@@ -5516,6 +5664,16 @@ bool Minidump::ReadBytes(void* bytes, size_t count) {
 bool Minidump::SeekSet(off_t offset) {
   // Can't check valid_ because Read needs to call this method before
   // validity can be determined.
+  if (map_base_) {
+    if (offset < 0 || static_cast<uint64_t>(offset) > map_size_) {
+      BPLOG(ERROR) << "SeekSet: offset " << offset << " past end of minidump";
+      return false;
+    }
+
+    map_offset_ = offset;
+    return true;
+  }
+
   if (!stream_) {
     return false;
   }
@@ -5530,6 +5688,10 @@ bool Minidump::SeekSet(off_t offset) {
 }
 
 off_t Minidump::Tell() {
+  if (valid_ && map_base_) {
+    return static_cast<off_t>(map_offset_);
+  }
+
   if (!valid_ || !stream_) {
     return (off_t)-1;
   }
@@ -5546,6 +5708,16 @@ off_t Minidump::Tell() {
 }
 
 
+const uint8_t* Minidump::MapBytes(off_t offset, size_t count) const {
+  if (!map_base_ || offset < 0 || static_cast<uint64_t>(offset) > map_size_ ||
+      count > map_size_ - offset) {
+    return NULL;
+  }
+
+  return map_base_ + offset;
+}
+
+
 string* Minidump::ReadString(off_t offset) {
   if (!valid_) {
     BPLOG(ERROR) << "Invalid Minidump for ReadString";
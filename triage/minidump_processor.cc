@@ -31,6 +31,7 @@
 
 #include <assert.h>
 
+#include <chrono>
 #include <string>
 
 #include "common/scoped_ptr.h"
@@ -47,12 +48,37 @@
 
 namespace google_breakpad {
 
+namespace {
+
+// Adds the time between its construction and destruction to *total, in
+// microseconds.
+class WalkTimer {
+ public:
+  explicit WalkTimer(uint64_t *total)
+      : total_(total), start_(std::chrono::steady_clock::now()) {}
+
+  ~WalkTimer() {
+    *total_ += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_).count();
+  }
+
+ private:
+  uint64_t *total_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace
+
 MinidumpProcessor::MinidumpProcessor(SymbolSupplier *supplier,
                                      SourceLineResolverInterface *resolver)
     : frame_symbolizer_(new StackFrameSymbolizer(supplier, resolver)),
       own_frame_symbolizer_(true),
       enable_exploitability_(false),
-      enable_objdump_(false) {
+      enable_objdump_(false),
+      requesting_thread_only_(false),
+      max_frames_(0),
+      max_scan_words_(0),
+      stackwalk_microseconds_(0) {
 }
 
 MinidumpProcessor::MinidumpProcessor(SymbolSupplier *supplier,
@@ -61,7 +87,11 @@ MinidumpProcessor::MinidumpProcessor(SymbolSupplier *supplier,
     : frame_symbolizer_(new StackFrameSymbolizer(supplier, resolver)),
       own_frame_symbolizer_(true),
       enable_exploitability_(enable_exploitability),
-      enable_objdump_(false) {
+      enable_objdump_(false),
+      requesting_thread_only_(false),
+      max_frames_(0),
+      max_scan_words_(0),
+      stackwalk_microseconds_(0) {
 }
 
 MinidumpProcessor::MinidumpProcessor(StackFrameSymbolizer *frame_symbolizer,
@@ -69,7 +99,11 @@ MinidumpProcessor::MinidumpProcessor(StackFrameSymbolizer *frame_symbolizer,
     : frame_symbolizer_(frame_symbolizer),
       own_frame_symbolizer_(false),
       enable_exploitability_(enable_exploitability),
-      enable_objdump_(false) {
+      enable_objdump_(false),
+      requesting_thread_only_(false),
+      max_frames_(0),
+      max_scan_words_(0),
+      stackwalk_microseconds_(0) {
   assert(frame_symbolizer_);
 }
 
@@ -83,6 +117,8 @@ ProcessResult MinidumpProcessor::Process(
   assert(process_state);
 
   process_state->Clear();
+  deferred_threads_.clear();
+  stackwalk_microseconds_ = 0;
 
   const MDRawHeader *header = dump->header();
   if (!header) {
@@ -209,8 +245,10 @@ ProcessResult MinidumpProcessor::Process(
     }
 
     MinidumpContext *context = thread->GetContext();
+    bool is_requesting_thread =
+        has_requesting_thread && thread_id == requesting_thread_id;
 
-    if (has_requesting_thread && thread_id == requesting_thread_id) {
+    if (is_requesting_thread) {
       if (found_requesting_thread) {
         // There can't be more than one requesting thread.
         BPLOG(ERROR) << "Duplicate requesting thread: " << thread_string;
@@ -255,6 +293,19 @@ ProcessResult MinidumpProcessor::Process(
       BPLOG(ERROR) << "No memory region for " << thread_string;
     }
 
+    // In requesting-thread-only mode, leave an empty stack in this thread's
+    // slot and walk it later, if anyone asks for it.
+    if (requesting_thread_only_ && has_requesting_thread &&
+        !is_requesting_thread) {
+      CallStack *stack = new CallStack();
+      stack->set_tid(thread_id);
+      deferred_threads_.push_back(
+          std::make_pair(process_state->threads_.size(), thread_index));
+      process_state->threads_.push_back(stack);
+      process_state->thread_memory_regions_.push_back(thread_memory);
+      continue;
+    }
+
     // Use process_state->modules_ instead of module_list, because the
     // |modules| argument will be used to populate the |module| fields in
     // the returned StackFrame objects, which will be placed into the
@@ -273,6 +324,10 @@ ProcessResult MinidumpProcessor::Process(
 
     scoped_ptr<CallStack> stack(new CallStack());
     if (stackwalker.get()) {
+      if (is_requesting_thread)
+        stackwalker->set_frame_limit(max_frames_);
+      stackwalker->set_scan_limit(max_scan_words_);
+      WalkTimer timer(&stackwalk_microseconds_);
       if (!stackwalker->Walk(stack.get(),
                              &process_state->modules_without_symbols_,
                              &process_state->modules_with_corrupt_symbols_)) {
@@ -327,6 +382,70 @@ ProcessResult MinidumpProcessor::Process(
   return PROCESS_OK;
 }
 
+ProcessResult MinidumpProcessor::WalkDeferredThreads(
+    Minidump *dump, ProcessState *process_state) {
+  assert(dump);
+  assert(process_state);
+
+  if (deferred_threads_.empty())
+    return PROCESS_OK;
+
+  MinidumpThreadList *threads = dump->GetThreadList();
+  if (!threads) {
+    BPLOG(ERROR) << "Minidump " << dump->path() << " has no thread list";
+    return PROCESS_ERROR_NO_THREAD_LIST;
+  }
+
+  bool interrupted = false;
+  for (size_t i = 0; i < deferred_threads_.size(); ++i) {
+    size_t state_index = deferred_threads_[i].first;
+    unsigned int thread_index = deferred_threads_[i].second;
+
+    MinidumpThread *thread = threads->GetThreadAtIndex(thread_index);
+    if (!thread) {
+      BPLOG(ERROR) << "Could not get thread " << thread_index << " for "
+                   << dump->path();
+      return PROCESS_ERROR_GETTING_THREAD;
+    }
+
+    // None of these is the requesting thread, so the thread's own context
+    // is the right one, and the stack memory was already found by Process.
+    scoped_ptr<Stackwalker> stackwalker(
+        Stackwalker::StackwalkerForCPU(
+            process_state->system_info(),
+            thread->GetContext(),
+            process_state->thread_memory_regions_[state_index],
+            process_state->modules_,
+            process_state->unloaded_modules_,
+            frame_symbolizer_));
+
+    if (!stackwalker.get()) {
+      BPLOG(ERROR) << "No stackwalker for thread " << thread_index << " in "
+                   << dump->path();
+      continue;
+    }
+
+    stackwalker->set_scan_limit(max_scan_words_);
+    WalkTimer timer(&stackwalk_microseconds_);
+    if (!stackwalker->Walk(process_state->threads_[state_index],
+                           &process_state->modules_without_symbols_,
+                           &process_state->modules_with_corrupt_symbols_)) {
+      BPLOG(INFO) << "Stackwalker interrupt (missing symbols?) at thread "
+                  << thread_index << " in " << dump->path();
+      interrupted = true;
+    }
+  }
+
+  deferred_threads_.clear();
+
+  if (interrupted) {
+    BPLOG(INFO) << "Processing interrupted for " << dump->path();
+    return PROCESS_SYMBOL_SUPPLIER_INTERRUPTED;
+  }
+
+  return PROCESS_OK;
+}
+
 ProcessResult MinidumpProcessor::Process(
     const string &minidump_file, ProcessState *process_state) {
   BPLOG(INFO) << "Processing minidump in file " << minidump_file;
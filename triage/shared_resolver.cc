@@ -0,0 +1,198 @@
+// XXX_INCLUDE_TOB_COPYRIGHT_HERE
+
+// A source line resolver that can be shared by several Triage objects processing minidumps concurrently.
+// See shared_resolver.h.
+
+#include "shared_resolver.h"
+
+#include <mutex>
+
+#include "google_breakpad/processor/stack_frame.h"
+
+using namespace std;
+using namespace google_breakpad;
+
+namespace sl2 {
+
+
+/**
+ * Presents a module to the underlying resolver with its debug file and identifier as its code file,
+ * since that's what breakpad's resolvers key their modules by.
+ */
+class DebugIdModule : public CodeModule {
+
+public:
+    DebugIdModule( const CodeModule* module )
+        :   module_(module) {
+        if( module_->debug_identifier().empty() ) {
+            key_ = module_->code_file() + "/" + module_->code_identifier();
+        } else {
+            key_ = module_->debug_file() + "/" + module_->debug_identifier();
+        }
+    }
+
+    uint64_t    base_address()      const override { return module_->base_address(); }
+    uint64_t    size()              const override { return module_->size(); }
+    string      code_file()         const override { return key_; }
+    string      code_identifier()   const override { return module_->code_identifier(); }
+    string      debug_file()        const override { return module_->debug_file(); }
+    string      debug_identifier()  const override { return module_->debug_identifier(); }
+    string      version()           const override { return module_->version(); }
+    CodeModule* Copy()              const override { return module_->Copy(); }
+    uint64_t    shrink_down_delta() const override { return module_->shrink_down_delta(); }
+    void        SetShrinkDownDelta( uint64_t ) override {}
+    bool        is_unloaded()       const override { return module_->is_unloaded(); }
+
+private:
+    const CodeModule*   module_;
+    string              key_;
+};
+
+
+/**
+ * Loads a module's symbols from a file, unless another dump already has.
+ * @return whether the module's symbols are loaded
+ */
+bool SharedResolver::LoadModule( const CodeModule* module, const string& map_file ) {
+    if( !module ) {
+        return false;
+    }
+
+    DebugIdModule keyed(module);
+    unique_lock<shared_mutex> lock(mutex_);
+
+    if( resolver_.HasModule(&keyed) ) {
+        return true;
+    }
+
+    return resolver_.LoadModule( &keyed, map_file );
+}
+
+/**
+ * Loads a module's symbols from a string, unless another dump already has.
+ * @return whether the module's symbols are loaded
+ */
+bool SharedResolver::LoadModuleUsingMapBuffer( const CodeModule* module, const string& map_buffer ) {
+    if( !module ) {
+        return false;
+    }
+
+    DebugIdModule keyed(module);
+    unique_lock<shared_mutex> lock(mutex_);
+
+    if( resolver_.HasModule(&keyed) ) {
+        return true;
+    }
+
+    return resolver_.LoadModuleUsingMapBuffer( &keyed, map_buffer );
+}
+
+/**
+ * Loads a module's symbols from a buffer, unless another dump already has.
+ * Two dumps can race to load the same module; the loser's buffer is simply not parsed.
+ * @return whether the module's symbols are loaded
+ */
+bool SharedResolver::LoadModuleUsingMemoryBuffer( const CodeModule* module, char* memory_buffer,
+                                                  size_t memory_buffer_size ) {
+    if( !module ) {
+        return false;
+    }
+
+    DebugIdModule keyed(module);
+    unique_lock<shared_mutex> lock(mutex_);
+
+    if( resolver_.HasModule(&keyed) ) {
+        return true;
+    }
+
+    return resolver_.LoadModuleUsingMemoryBuffer( &keyed, memory_buffer, memory_buffer_size );
+}
+
+/**
+ * The fast resolver reads modules in place, so their buffers must outlive it.
+ * CompiledSymbolSupplier's buffers last as long as the process does.
+ */
+bool SharedResolver::ShouldDeleteMemoryBufferAfterLoadModule() {
+    return false;
+}
+
+/**
+ * Unloading is ignored, since other dumps may still be using the module's symbols.
+ */
+void SharedResolver::UnloadModule( const CodeModule* module ) {
+}
+
+bool SharedResolver::HasModule( const CodeModule* module ) {
+    if( !module ) {
+        return false;
+    }
+
+    DebugIdModule keyed(module);
+    shared_lock<shared_mutex> lock(mutex_);
+    return resolver_.HasModule(&keyed);
+}
+
+bool SharedResolver::IsModuleCorrupt( const CodeModule* module ) {
+    if( !module ) {
+        return false;
+    }
+
+    DebugIdModule keyed(module);
+    shared_lock<shared_mutex> lock(mutex_);
+    return resolver_.IsModuleCorrupt(&keyed);
+}
+
+/**
+ * Fills in a frame's function and source line information.
+ * The frame's module is swapped for its keyed stand-in for the duration of the lookup.
+ */
+void SharedResolver::FillSourceLineInfo( StackFrame* frame ) {
+    if( !frame->module ) {
+        return;
+    }
+
+    const CodeModule* module = frame->module;
+    DebugIdModule keyed(module);
+
+    frame->module = &keyed;
+    {
+        shared_lock<shared_mutex> lock(mutex_);
+        resolver_.FillSourceLineInfo(frame);
+    }
+    frame->module = module;
+}
+
+/**
+ * @return the frame's Windows (STACK WIN) unwind information, owned by the caller, or NULL
+ */
+WindowsFrameInfo* SharedResolver::FindWindowsFrameInfo( const StackFrame* frame ) {
+    if( !frame->module ) {
+        return NULL;
+    }
+
+    DebugIdModule keyed(frame->module);
+    StackFrame copy = *frame;
+    copy.module = &keyed;
+
+    shared_lock<shared_mutex> lock(mutex_);
+    return resolver_.FindWindowsFrameInfo(&copy);
+}
+
+/**
+ * @return the frame's CFI unwind rules, owned by the caller, or NULL
+ */
+CFIFrameInfo* SharedResolver::FindCFIFrameInfo( const StackFrame* frame ) {
+    if( !frame->module ) {
+        return NULL;
+    }
+
+    DebugIdModule keyed(frame->module);
+    StackFrame copy = *frame;
+    copy.module = &keyed;
+
+    shared_lock<shared_mutex> lock(mutex_);
+    return resolver_.FindCFIFrameInfo(&copy);
+}
+
+
+} // namespace
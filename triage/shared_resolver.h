@@ -0,0 +1,55 @@
+// XXX_INCLUDE_TOB_COPYRIGHT_HERE
+
+// A source line resolver that can be shared by several Triage objects processing minidumps concurrently
+// (see batch mode in triager.cc).  Symbols and CFI for a module are parsed once, the first time any dump
+// needs them, and every later dump that loaded the same build of the module reuses them.
+//
+// Symbols come from a CompiledSymbolSupplier, so the underlying resolver is a FastSourceLineResolver; it
+// only keeps pointers into the supplier's mapped symbol files, which outlive every Triage.
+//
+// Modules are keyed by their debug file and debug identifier rather than by code file (as breakpad's
+// resolvers do), so two dumps from different builds of the same binary don't share symbols.
+
+#ifndef SharedResolver_H
+#define SharedResolver_H
+
+#include <shared_mutex>
+#include <string>
+
+#include "google_breakpad/processor/code_module.h"
+#include "google_breakpad/processor/fast_source_line_resolver.h"
+#include "google_breakpad/processor/source_line_resolver_interface.h"
+
+using namespace std;
+using namespace google_breakpad;
+
+
+namespace sl2 {
+
+class SharedResolver : public SourceLineResolverInterface {
+
+public:
+    bool                LoadModule( const CodeModule* module, const string& map_file ) override;
+    bool                LoadModuleUsingMapBuffer( const CodeModule* module, const string& map_buffer ) override;
+    bool                LoadModuleUsingMemoryBuffer( const CodeModule* module, char* memory_buffer,
+                                                     size_t memory_buffer_size ) override;
+    bool                ShouldDeleteMemoryBufferAfterLoadModule() override;
+    void                UnloadModule( const CodeModule* module ) override;
+    bool                HasModule( const CodeModule* module ) override;
+    bool                IsModuleCorrupt( const CodeModule* module ) override;
+    void                FillSourceLineInfo( StackFrame* frame ) override;
+    WindowsFrameInfo*   FindWindowsFrameInfo( const StackFrame* frame ) override;
+    CFIFrameInfo*       FindCFIFrameInfo( const StackFrame* frame ) override;
+
+private:
+
+    // Loads are rare (once per module build) and everything else is a lookup, so lookups only
+    // take the lock shared.
+    shared_mutex                    mutex_;
+    FastSourceLineResolver          resolver_;
+
+};
+
+} // namespace
+
+#endif
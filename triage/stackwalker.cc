@@ -37,6 +37,9 @@
 
 #include <assert.h>
 
+#include <algorithm>
+#include <limits>
+
 #include "common/scoped_ptr.h"
 #include "google_breakpad/processor/call_stack.h"
 #include "google_breakpad/processor/code_module.h"
@@ -78,7 +81,10 @@ Stackwalker::Stackwalker(const SystemInfo* system_info,
       memory_(memory),
       modules_(modules),
       unloaded_modules_(NULL),
-      frame_symbolizer_(frame_symbolizer) {
+      frame_symbolizer_(frame_symbolizer),
+      frame_limit_(0),
+      scan_limit_(0),
+      module_ranges_built_(false) {
   assert(frame_symbolizer_);
 }
 
@@ -177,6 +183,9 @@ bool Stackwalker::Walk(
     // Add the frame to the call stack.  Relinquish the ownership claim
     // over the frame, because the stack now owns it.
     stack->frames_.push_back(frame.release());
+    if (frame_limit_ && stack->frames_.size() >= frame_limit_) {
+      break;
+    }
     if (stack->frames_.size() > max_frames_) {
       // Only emit an error message in the case where the limit
       // reached is the default limit, not set by the user.
@@ -302,6 +311,45 @@ bool Stackwalker::TerminateWalk(uint64_t caller_ip,
   return false;
 }
 
+void Stackwalker::BuildModuleRanges() {
+  if (module_ranges_built_)
+    return;
+  module_ranges_built_ = true;
+
+  vector<std::pair<uint64_t, uint64_t> > ranges;
+  for (unsigned int i = 0; i < modules_->module_count(); ++i) {
+    const CodeModule* module = modules_->GetModuleAtIndex(i);
+    if (!module || !module->size() ||
+        module->base_address() + module->size() < module->base_address())
+      continue;
+    ranges.push_back(std::make_pair(module->base_address(),
+                                    module->base_address() + module->size()));
+  }
+  std::sort(ranges.begin(), ranges.end());
+
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    if (!module_ranges_.empty() &&
+        ranges[i].first <= module_ranges_.back().second) {
+      module_ranges_.back().second =
+          std::max(module_ranges_.back().second, ranges[i].second);
+    } else {
+      module_ranges_.push_back(ranges[i]);
+    }
+  }
+}
+
+bool Stackwalker::InModuleRanges(uint64_t address) const {
+  // Find the last range starting at or before address.
+  vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+      std::upper_bound(module_ranges_.begin(), module_ranges_.end(),
+                       std::make_pair(address,
+                                      std::numeric_limits<uint64_t>::max()));
+  if (it == module_ranges_.begin())
+    return false;
+  --it;
+  return address < it->second;
+}
+
 bool Stackwalker::InstructionAddressSeemsValid(uint64_t address) const {
   StackFrame frame;
   frame.instruction = address;
@@ -35,8 +35,15 @@
 
 #include <assert.h>
 
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
 #include "common/scoped_ptr.h"
 #include "google_breakpad/processor/call_stack.h"
+#include "google_breakpad/processor/code_module.h"
 #include "google_breakpad/processor/memory_region.h"
 #include "google_breakpad/processor/source_line_resolver_interface.h"
 #include "google_breakpad/processor/stack_frame_cpu.h"
@@ -47,6 +54,32 @@
 
 namespace google_breakpad {
 
+namespace {
+
+// Compiled CFI rules, shared by every AMD64 stackwalker in the process.
+// They're keyed by module build (debug file and identifier, the same key
+// symbols are found by) and then by the start of the module-relative
+// address range they cover, so rules compiled for one frame serve every
+// later frame in the same range, in this dump or any other.
+struct CFICacheEntry {
+  uint64_t end;
+  std::shared_ptr<const CompiledCFIWalker<uint64_t,
+                                          MDRawContextAMD64>::Program> program;
+};
+
+typedef std::map<uint64_t, CFICacheEntry> CFIRangeCache;
+
+std::shared_mutex cfi_cache_mutex;
+std::map<string, CFIRangeCache> cfi_cache;
+
+string CFICacheKey(const CodeModule* module) {
+  if (module->debug_identifier().empty())
+    return module->code_file() + "/" + module->code_identifier();
+  return module->debug_file() + "/" + module->debug_identifier();
+}
+
+}  // namespace
+
 
 const StackwalkerAMD64::CFIWalker::RegisterSet
 StackwalkerAMD64::cfi_register_map_[] = {
@@ -99,7 +132,10 @@ StackwalkerAMD64::StackwalkerAMD64(const SystemInfo* system_info,
     : Stackwalker(system_info, memory, modules, resolver_helper),
       context_(context),
       cfi_walker_(cfi_register_map_,
-                  (sizeof(cfi_register_map_) / sizeof(cfi_register_map_[0]))) {
+                  (sizeof(cfi_register_map_) / sizeof(cfi_register_map_[0]))),
+      compiled_cfi_walker_(cfi_register_map_,
+                           (sizeof(cfi_register_map_) /
+                            sizeof(cfi_register_map_[0]))) {
 }
 
 uint64_t StackFrameAMD64::ReturnAddress() const {
@@ -147,6 +183,71 @@ StackFrameAMD64* StackwalkerAMD64::GetCallerByCFIFrameInfo(
   return frame.release();
 }
 
+StackFrameAMD64* StackwalkerAMD64::GetCallerByCFIProgram(
+    const vector<StackFrame*> &frames,
+    const CFIProgram &cfi_program) {
+  StackFrameAMD64* last_frame = static_cast<StackFrameAMD64*>(frames.back());
+
+  scoped_ptr<StackFrameAMD64> frame(new StackFrameAMD64());
+  if (!compiled_cfi_walker_
+      .FindCallerRegisters(*memory_, cfi_program,
+                           last_frame->context, last_frame->context_validity,
+                           &frame->context, &frame->context_validity))
+    return NULL;
+
+  // Make sure we recovered all the essentials.
+  static const int essentials = (StackFrameAMD64::CONTEXT_VALID_RIP
+                                 | StackFrameAMD64::CONTEXT_VALID_RSP);
+  if ((frame->context_validity & essentials) != essentials)
+    return NULL;
+
+  frame->trust = StackFrame::FRAME_TRUST_CFI;
+  return frame.release();
+}
+
+std::shared_ptr<const StackwalkerAMD64::CFIProgram>
+StackwalkerAMD64::FindCFIProgram(const StackFrame* frame) {
+  if (!frame->module)
+    return NULL;
+
+  uint64_t address = frame->instruction - frame->module->base_address();
+  string key = CFICacheKey(frame->module);
+
+  std::shared_lock<std::shared_mutex> lock(cfi_cache_mutex);
+  std::map<string, CFIRangeCache>::const_iterator module =
+      cfi_cache.find(key);
+  if (module == cfi_cache.end())
+    return NULL;
+
+  // Find the last range starting at or before the address.
+  CFIRangeCache::const_iterator range = module->second.upper_bound(address);
+  if (range == module->second.begin())
+    return NULL;
+  --range;
+
+  if (address >= range->second.end)
+    return NULL;
+  return range->second.program;
+}
+
+std::shared_ptr<const StackwalkerAMD64::CFIProgram>
+StackwalkerAMD64::CompileCFIProgram(const StackFrame* frame,
+                                    const CFIFrameInfo& cfi_frame_info) {
+  std::shared_ptr<const CFIProgram> program(
+      compiled_cfi_walker_.Compile(cfi_frame_info));
+  if (!program || !frame->module)
+    return program;
+
+  uint64_t start, end;
+  if (!cfi_frame_info.GetRange(&start, &end))
+    return program;
+
+  CFICacheEntry entry = { end, program };
+  std::unique_lock<std::shared_mutex> lock(cfi_cache_mutex);
+  cfi_cache[CFICacheKey(frame->module)].insert(std::make_pair(start, entry));
+  return program;
+}
+
 // Returns true if `ptr` is not in x86-64 canonical form.
 // https://en.wikipedia.org/wiki/X86-64#Virtual_address_space_details
 static bool is_non_canonical(uint64_t ptr) {
@@ -277,11 +378,23 @@ StackFrame* StackwalkerAMD64::GetCallerFrame(const CallStack* stack,
   StackFrameAMD64* last_frame = static_cast<StackFrameAMD64*>(frames.back());
   scoped_ptr<StackFrameAMD64> new_frame;
 
-  // If we have DWARF CFI information, use it.
-  scoped_ptr<CFIFrameInfo> cfi_frame_info(
-      frame_symbolizer_->FindCFIFrameInfo(last_frame));
-  if (cfi_frame_info.get())
-    new_frame.reset(GetCallerByCFIFrameInfo(frames, cfi_frame_info.get()));
+  // If we have DWARF CFI information, use it.  Rules that have been used
+  // before, by any stackwalker in this process, are already compiled;
+  // anything else is looked up, compiled and cached for next time.
+  std::shared_ptr<const CFIProgram> cfi_program = FindCFIProgram(last_frame);
+  if (cfi_program) {
+    new_frame.reset(GetCallerByCFIProgram(frames, *cfi_program));
+  } else {
+    scoped_ptr<CFIFrameInfo> cfi_frame_info(
+        frame_symbolizer_->FindCFIFrameInfo(last_frame));
+    if (cfi_frame_info.get()) {
+      cfi_program = CompileCFIProgram(last_frame, *cfi_frame_info);
+      if (cfi_program)
+        new_frame.reset(GetCallerByCFIProgram(frames, *cfi_program));
+      else
+        new_frame.reset(GetCallerByCFIFrameInfo(frames, cfi_frame_info.get()));
+    }
+  }
 
   // If CFI was not available or failed, try using frame pointer recovery.
   if (!new_frame.get()) {
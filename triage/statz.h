@@ -1,6 +1,8 @@
 #ifndef Statz_HH
 #define Statz_HH
 
+#include <cmath>
+#include <cstdint>
 #include <vector>
 
 using namespace std;
@@ -8,6 +8,7 @@
 #include "triage.h"
 
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <iterator>
@@ -23,6 +24,7 @@
 #include "google_breakpad/processor/process_state.h"
 #include "google_breakpad/processor/call_stack.h"
 #include "google_breakpad/processor/stack_frame.h"
+#include "processor/pathname_stripper.h"
 #include "stackwalk_common.h"
 
 
@@ -33,22 +35,63 @@ using namespace google_breakpad;
 
 using google_breakpad::MinidumpProcessor;
 using google_breakpad::ProcessState;
-using google_breakpad::SimpleSymbolSupplier;
 
 namespace sl2 {
 
 
+uint32_t Triage::maxFrames_ = 0;
+uint32_t Triage::maxScanWords_ = 0;
+
 
 /**
  * Constructor for Triage class which loads a minidump file
  * @param minidumpPath path to the minidump to load
  */
 Triage::Triage( const string& minidumpPath )
+    :   Triage(minidumpPath, nullptr) {
+
+}
+
+/**
+ * Constructor for Triage class which loads a minidump file, resolving symbols through a resolver
+ * shared with other Triage objects (see SharedResolver)
+ * @param minidumpPath path to the minidump to load
+ * @param resolver the resolver to use, or nullptr for one of our own.  Symbols are supplied
+ * precompiled (see CompiledSymbolSupplier), so it must be backed by a FastSourceLineResolver.
+ */
+Triage::Triage( const string& minidumpPath, SourceLineResolverInterface* resolver )
     :   minidumpPath_(minidumpPath),
         symbolSupplier_(minidumpPath),
-        proc_(&symbolSupplier_, &resolver_, true),
+        symbolResolver_(resolver ? resolver : &resolver_),
+        proc_(&symbolSupplier_, symbolResolver_, true),
         dump_ (minidumpPath) {
+    // Full-memory dumps can be hundreds of MB; map them rather than copying every region we touch.
+    dump_.set_mapped(true);
+
+    // Only the crashing thread matters for bucketing and exploitability; the other threads are
+    // walked on demand, for the human-readable report.
+    proc_.set_requesting_thread_only(true);
+    proc_.set_max_frames(maxFrames_);
+    proc_.set_max_scan_words(maxScanWords_);
+}
+
+
+/**
+ * Limits how deep the crashing thread's stack is walked, and so how many frames go into the crash
+ * hash, for every Triage constructed afterwards
+ * @param maxFrames the maximum number of frames, or 0 for no limit
+ */
+void Triage::setMaxFrames( uint32_t maxFrames ) {
+    maxFrames_ = maxFrames;
+}
 
+/**
+ * Limits how far each stack scan looks for a return address, for every Triage constructed afterwards.
+ * Stack-smashing crashes are walked almost entirely by scanning, so this bounds their cost.
+ * @param maxScanWords the maximum number of stack words per scan, or 0 for breakpad's defaults
+ */
+void Triage::setMaxScanWords( uint32_t maxScanWords ) {
+    maxScanWords_ = maxScanWords;
 }
 
 /**
@@ -57,15 +100,20 @@ Triage::Triage( const string& minidumpPath )
  */
 StatusCode Triage::preProcess() {
     ProcessResult   sc;
+    auto            start = chrono::steady_clock::now();
 
     // Read in minidump
     if( !dump_.Read() ) {
         return StatusCode::ERROR;
     }
 
+    auto            read = chrono::steady_clock::now();
+    stageTimes_.read = chrono::duration<double>( read - start ).count();
 
     // Do some breakpad processing
     sc = proc_.Process( &dump_, &state_);
+    stageTimes_.process     = chrono::duration<double>( chrono::steady_clock::now() - read ).count();
+    stageTimes_.stackwalk   = proc_.stackwalk_microseconds() / 1e6;
     if( PROCESS_OK!=sc ) {
         return StatusCode::ERROR;
     }
@@ -97,15 +145,7 @@ StatusCode Triage::process() {
 
 
 
-    // There is a bug in Visual Studio that doesn't let you do this the sane way...
-    vector< unique_ptr<Xploitability> > engine;
-    engine.push_back( make_unique<XploitabilityBreakpad>( &dump_, &state_) );
-    engine.push_back( make_unique<XploitabilityBangExploitable>( &dump_, &state_) );
-
-    for( const unique_ptr<Xploitability>& mod : engine ) {
-        processEngine(*mod);
-        xploitabilityEngine_ = mod.get();
-    }
+    processEngines(true);
 
     // Write the final triage information to the triage.json file
     // fs::path outminidumpPath(dirPath_.string());
@@ -113,7 +153,9 @@ StatusCode Triage::process() {
     // persist(outminidumpPath.string());
 
 
-    PrintProcessState( state_, true, &resolver_);
+    // The report prints every thread, so walk the ones that preProcess() skipped.
+    proc_.WalkDeferredThreads( &dump_, &state_ );
+    PrintProcessState( state_, true, symbolResolver_);
 
 
     const ProcessState& process_state = state_;
@@ -126,16 +168,61 @@ StatusCode Triage::process() {
 
 
 
+/**
+ * Does the same processing as process(), without printing anything.  Safe to call from several
+ * threads at once, on different Triage objects.
+ * @return Status code
+ */
+StatusCode Triage::analyze() {
+    StatusCode   sc;
+
+    sc = preProcess();
+    if( StatusCode::GOOD!=sc ) {
+        return StatusCode::ERROR;
+    }
+
+    processEngines(false);
+
+    return StatusCode::GOOD;
+}
+
+
+/**
+ * Runs every exploitability engine on the minidump.  The engines are kept around, since
+ * toJson() needs the last one's context.
+ * @param verbose whether to print each engine's result
+ */
+void Triage::processEngines( bool verbose ) {
+    // There is a bug in Visual Studio that doesn't let you do this the sane way...
+    engines_.clear();
+    stageTimes_.engines.clear();
+    engines_.push_back( make_unique<XploitabilityBreakpad>( &dump_, &state_) );
+    engines_.push_back( make_unique<XploitabilityBangExploitable>( &dump_, &state_) );
+
+    for( const unique_ptr<Xploitability>& mod : engines_ ) {
+        processEngine(*mod, verbose);
+        xploitabilityEngine_ = mod.get();
+    }
+}
+
+
 /**
  * process a single exploitability engine
  * @param x Which exploitability engine (!exploitable, tracer, breakpad) to use
+ * @param verbose whether to print the engine's result
  */
-void Triage::processEngine(Xploitability& x) {
+void Triage::processEngine(Xploitability& x, bool verbose) {
+    auto start = chrono::steady_clock::now();
+
     try {
-        cout << "Processing engine: " << x.name() << endl;
+        if( verbose ) {
+            cout << "Processing engine: " << x.name() << endl;
+        }
         const auto result   = x.process();
         results_.push_back( result );
-        cout << result << endl;
+        if( verbose ) {
+            cout << result << endl;
+        }
     } catch( string& x1 ) {
         cerr << x1 << endl;
     } catch( exception& x2 ) {
@@ -143,6 +230,8 @@ void Triage::processEngine(Xploitability& x) {
     } catch(...) {
         cerr << "processEngine() error" << endl;
     }
+
+    stageTimes_.engines.emplace_back( x.name(), chrono::duration<double>(chrono::steady_clock::now() - start).count() );
 }
 
 
@@ -160,17 +249,33 @@ int Triage::signalType() {
 }
 
 
+/**
+ * Finds the stack of the thread that crashed
+ * @return the crashing thread's stack, or nullptr if the minidump doesn't say which thread crashed
+ */
+const CallStack* Triage::crashingStack() const {
+    int threadid = state_.requesting_thread();
+    if( threadid < 0 || (size_t)threadid >= state_.threads()->size() ) {
+        return nullptr;
+    }
+    return state_.threads()->at(threadid);
+}
+
+
 /**
  * Retrieves the call stack from the minidump
- * @return Vector of stack frames
+ * @return Vector of stack frames, which is empty if there's no crashing thread
  */
 const vector<uint64_t> Triage::callStack() const {
-    int threadid = state_.requesting_thread();
-    const CallStack* stack = state_.threads()->at(threadid);
+    const CallStack* stack = crashingStack();
 
     uint8_t     i = 0;
 
     vector<uint64_t> ret;
+    if( !stack ) {
+        return ret;
+    }
+
     for( StackFrame* frame : *stack->frames()  ) {
         ret.push_back(frame->ReturnAddress());
     }
@@ -178,6 +283,36 @@ const vector<uint64_t> Triage::callStack() const {
 }
 
 
+/**
+ * Retrieves the call stack with each return address made relative to its module, so that the same
+ * crash gives the same frames from run to run despite ASLR.  Used to index crashes by the shape of
+ * their stacks.
+ * @return Vector of "module+0xoffset" strings, innermost frame first, or "???" for frames outside
+ * of any module.  Empty if there's no crashing thread.
+ */
+const vector<string> Triage::moduleFrames() const {
+    const CallStack* stack = crashingStack();
+
+    vector<string> ret;
+    if( !stack ) {
+        return ret;
+    }
+
+    for( const StackFrame* frame : *stack->frames() ) {
+        if( !frame->module ) {
+            ret.push_back("???");
+            continue;
+        }
+
+        ostringstream oss;
+        oss << PathnameStripper::File( frame->module->code_file() ) << "+0x" << hex
+            << ( frame->ReturnAddress() - frame->module->base_address() );
+        ret.push_back( oss.str() );
+    }
+    return ret;
+}
+
+
 /**
  * Returns the hash of the callstack.  This should uniquely identifiy
  * a crash (even with ASLR) by using the last 3 nibbles of the offset for each call in the callstack.
@@ -294,6 +429,14 @@ vector<XploitabilityRank>   Triage::ranks() const {
 }
 
 
+/**
+ * @return the time spent in each stage of the last preProcess(), analyze() or process()
+ */
+const StageTimes& Triage::stageTimes() const {
+    return stageTimes_;
+}
+
+
 /**
  * @return Stringified version of all three ranks
  */
@@ -318,53 +461,62 @@ const string Triage::minidumpPath() const {
  * @return the json object
  */
 json Triage::toJson() const {
-    auto ctx = xploitabilityEngine_->getContext();
-    return json{
+    json j = {
         { "crashReason",        crashReason() },
         { "crashAddress",       crashAddress() },
         { "exploitability",     exploitability() },
         { "tag",                triageTag() },
         { "callStack",          callStack() },
+        { "moduleFrames",       moduleFrames() },
         { "crashash",           crashash() },
         { "minidumpPath",       minidumpPath() },
         { "ranks",              ranks() },
         { "rank",               exploitabilityRank() },
         { "instructionPointer", instructionPointer() },
         { "stackPointer",       stackPointer() },
-        { "triage",             xploitabilityEngine_->str() },
-        { "context_flags",      ctx->context_flags },
-        { "cs",                 ctx->cs },
-        { "dr0",                ctx->dr0 },
-        { "dr1",                ctx->dr1 },
-        { "dr2",                ctx->dr2 },
-        { "dr3",                ctx->dr3 },
-        { "dr6",                ctx->dr6 },
-        { "dr7",                ctx->dr7 },
-        { "ds",                 ctx->ds },
-        { "eflags",             ctx->eflags },
-        { "es",                 ctx->es },
-        { "fs",                 ctx->fs },
-        { "gs",                 ctx->gs },
-        { "mx_csr",             ctx->mx_csr },
-        { "r10",                ctx->r10 },
-        { "r11",                ctx->r11 },
-        { "r12",                ctx->r12 },
-        { "r13",                ctx->r13 },
-        { "r14",                ctx->r14 },
-        { "r15",                ctx->r15 },
-        { "r8",                 ctx->r8 },
-        { "r9",                 ctx->r9 },
-        { "rax",                ctx->rax },
-        { "rbp",                ctx->rbp },
-        { "rbx",                ctx->rbx },
-        { "rcx",                ctx->rcx },
-        { "rdi",                ctx->rdi },
-        { "rdx",                ctx->rdx },
-        { "rip",                ctx->rip },
-        { "rsi",                ctx->rsi },
-        { "rsp",                ctx->rsp },
-        { "ss",                 ctx->ss }
+        { "triage",             xploitabilityEngine_->str() }
     };
+
+    // Registers are only reported for AMD64 minidumps.
+    auto ctx = xploitabilityEngine_->getContext();
+    if( ctx ) {
+        j.update( json{
+            { "context_flags",      ctx->context_flags },
+            { "cs",                 ctx->cs },
+            { "dr0",                ctx->dr0 },
+            { "dr1",                ctx->dr1 },
+            { "dr2",                ctx->dr2 },
+            { "dr3",                ctx->dr3 },
+            { "dr6",                ctx->dr6 },
+            { "dr7",                ctx->dr7 },
+            { "ds",                 ctx->ds },
+            { "eflags",             ctx->eflags },
+            { "es",                 ctx->es },
+            { "fs",                 ctx->fs },
+            { "gs",                 ctx->gs },
+            { "mx_csr",             ctx->mx_csr },
+            { "r10",                ctx->r10 },
+            { "r11",                ctx->r11 },
+            { "r12",                ctx->r12 },
+            { "r13",                ctx->r13 },
+            { "r14",                ctx->r14 },
+            { "r15",                ctx->r15 },
+            { "r8",                 ctx->r8 },
+            { "r9",                 ctx->r9 },
+            { "rax",                ctx->rax },
+            { "rbp",                ctx->rbp },
+            { "rbx",                ctx->rbx },
+            { "rcx",                ctx->rcx },
+            { "rdi",                ctx->rdi },
+            { "rdx",                ctx->rdx },
+            { "rip",                ctx->rip },
+            { "rsi",                ctx->rsi },
+            { "rsp",                ctx->rsp },
+            { "ss",                 ctx->ss }
+        } );
+    }
+
+    return j;
 }
 
 
@@ -9,17 +9,25 @@
 #define Triage_H
 
 #include "Xploitability.h"
-#include "google_breakpad/processor/basic_source_line_resolver.h"
+#include "compiled_symbol_supplier.h"
+#include "google_breakpad/processor/fast_source_line_resolver.h"
 #include "google_breakpad/processor/minidump_processor.h"
 #include "google_breakpad/processor/process_state.h"
-#include "simple_symbol_supplier.h"
+#include "google_breakpad/processor/source_line_resolver_interface.h"
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "vendor/json.hpp"
 using json = nlohmann::json;
+#ifdef _MSC_VER
 namespace fs = std::experimental::filesystem;
+#else
+namespace fs = std::filesystem;
+#endif
 
 using namespace std;
 using namespace google_breakpad;
@@ -33,12 +41,23 @@ enum StatusCode {
 };
 
 
+/** Wall-clock time spent in each stage of triaging a minidump, in seconds */
+struct StageTimes {
+    double                          read        = 0;    // reading the minidump
+    double                          process     = 0;    // breakpad's processing, stackwalk included
+    double                          stackwalk   = 0;    // walking the crashing thread's stack
+    vector< pair<string, double> >  engines;            // each exploitability engine, by name
+};
+
+
 class Triage {
 
 public:
     Triage( const string& path );
+    Triage( const string& path, SourceLineResolverInterface* resolver );
 
     StatusCode                  process();
+    StatusCode                  analyze();
     StatusCode                  preProcess();
     XploitabilityRank           exploitabilityRank()        const;
     const string                crashReason()               const;
@@ -51,25 +70,41 @@ public:
     const uint64_t              instructionPointer()        const;
     const uint64_t              stackPointer()              const;
     const vector<uint64_t>      callStack()                 const;
+    const vector<string>        moduleFrames()              const;
     friend ostream&             operator<< (ostream& os, Triage& self);
     int                         signalType();
     json                        toJson()                    const;
     static double               normalize(double x);
+    static void                 setMaxFrames(uint32_t maxFrames);
+    static void                 setMaxScanWords(uint32_t maxScanWords);
     vector<XploitabilityRank>   ranks()                     const;
+    const StageTimes&           stageTimes()                const;
     void                        persist(const string path)  const;
-    void                        processEngine(Xploitability& x);
+    void                        processEngine(Xploitability& x, bool verbose = true);
 
 private:
 
-    BasicSourceLineResolver         resolver_;
+    void                        processEngines( bool verbose );
+    const CallStack*            crashingStack()             const;
+
+    // How many frames of the crashing thread's stack to walk (and hash), or 0 for all of them
+    static uint32_t                 maxFrames_;
+
+    // How many stack words each stack scan may look at, or 0 for the stackwalkers' defaults
+    static uint32_t                 maxScanWords_;
+
+    FastSourceLineResolver          resolver_;
+    SourceLineResolverInterface*    symbolResolver_;
     Minidump                        dump_;
     MinidumpProcessor               proc_;
     ProcessState                    state_;
-    SimpleSymbolSupplier            symbolSupplier_;
+    CompiledSymbolSupplier          symbolSupplier_;
     const string                    minidumpPath_;
     fs::path                        dirPath_;
     vector<XploitabilityResult>     results_;
+    vector< unique_ptr<Xploitability> > engines_;
     Xploitability*                  xploitabilityEngine_;
+    StageTimes                      stageTimes_;
 
 };
 
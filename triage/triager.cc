@@ -5,32 +5,432 @@
 
 #include "statz.h"
 #include "triage.h"
+#include "XploitabilityBangExploitable.h"
+#include "compiled_symbol_supplier.h"
+#include "shared_resolver.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 using namespace std;
 
 
+// How results are written: the text report, one line of compact JSON per minidump, or one
+// length-prefixed MessagePack record per minidump (see encode()).
+enum class OutputMode {
+    Text,
+    Json,
+    Binary
+};
+
+
+// A minidump to triage, and the file its result goes to (stdout if empty).
+struct Job {
+    string      minidumpPath;
+    string      outPath;
+};
+
+
 void usage(char* argv[]) {
-    cout << "Syntax : " << argv[0] << " <minidump1> [minidump2 ... minidumpN]" << endl;
+    cout << "Syntax : " << argv[0] << " [-f frames] [-s words] [-v] [-m mode] [-b [-j workers]] [-o out1] <minidump1> [[-o out2] minidump2 ...]" << endl;
+    cout << "         " << argv[0] << " [-f frames] [-s words] [-v] [-m mode] -d [-j workers]" << endl;
+    cout << "         " << argv[0] << " -c <symbols1.sym> [symbols2.sym ... symbolsN.sym]" << endl;
     cout << "Example: " << argv[0] << " mem.dmp crash2.dmp" << endl;
+    cout << endl;
+    cout << "  -b          batch mode: process the minidumps concurrently, sharing symbols between them," << endl;
+    cout << "              and print one line of JSON per minidump as each one finishes" << endl;
+    cout << "  -d          daemon mode: like batch mode, but read minidump paths from stdin, one per line," << endl;
+    cout << "              until it's closed.  A line of the form <minidump>\t<out> writes the result to <out>" << endl;
+    cout << "              and answers with {\"minidumpPath\", \"resultPath\"} instead" << endl;
+    cout << "  -m mode     how to write results: text (the full report; the default outside of batch and daemon" << endl;
+    cout << "              modes), json (one line of compact JSON per minidump) or binary (per minidump, a 4-byte" << endl;
+    cout << "              little-endian length followed by that many bytes of MessagePack).  json and binary skip" << endl;
+    cout << "              the text report and the walk of threads other than the crashing one" << endl;
+    cout << "  -o out      write the result for the minidump that follows to this file instead of stdout;" << endl;
+    cout << "              implies -m json unless another structured mode was given" << endl;
+    cout << "  -c          compile symbol files into the binary .symc files that triage maps, so the first" << endl;
+    cout << "              triage to need them doesn't have to" << endl;
+    cout << "  -j workers  the number of minidumps to process at once (default: one per core)" << endl;
+    cout << "  -f frames   walk at most this many frames of the crashing thread, which also bounds the" << endl;
+    cout << "              frames that go into the crash hash (default: no limit)" << endl;
+    cout << "  -s words    look at most this many stack words for each return address found by stack" << endl;
+    cout << "              scanning, which bounds the cost of smashed stacks (default: breakpad's own limits)" << endl;
+    cout << "  -v          print each fact !exploitable gathered for each minidump and how long it took," << endl;
+    cout << "              and each of its rules' results, to stderr" << endl;
 }
 
+
+/**
+ * Parses a count given on the command line.
+ * @param text the option's argument
+ * @param count set to the count on success
+ * @return false if text isn't entirely a non-negative number that fits in 32 bits
+ */
+static bool parseCount( const char* text, uint32_t& count ) {
+    if( !isdigit( (unsigned char)text[0] ) ) {
+        return false;
+    }
+
+    try {
+        size_t          end;
+        unsigned long   value = stoul( text, &end );
+
+        if( text[end] || value>UINT32_MAX ) {
+            return false;
+        }
+        count = (uint32_t)value;
+        return true;
+    } catch( const logic_error& ) {
+        // invalid_argument or out_of_range
+        return false;
+    }
+}
+
+
+/**
+ * Processes a single minidump without printing anything, for batch and daemon modes.
+ * @param path the minidump to process
+ * @param resolver the resolver shared by every minidump
+ * @return the triage results, or an object with "minidumpPath" and "error" keys on failure
+ */
+json triageOne(const string& path, sl2::SharedResolver& resolver) {
+    try {
+        sl2::Triage triage( path, &resolver );
+
+        if( triage.analyze()==sl2::GOOD ) {
+            return triage.toJson();
+        }
+
+        return json{ { "minidumpPath", path }, { "error", "unable to process dumpfile" } };
+    } catch (...) {
+        return json{ { "minidumpPath", path }, { "error", "exception while processing dumpfile" } };
+    }
+}
+
+
+/**
+ * Encodes a result as a single structured record.
+ * @param result the result to encode
+ * @param mode OutputMode::Json for compact JSON and a newline, or OutputMode::Binary for a 4-byte
+ * little-endian length followed by the result in MessagePack
+ * @return the record
+ */
+string encode(const json& result, OutputMode mode) {
+    if( mode!=OutputMode::Binary ) {
+        return result.dump() + "\n";
+    }
+
+    vector<uint8_t> payload = json::to_msgpack(result);
+    uint32_t        size    = static_cast<uint32_t>( payload.size() );
+    string          record;
+
+    record.reserve( sizeof(size) + payload.size() );
+    for( unsigned i=0; i<sizeof(size); i++ ) {
+        record.push_back( static_cast<char>( (size >> (8*i)) & 0xff ) );
+    }
+    record.append( payload.begin(), payload.end() );
+
+    return record;
+}
+
+
+/**
+ * Writes a record to stdout.  Callers serialize calls themselves.
+ */
+void emit(const string& record) {
+    cout.write( record.data(), record.size() );
+    cout.flush();
+}
+
+
+/**
+ * Writes a record to its own file, replacing whatever was there.
+ * @return whether the whole record was written
+ */
+bool emit(const string& record, const string& outPath) {
+    ofstream out( outPath, ios::out | ios::binary | ios::trunc );
+    out.write( record.data(), record.size() );
+
+    return bool(out);
+}
+
+
+/**
+ * Processes minidumps on a pool of worker threads.  Every worker resolves symbols through the same
+ * SharedResolver, so each module's symbols and CFI are only parsed once for the whole batch.
+ * Results are written as they complete, one record each, either to the job's own output file or to
+ * stdout; minidumps that can't be processed get an object with an "error" key instead.
+ * @param jobs the minidumps to process
+ * @param workers the number of worker threads
+ * @param mode OutputMode::Json or OutputMode::Binary
+ */
+void batch(const vector<Job>& jobs, unsigned workers, OutputMode mode) {
+    sl2::SharedResolver     resolver;
+    atomic<size_t>          next(0);
+    mutex                   outputMutex;
+    vector<thread>          pool;
+
+    auto work = [&]() {
+        for( size_t i = next++; i < jobs.size(); i = next++ ) {
+            const Job&  job     = jobs[i];
+            string      record  = encode( triageOne(job.minidumpPath, resolver), mode );
+
+            if( !job.outPath.empty() ) {
+                if( !emit(record, job.outPath) ) {
+                    lock_guard<mutex> lock(outputMutex);
+                    cerr << "error on writing " << job.outPath << endl;
+                }
+                continue;
+            }
+
+            lock_guard<mutex> lock(outputMutex);
+            emit(record);
+        }
+    };
+
+    workers = max(1u, min<unsigned>(workers, jobs.size()));
+    for( unsigned i=0; i<workers; i++ ) {
+        pool.emplace_back(work);
+    }
+
+    for( thread& t : pool ) {
+        t.join();
+    }
+}
+
+
+/**
+ * Runs as a resident triage service: reads minidump paths from stdin, one per line, and answers each
+ * with one record on stdout, exactly as batch mode does.  A request line can also name a file for the
+ * result, after a tab; the result is written there and the answer on stdout is just the minidump and
+ * result paths.  Requests are processed concurrently, so answers can arrive out of order; callers
+ * match them up by their "minidumpPath", which is echoed back verbatim.  The shared resolver lives as
+ * long as the daemon does, so symbols stay warm across requests.
+ * Exits once stdin is closed and every outstanding request has been answered.
+ * @param workers the number of worker threads
+ * @param mode OutputMode::Json or OutputMode::Binary
+ */
+void serve(unsigned workers, OutputMode mode) {
+    sl2::SharedResolver     resolver;
+    mutex                   queueMutex;
+    condition_variable      queueReady;
+    deque<Job>              pending;
+    bool                    done = false;
+    mutex                   outputMutex;
+    vector<thread>          pool;
+
+    auto work = [&]() {
+        while( true ) {
+            Job job;
+
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueReady.wait( lock, [&]() { return done || !pending.empty(); } );
+
+                if( pending.empty() ) {
+                    return;
+                }
+
+                job = pending.front();
+                pending.pop_front();
+            }
+
+            json result = triageOne( job.minidumpPath, resolver );
+
+            if( !job.outPath.empty() ) {
+                if( emit(encode(result, mode), job.outPath) ) {
+                    result = json{ { "minidumpPath", job.minidumpPath }, { "resultPath", job.outPath } };
+                } else {
+                    result = json{ { "minidumpPath", job.minidumpPath }, { "error", "unable to write " + job.outPath } };
+                }
+            }
+
+            string record = encode( result, mode );
+
+            lock_guard<mutex> lock(outputMutex);
+            emit(record);
+        }
+    };
+
+    for( unsigned i=0; i<max(1u, workers); i++ ) {
+        pool.emplace_back(work);
+    }
+
+    string line;
+    while( getline(cin, line) ) {
+        // Tolerate CRLF line endings from clients that write to us in text mode.
+        if( !line.empty() && line.back()=='\r' ) {
+            line.pop_back();
+        }
+
+        if( line.empty() ) {
+            continue;
+        }
+
+        Job     job;
+        size_t  tab = line.find('\t');
+
+        job.minidumpPath = line.substr( 0, tab );
+        if( tab!=string::npos ) {
+            job.outPath = line.substr( tab+1 );
+        }
+
+        {
+            lock_guard<mutex> lock(queueMutex);
+            pending.push_back(job);
+        }
+        queueReady.notify_one();
+    }
+
+    {
+        lock_guard<mutex> lock(queueMutex);
+        done = true;
+    }
+    queueReady.notify_all();
+
+    for( thread& t : pool ) {
+        t.join();
+    }
+}
+
+
 int main(int argc, char* argv[] ) {
 
     uint32_t parity = 0;
     int i=1;
+    bool batchMode = false;
+    bool daemonMode = false;
+    bool compileMode = false;
+    unsigned workers = thread::hardware_concurrency();
+    OutputMode mode = OutputMode::Text;
+
+    for( ; i<argc; i++ ) {
+        string arg(argv[i]);
+
+        if( arg=="-b" ) {
+            batchMode = true;
+        } else if( arg=="-d" ) {
+            daemonMode = true;
+        } else if( arg=="-c" ) {
+            compileMode = true;
+        } else if( arg=="-j" || arg=="-f" || arg=="-s" ) {
+            uint32_t count;
+
+            if( i+1>=argc || !parseCount( argv[++i], count ) ) {
+                usage(argv);
+                return -1;
+            }
+
+            if( arg=="-j" ) {
+                workers = count;
+            } else if( arg=="-f" ) {
+                sl2::Triage::setMaxFrames(count);
+            } else {
+                sl2::Triage::setMaxScanWords(count);
+            }
+        } else if( arg=="-v" ) {
+            sl2::XploitabilityBangExploitable::setTraceRules(true);
+        } else if( arg=="-m" && i+1<argc ) {
+            string name(argv[++i]);
 
-    if(argc==1) {
+            if( name=="text" ) {
+                mode = OutputMode::Text;
+            } else if( name=="json" ) {
+                mode = OutputMode::Json;
+            } else if( name=="binary" ) {
+                mode = OutputMode::Binary;
+            } else {
+                usage(argv);
+                return -1;
+            }
+        } else {
+            break;
+        }
+    }
+
+    // Batch and daemon modes only ever produce structured results.
+    if( (batchMode || daemonMode) && mode==OutputMode::Text ) {
+        mode = OutputMode::Json;
+    }
+
+#ifdef _WIN32
+    // Text mode would turn every 0x0a in a record's length or payload into "\r\n".
+    if( mode==OutputMode::Binary ) {
+        _setmode( _fileno(stdout), _O_BINARY );
+    }
+#endif
+
+    if( daemonMode ) {
+        serve(workers, mode);
+        return 0;
+    }
+
+    if(i==argc) {
+        usage(argv);
+        return -1;
+    }
+
+    if( compileMode ) {
+        int ret = 0;
+        for( ; i<argc; i++ ) {
+            if( sl2::CompiledSymbolSupplier::compile(argv[i]) ) {
+                cout << sl2::CompiledSymbolSupplier::compiledPath(argv[i]) << endl;
+            } else {
+                cerr << "error on compiling " << argv[i] << endl;
+                ret = -1;
+            }
+        }
+        return ret;
+    }
+
+    // Each -o applies to the minidump right after it.
+    vector<Job> jobs;
+    string      outPath;
+
+    for( ; i<argc; i++ ) {
+        string arg(argv[i]);
+
+        if( arg=="-o" && i+1<argc ) {
+            outPath = argv[++i];
+            continue;
+        }
+
+        jobs.push_back( Job{ arg, outPath } );
+        outPath.clear();
+    }
+
+    if( mode==OutputMode::Text && any_of(jobs.begin(), jobs.end(), [](const Job& job) { return !job.outPath.empty(); }) ) {
+        mode = OutputMode::Json;
+    }
+
+    if( jobs.empty() ) {
         usage(argv);
         return -1;
     }
 
+    if( mode!=OutputMode::Text ) {
+        // Outside of batch mode results come back in order, from one worker.
+        batch( jobs, batchMode ? workers : 1, mode );
+        return 0;
+    }
 
-    for( i=1; i<argc; i++ ) {
+    for( const Job& job : jobs ) {
         try {
-            sl2::Triage triage = string(argv[i]);
+            sl2::Triage triage = job.minidumpPath;
             sl2::StatusCode sc = triage.process();
 
             if(sc!=sl2::GOOD) {
@@ -39,7 +439,7 @@ int main(int argc, char* argv[] ) {
 
             cout << triage << endl;
         } catch (...) {
-            cerr << "error on processing "<< argv[i] << endl;
+            cerr << "error on processing "<< job.minidumpPath << endl;
         }
     }
 
@@ -47,4 +447,3 @@ int main(int argc, char* argv[] ) {
     return 0;
 
 }
-
@@ -11,6 +11,303 @@ using namespace std;
 /*! Creates a client for the wizard to use (not inherited) */
 static SL2Client client;
 
+// NOTE(ww): Keep these up-to-date with sl2/harness/wizard_stream.py!
+/*! "SL2W", little-endian */
+#define SL2_WIZARD_STREAM_MAGIC 0x57324c53
+#define SL2_WIZARD_STREAM_VERSION 1
+/*! Size of the in-memory buffer that records are batched in before being written */
+#define SL2_WIZARD_STREAM_BUFSIZE (64 * 1024)
+/*! The largest single record we ever write */
+#define SL2_WIZARD_RECORD_MAX 4096
+/*! The number of buffer bytes sampled per call */
+#define SL2_WIZARD_BUFFER_SAMPLE 64
+/*! The maximum length of a UTF-8 encoded source path */
+#define SL2_WIZARD_SOURCE_MAX (MAX_PATH * 3)
+
+/** The kinds of records in the binary stream. */
+enum class WizardRecord : uint8_t {
+  Functions = 1,
+  Map = 2,
+  Id = 3,
+  Site = 4,
+};
+
+/** Flags on an Id record. */
+#define SL2_WIZARD_HAS_SOURCE 0x1
+#define SL2_WIZARD_LAST_SAMPLE 0x2
+
+/** Everything the wizard reports about a single hooked call. */
+struct wizard_finding {
+  Function function;
+  uint64_t callCount;
+  uint64_t retAddrCount;
+  uint64_t retAddrOffset;
+  uint64_t argHash;
+  bool hasSource;
+  uint64_t start;
+  uint64_t end;
+  char source[SL2_WIZARD_SOURCE_MAX + 1];
+  uint8_t bufferSize;
+  unsigned char buffer[SL2_WIZARD_BUFFER_SAMPLE];
+};
+
+/** Per-call-site (function + return address) bookkeeping for sampling. */
+struct wizard_site {
+  uint64_t hits;
+  uint64_t dropped;
+  wizard_finding last;
+};
+
+typedef std::pair<uint8_t, uint64_t> wizard_site_key;
+typedef std::map<wizard_site_key, wizard_site, std::less<wizard_site_key>,
+                 sl2_slab_allocator<std::pair<const wizard_site_key, wizard_site>>>
+    wizard_site_map;
+
+/*! Guards the record stream and the site map */
+static void *stream_lock;
+/*! The binary record stream, or INVALID_FILE if we're emitting JSONL */
+static file_t stream_file = INVALID_FILE;
+static char stream_buf[SL2_WIZARD_STREAM_BUFSIZE];
+static size_t stream_len = 0;
+static wizard_site_map sites;
+
+/** Accumulates a single length-prefixed record before it's appended to the stream. */
+struct wizard_record {
+  char data[SL2_WIZARD_RECORD_MAX];
+  size_t len;
+
+  wizard_record(WizardRecord type) : len(sizeof(uint32_t)) {
+    put_u8((uint8_t)type);
+  }
+
+  void put(const void *src, size_t size) {
+    DR_ASSERT(len + size <= sizeof(data));
+    memcpy(data + len, src, size);
+    len += size;
+  }
+
+  void put_u8(uint8_t v) {
+    put(&v, sizeof(v));
+  }
+
+  void put_u64(uint64_t v) {
+    put(&v, sizeof(v));
+  }
+
+  /** Writes a string prefixed by its 16-bit length. */
+  void put_str(const char *str) {
+    uint16_t slen = (uint16_t)strnlen(str, SL2_WIZARD_SOURCE_MAX);
+    put(&slen, sizeof(slen));
+    put(str, slen);
+  }
+};
+
+/** Writes out any buffered records. Must be called with the stream lock held. */
+static void flush_stream() {
+  if (stream_len) {
+    dr_write_file(stream_file, stream_buf, stream_len);
+    stream_len = 0;
+  }
+}
+
+/** Finalizes a record's length prefix and appends it to the stream. */
+static void write_record(wizard_record &rec) {
+  uint32_t size = (uint32_t)(rec.len - sizeof(uint32_t));
+  memcpy(rec.data, &size, sizeof(size));
+
+  dr_mutex_lock(stream_lock);
+
+  if (stream_len + rec.len > sizeof(stream_buf)) {
+    flush_stream();
+  }
+
+  memcpy(stream_buf + stream_len, rec.data, rec.len);
+  stream_len += rec.len;
+
+  dr_mutex_unlock(stream_lock);
+}
+
+/**
+ * Opens the binary record stream and writes its header, along with the table of function names
+ * that Id records refer to by index.
+ * @param path where to write the stream
+ * @return success
+ */
+static bool open_stream(const char *path) {
+  stream_file = dr_open_file(path, DR_FILE_WRITE_OVERWRITE);
+
+  if (stream_file == INVALID_FILE) {
+    return false;
+  }
+
+  uint32_t header[2] = {SL2_WIZARD_STREAM_MAGIC, SL2_WIZARD_STREAM_VERSION};
+  dr_write_file(stream_file, header, sizeof(header));
+
+  wizard_record rec(WizardRecord::Functions);
+  rec.put_u8(SL2_FUNCTION_COUNT);
+
+  for (size_t i = 0; i < SL2_FUNCTION_COUNT; i++) {
+    rec.put_str(client.function_to_string((Function)i));
+  }
+
+  write_record(rec);
+
+  return true;
+}
+
+/**
+ * Emits a single finding, either as a binary Id record or as a JSON line.
+ * @param finding the finding to emit
+ * @param last whether this is the last (held back) sample from a call site
+ */
+static void emit_finding(const wizard_finding &finding, bool last) {
+  if (stream_file != INVALID_FILE) {
+    wizard_record rec(WizardRecord::Id);
+    rec.put_u8((uint8_t)finding.function);
+    rec.put_u64(finding.callCount);
+    rec.put_u64(finding.retAddrCount);
+    rec.put_u64(finding.retAddrOffset);
+    rec.put_u64(finding.argHash);
+    rec.put_u8((finding.hasSource ? SL2_WIZARD_HAS_SOURCE : 0) |
+               (last ? SL2_WIZARD_LAST_SAMPLE : 0));
+    rec.put_u64(finding.start);
+    rec.put_u64(finding.end);
+    rec.put_str(finding.hasSource ? finding.source : "");
+    rec.put_u8(finding.bufferSize);
+    rec.put(finding.buffer, finding.bufferSize);
+    write_record(rec);
+    return;
+  }
+
+  json j;
+  j["type"] = "id";
+  j["callCount"] = finding.callCount;
+  j["retAddrCount"] = finding.retAddrCount;
+  j["retAddrOffset"] = finding.retAddrOffset;
+  j["func_name"] = client.function_to_string(finding.function);
+
+  if (finding.hasSource) {
+    j["source"] = finding.source;
+    j["start"] = finding.start;
+    j["end"] = finding.end;
+  }
+
+  char argHash[SL2_ARG_HASH_LEN + 1];
+  client.arg_hash_to_string(finding.argHash, argHash);
+  j["argHash"] = argHash;
+
+  if (last) {
+    j["lastSample"] = true;
+  }
+
+  vector<unsigned char> x(finding.buffer, finding.buffer + finding.bufferSize);
+  j["buffer"] = x;
+
+  SL2_LOG_JSONL(j);
+}
+
+/**
+ * Records a finding, subject to the per-call-site sample limit. Findings over the limit are only
+ * counted, except that the most recent one is kept around to be emitted at exit.
+ * @param finding the finding to record
+ */
+static void record_finding(const wizard_finding &finding) {
+  unsigned int samples = op_wizard_samples.get_value();
+
+  if (samples) {
+    wizard_site_key key((uint8_t)finding.function, finding.retAddrOffset);
+
+    dr_mutex_lock(stream_lock);
+    wizard_site &site = sites[key];
+    site.hits++;
+
+    if (site.hits > samples) {
+      site.dropped++;
+      site.last = finding;
+      dr_mutex_unlock(stream_lock);
+      return;
+    }
+
+    dr_mutex_unlock(stream_lock);
+  }
+
+  emit_finding(finding, false);
+}
+
+/** Emits the held-back last sample and a hit summary for every sampled call site. */
+static void emit_sites() {
+  wizard_site_map::iterator it;
+
+  for (it = sites.begin(); it != sites.end(); it++) {
+    const wizard_site &site = it->second;
+
+    if (site.dropped) {
+      emit_finding(site.last, true);
+    }
+
+    if (stream_file != INVALID_FILE) {
+      wizard_record rec(WizardRecord::Site);
+      rec.put_u8(it->first.first);
+      rec.put_u64(it->first.second);
+      rec.put_u64(site.hits);
+      rec.put_u64(site.dropped);
+      write_record(rec);
+    } else {
+      json j;
+      j["type"] = "site";
+      j["func_name"] = client.function_to_string((Function)it->first.first);
+      j["retAddrOffset"] = it->first.second;
+      j["hits"] = site.hits;
+      j["dropped"] = site.dropped;
+      SL2_LOG_JSONL(j);
+    }
+  }
+}
+
+/**
+ * Fills in the parts of a finding that are common to every hooked function.
+ * @param info the hooked call's metadata
+ * @param finding the finding to fill in
+ */
+static void init_finding(client_read_info *info, wizard_finding *finding) {
+  finding->function = info->function;
+  finding->callCount = client.increment_call_count(info->function);
+  finding->retAddrCount = client.increment_retaddr_count(info->retAddrOffset);
+  finding->retAddrOffset = (uint64_t)info->retAddrOffset;
+  finding->hasSource = false;
+  finding->start = 0;
+  finding->end = 0;
+  finding->source[0] = '\0';
+}
+
+/**
+ * Sets a finding's source and read range.
+ * @param finding the finding to update
+ * @param source the resource being read
+ * @param info the hooked call's metadata
+ */
+static void set_finding_source(wizard_finding *finding, const wchar_t *source,
+                               client_read_info *info) {
+  wstring_convert<std::codecvt_utf8<wchar_t>> utf8Converter;
+  std::string utf8 = utf8Converter.to_bytes(source);
+
+  finding->hasSource = true;
+  strncpy(finding->source, utf8.c_str(), SL2_WIZARD_SOURCE_MAX);
+  finding->source[SL2_WIZARD_SOURCE_MAX] = '\0';
+  finding->start = info->position;
+  finding->end = info->position + info->nNumberOfBytesToRead;
+}
+
+/**
+ * Samples the first bytes of a hooked call's buffer into a finding.
+ * @param finding the finding to update
+ * @param info the hooked call's metadata
+ */
+static void set_finding_buffer(wizard_finding *finding, client_read_info *info) {
+  finding->bufferSize = (uint8_t)min(info->nNumberOfBytesToRead, SL2_WIZARD_BUFFER_SAMPLE);
+  memcpy(finding->buffer, info->lpBuffer, finding->bufferSize);
+}
+
 /** Print a debug message when a new thread starts */
 static void on_thread_init(void *drcontext) {
   SL2_DR_DEBUG("wizard#on_thread_init\n");
@@ -42,13 +339,26 @@ static bool on_exception(void *drcontext, dr_exception_t *excpt) {
 static void on_dr_exit(void) {
   SL2_DR_DEBUG("wizard#on_dr_exit\n");
 
+  emit_sites();
+
+  if (stream_file != INVALID_FILE) {
+    dr_mutex_lock(stream_lock);
+    flush_stream();
+    dr_mutex_unlock(stream_lock);
+    dr_close_file(stream_file);
+  }
+
+  dr_mutex_destroy(stream_lock);
+
   drwrap_exit();
+  client.exit_call_records();
 
   if (!drmgr_unregister_thread_init_event(on_thread_init) ||
       !drmgr_unregister_thread_exit_event(on_thread_exit) || drreg_exit() != DRREG_SUCCESS) {
     DR_ASSERT(false);
   }
 
+  sl2_slab_exit();
   drmgr_exit();
 }
 
@@ -129,30 +439,16 @@ static void wrap_post_Generic(void *wrapcxt, void *user_data) {
     return;
   }
 
-  wstring_convert<std::codecvt_utf8<wchar_t>> utf8Converter;
-
   client_read_info *info = (client_read_info *)user_data;
-  const char *func_name = client.function_to_string(info->function);
+  wizard_finding finding;
 
-  json j;
-  j["type"] = "id";
-  j["callCount"] = client.increment_call_count(info->function);
-  j["retAddrCount"] = client.increment_retaddr_count(info->retAddrOffset);
-  j["retAddrOffset"] = (uint64_t)info->retAddrOffset;
-  j["func_name"] = func_name;
+  init_finding(info, &finding);
 
   if (info->source != NULL) {
-    wstring wsource = wstring(info->source);
-    j["source"] = utf8Converter.to_bytes(wsource);
-
-    size_t end = info->position + info->nNumberOfBytesToRead;
-    j["start"] = info->position;
-    j["end"] = end;
+    set_finding_source(&finding, info->source, info);
   }
 
-  if (info->argHash != NULL) {
-    j["argHash"] = info->argHash;
-  }
+  finding.argHash = info->argHash;
 
   if (info->function == Function::_read) {
 #pragma warning(suppress : 4311 4302)
@@ -163,20 +459,10 @@ static void wrap_post_Generic(void *wrapcxt, void *user_data) {
     info->nNumberOfBytesToRead = min(info->nNumberOfBytesToRead, (int)*(info->lpNumberOfBytesRead));
   }
 
-  vector<unsigned char> x((char *)info->lpBuffer,
-                          ((char *)info->lpBuffer) + min(info->nNumberOfBytesToRead, 64));
-  j["buffer"] = x;
+  set_finding_buffer(&finding, info);
+  record_finding(finding);
 
-  SL2_LOG_JSONL(j);
-
-  if (info->source) {
-    dr_thread_free(drcontext, info->source, MAX_PATH + 1);
-  }
-  if (info->argHash) {
-    dr_thread_free(drcontext, info->argHash, SL2_HASH_LEN + 1);
-  }
-
-  dr_thread_free(drcontext, info, sizeof(client_read_info));
+  client.free_call_record(drcontext, info);
 }
 
 /**
@@ -193,18 +479,11 @@ static void wrap_post_MapViewOfFile(void *wrapcxt, void *user_data) {
   }
 
   client_read_info *info = ((client_read_info *)user_data);
-  const char *func_name = client.function_to_string(info->function);
 
   info->lpBuffer = drwrap_get_retval(wrapcxt);
 
-  wstring_convert<std::codecvt_utf8<wchar_t>> utf8Converter;
-
-  json j;
-  j["type"] = "id";
-  j["callCount"] = client.increment_call_count(info->function);
-  j["retAddrCount"] = client.increment_retaddr_count(info->retAddrOffset);
-  j["retAddrOffset"] = (uint64_t)info->retAddrOffset;
-  j["func_name"] = func_name;
+  wizard_finding finding;
+  init_finding(info, &finding);
 
   hash_context hash_ctx = {0};
 
@@ -231,25 +510,16 @@ static void wrap_post_MapViewOfFile(void *wrapcxt, void *user_data) {
 
     hash_ctx.readSize = info->nNumberOfBytesToRead;
 
-    j["source"] = utf8Converter.to_bytes(wstring(hash_ctx.fileName));
-
-    size_t end = info->position + info->nNumberOfBytesToRead;
-    j["start"] = info->position;
-    j["end"] = end;
-
-    client.hash_args(info->argHash, &hash_ctx);
+    set_finding_source(&finding, hash_ctx.fileName, info);
 
-    j["argHash"] = info->argHash;
+    client.hash_args(info, &hash_ctx);
+    finding.argHash = info->argHash;
 
-    vector<unsigned char> x((char *)info->lpBuffer,
-                            ((char *)info->lpBuffer) + min(info->nNumberOfBytesToRead, 64));
-    j["buffer"] = x;
-
-    SL2_LOG_JSONL(j);
+    set_finding_buffer(&finding, info);
+    record_finding(finding);
   }
 
-  dr_thread_free(drcontext, info->argHash, SL2_HASH_LEN + 1);
-  dr_thread_free(drcontext, info, sizeof(client_read_info));
+  client.free_call_record(drcontext, info);
 }
 
 /**
@@ -264,12 +534,20 @@ static void on_module_load(void *drcontext, const module_data_t *mod, bool loade
     client.baseAddr = (size_t)mod->start;
   }
 
-  json j;
-  j["type"] = "map";
-  j["start"] = (size_t)mod->start;
-  j["end"] = (size_t)mod->end;
-  j["mod_name"] = dr_module_preferred_name(mod);
-  SL2_LOG_JSONL(j);
+  if (stream_file != INVALID_FILE) {
+    wizard_record rec(WizardRecord::Map);
+    rec.put_u64((size_t)mod->start);
+    rec.put_u64((size_t)mod->end);
+    rec.put_str(dr_module_preferred_name(mod));
+    write_record(rec);
+  } else {
+    json j;
+    j["type"] = "map";
+    j["start"] = (size_t)mod->start;
+    j["end"] = (size_t)mod->end;
+    j["mod_name"] = dr_module_preferred_name(mod);
+    SL2_LOG_JSONL(j);
+  }
 
   sl2_pre_proto_map pre_hooks;
   SL2_PRE_HOOK1(pre_hooks, ReadFile);
@@ -357,10 +635,19 @@ DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
   drreg_options_t ops = {sizeof(ops), 3, false};
   dr_set_client_name("Wizard", "https://github.com/trailofbits/sienna-locomotive");
 
-  if (!drmgr_init() || drreg_init(&ops) != DRREG_SUCCESS || !drwrap_init()) {
+  if (!drmgr_init() || drreg_init(&ops) != DRREG_SUCCESS || !drwrap_init() ||
+      !client.init_call_records() || !sl2_slab_init()) {
     DR_ASSERT(false);
   }
 
+  stream_lock = dr_mutex_create();
+
+  if (!op_wizard_stream.get_value().empty() && !open_stream(op_wizard_stream.get_value().c_str())) {
+    SL2_DR_DEBUG("wizard#main: couldn't open %s for writing!\n",
+                 op_wizard_stream.get_value().c_str());
+    dr_abort();
+  }
+
   dr_register_exit_event(on_dr_exit);
 
   if (!drmgr_register_module_load_event(on_module_load) ||